@@ -0,0 +1,172 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "key_link.h"
+
+static bool key_link_report_empty(const uint8_t *report)
+{
+    for (int i = 0; i < KEY_LINK_REPORT_LEN; i++)
+    {
+        if (report[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void key_link_frame_init(key_frame_t *frame, key_frame_type_t type, uint32_t seq, int64_t now_us)
+{
+    memset(frame, 0, sizeof(key_frame_t));
+    frame->magic = KEY_LINK_MAGIC;
+    frame->version = KEY_LINK_VERSION;
+    frame->type = type;
+    frame->seq = seq;
+    frame->timestamp_us = (uint32_t)now_us;
+}
+
+bool key_link_frame_parse(const void *data, size_t len, key_frame_t *frame)
+{
+    if (len != sizeof(key_frame_t))
+    {
+        return false;
+    }
+    memcpy(frame, data, sizeof(key_frame_t));
+    return frame->magic == KEY_LINK_MAGIC && frame->version == KEY_LINK_VERSION &&
+           frame->type >= KEY_FRAME_REPORT && frame->type <= KEY_FRAME_ANNOUNCE;
+}
+
+void key_link_tx_init(key_link_tx_t *tx)
+{
+    memset(tx, 0, sizeof(key_link_tx_t));
+}
+
+bool key_link_tx_update(key_link_tx_t *tx, const uint8_t *report, size_t len, int64_t now_us)
+{
+    uint8_t buffer[KEY_LINK_REPORT_LEN] = {0};
+    memcpy(buffer, report, len < sizeof(buffer) ? len : sizeof(buffer));
+    if (tx->seq != 0 && memcmp(buffer, tx->report, sizeof(buffer)) == 0)
+    {
+        return false;
+    }
+    memcpy(tx->report, buffer, sizeof(buffer));
+    tx->seq++;
+    tx->repeat_left = KEY_LINK_REPEAT;
+    tx->next_us = now_us;
+    return true;
+}
+
+bool key_link_tx_next(key_link_tx_t *tx, int64_t now_us, key_frame_t *frame, int64_t *wait_us)
+{
+    if (tx->seq == 0)
+    {
+        // 还没有任何状态
+        *wait_us = KEY_LINK_HEARTBEAT_IDLE_US;
+        return false;
+    }
+    if (now_us < tx->next_us)
+    {
+        *wait_us = tx->next_us - now_us;
+        return false;
+    }
+
+    key_link_frame_init(frame, tx->repeat_left ? KEY_FRAME_REPORT : KEY_FRAME_HEARTBEAT, tx->seq, now_us);
+    memcpy(frame->report, tx->report, sizeof(frame->report));
+
+    if (tx->repeat_left)
+    {
+        tx->repeat_left--;
+    }
+    if (tx->repeat_left)
+    {
+        tx->next_us = now_us + KEY_LINK_REPEAT_US;
+    }
+    else
+    {
+        tx->next_us = now_us + (key_link_report_empty(tx->report) ? KEY_LINK_HEARTBEAT_IDLE_US : KEY_LINK_HEARTBEAT_ACTIVE_US);
+    }
+    *wait_us = tx->next_us - now_us;
+    return true;
+}
+
+void key_link_rx_init(key_link_rx_t *rx)
+{
+    memset(rx, 0, sizeof(key_link_rx_t));
+}
+
+bool key_link_rx_input(key_link_rx_t *rx, const void *data, size_t len, int64_t now_us, uint8_t *report)
+{
+    key_frame_t frame;
+    if (!key_link_frame_parse(data, len, &frame))
+    {
+        rx->stats.received++;
+        rx->stats.invalid++;
+        return false;
+    }
+    if (frame.type != KEY_FRAME_REPORT && frame.type != KEY_FRAME_HEARTBEAT)
+    {
+        return false;
+    }
+    rx->stats.received++;
+
+    int32_t diff = (int32_t)(frame.seq - rx->seq);
+    if (rx->synced && diff == 0)
+    {
+        rx->stats.duplicate++;
+        rx->last_us = now_us;
+        return false;
+    }
+    if (rx->synced && diff < 0 && diff > -KEY_LINK_RESYNC_WINDOW)
+    {
+        // 已经有更新的状态, 乱序到达的旧帧直接丢弃
+        rx->stats.stale++;
+        rx->last_us = now_us;
+        return false;
+    }
+
+    if (rx->synced && diff < 0)
+    {
+        // 发送端重启, seq 从头开始
+        rx->stats.resync++;
+    }
+    else if (rx->synced && diff > 1)
+    {
+        rx->stats.skipped += diff - 1;
+    }
+    // 首帧和超时之后直接采用帧中的完整状态
+    rx->synced = true;
+    rx->seq = frame.seq;
+    rx->last_us = now_us;
+    rx->latency_us = (uint32_t)now_us - frame.timestamp_us;
+
+    if (memcmp(rx->report, frame.report, sizeof(rx->report)) == 0)
+    {
+        return false;
+    }
+    rx->stats.applied++;
+    memcpy(rx->report, frame.report, sizeof(rx->report));
+    memcpy(report, rx->report, sizeof(rx->report));
+    return true;
+}
+
+bool key_link_rx_check_timeout(key_link_rx_t *rx, int64_t now_us, uint8_t *report)
+{
+    if (!rx->synced || now_us - rx->last_us < KEY_LINK_TIMEOUT_US)
+    {
+        return false;
+    }
+    // 超时后下一帧重新同步, 发送端重启后 seq 从头开始也能接上
+    rx->synced = false;
+    if (key_link_report_empty(rx->report))
+    {
+        return false;
+    }
+    rx->stats.timeouts++;
+    memset(rx->report, 0, sizeof(rx->report));
+    memcpy(report, rx->report, sizeof(rx->report));
+    return true;
+}
@@ -0,0 +1,133 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * 键盘和接收器之间的按键报文协议, 两个工程共用.
+ *
+ * 每帧都带有完整的按键状态, 所以丢帧只会延迟而不会丢失最终状态:
+ * - 状态每变化一次 seq 加 1, 同一状态连续发送 KEY_LINK_REPEAT 次;
+ * - 没有变化时按间隔发送心跳, 有键按下时间隔更短;
+ * - 接收端丢弃重复和过时的帧, 超过 KEY_LINK_TIMEOUT_US 没有收到任何帧时释放全部按键.
+ *
+ * 只依赖标准 C, 可以在电脑上编译测试 (tools/key_link_sim). 多字节字段为小端.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define KEY_LINK_MAGIC                0x4B43    // "CK"
+#define KEY_LINK_VERSION              1
+#define KEY_LINK_REPORT_LEN           8
+
+#define KEY_LINK_REPEAT               3         // 每次状态变化发送的次数
+#define KEY_LINK_REPEAT_US            2000      // 副本之间的间隔
+#define KEY_LINK_HEARTBEAT_ACTIVE_US  100000    // 有键按下时的心跳间隔
+#define KEY_LINK_HEARTBEAT_IDLE_US    1000000   // 全部松开时的心跳间隔
+#define KEY_LINK_TIMEOUT_US           350000    // 有键按下时, 超过该时间没有收到任何帧就释放
+#define KEY_LINK_RESYNC_WINDOW        1024      // seq 倒退超过该值视为发送端重启
+#define KEY_LINK_DISCOVER_US          500000    // 没有配对时广播 DISCOVER 的间隔
+#define KEY_LINK_PEER_TIMEOUT_US      3000000   // 超过该时间没有收到接收器的回复, 回到广播
+#define KEY_LINK_ANNOUNCE_US          (KEY_LINK_PEER_TIMEOUT_US / 6) // 接收器对 REPORT 回复 ANNOUNCE 的最小间隔, 连续打字时没有心跳
+
+    typedef enum
+    {
+        KEY_FRAME_REPORT = 1,   // 状态变化
+        KEY_FRAME_HEARTBEAT,    // 状态没有变化, 重复当前状态
+        KEY_FRAME_DISCOVER,     // 键盘广播, 寻找接收器
+        KEY_FRAME_ANNOUNCE,     // 接收器单播回复 DISCOVER, 心跳和限速后的 REPORT, 键盘据此记录接收器地址
+    } key_frame_type_t;
+
+    typedef struct __attribute__((packed))
+    {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t type;               // key_frame_type_t
+        uint32_t seq;               // 状态序号, 副本和心跳使用当前状态的序号
+        uint32_t timestamp_us;      // 发送端时间的低 32 位
+        uint8_t report[KEY_LINK_REPORT_LEN];
+    } key_frame_t;
+
+    typedef struct
+    {
+        uint32_t seq;
+        uint8_t report[KEY_LINK_REPORT_LEN];
+        uint8_t repeat_left;        // 当前状态还要发送的副本数
+        int64_t next_us;            // 下一帧的发送时间
+    } key_link_tx_t;
+
+    typedef struct
+    {
+        uint32_t received;
+        uint32_t applied;           // 带来新状态的帧
+        uint32_t duplicate;
+        uint32_t stale;             // 比当前状态旧, 乱序到达
+        uint32_t invalid;
+        uint32_t skipped;           // 没有收到任何副本的状态数, 由后续帧补上
+        uint32_t resync;            // 发送端重启
+        uint32_t timeouts;          // 超时释放按键的次数
+    } key_link_rx_stats_t;
+
+    typedef struct
+    {
+        bool synced;
+        uint32_t seq;
+        uint8_t report[KEY_LINK_REPORT_LEN];
+        int64_t last_us;            // 最后一次收到有效帧的时间
+        uint32_t latency_us;        // 最后一次状态更新的 本地时间 - 发送时间, 两端时钟一致时才有意义
+        key_link_rx_stats_t stats;
+    } key_link_rx_t;
+
+    /// @brief 填写帧头, report 清零
+    void key_link_frame_init(key_frame_t *frame, key_frame_type_t type, uint32_t seq, int64_t now_us);
+
+    /// @brief 检查长度, magic, 版本和类型, 通过后复制到 frame
+    bool key_link_frame_parse(const void *data, size_t len, key_frame_t *frame);
+
+    void key_link_tx_init(key_link_tx_t *tx);
+
+    /**
+     * @brief 提交新的按键状态, 与当前状态相同时忽略.
+     *
+     * @return true: 状态改变, 应立即调用 key_link_tx_next 发送
+     */
+    bool key_link_tx_update(key_link_tx_t *tx, const uint8_t *report, size_t len, int64_t now_us);
+
+    /**
+     * @brief 取下一帧要发送的数据.
+     *
+     * @param wait_us 没有到发送时间时, 返回距下一帧的时间
+     * @return true: frame 已填写, 现在发送
+     */
+    bool key_link_tx_next(key_link_tx_t *tx, int64_t now_us, key_frame_t *frame, int64_t *wait_us);
+
+    void key_link_rx_init(key_link_rx_t *rx);
+
+    /**
+     * @brief 处理收到的一帧, 只有 REPORT 和 HEARTBEAT 会改变状态.
+     *
+     * @param report 状态改变时输出新的按键状态
+     * @return true: 状态改变, 需要转发给主机
+     */
+    bool key_link_rx_input(key_link_rx_t *rx, const void *data, size_t len, int64_t now_us, uint8_t *report);
+
+    /**
+     * @brief 定期调用, 有键按下且超时没有收到帧时释放全部按键.
+     *
+     * @return true: 按键已释放, report 输出全 0 的状态
+     */
+    bool key_link_rx_check_timeout(key_link_rx_t *rx, int64_t now_us, uint8_t *report);
+
+#ifdef __cplusplus
+}
+#endif
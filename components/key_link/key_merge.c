@@ -0,0 +1,214 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include "key_merge.h"
+
+static bool key_merge_report_empty(const uint8_t *report)
+{
+    for (int i = 0; i < KEY_LINK_REPORT_LEN; i++)
+    {
+        if (report[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void key_merge_init(key_merge_t *merge)
+{
+    memset(merge, 0, sizeof(key_merge_t));
+}
+
+key_merge_source_t *key_merge_find(key_merge_t *merge, const void *addr, size_t addr_len)
+{
+    for (int i = 0; i < KEY_MERGE_SOURCE_MAX; i++)
+    {
+        key_merge_source_t *src = &merge->sources[i];
+        if (src->addr_len == addr_len && memcmp(src->addr, addr, addr_len) == 0)
+        {
+            return src;
+        }
+    }
+    return NULL;
+}
+
+int key_merge_source_count(const key_merge_t *merge)
+{
+    int count = 0;
+    for (int i = 0; i < KEY_MERGE_SOURCE_MAX; i++)
+    {
+        if (merge->sources[i].addr_len)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/// @brief 为新来源找一个位置: 优先空闲位置, 其次是最久没有数据, 已超时且没有按键的来源
+static key_merge_source_t *key_merge_alloc(key_merge_t *merge)
+{
+    key_merge_source_t *reuse = NULL;
+    for (int i = 0; i < KEY_MERGE_SOURCE_MAX; i++)
+    {
+        key_merge_source_t *src = &merge->sources[i];
+        if (src->addr_len == 0)
+        {
+            return src;
+        }
+        if (!src->rx.synced && key_merge_report_empty(src->rx.report) &&
+            (reuse == NULL || src->last_us < reuse->last_us))
+        {
+            reuse = src;
+        }
+    }
+    return reuse;
+}
+
+void key_merge_build(const key_merge_t *merge, key_nkro_report_t *report)
+{
+    memset(report, 0, sizeof(key_nkro_report_t));
+    for (int i = 0; i < KEY_MERGE_SOURCE_MAX; i++)
+    {
+        const key_merge_source_t *src = &merge->sources[i];
+        if (src->addr_len == 0)
+        {
+            continue;
+        }
+        // 8 字节报文: 修饰键, 保留, 6 个键码
+        report->modifier |= src->rx.report[0];
+        for (int k = 2; k < KEY_LINK_REPORT_LEN; k++)
+        {
+            uint8_t usage = src->rx.report[k];
+            if (usage && usage < KEY_NKRO_USAGE_NUM)
+            {
+                report->keys[usage / 8] |= 1 << (usage % 8);
+            }
+        }
+    }
+}
+
+/// @brief 重新合并, 与上次结果不同时输出
+static bool key_merge_update(key_merge_t *merge, key_nkro_report_t *report)
+{
+    key_nkro_report_t merged;
+    key_merge_build(merge, &merged);
+    if (memcmp(&merged, &merge->report, sizeof(merged)) == 0)
+    {
+        return false;
+    }
+    merge->report = merged;
+    memcpy(report, &merged, sizeof(merged));
+    return true;
+}
+
+bool key_merge_input(key_merge_t *merge, const void *addr, size_t addr_len,
+                     const void *data, size_t len, int64_t now_us, key_nkro_report_t *report)
+{
+    if (addr_len == 0 || addr_len > KEY_MERGE_ADDR_LEN)
+    {
+        return false;
+    }
+    key_merge_source_t *src = key_merge_find(merge, addr, addr_len);
+    if (src == NULL)
+    {
+        // DISCOVER 和无效数据不占用位置
+        key_frame_t frame;
+        if (len != KEY_LINK_REPORT_LEN &&
+            (!key_link_frame_parse(data, len, &frame) || (frame.type != KEY_FRAME_REPORT && frame.type != KEY_FRAME_HEARTBEAT)))
+        {
+            return false;
+        }
+        src = key_merge_alloc(merge);
+        if (src == NULL)
+        {
+            merge->rejected++;
+            return false;
+        }
+        memset(src, 0, sizeof(key_merge_source_t));
+        memcpy(src->addr, addr, addr_len);
+        src->addr_len = addr_len;
+    }
+    src->last_us = now_us;
+
+    uint8_t buffer[KEY_LINK_REPORT_LEN];
+    if (len == KEY_LINK_REPORT_LEN)
+    {
+        // 旧版本键盘, 报文就是完整状态; rx.synced 保持 false, 由 key_merge_check_timeout 按 last_us 释放
+        src->legacy = true;
+        if (memcmp(src->rx.report, data, KEY_LINK_REPORT_LEN) == 0)
+        {
+            return false;
+        }
+        memcpy(src->rx.report, data, KEY_LINK_REPORT_LEN);
+    }
+    else if (!key_link_rx_input(&src->rx, data, len, now_us, buffer))
+    {
+        // 重复, 过时或没有变化的帧
+        return false;
+    }
+
+    for (int k = 2; k < KEY_LINK_REPORT_LEN; k++)
+    {
+        if (src->rx.report[k] >= KEY_NKRO_USAGE_NUM)
+        {
+            merge->overflow++;
+        }
+    }
+    return key_merge_update(merge, report);
+}
+
+bool key_merge_announce(key_merge_t *merge, const void *addr, size_t addr_len, const key_frame_t *frame, int64_t now_us)
+{
+    key_merge_source_t *src = key_merge_find(merge, addr, addr_len);
+    if (frame->type == KEY_FRAME_REPORT)
+    {
+        if (src && src->announce_us && now_us - src->announce_us < KEY_LINK_ANNOUNCE_US)
+        {
+            return false;
+        }
+    }
+    else if (frame->type != KEY_FRAME_DISCOVER && frame->type != KEY_FRAME_HEARTBEAT)
+    {
+        return false;
+    }
+    if (src)
+    {
+        src->announce_us = now_us;
+    }
+    return true;
+}
+
+bool key_merge_check_timeout(key_merge_t *merge, int64_t now_us, key_nkro_report_t *report)
+{
+    bool released = false;
+    uint8_t buffer[KEY_LINK_REPORT_LEN];
+    for (int i = 0; i < KEY_MERGE_SOURCE_MAX; i++)
+    {
+        key_merge_source_t *src = &merge->sources[i];
+        if (src->addr_len == 0)
+        {
+            continue;
+        }
+        if (src->legacy)
+        {
+            // 旧版本键盘没有心跳, 发送端消失时不能一直按着
+            if (now_us - src->last_us >= KEY_MERGE_LEGACY_TIMEOUT_US && !key_merge_report_empty(src->rx.report))
+            {
+                memset(src->rx.report, 0, sizeof(src->rx.report));
+                src->rx.stats.timeouts++;
+                released = true;
+            }
+        }
+        else if (key_link_rx_check_timeout(&src->rx, now_us, buffer))
+        {
+            released = true;
+        }
+    }
+    return released && key_merge_update(merge, report);
+}
@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+/*
+ * 接收器同时接收多个键盘 (或小键盘, 宏键盘), 按来源分别保存按键状态, 合并为一个 NKRO 报文.
+ *
+ * - 来源按地址区分: ESP-NOW 用 MAC, UDP 用 IP;
+ * - 每个来源有独立的 key_link_rx_t, seq 去重和超时释放互不影响;
+ * - 合并结果: 修饰键按位或, 其他键置位到位图中; 只有合并结果变化时才需要发给主机.
+ *
+ * 与 key_link 一样只依赖标准 C, 可以在电脑上测试 (tools/key_merge_bench).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "key_link.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define KEY_MERGE_SOURCE_MAX   8         // 最多同时接收的键盘数
+#define KEY_MERGE_ADDR_LEN     16        // 来源地址的最大长度, 可以放下 IPv6
+#define KEY_NKRO_USAGE_NUM     0xE0      // 位图覆盖的键码 0x00 ~ 0xDF, 修饰键 0xE0 ~ 0xE7 单独一个字节
+#define KEY_MERGE_LEGACY_TIMEOUT_US 5000000 // 旧版本键盘只在变化时发送, 超过该时间没有数据时释放它的键
+
+    typedef struct __attribute__((packed))
+    {
+        uint8_t modifier;
+        uint8_t keys[KEY_NKRO_USAGE_NUM / 8];   // 键码 n 对应 keys[n / 8] 的第 n % 8 位
+    } key_nkro_report_t;
+
+    typedef struct
+    {
+        uint8_t addr[KEY_MERGE_ADDR_LEN];
+        uint8_t addr_len;           // 0: 空闲
+        bool legacy;                // 旧版本键盘, 直接发送 8 字节报文, 不带帧头, 按 KEY_MERGE_LEGACY_TIMEOUT_US 超时释放
+        int64_t last_us;            // 最后一次收到任何数据的时间
+        int64_t announce_us;        // 最后一次回复 ANNOUNCE 的时间
+        key_link_rx_t rx;           // rx.report 为该来源当前的按键状态
+    } key_merge_source_t;
+
+    typedef struct
+    {
+        key_merge_source_t sources[KEY_MERGE_SOURCE_MAX];
+        key_nkro_report_t report;   // 最后一次合并的结果
+        uint32_t rejected;          // 来源已满, 丢弃的帧
+        uint32_t overflow;          // 报文中超出位图范围的键码
+    } key_merge_t;
+
+    void key_merge_init(key_merge_t *merge);
+
+    /**
+     * @brief 处理某个来源收到的一帧: key_link 帧或旧版本的 8 字节报文.
+     *
+     * 只有 REPORT, 心跳和 8 字节报文会创建来源. 新来源占用空闲位置; 没有空闲位置时复用
+     * 已超时且没有按键的来源, 仍没有时丢弃并计入 rejected.
+     *
+     * @param report 合并结果改变时输出新的 NKRO 报文
+     * @return true: 合并结果改变, 需要发给主机
+     */
+    bool key_merge_input(key_merge_t *merge, const void *addr, size_t addr_len,
+                         const void *data, size_t len, int64_t now_us, key_nkro_report_t *report);
+
+    /**
+     * @brief 定期调用, 对每个来源做超时检查, 释放掉线键盘的按键.
+     *
+     * @return true: 合并结果改变, report 已输出
+     */
+    bool key_merge_check_timeout(key_merge_t *merge, int64_t now_us, key_nkro_report_t *report);
+
+    /**
+     * @brief 判断收到的帧是否需要回复 ANNOUNCE, 在 key_merge_input 之后调用.
+     *
+     * DISCOVER 和心跳总是回复; REPORT 每个来源最多每 KEY_LINK_ANNOUNCE_US 回复一次,
+     * 键盘连续打字 (没有心跳) 时也能确认接收器在线.
+     */
+    bool key_merge_announce(key_merge_t *merge, const void *addr, size_t addr_len, const key_frame_t *frame, int64_t now_us);
+
+    /// @brief 查找来源, 没有时返回 NULL
+    key_merge_source_t *key_merge_find(key_merge_t *merge, const void *addr, size_t addr_len);
+
+    /// @brief 已占用的来源数
+    int key_merge_source_count(const key_merge_t *merge);
+
+    /// @brief 按所有来源的当前状态重新合并, 不修改 merge->report
+    void key_merge_build(const key_merge_t *merge, key_nkro_report_t *report);
+
+#ifdef __cplusplus
+}
+#endif
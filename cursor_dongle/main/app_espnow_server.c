@@ -0,0 +1,178 @@
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "app_tusb_hid.h"
+#include "app_espnow_server.h"
+#include "key_link.h"
+#include "key_merge.h"
+
+static const char *TAG = "APP_ESPNOW_SERVER";
+
+#define ESPNOW_SERVER_POLL_MS   50                  // 没有数据时检查按键超时的间隔
+#define ESPNOW_SERVER_QUEUE_LEN 32
+#define ESPNOW_SERVER_RATE      WIFI_PHY_RATE_24M   // 回复 ANNOUNCE 的速率, 与键盘一致
+#define ESPNOW_SERVER_DEBUG     (0)                 // 1: 打印每一帧的来源和内容, 会增加延迟
+
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t len;
+    uint8_t data[sizeof(key_frame_t)];
+    int64_t rx_us;
+} espnow_server_item_t;
+
+static QueueHandle_t s_queue = NULL;
+static key_merge_t s_merge;     // 每个键盘 (按 MAC 区分) 的状态, 合并后发给主机
+static uint32_t s_applied = 0;
+static uint32_t s_queue_full = 0;
+static uint32_t s_queue_max_us = 0;     // 接收回调到接收任务的最长时间
+
+static void espnow_server_log_stats(void)
+{
+    for (int i = 0; i < KEY_MERGE_SOURCE_MAX; i++)
+    {
+        const key_merge_source_t *src = &s_merge.sources[i];
+        if (src->addr_len == 0)
+        {
+            continue;
+        }
+        const key_link_rx_stats_t *st = &src->rx.stats;
+        ESP_LOGI(TAG, MACSTR ": frames %lu, applied %lu, duplicate %lu, stale %lu, skipped %lu, invalid %lu, resync %lu, timeouts %lu",
+                 MAC2STR(src->addr), st->received, st->applied, st->duplicate, st->stale, st->skipped, st->invalid, st->resync, st->timeouts);
+    }
+    ESP_LOGI(TAG, "sources %d/%d, rejected %lu, queue full %lu, queue max %lu us",
+             key_merge_source_count(&s_merge), KEY_MERGE_SOURCE_MAX, s_merge.rejected, s_queue_full, s_queue_max_us);
+}
+
+static void espnow_server_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    // 在 Wi-Fi 任务中回调, 只入队
+    espnow_server_item_t item;
+    item.rx_us = esp_timer_get_time();
+    if (len <= 0 || len > (int)sizeof(item.data))
+    {
+        return;
+    }
+    memcpy(item.mac, recv_info->src_addr, ESP_NOW_ETH_ALEN);
+    memcpy(item.data, data, len);
+    item.len = len;
+    if (xQueueSend(s_queue, &item, 0) != pdTRUE)
+    {
+        s_queue_full++;
+    }
+}
+
+static void espnow_server_announce(const uint8_t *mac, uint32_t seq)
+{
+    if (!esp_now_is_peer_exist(mac))
+    {
+        // 信道填 0 表示使用当前信道, 连接 AP 后跟随 AP 的信道
+        esp_now_peer_info_t peer_info = {
+            .channel = 0,
+            .ifidx = WIFI_IF_STA,
+            .encrypt = false,
+        };
+        memcpy(peer_info.peer_addr, mac, ESP_NOW_ETH_ALEN);
+        esp_err_t err = esp_now_add_peer(&peer_info);
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "add peer " MACSTR " failed: %s", MAC2STR(mac), esp_err_to_name(err));
+            return;
+        }
+        ESP_LOGI(TAG, "keyboard " MACSTR " found", MAC2STR(mac));
+    }
+
+    // report[0] 带上本机信道, 键盘没有连接 AP 时切换到该信道
+    uint8_t primary = 0;
+    wifi_second_chan_t second = WIFI_SECOND_CHAN_NONE;
+    esp_wifi_get_channel(&primary, &second);
+    key_frame_t frame;
+    key_link_frame_init(&frame, KEY_FRAME_ANNOUNCE, seq, esp_timer_get_time());
+    frame.report[0] = primary;
+    esp_err_t err = esp_now_send(mac, (const uint8_t *)&frame, sizeof(frame));
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "announce failed: %s", esp_err_to_name(err));
+    }
+}
+
+static void espnow_server_task(void *pvParameters)
+{
+    espnow_server_item_t item;
+    key_merge_init(&s_merge);
+    while (1)
+    {
+        // 收到的帧立即处理; 没有数据时最多阻塞 ESPNOW_SERVER_POLL_MS
+        bool received = xQueueReceive(s_queue, &item, pdMS_TO_TICKS(ESPNOW_SERVER_POLL_MS)) == pdTRUE;
+        int64_t now = esp_timer_get_time();
+
+        // 键盘掉线或连续丢帧, 释放该键盘按住的键, 其他键盘不受影响
+        key_nkro_report_t report;
+        if (key_merge_check_timeout(&s_merge, now, &report))
+        {
+            ESP_LOGW(TAG, "keyboard timeout, release its keys");
+            app_tusb_hid_send_report(&report, now);
+            espnow_server_log_stats();
+        }
+        if (!received)
+        {
+            continue;
+        }
+
+        uint32_t queue_us = now - item.rx_us;
+        if (queue_us > s_queue_max_us)
+        {
+            s_queue_max_us = queue_us;
+        }
+#if ESPNOW_SERVER_DEBUG
+        ESP_LOGI(TAG, "Receive data from " MACSTR ", len: %d", MAC2STR(item.mac), item.len);
+        ESP_LOG_BUFFER_HEX(TAG, item.data, item.len);
+#endif
+
+        bool changed = key_merge_input(&s_merge, item.mac, ESP_NOW_ETH_ALEN, item.data, item.len, item.rx_us, &report);
+
+        // 回复 DISCOVER, 心跳和限速后的 REPORT, 键盘据此记录本机 MAC 并改为单播, 也用来判断本机是否在线
+        key_frame_t frame;
+        if (key_link_frame_parse(item.data, item.len, &frame) &&
+            key_merge_announce(&s_merge, item.mac, ESP_NOW_ETH_ALEN, &frame, item.rx_us))
+        {
+            espnow_server_announce(item.mac, frame.seq);
+        }
+
+        if (!changed)
+        {
+            // 重复, 过时或合并结果没有变化的帧
+            continue;
+        }
+        app_tusb_hid_send_report(&report, item.rx_us);
+        if (++s_applied % 1000 == 0)
+        {
+            espnow_server_log_stats();
+        }
+    }
+
+    vTaskDelete(NULL);
+}
+
+void app_espnow_server_start(void)
+{
+    s_queue = xQueueCreate(ESPNOW_SERVER_QUEUE_LEN, sizeof(espnow_server_item_t));
+    ESP_ERROR_CHECK(s_queue ? ESP_OK : ESP_ERR_NO_MEM);
+
+    ESP_ERROR_CHECK(esp_now_init());
+    ESP_ERROR_CHECK(esp_now_register_recv_cb(espnow_server_recv_cb));
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_wifi_config_espnow_rate(WIFI_IF_STA, ESPNOW_SERVER_RATE));
+    // 没有连接 AP 时固定在该信道; 连接 AP 后跟随 AP 的信道, 键盘从 ANNOUNCE 中得知
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_wifi_set_channel(APP_ESPNOW_SERVER_CHANNEL, WIFI_SECOND_CHAN_NONE));
+
+    xTaskCreate(espnow_server_task, "espnow_server", 4096, NULL, 5, NULL);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define APP_ESPNOW_SERVER_CHANNEL 1 // 没有连接 AP 时使用的信道, 键盘会轮流在各信道上寻找
+
+/// @brief 初始化 ESP-NOW 并启动接收任务, 需要在 esp_wifi_start 之后调用
+void app_espnow_server_start(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -11,11 +11,12 @@
 #include "esp_wifi.h"
 #include "led_strip.h"
 #include "esp_mac.h"
-#include "espnow.h"
+#include "esp_timer.h"
 #include "iot_button.h"
 #include <wifi_provisioning/manager.h>
 #include "app_tusb_hid.h"
 #include "app_udp_server.h"
+#include "app_espnow_server.h"
 #include "settings.h"
 
 static const char *TAG = "app";
@@ -89,25 +90,6 @@ static void app_wifi_event_handler(void *arg, esp_event_base_t event_base,
     }
 }
 
-static esp_err_t espnow_recv_data_cb(uint8_t *src_addr, void *data, size_t size, wifi_pkt_rx_ctrl_t *rx_ctrl)
-{
-    ESP_PARAM_CHECK(src_addr);
-    ESP_PARAM_CHECK(data);
-    ESP_PARAM_CHECK(size);
-    ESP_PARAM_CHECK(rx_ctrl);
-
-    uint8_t *dataBuff = (uint8_t *)data;
-    printf("Receive data from " MACSTR ", len: %d, data: ", MAC2STR(src_addr), size);
-    for (int i = 0; i < size; i++)
-    {
-        printf("%02x ", dataBuff[i]);
-    }
-    printf("\r\n");
-    app_tusb_hid_send_key(dataBuff, size);
-
-    return ESP_OK;
-}
-
 static void app_wifi_init()
 {
     ESP_ERROR_CHECK(esp_netif_init());
@@ -127,7 +109,9 @@ static void app_wifi_init()
     esp_event_handler_register(IP_EVENT,   IP_EVENT_STA_GOT_IP, app_wifi_event_handler, NULL);
 }
 
-static void app_wifi_connect(void)
+/// @brief 连接保存的 AP
+/// @param fallback 没有配置时是否使用默认的 SSID; ESP-NOW 模式不需要 AP, 没有配置时停在固定信道上
+static void app_wifi_connect(bool fallback)
 {
     wifi_config_t wifi_config = {0};
     esp_err_t ret = esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
@@ -140,6 +124,10 @@ static void app_wifi_connect(void)
     if (strlen((const char *)wifi_config.sta.ssid) == 0)
     {
         ESP_LOGW(TAG, "WiFi not configured");
+        if (!fallback)
+        {
+            return;
+        }
         memcpy(wifi_config.sta.ssid, (char *)SSID, strlen((char *)SSID));
         memcpy(wifi_config.sta.password, (char *)PASSWORD, strlen((char *)PASSWORD));
     }
@@ -199,9 +187,7 @@ void app_main()
     {
         ESP_LOGI(TAG, "++++++++++HID mode: ESPNOW");
         wifi_disconnected_color = 0x000300;
-        espnow_config_t espnow_config = ESPNOW_INIT_CONFIG_DEFAULT();
-        espnow_init(&espnow_config);
-        espnow_set_config_for_data_type(ESPNOW_DATA_TYPE_DATA, true, espnow_recv_data_cb);
+        app_espnow_server_start();
     }
     else
     {
@@ -213,5 +199,5 @@ void app_main()
     vTaskDelay(2000 / portTICK_PERIOD_MS);
 
     app_tusb_hid_init();
-    app_wifi_connect();
+    app_wifi_connect(sys_param->mode_hid != MODE_HID_ESPNOW);
 }
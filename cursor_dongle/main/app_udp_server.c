@@ -16,6 +16,7 @@
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
@@ -24,20 +25,80 @@
 
 #include "app_tusb_hid.h"
 #include "app_udp_server.h"
+#include "key_link.h"
+#include "key_merge.h"
 
 #define CONFIG_EXAMPLE_IPV4 1
 #define PORT 3333
 
 static const char *TAG = "APP_UDP_SERVER";
 
+#define UDP_SERVER_POLL_MS 50 // 没有数据时检查按键超时的间隔
+#define UDP_SERVER_DEBUG   (0)  // 1: 打印每一帧的来源和内容, 会增加延迟
+
+static key_merge_t s_merge;     // 每个键盘 (按 IP 区分) 的状态, 合并后发给主机
+static uint32_t s_applied = 0;
+
+static void udp_server_log_stats(void)
+{
+    char addr_str[INET6_ADDRSTRLEN];
+    for (int i = 0; i < KEY_MERGE_SOURCE_MAX; i++)
+    {
+        const key_merge_source_t *src = &s_merge.sources[i];
+        if (src->addr_len == 0)
+        {
+            continue;
+        }
+        if (src->addr_len == sizeof(struct in_addr))
+        {
+            inet_ntop(AF_INET, src->addr, addr_str, sizeof(addr_str));
+        }
+        else
+        {
+            inet_ntop(AF_INET6, src->addr, addr_str, sizeof(addr_str));
+        }
+        const key_link_rx_stats_t *st = &src->rx.stats;
+        ESP_LOGI(TAG, "%s%s: frames %lu, applied %lu, duplicate %lu, stale %lu, skipped %lu, invalid %lu, resync %lu, timeouts %lu",
+                 addr_str, src->legacy ? " (legacy)" : "",
+                 st->received, st->applied, st->duplicate, st->stale, st->skipped, st->invalid, st->resync, st->timeouts);
+    }
+    ESP_LOGI(TAG, "sources %d/%d, rejected %lu", key_merge_source_count(&s_merge), KEY_MERGE_SOURCE_MAX, s_merge.rejected);
+}
+
+/// @brief 来源地址: IPv4 4 字节, IPv6 16 字节
+static size_t udp_server_source_key(const struct sockaddr_storage *source_addr, const void **key)
+{
+    if (source_addr->ss_family == PF_INET6)
+    {
+        *key = &((const struct sockaddr_in6 *)source_addr)->sin6_addr;
+        return sizeof(struct in6_addr);
+    }
+    *key = &((const struct sockaddr_in *)source_addr)->sin_addr;
+    return sizeof(struct in_addr);
+}
+
+static void udp_server_announce(int sock, const struct sockaddr_storage *source_addr, uint32_t seq)
+{
+    key_frame_t frame;
+    key_link_frame_init(&frame, KEY_FRAME_ANNOUNCE, seq, esp_timer_get_time());
+    socklen_t addr_len = source_addr->ss_family == PF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    if (sendto(sock, &frame, sizeof(frame), 0, (const struct sockaddr *)source_addr, addr_len) < 0)
+    {
+        ESP_LOGW(TAG, "announce failed: errno %d", errno);
+    }
+}
+
 static void udp_server_task(void *pvParameters)
 {
     uint8_t rx_buffer[128];
+#if UDP_SERVER_DEBUG
     char addr_str[128];
+#endif
     int addr_family = (int)pvParameters;
     int ip_protocol = 0;
     struct sockaddr_in6 dest_addr;
 
+    key_merge_init(&s_merge);
     while (1)
     {
         if (addr_family == AF_INET)
@@ -79,10 +140,10 @@ static void udp_server_task(void *pvParameters)
             setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt));
         }
 #endif
-        // Set timeout
+        // 超时返回, 检查是否需要释放按键
         struct timeval timeout;
-        timeout.tv_sec = 10;
-        timeout.tv_usec = 0;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = UDP_SERVER_POLL_MS * 1000;
         setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
 
         int err = bind(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
@@ -114,21 +175,33 @@ static void udp_server_task(void *pvParameters)
 
         while (1)
         {
-            // ESP_LOGI(TAG, "Waiting for data");
+            // 不在循环中休眠, 收到的帧立即处理; 没有数据时 recv 最多阻塞 UDP_SERVER_POLL_MS
 #if defined(CONFIG_LWIP_NETBUF_RECVINFO) && !defined(CONFIG_EXAMPLE_IPV6)
             int len = recvmsg(sock, &msg, 0);
 #else
+            socklen = sizeof(source_addr);
             int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer) - 1, 0, (struct sockaddr *)&source_addr, &socklen);
 #endif
-            if (len < 0)
+            int64_t rx_us = esp_timer_get_time();
+            if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
             {
                 // Error occurred during receiving
                 ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
                 break;
             }
-            else
+
+            // 键盘掉线或连续丢帧, 释放该键盘按住的键, 其他键盘不受影响
+            key_nkro_report_t report;
+            if (key_merge_check_timeout(&s_merge, rx_us, &report))
             {
-                // Data received
+                ESP_LOGW(TAG, "keyboard timeout, release its keys");
+                app_tusb_hid_send_report(&report, rx_us);
+                udp_server_log_stats();
+            }
+
+            if (len > 0)
+            {
+#if UDP_SERVER_DEBUG
                 // Get the sender's ip address as string
                 if (source_addr.ss_family == PF_INET)
                 {
@@ -149,23 +222,41 @@ static void udp_server_task(void *pvParameters)
                 {
                     inet6_ntoa_r(((struct sockaddr_in6 *)&source_addr)->sin6_addr, addr_str, sizeof(addr_str) - 1);
                 }
+                ESP_LOG_BUFFER_HEX_LEVEL(addr_str, rx_buffer, len, ESP_LOG_INFO);
+#endif
+
+                // 旧版本键盘的 8 字节报文也按来源合并
+                const void *key = NULL;
+                size_t key_len = udp_server_source_key(&source_addr, &key);
+                bool changed = key_merge_input(&s_merge, key, key_len, rx_buffer, len, rx_us, &report);
+
+                // 回复 DISCOVER, 心跳和限速后的 REPORT, 键盘据此记录本机地址并改为单播, 也用来判断本机是否在线
+                key_frame_t frame;
+                if (key_link_frame_parse(rx_buffer, len, &frame) &&
+                    key_merge_announce(&s_merge, key, key_len, &frame, rx_us))
+                {
+                    udp_server_announce(sock, &source_addr, frame.seq);
+                }
 
-                // 打印接收到的信息
-                for (uint8_t i = 0; i < 8; i++)
+                if (!changed)
                 {
-                    printf("%02X ", rx_buffer[i]);
+                    // 重复, 过时或合并结果没有变化的帧
+                    continue;
                 }
-                printf("\r\n");
 
-                app_tusb_hid_send_key((uint8_t *)rx_buffer, 8);
+                app_tusb_hid_send_report(&report, rx_us);
+                if (++s_applied % 1000 == 0)
+                {
+                    udp_server_log_stats();
+                }
             }
-            vTaskDelay(10 / portTICK_PERIOD_MS);
         }
 
         if (sock != -1)
         {
-            memset(rx_buffer, 0, sizeof(rx_buffer));
-            app_tusb_hid_send_key((uint8_t *)rx_buffer, 8);
+            key_nkro_report_t report = {0};
+            key_merge_init(&s_merge);
+            app_tusb_hid_send_report(&report, esp_timer_get_time());
             ESP_LOGE(TAG, "Shutting down socket and restarting...");
             shutdown(sock, 0);
             close(sock);
@@ -5,9 +5,13 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "tinyusb.h"
 #include "class/hid/hid_device.h"
 #include "driver/gpio.h"
@@ -19,6 +23,24 @@ static const char *TAG = "TUSB HID";
 static bool tusb_hid_is_inited = false;
 static uint8_t tusb_report_id = HID_ITF_PROTOCOL_NONE;
 
+#define TUSB_HID_QUEUE_LEN 32
+
+// NKRO 键盘使用新的报文 ID, 原来的 6 键键盘保留用于接收主机的 LED 状态
+#define HID_REPORT_ID_NKRO (HID_ITF_PROTOCOL_MOUSE + 1)
+
+typedef struct
+{
+    key_nkro_report_t report;
+    int64_t rx_us;
+} tusb_hid_item_t;
+
+// 网络任务和 ESP-NOW 回调只入队, 由发送任务按 tud_hid_ready() 节奏交给 TinyUSB
+static QueueHandle_t s_hid_queue = NULL;
+static TaskHandle_t s_hid_task = NULL;
+static int64_t s_inflight_rx_us = 0; // 正在传输的报文的接收时间, 传输完成时统计
+static app_tusb_hid_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
 /************* TinyUSB descriptors ****************/
 
 #define TUSB_DESC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + CFG_TUD_HID * TUD_HID_DESC_LEN)
@@ -32,6 +54,25 @@ static uint8_t tusb_report_id = HID_ITF_PROTOCOL_NONE;
 const uint8_t hid_report_descriptor[] = {
     TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(HID_ITF_PROTOCOL_KEYBOARD)),
     TUD_HID_REPORT_DESC_MOUSE(HID_REPORT_ID(HID_ITF_PROTOCOL_MOUSE)),
+    // NKRO 键盘: 8 个修饰键 + 键码 0x00 ~ 0xDF 的位图, 与 key_nkro_report_t 一致
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+    HID_USAGE(HID_USAGE_DESKTOP_KEYBOARD),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+        HID_REPORT_ID(HID_REPORT_ID_NKRO)
+        HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD),
+            HID_USAGE_MIN(224),
+            HID_USAGE_MAX(231),
+            HID_LOGICAL_MIN(0),
+            HID_LOGICAL_MAX(1),
+            HID_REPORT_COUNT(8),
+            HID_REPORT_SIZE(1),
+            HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+            HID_USAGE_MIN(0),
+            HID_USAGE_MAX(KEY_NKRO_USAGE_NUM - 1),
+            HID_REPORT_COUNT(KEY_NKRO_USAGE_NUM),
+            HID_REPORT_SIZE(1),
+            HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+    HID_COLLECTION_END,
 };
 
 /**
@@ -56,7 +97,8 @@ static const uint8_t hid_configuration_descriptor[] = {
     TUD_CONFIG_DESCRIPTOR(1, 1, 0, TUSB_DESC_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
 
     // Interface number, string index, boot protocol, report descriptor len, EP In address, size & polling interval
-    TUD_HID_DESCRIPTOR(0, 4, false, sizeof(hid_report_descriptor), 0x81, 16, 10),
+    // 轮询间隔 1 ms, 报文在端点上最多等待 1 ms; 端点需要放下报文 ID + NKRO 报文
+    TUD_HID_DESCRIPTOR(0, 4, false, sizeof(hid_report_descriptor), 0x81, 32, 1),
 };
 
 /********* TinyUSB HID callbacks ***************/
@@ -89,18 +131,117 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_
     tusb_report_id = report_id;
 }
 
-void app_tusb_hid_send_key(uint8_t *keyBuf, uint8_t len)
+static void tusb_hid_record(uint32_t *max_us, uint64_t *total_us, int64_t latency_us)
+{
+    if (latency_us > *max_us)
+    {
+        *max_us = latency_us;
+    }
+    *total_us += latency_us;
+}
+
+// Invoked when sent REPORT successfully to host
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint16_t len)
+{
+    (void)instance;
+    (void)report;
+    (void)len;
+    if (s_inflight_rx_us)
+    {
+        int64_t latency_us = esp_timer_get_time() - s_inflight_rx_us;
+        s_inflight_rx_us = 0;
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.completed++;
+        tusb_hid_record(&s_stats.done_max_us, &s_stats.done_total_us, latency_us);
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+    if (s_hid_task)
+    {
+        xTaskNotifyGive(s_hid_task);
+    }
+}
+
+static void tusb_hid_task(void *arg)
+{
+    tusb_hid_item_t item;
+    while (1)
+    {
+        if (xQueueReceive(s_hid_queue, &item, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        if (tusb_report_id != HID_ITF_PROTOCOL_KEYBOARD)
+        {
+            continue;
+        }
+
+        // 上一帧还在端点上时等待传输完成, 超时说明主机没有轮询(挂起或拔出)
+        int retry = 0;
+        while (!tud_hid_ready() && retry++ < 10)
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+        }
+        if (!tud_hid_ready())
+        {
+            portENTER_CRITICAL(&s_stats_lock);
+            s_stats.dropped++;
+            portEXIT_CRITICAL(&s_stats_lock);
+            continue;
+        }
+
+        s_inflight_rx_us = item.rx_us;
+        if (!tud_hid_report(HID_REPORT_ID_NKRO, &item.report, sizeof(item.report)))
+        {
+            s_inflight_rx_us = 0;
+            continue;
+        }
+
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.sent++;
+        tusb_hid_record(&s_stats.submit_max_us, &s_stats.submit_total_us, esp_timer_get_time() - item.rx_us);
+        portEXIT_CRITICAL(&s_stats_lock);
+        if (s_stats.sent % 1000 == 0)
+        {
+            app_tusb_hid_log_stats();
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+void app_tusb_hid_send_report(const key_nkro_report_t *report, int64_t rx_us)
 {
     if (!tusb_hid_is_inited)
         return;
-    if (len != 8)
-        return;
-    if (tusb_report_id != HID_ITF_PROTOCOL_KEYBOARD)
-        return;
-    uint8_t special_key_mask = keyBuf[0];
-    uint8_t key_cmd[6] = {0};
-    memcpy(key_cmd, keyBuf + 2, len - 2);
-    tud_hid_keyboard_report(tusb_report_id, special_key_mask, key_cmd);
+
+    tusb_hid_item_t item = {.report = *report, .rx_us = rx_us};
+    if (xQueueSend(s_hid_queue, &item, 0) != pdTRUE)
+    {
+        // 主机不轮询时队列会满, 丢掉最旧的状态, 保留最新的
+        tusb_hid_item_t oldest;
+        xQueueReceive(s_hid_queue, &oldest, 0);
+        xQueueSend(s_hid_queue, &item, 0);
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.dropped++;
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+}
+
+void app_tusb_hid_get_stats(app_tusb_hid_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+void app_tusb_hid_log_stats(void)
+{
+    app_tusb_hid_stats_t st;
+    app_tusb_hid_get_stats(&st);
+    ESP_LOGI(TAG, "sent %" PRIu32 ", dropped %" PRIu32 ", rx->submit avg %" PRIu32 " us max %" PRIu32 " us, "
+                  "rx->host avg %" PRIu32 " us max %" PRIu32 " us",
+             st.sent, st.dropped,
+             st.sent ? (uint32_t)(st.submit_total_us / st.sent) : 0, st.submit_max_us,
+             st.completed ? (uint32_t)(st.done_total_us / st.completed) : 0, st.done_max_us);
 }
 
 void app_tusb_hid_init(void)
@@ -116,5 +257,11 @@ void app_tusb_hid_init(void)
 
     ESP_ERROR_CHECK(tinyusb_driver_install(&tusb_cfg));
     ESP_LOGI(TAG, "USB initialization DONE");
+
+    s_hid_queue = xQueueCreate(TUSB_HID_QUEUE_LEN, sizeof(tusb_hid_item_t));
+    assert(s_hid_queue);
+    // 与 TinyUSB 任务同优先级, 高于网络接收
+    xTaskCreatePinnedToCore(tusb_hid_task, "tusb_hid_tx", 3 * 1024, NULL, CONFIG_TINYUSB_TASK_PRIORITY, &s_hid_task, 1);
+    assert(s_hid_task);
     tusb_hid_is_inited = true;
 }
\ No newline at end of file
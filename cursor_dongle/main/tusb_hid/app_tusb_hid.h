@@ -1,11 +1,34 @@
 #pragma once
 
+#include <stdint.h>
+#include "key_merge.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+    typedef struct
+    {
+        uint32_t sent;          // 交给 TinyUSB 的报文数
+        uint32_t completed;     // 主机已取走的报文数
+        uint32_t dropped;       // 队列满或主机长时间不轮询时丢弃的报文数
+        uint32_t submit_max_us; // 收到到交给 TinyUSB
+        uint64_t submit_total_us;
+        uint32_t done_max_us;   // 收到到主机取走
+        uint64_t done_total_us;
+    } app_tusb_hid_stats_t;
+
     void app_tusb_hid_init(void);
-    void app_tusb_hid_send_key(uint8_t *keyBuf, uint8_t len);
+
+    /**
+     * @brief 把合并后的 NKRO 报文放入发送队列, 不会阻塞.
+     *
+     * @param rx_us 报文从网络收到的时间 (esp_timer_get_time), 用于统计接收器增加的延迟
+     */
+    void app_tusb_hid_send_report(const key_nkro_report_t *report, int64_t rx_us);
+
+    void app_tusb_hid_get_stats(app_tusb_hid_stats_t *stats);
+    void app_tusb_hid_log_stats(void);
 
 #ifdef __cplusplus
 }
@@ -24,11 +24,20 @@
 #include "bsp_keyboard.h"
 #include "app_sr.h"
 #include "app_audio.h"
+#include "audio_stream.h"
+#include "audio_bank.h"
+#include "audio_resampler.h"
+#include "audio_ref.h"
+#include "app_sr_cmd.h"
 #include "app_wifi.h"
 #include "chatgpt_api.h"
 #include "baidu_api.h"
+#include "tts_cache.h"
+#include "json_utils.h"
 #include "keyboard.h"
 #include "function_keys.h"
+#include "voice_sched.h"
+#include "wifi_power.h"
 
 static const char *TAG = "app_audio";
 
@@ -38,9 +47,16 @@ bool record_flag = false;
 uint32_t record_total_len = 0;
 uint32_t file_total_len = 0;
 static uint8_t *record_audio_buffer = NULL;
-uint8_t *audio_rx_buffer = NULL;
 audio_play_finish_cb_t audio_play_finish_cb = NULL;
-static bool g_audio_chat_running = false;
+
+// 播放源格式与总线格式不一致时, 由重采样器转换, 总线始终保持录音的配置
+#define AUDIO_PLAY_CHUNK_FRAMES (512)
+static audio_resampler_t *s_play_resampler = NULL;
+static uint32_t s_play_src_rate = AUDIO_PLAY_SAMPLE_RATE;
+static int s_play_src_channels = 2;
+static bool s_play_passthrough = true;
+static bool s_play_ref_tap = true; // 16K 双声道输出才能作为 AEC 参考
+static int16_t s_play_out[AUDIO_PLAY_CHUNK_FRAMES * 2];
 
 extern int Cache_WriteBack_Addr(uint32_t addr, uint32_t size);
 
@@ -58,6 +74,11 @@ static esp_err_t audio_mute_function(AUDIO_PLAYER_MUTE_SETTING setting)
 static esp_err_t audio_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
 {
     esp_err_t ret = ESP_OK;
+    // 配置未变化时不重开编解码器, 也不需要等待时钟稳定
+    if (bsp_codec_fs_match(rate, bits_cfg, ch))
+    {
+        return bsp_codec_volume_set(CONFIG_VOLUME_LEVEL, NULL);
+    }
     ret = bsp_codec_set_fs(rate, bits_cfg, ch);
     bsp_codec_mute_set(true);
     bsp_codec_mute_set(false);
@@ -66,13 +87,83 @@ static esp_err_t audio_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_m
     return ret;
 }
 
+/// @brief audio_player 的 clk_set_fn, 只记录源格式, 不重新配置总线
+static esp_err_t audio_player_clk_set(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
+{
+    int channels = (ch == I2S_SLOT_MODE_MONO) ? 1 : 2;
+
+    // 非 16bit 数据无法重采样, 退回到重新配置总线
+    if (bits_cfg != 16)
+    {
+        s_play_passthrough = true;
+        s_play_ref_tap = false;
+        return audio_codec_set_fs(rate, bits_cfg, ch);
+    }
+    s_play_ref_tap = true;
+
+    esp_err_t ret = audio_codec_set_fs(AUDIO_PLAY_SAMPLE_RATE, 16, I2S_SLOT_MODE_STEREO);
+    if (rate == AUDIO_PLAY_SAMPLE_RATE && channels == 2)
+    {
+        s_play_passthrough = true;
+        return ret;
+    }
+
+    if (NULL == s_play_resampler || s_play_src_rate != rate || s_play_src_channels != channels)
+    {
+        audio_resampler_delete(s_play_resampler);
+        s_play_resampler = NULL;
+        if (audio_resampler_create(rate, AUDIO_PLAY_SAMPLE_RATE, channels, &s_play_resampler) != ESP_OK)
+        {
+            s_play_passthrough = true;
+            s_play_ref_tap = false;
+            return audio_codec_set_fs(rate, bits_cfg, ch);
+        }
+        s_play_src_rate = rate;
+        s_play_src_channels = channels;
+    }
+    audio_resampler_reset(s_play_resampler);
+    s_play_passthrough = false;
+    return ret;
+}
+
+/// @brief audio_player 的 write_fn, 需要时先重采样到总线采样率
+static esp_err_t audio_player_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms)
+{
+    if (s_play_passthrough)
+    {
+        if (s_play_ref_tap)
+        {
+            return audio_ref_i2s_write(audio_buffer, len, bytes_written, timeout_ms);
+        }
+        return bsp_i2s_write(audio_buffer, len, bytes_written, timeout_ms);
+    }
+
+    esp_err_t ret = ESP_OK;
+    const int16_t *in = (const int16_t *)audio_buffer;
+    size_t left = len / (s_play_src_channels * sizeof(int16_t));
+    while (left > 0 && ret == ESP_OK)
+    {
+        size_t consumed = left;
+        size_t produced = audio_resampler_process(s_play_resampler, in, &consumed, s_play_out, AUDIO_PLAY_CHUNK_FRAMES);
+        in += consumed * s_play_src_channels;
+        left -= consumed;
+        if (produced > 0)
+        {
+            size_t cnt = 0;
+            ret = audio_ref_i2s_write(s_play_out, produced * 2 * sizeof(int16_t), &cnt, timeout_ms);
+        }
+    }
+    *bytes_written = len;
+    return ret;
+}
+
 static void audio_player_cb(audio_player_cb_ctx_t *ctx)
 {
     switch (ctx->audio_event)
     {
     case AUDIO_PLAYER_CALLBACK_EVENT_IDLE:
         ESP_LOGI(TAG, "Player IDLE");
-        bsp_codec_set_fs(16000, 16, 2);
+        bsp_codec_set_fs(AUDIO_PLAY_SAMPLE_RATE, 16, 2);
         if (audio_play_finish_cb)
         {
             audio_play_finish_cb();
@@ -95,23 +186,23 @@ static void audio_player_cb(audio_player_cb_ctx_t *ctx)
     }
 }
 
-void audio_record_save(int16_t *audio_buffer, int audio_chunksize)
+void audio_record_save(const int16_t *audio_buffer, int samples)
 {
 #if DEBUG_SAVE_PCM
     if (record_flag)
     {
         uint16_t *record_buff = (uint16_t *)(record_audio_buffer + sizeof(wav_header_t));
         record_buff += record_total_len;
-        for (int i = 0; i < (audio_chunksize - 1); i++)
+        for (int i = 0; i < samples; i++)
         {
             if (record_total_len < (MAX_FILE_SIZE - sizeof(wav_header_t)) / 2)
             {
 #if PCM_ONE_CHANNEL
-                record_buff[i * 1 + 0] = audio_buffer[i * 3 + 0];
+                record_buff[i * 1 + 0] = audio_buffer[i];
                 record_total_len += 1;
 #else
-                record_buff[i * 2 + 0] = audio_buffer[i * 3 + 0];
-                record_buff[i * 2 + 1] = audio_buffer[i * 3 + 1];
+                record_buff[i * 2 + 0] = audio_buffer[i];
+                record_buff[i * 2 + 1] = audio_buffer[i];
                 record_total_len += 2;
 #endif
             }
@@ -129,18 +220,38 @@ static void audio_record_start()
 {
 #if DEBUG_SAVE_PCM
     ESP_LOGI(TAG, "### record Start");
+    audio_stream_abort();
     audio_player_stop();
     record_flag = true;
+    wifi_power_hold(WIFI_POWER_HOLD_RECORD, true);
     record_total_len = 0;
     file_total_len = sizeof(wav_header_t);
 #endif
 }
 
+void audio_wav_header_fill(wav_header_t *head, uint32_t rate, int channels, uint32_t data_size)
+{
+    memcpy(head->ChunkID, "RIFF", 4);
+    head->ChunkSize = sizeof(wav_header_t) + data_size - 8;
+    memcpy(head->Format, "WAVE", 4);
+    memcpy(head->Subchunk1ID, "fmt ", 4);
+    head->Subchunk1Size = 16;
+    head->AudioFormat = 1;
+    head->NumChannels = channels;
+    head->SampleRate = rate;
+    head->BitsPerSample = 16;
+    head->ByteRate = rate * head->BitsPerSample * channels / 8;
+    head->BlockAlign = head->BitsPerSample * channels / 8;
+    memcpy(head->Subchunk2ID, "data", 4);
+    head->Subchunk2Size = data_size;
+}
+
 static esp_err_t audio_record_stop()
 {
     esp_err_t ret = ESP_OK;
 #if DEBUG_SAVE_PCM
     record_flag = false;
+    wifi_power_hold(WIFI_POWER_HOLD_RECORD, false);
 #if PCM_ONE_CHANNEL
     record_total_len *= 2; // record_total_len *= 1;
 #else
@@ -151,35 +262,13 @@ static esp_err_t audio_record_stop()
              record_total_len,
              record_total_len / 1024);
 
-    FILE *fp = fopen("/spiffs/echo_en_wake.wav", "r");
-    ESP_GOTO_ON_FALSE(NULL != fp, ESP_FAIL, err, TAG, "Failed create record file");
-
-    wav_header_t wav_head;
-    int len = fread(&wav_head, 1, sizeof(wav_header_t), fp);
-    ESP_GOTO_ON_FALSE(len > 0, ESP_FAIL, err, TAG, "Failed create record file");
-
-    wav_head.SampleRate = 16000;
 #if PCM_ONE_CHANNEL
-    wav_head.NumChannels = 1;
+    audio_wav_header_fill((wav_header_t *)record_audio_buffer, 16000, 1, record_total_len);
 #else
-    wav_head.NumChannels = 2;
+    audio_wav_header_fill((wav_header_t *)record_audio_buffer, 16000, 2, record_total_len);
 #endif
-    wav_head.BitsPerSample = 16;
-    wav_head.ChunkSize = file_total_len - 8;
-    wav_head.ByteRate  = wav_head.SampleRate * wav_head.BitsPerSample * wav_head.NumChannels / 8;
-    wav_head.Subchunk2ID[0] = 'd';
-    wav_head.Subchunk2ID[1] = 'a';
-    wav_head.Subchunk2ID[2] = 't';
-    wav_head.Subchunk2ID[3] = 'a';
-    wav_head.Subchunk2Size = record_total_len;
-    memcpy((void *)record_audio_buffer, &wav_head, sizeof(wav_header_t));
     Cache_WriteBack_Addr((uint32_t)record_audio_buffer, record_total_len);
 #endif
-err:
-    if (fp)
-    {
-        fclose(fp);
-    }
     return ret;
 }
 
@@ -202,67 +291,34 @@ void audio_play_filepath(const char *filepath)
         audio_player_play(fp);
 }
 
-esp_err_t audio_play_task(void *filepath)
+/// @brief 播放中被唤醒时打断播放, 等待播放器空闲后再输出提示音
+static void audio_play_barge_in(void)
 {
-    FILE *fp = NULL;
-    struct stat file_stat;
-    esp_err_t ret = ESP_OK;
-
-    const size_t chunk_size = (1024 * 8);
-    uint8_t *buffer = malloc(chunk_size);
-    ESP_GOTO_ON_FALSE(NULL != buffer, ESP_FAIL, EXIT, TAG, "buffer malloc failed");
-
-    ESP_GOTO_ON_FALSE(-1 != stat(filepath, &file_stat), ESP_FAIL, EXIT, TAG, "Failed to stat file");
-
-    fp = fopen(filepath, "r");
-    ESP_GOTO_ON_FALSE(NULL != fp, ESP_FAIL, EXIT, TAG, "Failed create record file");
-
-    wav_header_t wav_head;
-    int len = fread(&wav_head, 1, sizeof(wav_header_t), fp);
-    ESP_GOTO_ON_FALSE(len > 0, ESP_FAIL, EXIT, TAG, "Read wav header failed");
-
-    if (NULL == strstr((char *)wav_head.Subchunk1ID, "fmt") &&
-        NULL == strstr((char *)wav_head.Subchunk2ID, "data"))
+    if (!audio_stream_is_open() && audio_player_get_state() == AUDIO_PLAYER_STATE_IDLE)
     {
-        ESP_LOGI(TAG, "PCM format");
-        fseek(fp, 0, SEEK_SET);
-        wav_head.SampleRate = 16000;
-        wav_head.NumChannels = 2;
-        wav_head.BitsPerSample = 16;
+        return;
     }
-
-    ESP_LOGI(TAG, "frame_rate= %" PRIi32 ", ch=%d, width=%d", wav_head.SampleRate, wav_head.NumChannels, wav_head.BitsPerSample);
-    bsp_codec_set_fs(wav_head.SampleRate, wav_head.BitsPerSample, I2S_SLOT_MODE_STEREO);
-    bsp_codec_mute_set(true);
-    bsp_codec_mute_set(false);
-    bsp_codec_volume_set(CONFIG_VOLUME_LEVEL, NULL);
-
-    size_t cnt, total_cnt = 0;
-    do
+    ESP_LOGI(TAG, "barge-in, stop playback");
+    audio_stream_abort();
+    audio_player_stop();
+    for (int i = 0; i < 20 && audio_player_get_state() != AUDIO_PLAYER_STATE_IDLE; i++)
     {
-        /* Read file in chunks into the scratch buffer */
-        len = fread(buffer, 1, chunk_size, fp);
-        if (len <= 0)
-        {
-            break;
-        }
-        else if (len > 0)
-        {
-            bsp_i2s_write(buffer, len, &cnt, portMAX_DELAY);
-            total_cnt += cnt;
-        }
-    } while (1);
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
 
-EXIT:
-    if (fp)
+/// @brief 把当前录音提交给调度器, 排不进去时提示用户稍后再说
+static void audio_record_submit(audio_chat_mode_t mode)
+{
+    if (voice_sched_submit(mode, record_audio_buffer, record_total_len) != ESP_OK)
     {
-        fclose(fp);
+        audio_bank_play(AUDIO_PROMPT_BOING);
+        return;
     }
-    if (buffer)
+    if (mode == AUDIO_CHAT_MODE_GPT)
     {
-        free(buffer);
+        audio_bank_play(AUDIO_PROMPT_THINKING);
     }
-    return ret;
 }
 
 void sr_handler_task(void *pvParam)
@@ -280,34 +336,29 @@ void sr_handler_task(void *pvParam)
         if (ESP_MN_STATE_TIMEOUT == result.state)
         {
             ESP_LOGI(TAG, "ESP_MN_STATE_TIMEOUT");
-            if (g_audio_chat_running || !record_flag)
+            if (!record_flag)
             {
                 continue;
             }
             audio_record_stop(); // 停止录音
             // audio_play_task("/spiffs/echo_cn_end.wav");// 我去休息了
-            audio_play_filepath("/spiffs/IamThinking.wav");
-            g_audio_chat_running = true;
-            audio_chat_mode_t chat_mode = AUDIO_CHAT_MODE_GPT;
-            app_sr_set_chat_mode(&chat_mode, 10);
+            audio_record_submit(AUDIO_CHAT_MODE_GPT);
             continue;
         }
 
         // 识别到唤醒词
         if (WAKENET_DETECTED == result.wakenet_mode)
         {
-            if (g_audio_chat_running)
-            {
-                audio_play_filepath("/spiffs/Boing.wav");
-                continue;
-            }
+            // 新的一轮对话取代还没说完的回答; 听写请求不受影响, 继续在后台识别输入
+            voice_sched_cancel(AUDIO_CHAT_MODE_GPT);
+            audio_play_barge_in();
             switch (result.command_id)
             {
             case 0x55:
-                audio_play_task("/spiffs/echo_en_wake.wav"); // 叮...
+                audio_bank_play_sync(AUDIO_PROMPT_WAKE_EN); // 叮...
                 break;
             default:
-                audio_play_task("/spiffs/echo_cn_wake.wav");// 我在
+                audio_bank_play_sync(AUDIO_PROMPT_WAKE_CN);// 我在
                 break;
             }
             audio_record_start();// 开始录音
@@ -318,19 +369,24 @@ void sr_handler_task(void *pvParam)
         if (ESP_MN_STATE_DETECTED & result.state)
         {
             ESP_LOGE(TAG, "STOP: %02X", result.command_id);
-            if (g_audio_chat_running || !record_flag)
+            if (!record_flag)
             {
                 continue;
             }
             audio_record_stop();// 停止录音
             // audio_play_task("/spiffs/echo_cn_ok.wav");// 好的
             // audio_play_filepath("/spiffs/Voice2Unicode.wav");
+            // 本地命令词: 丢弃录音, 直接执行
+            if (app_sr_cmd_is_local(result.command_id))
+            {
+                app_sr_cmd_handle(result.command_id);
+                audio_bank_play(AUDIO_PROMPT_DONE);
+                continue;
+            }
             switch (result.command_id)
             {
             case 0x55:
-                g_audio_chat_running = true;
-                audio_chat_mode_t chat_mode = AUDIO_CHAT_MODE_ASR;
-                app_sr_set_chat_mode(&chat_mode, 10);
+                audio_record_submit(AUDIO_CHAT_MODE_ASR);
                 break;
             default:
                 break;
@@ -340,66 +396,57 @@ void sr_handler_task(void *pvParam)
     vTaskDelete(NULL);
 }
 
-void audio_chat_task(void *pvParam)
+void audio_chat_job_handler(voice_job_t *job)
 {
-    while (true)
+    if (WIFI_STATUS_CONNECTED_OK != app_wifi_connected_already())
     {
-        audio_chat_mode_t chat_mode;
-        if (app_sr_get_chat_mode(&chat_mode, portMAX_DELAY) == pdTRUE)
+        audio_bank_play(AUDIO_PROMPT_SORRY);
+        return;
+    }
+    switch (job->mode)
+    {
+    case AUDIO_CHAT_MODE_GPT:
+        // HTTP 请求不再持有 wifi 锁, 连接池和 token 各自保护自己的状态, 不影响按键发送
+        esp_err_t err = chatgpt_bot(job->audio, job->audio_len, job->arena);
+        if (err != ESP_OK && !job->cancelled)
         {
-            if (WIFI_STATUS_CONNECTED_OK != app_wifi_connected_already())
-                continue;
-            switch (chat_mode)
-            {
-            case AUDIO_CHAT_MODE_GPT:
-                app_wifi_lock(0);
-                esp_err_t err = chatgpt_bot((uint8_t *)record_audio_buffer, record_total_len);
-                app_wifi_unlock();
-                if (err != ESP_OK)
-                {
-                    audio_play_filepath("/spiffs/IamSorry.wav");
-                }
-                g_audio_chat_running = false;
-                break;
-            case AUDIO_CHAT_MODE_ASR:
-                // 1.语音转文字
-                app_wifi_lock(0);
-                char *recognition_result = baidu_get_asr_result((uint8_t *)record_audio_buffer, record_total_len);
-                app_wifi_unlock();
-                g_audio_chat_running = false;
-
-                if (recognition_result == NULL)
-                {
-                    ESP_LOGE(TAG, "0. No text recognized");
-                    goto baidu_asr_end;
-                }
-
-                if (strlen(recognition_result) == 0)
-                {
-                    ESP_LOGE(TAG, "1. No text recognized");
-                    goto baidu_asr_end;
-                }
-
-                int recognition_result_len = strlen(recognition_result);
-                ESP_LOGE(TAG, "user input: %s", recognition_result);
-                ESP_LOGE(TAG, "user input length: %d", recognition_result_len);
-
-                // 3.GBK字符串转HEX数组
-                gbkStrToHex(recognition_result, recognition_result_len);
-baidu_asr_end:
-                if (recognition_result)
-                {
-                    free(recognition_result);
-                    recognition_result = NULL;
-                }
-                audio_play_filepath("/spiffs/Done.wav");
-                break;
-            default:
-                break;
-            }
+            audio_bank_play(AUDIO_PROMPT_SORRY);
         }
+        break;
+    case AUDIO_CHAT_MODE_ASR:
+        // 1.语音转文字
+        char *recognition_result = baidu_get_asr_result(job->audio, job->audio_len, job->arena);
+
+        if (recognition_result == NULL)
+        {
+            ESP_LOGE(TAG, "0. No text recognized");
+            goto baidu_asr_end;
+        }
+
+        if (strlen(recognition_result) == 0)
+        {
+            ESP_LOGE(TAG, "1. No text recognized");
+            goto baidu_asr_end;
+        }
+
+        if (job->cancelled)
+        {
+            goto baidu_asr_end;
+        }
+
+        int recognition_result_len = strlen(recognition_result);
+        ESP_LOGE(TAG, "user input: %s", recognition_result);
+        ESP_LOGE(TAG, "user input length: %d", recognition_result_len);
+
+        // 3.GBK字符串转HEX数组, 只在听写通道中调用, 不会重入
+        gbkStrToHex(recognition_result, recognition_result_len);
+baidu_asr_end:
+        // 识别结果在请求的 arena 中, 不需要释放
+        audio_bank_play(AUDIO_PROMPT_DONE);
+        break;
+    default:
+        break;
     }
-    vTaskDelete(NULL);
 }
 
 void audio_record_init()
@@ -409,13 +456,22 @@ void audio_record_init()
     record_audio_buffer = heap_caps_calloc(1, RECORD_FILE_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     assert(record_audio_buffer);
     printf("successfully created record_audio_buffer with a size: %zu\r\n", RECORD_FILE_SIZE);
-    // 分配语音合成缓存
-    audio_rx_buffer = heap_caps_calloc(1, MAX_FILE_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    assert(audio_rx_buffer);
-    printf("successfully created audio_rx_buffer with a size: %zu\r\n", MAX_FILE_SIZE);
 #endif
 
-    if (record_audio_buffer == NULL || audio_rx_buffer == NULL)
+    // 语音合成边下载边播放的缓冲
+    ESP_ERROR_CHECK(audio_stream_init());
+    // 语音合成结果缓存
+    ESP_ERROR_CHECK(tts_cache_init());
+    // 提示音常驻 PSRAM
+    ESP_ERROR_CHECK(audio_bank_init());
+#if AUDIO_RESAMPLER_BENCHMARK
+    audio_resampler_benchmark();
+#endif
+#if JSON_UTILS_BENCHMARK
+    json_utils_benchmark();
+#endif
+
+    if (record_audio_buffer == NULL)
     {
         printf("Error: Failed to allocate memory for buffers\r\n");
         return;
@@ -426,8 +482,8 @@ void audio_record_init()
 
     audio_player_config_t config = {
         .mute_fn = audio_mute_function,
-        .write_fn = bsp_i2s_write,
-        .clk_set_fn = audio_codec_set_fs,
+        .write_fn = audio_player_write,
+        .clk_set_fn = audio_player_clk_set,
         .priority = 5,
     };
     ESP_ERROR_CHECK(audio_player_new(config));
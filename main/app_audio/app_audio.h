@@ -6,10 +6,13 @@
 
 #pragma once
 
+#include "voice_sched.h"
+
 #define DEBUG_SAVE_PCM      (1)
 #define PCM_ONE_CHANNEL     (1)
 #define RECORD_FILE_SIZE    (1 * 1024 * 1024)
 #define MAX_FILE_SIZE       (1 * 1024 * 1024)
+#define AUDIO_PLAY_SAMPLE_RATE (16000) // 播放与录音共用的总线采样率
 
 typedef struct {
     // The "RIFF" chunk descriptor
@@ -33,19 +36,14 @@ typedef struct {
 typedef void (*audio_play_finish_cb_t)(void);
 
 void sr_handler_task(void *pvParam);
-void audio_chat_task(void *pvParam);
-
-/**
- * @brief The buffer to hold the recorded audio.
- */
-extern uint8_t *audio_rx_buffer;
+void audio_chat_job_handler(voice_job_t *job);
 
-esp_err_t audio_play_task(void *filepath);
+void audio_wav_header_fill(wav_header_t *head, uint32_t rate, int channels, uint32_t data_size);
 
 void audio_play_filepath(const char *filepath);
 
 void audio_record_init();
 
-void audio_record_save(int16_t *audio_buffer, int audio_chunksize);
+void audio_record_save(const int16_t *audio_buffer, int samples);
 
 void audio_register_play_finish_cb(audio_play_finish_cb_t cb);
@@ -29,6 +29,8 @@
 #include "bsp_keyboard.h"
 #include "app_sr.h"
 #include "app_audio.h"
+#include "audio_ref.h"
+#include "app_sr_cmd.h"
 #include "app_wifi.h"
 #include "function_keys.h"
 
@@ -41,8 +43,6 @@ static srmodel_list_t *models = NULL;
 static bool manul_detect_flag = false;
 sr_data_t *g_sr_data = NULL;
 
-static QueueHandle_t g_audio_chat_mode_que = NULL;
-
 static void audio_feed_task(void *arg)
 {
     size_t bytes_read = 0;
@@ -52,6 +52,8 @@ static void audio_feed_task(void *arg)
     ESP_LOGI(TAG, "audio_chunksize = %d, feed_channel = %d", audio_chunksize, feed_channel);
     int16_t *audio_buffer = heap_caps_malloc(audio_chunksize * sizeof(int16_t) * feed_channel, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     assert(audio_buffer);
+    int16_t *ref_buffer = heap_caps_malloc(audio_chunksize * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    assert(ref_buffer);
     g_sr_data->afe_in_buffer = audio_buffer;
 
     while (true)
@@ -59,21 +61,20 @@ static void audio_feed_task(void *arg)
         /* Read audio data from I2S bus */
         bsp_i2s_read((char *)audio_buffer, audio_chunksize * I2S_CHANNEL_NUM * sizeof(int16_t), &bytes_read);
 
-        // AFE需要3通道数据, 将第3通道（参考回路）置0
-        // 如不需要AEC功能, 只需两通道mic数据即可
+        // 取出与本块麦克风数据对齐的播放参考信号
+        audio_ref_read(ref_buffer, audio_chunksize);
+
+        // AFE需要3通道数据, 第3通道为参考回路, 用于AEC
         for (int i = audio_chunksize - 1; i >= 0; i--)
         {
             audio_buffer[i * 3 + 0] = audio_buffer[i * 2 + 0]; // mic_l
             audio_buffer[i * 3 + 1] = audio_buffer[i * 2 + 1]; // mic_r
-            audio_buffer[i * 3 + 2] = 0;                       // ref
+            audio_buffer[i * 3 + 2] = ref_buffer[i];           // ref
         }
 
         /* Feed samples of an audio stream to the AFE_SR */
         afe_handle->feed(afe_data, audio_buffer);
 
-        // 保存音频数据
-        audio_record_save(audio_buffer, audio_chunksize);
-
         vTaskDelay(pdMS_TO_TICKS(1));
     }
 
@@ -100,6 +101,9 @@ static void audio_detect_task(void *arg)
             continue;
         }
 
+        // 保存经过AEC/NS处理后的音频, 录音中不再混入提示音
+        audio_record_save(res->data, res->data_size / sizeof(int16_t));
+
         // -------------------------------------------------------------------------------
         // 按下按键开始录音
         if (getRecKey())
@@ -156,11 +160,36 @@ static void audio_detect_task(void *arg)
             frame_keep = 0;
             detect_flag = true;                               // 使能VAD检测
             g_sr_data->afe_handle->disable_wakenet(afe_data); // 关闭唤醒词检测
+            if (g_sr_data->model_data)
+            {
+                g_sr_data->multinet->clean(g_sr_data->model_data);
+            }
             ESP_LOGI(TAG, LOG_BOLD(LOG_COLOR_GREEN) "AFE_FETCH_CHANNEL_VERIFIED, channel index: %d\n", res->trigger_channel_id);
         }
 
         if (true == detect_flag)
         {
+            // 本地命令词识别, 命中后直接执行, 不再等待 VAD 结束和云端识别
+            if (g_sr_data->model_data)
+            {
+                esp_mn_state_t mn_state = g_sr_data->multinet->detect(g_sr_data->model_data, res->data);
+                if (ESP_MN_STATE_DETECTED == mn_state)
+                {
+                    esp_mn_results_t *mn_result = g_sr_data->multinet->get_results(g_sr_data->model_data);
+                    ESP_LOGI(TAG, LOG_BOLD(LOG_COLOR_GREEN) "local command %d, prob %.2f", mn_result->command_id[0], mn_result->prob[0]);
+                    sr_result_t result = {
+                        .wakenet_mode = WAKENET_NO_DETECT,
+                        .state = ESP_MN_STATE_DETECTED,
+                        .command_id = mn_result->command_id[0],
+                    };
+                    app_sr_set_result(&result, 0);
+                    g_sr_data->multinet->clean(g_sr_data->model_data);
+                    g_sr_data->afe_handle->enable_wakenet(afe_data);
+                    detect_flag = false;
+                    continue;
+                }
+            }
+
             if (local_state != res->vad_state)
             {
                 local_state = res->vad_state;
@@ -207,10 +236,28 @@ esp_err_t app_sr_set_language(sr_language_t new_lang)
     if (g_sr_data->model_data)
     {
         g_sr_data->multinet->destroy(g_sr_data->model_data);
+        g_sr_data->model_data = NULL;
     }
     char *wn_name = esp_srmodel_filter(models, ESP_WN_PREFIX, "");
     ESP_LOGI(TAG, "load wakenet:%s", wn_name);
     g_sr_data->afe_handle->set_wakenet(g_sr_data->afe_data, wn_name);
+
+    // 加载 model 分区中的 MultiNet 命令词模型, 没有模型时所有语音都交给云端
+    char *mn_name = esp_srmodel_filter(models, ESP_MN_PREFIX, (SR_LANG_EN == g_sr_data->lang) ? ESP_MN_ENGLISH : ESP_MN_CHINESE);
+    if (NULL == mn_name)
+    {
+        ESP_LOGW(TAG, "No multinet model found");
+        return ESP_OK;
+    }
+    g_sr_data->multinet = esp_mn_handle_from_name(mn_name);
+    g_sr_data->model_data = g_sr_data->multinet->create(mn_name, SR_CMD_MN_TIMEOUT_MS);
+    ESP_LOGI(TAG, "load multinet:%s", mn_name);
+    if (app_sr_cmd_register(g_sr_data->multinet, g_sr_data->model_data) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to register commands, local commands disabled");
+        g_sr_data->multinet->destroy(g_sr_data->model_data);
+        g_sr_data->model_data = NULL;
+    }
     return ESP_OK;
 }
 
@@ -218,9 +265,6 @@ esp_err_t app_sr_set_language(sr_language_t new_lang)
 static StaticTask_t xSrHandleTaskBuffer;
 static StackType_t *xSrHandleTaskStack;
 
-#define CHAT_TASK_STACK_SIZE (10 * 1024)
-static StaticTask_t xChatTaskBuffer;
-static StackType_t *xChatTaskStack;
 
 esp_err_t app_sr_start(void)
 {
@@ -233,16 +277,14 @@ esp_err_t app_sr_start(void)
     g_sr_data->result_que = xQueueCreate(3, sizeof(sr_result_t));
     ESP_GOTO_ON_FALSE(NULL != g_sr_data->result_que, ESP_ERR_NO_MEM, err, TAG, "Failed create result queue");
 
-    g_audio_chat_mode_que = xQueueCreate(1, sizeof(audio_chat_mode_t));
-    ESP_GOTO_ON_FALSE(NULL != g_audio_chat_mode_que, ESP_ERR_NO_MEM, err, TAG, "Failed create audio chat mode queue");
-
     BaseType_t ret_val;
     models = esp_srmodel_init("model");
     afe_handle = (esp_afe_sr_iface_t *)&ESP_AFE_SR_HANDLE;
     afe_config_t afe_config = AFE_CONFIG_DEFAULT();
     afe_config.wakenet_model_name = esp_srmodel_filter(models, ESP_WN_PREFIX, NULL);
-    afe_config.aec_init = false; //aec不使能：BSS/NS 算法处理在 feed() 中进行
+    afe_config.aec_init = true; // 第3通道为播放参考信号, 播放时也能唤醒和打断
 
+    ESP_GOTO_ON_ERROR(audio_ref_init(), err, TAG, "Failed to init reference ring");
     esp_afe_sr_data_t *afe_data = afe_handle->create_from_config(&afe_config);
     g_sr_data->afe_handle = afe_handle;
     g_sr_data->afe_data   = afe_data;
@@ -262,11 +304,8 @@ esp_err_t app_sr_start(void)
     assert(xSrHandleTaskStack);
     TaskHandle_t xSrHandleTask = xTaskCreateStaticPinnedToCore(&sr_handler_task, "SR Handler Task", SR_HANDLE_TASK_STACK_SIZE, NULL, 4, xSrHandleTaskStack, &xSrHandleTaskBuffer, 1);
     ESP_GOTO_ON_FALSE(xSrHandleTask != NULL, ESP_FAIL, err, TAG, "Failed create audio handler task");
-    // 聊天任务
-    xChatTaskStack = (StackType_t *)heap_caps_malloc(CHAT_TASK_STACK_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    assert(xChatTaskStack);
-    TaskHandle_t xChatTask = xTaskCreateStaticPinnedToCore(&audio_chat_task, "Audio Chat Task", CHAT_TASK_STACK_SIZE, NULL, 3, xChatTaskStack, &xChatTaskBuffer, 1);
-    ESP_GOTO_ON_FALSE(xChatTask != NULL, ESP_FAIL, err, TAG, "Failed create audio chat task");
+    // 聊天 / 听写请求调度, 每种请求一个工作任务
+    ESP_GOTO_ON_ERROR(voice_sched_init(audio_chat_job_handler), err, TAG, "Failed to init voice scheduler");
     // 语音处理任务
     // ret_val = xTaskCreatePinnedToCore(&sr_handler_task, "SR Handler Task", 4 * 1024, NULL, 4, &g_sr_data->handle_task, 0);
     // ESP_GOTO_ON_FALSE(pdPASS == ret_val, ESP_FAIL, err, TAG, "Failed create audio handler task");
@@ -336,16 +375,3 @@ esp_err_t app_sr_set_result(sr_result_t *result, TickType_t xTicksToWait)
     xQueueSend(g_sr_data->result_que, result, xTicksToWait);
     return ESP_OK;
 }
-
-BaseType_t app_sr_get_chat_mode(audio_chat_mode_t *chat_mode, TickType_t xTicksToWait)
-{
-    ESP_RETURN_ON_FALSE(NULL != g_audio_chat_mode_que, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
-    return xQueueReceive(g_audio_chat_mode_que, chat_mode, xTicksToWait);
-}
-
-esp_err_t app_sr_set_chat_mode(audio_chat_mode_t *chat_mode, TickType_t xTicksToWait)
-{
-    ESP_RETURN_ON_FALSE(NULL != g_audio_chat_mode_que, ESP_ERR_INVALID_STATE, TAG, "SR is not running");
-    xQueueSend(g_audio_chat_mode_que, chat_mode, xTicksToWait);
-    return ESP_OK;
-}
@@ -85,8 +85,6 @@ extern "C"
     esp_err_t app_sr_stop(void);
     esp_err_t app_sr_set_result(sr_result_t *result, TickType_t xTicksToWait);
     esp_err_t app_sr_get_result(sr_result_t *result, TickType_t xTicksToWait);
-    BaseType_t app_sr_get_chat_mode(audio_chat_mode_t *chat_mode, TickType_t xTicksToWait);
-    esp_err_t app_sr_set_chat_mode(audio_chat_mode_t *chat_mode, TickType_t xTicksToWait);
 
 #ifdef __cplusplus
 }
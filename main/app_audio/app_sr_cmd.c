@@ -0,0 +1,133 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "esp_mn_speech_commands.h"
+#include "rgb_matrix.h"
+#include "hid_dev.h"
+#include "bsp_keyboard.h"
+#include "app_led.h"
+#include "app_uart.h"
+#include "keyboard.h"
+#include "app_sr_cmd.h"
+
+static const char *TAG = "app_sr_cmd";
+
+typedef struct
+{
+    sr_cmd_id_t id;
+    const char *phoneme; // MultiNet6 中文模型使用空格分隔的拼音
+    const char *desc;
+} sr_cmd_t;
+
+static const sr_cmd_t sr_cmd_table[] = {
+    {SR_CMD_LIGHT_ON,        "da kai deng guang",    "打开灯光"},
+    {SR_CMD_LIGHT_ON,        "kai deng",             "开灯"},
+    {SR_CMD_LIGHT_OFF,       "guan bi deng guang",   "关闭灯光"},
+    {SR_CMD_LIGHT_OFF,       "guan deng",            "关灯"},
+    {SR_CMD_LIGHT_SOLID,     "chang liang mo shi",   "常亮模式"},
+    {SR_CMD_LIGHT_BREATHING, "hu xi mo shi",         "呼吸模式"},
+    {SR_CMD_LIGHT_CYCLE,     "xuan cai mo shi",      "炫彩模式"},
+    {SR_CMD_MUTE_ON,         "jing yin",             "静音"},
+    {SR_CMD_MUTE_OFF,        "qu xiao jing yin",     "取消静音"},
+    {SR_CMD_MODE_USB,        "qie huan dao you xian", "切换到有线"},
+    {SR_CMD_MODE_BLE,        "qie huan dao lan ya",  "切换到蓝牙"},
+    {SR_CMD_MODE_ESPNOW,     "qie huan dao wu xian", "切换到无线"},
+    {SR_CMD_MODE_UDP,        "qie huan dao wang luo", "切换到网络"},
+    {SR_CMD_KEY_ENTER,       "hui che",              "回车"},
+    {SR_CMD_KEY_BACKSPACE,   "tui ge",               "退格"},
+    {SR_CMD_KEY_ESCAPE,      "tui chu",              "退出"},
+};
+
+esp_err_t app_sr_cmd_register(const esp_mn_iface_t *multinet, model_iface_data_t *model_data)
+{
+    esp_mn_commands_alloc((esp_mn_iface_t *)multinet, model_data);
+    esp_mn_commands_clear();
+    for (int i = 0; i < sizeof(sr_cmd_table) / sizeof(sr_cmd_table[0]); i++)
+    {
+        esp_mn_commands_add(sr_cmd_table[i].id, (char *)sr_cmd_table[i].phoneme);
+    }
+
+    esp_mn_error_t *err = esp_mn_commands_update();
+    if (err)
+    {
+        for (int i = 0; i < err->num; i++)
+        {
+            ESP_LOGE(TAG, "invalid command: %d %s", err->phrases[i]->command_id, err->phrases[i]->string);
+        }
+        return ESP_FAIL;
+    }
+    multinet->print_active_speech_commands(model_data);
+    return ESP_OK;
+}
+
+bool app_sr_cmd_is_local(int command_id)
+{
+    return command_id > SR_CMD_NONE && command_id < SR_CMD_MAX;
+}
+
+esp_err_t app_sr_cmd_handle(int command_id)
+{
+    ESP_RETURN_ON_FALSE(app_sr_cmd_is_local(command_id), ESP_ERR_INVALID_ARG, TAG, "unknown command %d", command_id);
+
+    for (int i = 0; i < sizeof(sr_cmd_table) / sizeof(sr_cmd_table[0]); i++)
+    {
+        if (sr_cmd_table[i].id == command_id)
+        {
+            ESP_LOGI(TAG, "command %d: %s", command_id, sr_cmd_table[i].desc);
+            break;
+        }
+    }
+
+    switch (command_id)
+    {
+    case SR_CMD_LIGHT_ON:
+        bspWs2812Enable(true);
+        break;
+    case SR_CMD_LIGHT_OFF:
+        bspWs2812Enable(false);
+        break;
+    case SR_CMD_LIGHT_SOLID:
+    case SR_CMD_LIGHT_BREATHING:
+    case SR_CMD_LIGHT_CYCLE:
+        // 与 app_uart 中的灯效编号一致
+        bspWs2812Enable(true);
+        rgb_matrix_mode(command_id - SR_CMD_LIGHT_SOLID + 1);
+        break;
+    case SR_CMD_MUTE_ON:
+        bsp_audio_mute_enable(true);
+        break;
+    case SR_CMD_MUTE_OFF:
+        bsp_audio_mute_enable(false);
+        break;
+    case SR_CMD_MODE_USB:
+    case SR_CMD_MODE_BLE:
+    case SR_CMD_MODE_ESPNOW:
+    case SR_CMD_MODE_UDP:
+        // 保存后关机, 与串口切换模式的流程一致
+        appUartSetHidMode(0x11 + command_id - SR_CMD_MODE_USB);
+        break;
+    case SR_CMD_KEY_ENTER:
+        keyboard_tap_key(HID_KEY_RETURN);
+        break;
+    case SR_CMD_KEY_BACKSPACE:
+        keyboard_tap_key(HID_KEY_DELETE);
+        break;
+    case SR_CMD_KEY_ESCAPE:
+        keyboard_tap_key(HID_KEY_ESCAPE);
+        break;
+    default:
+        break;
+    }
+    return ESP_OK;
+}
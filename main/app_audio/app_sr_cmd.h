@@ -0,0 +1,56 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_mn_iface.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SR_CMD_MN_TIMEOUT_MS (5760) // MultiNet 单次识别的最长时间
+
+    /// @brief 本地命令词, 0x55 已被录音键占用
+    typedef enum
+    {
+        SR_CMD_NONE = 0,
+        SR_CMD_LIGHT_ON,
+        SR_CMD_LIGHT_OFF,
+        SR_CMD_LIGHT_SOLID,
+        SR_CMD_LIGHT_BREATHING,
+        SR_CMD_LIGHT_CYCLE,
+        SR_CMD_MUTE_ON,
+        SR_CMD_MUTE_OFF,
+        SR_CMD_MODE_USB,
+        SR_CMD_MODE_BLE,
+        SR_CMD_MODE_ESPNOW,
+        SR_CMD_MODE_UDP,
+        SR_CMD_KEY_ENTER,
+        SR_CMD_KEY_BACKSPACE,
+        SR_CMD_KEY_ESCAPE,
+        SR_CMD_MAX,
+    } sr_cmd_id_t;
+
+    /**
+     * @brief 向 MultiNet 注册命令词表.
+     *
+     * 命令词表见 app_sr_cmd.c 中的 sr_cmd_table, 一个命令可以对应多条拼音.
+     */
+    esp_err_t app_sr_cmd_register(const esp_mn_iface_t *multinet, model_iface_data_t *model_data);
+
+    /// @brief 是否为本地命令
+    bool app_sr_cmd_is_local(int command_id);
+
+    /// @brief 执行本地命令, 不需要网络
+    esp_err_t app_sr_cmd_handle(int command_id);
+
+#ifdef __cplusplus
+}
+#endif
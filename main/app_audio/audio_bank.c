@@ -0,0 +1,413 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+#include "audio_player.h"
+#include "mp3dec.h"
+#include "bsp_keyboard.h"
+#include "app_audio.h"
+#include "audio_bank.h"
+#include "audio_resampler.h"
+#include "audio_ref.h"
+
+static const char *TAG = "audio_bank";
+
+#define AUDIO_BANK_VOLUME_LEVEL 90
+#define AUDIO_BANK_WRITE_FRAMES 512
+#define AUDIO_BANK_START_TIMEOUT_MS 300  // 按文件播放时等待 audio_player 开始的时间
+#define AUDIO_BANK_SYNC_TIMEOUT_MS  5000 // 按文件同步播放的最长等待时间
+
+typedef struct
+{
+    uint8_t *image;     // WAV 头 + PCM
+    size_t len;
+    size_t cap;
+    uint32_t rate;
+} audio_bank_item_t;
+
+static const char *const s_prompt_path[AUDIO_PROMPT_MAX] = {
+    [AUDIO_PROMPT_POWER_ON] = "/spiffs/powerOn.mp3",
+    [AUDIO_PROMPT_POWER_OFF] = "/spiffs/powerOff.mp3",
+    [AUDIO_PROMPT_WAKE_EN] = "/spiffs/echo_en_wake.wav",
+    [AUDIO_PROMPT_WAKE_CN] = "/spiffs/echo_cn_wake.wav",
+    [AUDIO_PROMPT_THINKING] = "/spiffs/IamThinking.wav",
+    [AUDIO_PROMPT_SORRY] = "/spiffs/IamSorry.wav",
+    [AUDIO_PROMPT_DONE] = "/spiffs/Done.wav",
+    [AUDIO_PROMPT_BOING] = "/spiffs/Boing.wav",
+};
+
+static audio_bank_item_t s_bank[AUDIO_PROMPT_MAX];
+
+static void *audio_bank_load_file(const char *path, size_t *size)
+{
+    struct stat st;
+    if (stat(path, &st) != 0 || st.st_size <= 0)
+    {
+        return NULL;
+    }
+
+    uint8_t *data = heap_caps_malloc(st.st_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (NULL == data)
+    {
+        return NULL;
+    }
+
+    FILE *fp = fopen(path, "rb");
+    if (NULL == fp)
+    {
+        free(data);
+        return NULL;
+    }
+    *size = fread(data, 1, st.st_size, fp);
+    fclose(fp);
+    return data;
+}
+
+/// @brief 追加 PCM, 单声道复制为双声道
+static esp_err_t audio_bank_append(audio_bank_item_t *item, const int16_t *pcm, size_t frames, int channels)
+{
+    size_t need = item->len + frames * 2 * sizeof(int16_t);
+    if (need > item->cap)
+    {
+        size_t cap = item->cap ? item->cap : 32 * 1024;
+        while (cap < need)
+        {
+            cap *= 2;
+        }
+        uint8_t *image = heap_caps_realloc(item->image, cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        ESP_RETURN_ON_FALSE(NULL != image, ESP_ERR_NO_MEM, TAG, "no mem for prompt");
+        item->image = image;
+        item->cap = cap;
+    }
+
+    int16_t *out = (int16_t *)(item->image + item->len);
+    if (channels == 1)
+    {
+        for (size_t i = 0; i < frames; i++)
+        {
+            out[i * 2 + 0] = pcm[i];
+            out[i * 2 + 1] = pcm[i];
+        }
+    }
+    else if (frames > 0)
+    {
+        memcpy(out, pcm, frames * 2 * sizeof(int16_t));
+    }
+    item->len = need;
+    return ESP_OK;
+}
+
+static esp_err_t audio_bank_decode_wav(audio_bank_item_t *item, const uint8_t *data, size_t size)
+{
+    // 没有 WAV 头时与原来的 audio_play_task 一致, 当作总线采样率的 16bit 双声道 PCM
+    if (size <= 12 || memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4))
+    {
+        ESP_LOGW(TAG, "no wav header, play as raw PCM %dHz/16bit/2ch", AUDIO_PLAY_SAMPLE_RATE);
+        item->rate = AUDIO_PLAY_SAMPLE_RATE;
+        return audio_bank_append(item, (const int16_t *)data, size / (2 * sizeof(int16_t)), 2);
+    }
+
+    int channels = 0;
+    int bits = 0;
+    size_t pos = 12;
+    while (pos + 8 <= size)
+    {
+        const uint8_t *chunk = data + pos;
+        uint32_t chunk_size = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | ((uint32_t)chunk[7] << 24);
+        const uint8_t *body = chunk + 8;
+        size_t avail = size - pos - 8;
+        if (chunk_size > avail)
+        {
+            chunk_size = avail;
+        }
+
+        if (!memcmp(chunk, "fmt ", 4) && chunk_size >= 16)
+        {
+            uint16_t format = body[0] | (body[1] << 8);
+            channels = body[2] | (body[3] << 8);
+            item->rate = body[4] | (body[5] << 8) | (body[6] << 16) | ((uint32_t)body[7] << 24);
+            bits = body[14] | (body[15] << 8);
+            ESP_RETURN_ON_FALSE(format == 1 && bits == 16 && (channels == 1 || channels == 2),
+                                ESP_ERR_NOT_SUPPORTED, TAG, "unsupported wav format %d/%d/%d", format, bits, channels);
+        }
+        else if (!memcmp(chunk, "data", 4))
+        {
+            ESP_RETURN_ON_FALSE(channels != 0, ESP_ERR_INVALID_ARG, TAG, "wav data before fmt");
+            size_t frames = chunk_size / (channels * sizeof(int16_t));
+            return audio_bank_append(item, (const int16_t *)body, frames, channels);
+        }
+        pos += 8 + chunk_size + (chunk_size & 1);
+    }
+    return ESP_ERR_INVALID_SIZE;
+}
+
+static esp_err_t audio_bank_decode_mp3(audio_bank_item_t *item, uint8_t *data, size_t size)
+{
+    esp_err_t ret = ESP_OK;
+    int16_t *frame = NULL;
+
+    // 跳过 ID3v2 标签
+    if (size > 10 && !memcmp(data, "ID3", 3))
+    {
+        size_t tag = ((data[6] & 0x7f) << 21) | ((data[7] & 0x7f) << 14) | ((data[8] & 0x7f) << 7) | (data[9] & 0x7f);
+        tag += 10;
+        if (tag < size)
+        {
+            data += tag;
+            size -= tag;
+        }
+    }
+
+    HMP3Decoder decoder = MP3InitDecoder();
+    ESP_RETURN_ON_FALSE(NULL != decoder, ESP_ERR_NO_MEM, TAG, "mp3 decoder init failed");
+    frame = malloc(MAX_NCHAN * MAX_NGRAN * MAX_NSAMP * sizeof(int16_t));
+    ESP_GOTO_ON_FALSE(NULL != frame, ESP_ERR_NO_MEM, _exit, TAG, "no mem for mp3 frame");
+
+    unsigned char *ptr = data;
+    int left = size;
+    while (left > 0)
+    {
+        int offset = MP3FindSyncWord(ptr, left);
+        if (offset < 0)
+        {
+            break;
+        }
+        ptr += offset;
+        left -= offset;
+
+        int err = MP3Decode(decoder, &ptr, &left, frame, 0);
+        if (err == ERR_MP3_INDATA_UNDERFLOW)
+        {
+            break;
+        }
+        if (err == ERR_MP3_MAINDATA_UNDERFLOW)
+        {
+            continue; // 位储备不足, 帧已消耗, 没有输出
+        }
+        if (err != ERR_MP3_NONE)
+        {
+            // 错误帧, 跳过同步字继续查找
+            ptr++;
+            left--;
+            continue;
+        }
+
+        MP3FrameInfo info;
+        MP3GetLastFrameInfo(decoder, &info);
+        ESP_GOTO_ON_FALSE(info.bitsPerSample == 16, ESP_ERR_NOT_SUPPORTED, _exit, TAG, "unsupported mp3 bits");
+        item->rate = info.samprate;
+        ESP_GOTO_ON_ERROR(audio_bank_append(item, frame, info.outputSamps / info.nChans, info.nChans), _exit, TAG, "append failed");
+    }
+    ESP_GOTO_ON_FALSE(item->len > sizeof(wav_header_t), ESP_ERR_INVALID_SIZE, _exit, TAG, "no mp3 frame decoded");
+
+_exit:
+    free(frame);
+    MP3FreeDecoder(decoder);
+    return ret;
+}
+
+/// @brief 转换到总线采样率, 播放时不需要重新配置 I2S
+static esp_err_t audio_bank_resample(audio_bank_item_t *item)
+{
+    audio_resampler_t *rs = NULL;
+    ESP_RETURN_ON_ERROR(audio_resampler_create(item->rate, AUDIO_PLAY_SAMPLE_RATE, 2, &rs), TAG, "create resampler failed");
+
+    size_t in_frames = (item->len - sizeof(wav_header_t)) / (2 * sizeof(int16_t));
+    size_t out_frames = audio_resampler_max_output(rs, in_frames);
+    size_t cap = sizeof(wav_header_t) + out_frames * 2 * sizeof(int16_t);
+    uint8_t *image = heap_caps_malloc(cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (NULL == image)
+    {
+        audio_resampler_delete(rs);
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t consumed = in_frames;
+    size_t produced = audio_resampler_process(rs, (const int16_t *)(item->image + sizeof(wav_header_t)), &consumed,
+                                              (int16_t *)(image + sizeof(wav_header_t)), out_frames);
+    audio_resampler_delete(rs);
+
+    free(item->image);
+    item->image = image;
+    item->cap = cap;
+    item->len = sizeof(wav_header_t) + produced * 2 * sizeof(int16_t);
+    item->rate = AUDIO_PLAY_SAMPLE_RATE;
+    return ESP_OK;
+}
+
+static esp_err_t audio_bank_load(audio_prompt_t id)
+{
+    esp_err_t ret = ESP_OK;
+    audio_bank_item_t *item = &s_bank[id];
+    const char *path = s_prompt_path[id];
+    size_t size = 0;
+
+    uint8_t *data = audio_bank_load_file(path, &size);
+    ESP_RETURN_ON_FALSE(NULL != data, ESP_ERR_NOT_FOUND, TAG, "load %s failed", path);
+
+    // 预留 WAV 头
+    item->len = sizeof(wav_header_t);
+    item->cap = 0;
+    item->image = NULL;
+    ESP_GOTO_ON_ERROR(audio_bank_append(item, NULL, 0, 2), _exit, TAG, "no mem");
+
+    if (strstr(path, ".mp3"))
+    {
+        ret = audio_bank_decode_mp3(item, data, size);
+    }
+    else
+    {
+        ret = audio_bank_decode_wav(item, data, size);
+    }
+    ESP_GOTO_ON_ERROR(ret, _exit, TAG, "decode %s failed", path);
+    if (item->rate != AUDIO_PLAY_SAMPLE_RATE)
+    {
+        ESP_GOTO_ON_ERROR(audio_bank_resample(item), _exit, TAG, "resample %s failed", path);
+    }
+
+    audio_wav_header_fill((wav_header_t *)item->image, item->rate, 2, item->len - sizeof(wav_header_t));
+    // 收缩到实际大小
+    uint8_t *image = heap_caps_realloc(item->image, item->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (image)
+    {
+        item->image = image;
+        item->cap = item->len;
+    }
+
+_exit:
+    free(data);
+    if (ret != ESP_OK)
+    {
+        free(item->image);
+        memset(item, 0, sizeof(audio_bank_item_t));
+    }
+    return ret;
+}
+
+esp_err_t audio_bank_init(void)
+{
+    int64_t start = esp_timer_get_time();
+    size_t total = 0;
+    for (int i = 0; i < AUDIO_PROMPT_MAX; i++)
+    {
+        if (audio_bank_load(i) == ESP_OK)
+        {
+            total += s_bank[i].len;
+            ESP_LOGI(TAG, "%s: %" PRIu32 "Hz, %zu bytes", s_prompt_path[i], s_bank[i].rate, s_bank[i].len);
+        }
+    }
+    ESP_LOGI(TAG, "sound bank loaded, %zu bytes in PSRAM, %lld ms", total, (esp_timer_get_time() - start) / 1000);
+    return ESP_OK;
+}
+
+esp_err_t audio_bank_play(audio_prompt_t id)
+{
+    ESP_RETURN_ON_FALSE(id < AUDIO_PROMPT_MAX, ESP_ERR_INVALID_ARG, TAG, "invalid prompt");
+
+    audio_bank_item_t *item = &s_bank[id];
+    if (NULL == item->image)
+    {
+        audio_play_filepath(s_prompt_path[id]);
+        return ESP_OK;
+    }
+
+    if (bsp_audio_mute_is_enable())
+    {
+        return ESP_OK;
+    }
+
+    if (audio_player_get_state() != AUDIO_PLAYER_STATE_IDLE)
+    {
+        audio_player_stop();
+    }
+
+    FILE *fp = fmemopen(item->image, item->len, "rb");
+    ESP_RETURN_ON_FALSE(NULL != fp, ESP_FAIL, TAG, "fmemopen failed");
+    return audio_player_play(fp);
+}
+
+/// @brief 没有载入的提示音交给 audio_player 按文件播放, 等待播放结束
+static esp_err_t audio_bank_play_file_sync(const char *path)
+{
+    struct stat st;
+    ESP_RETURN_ON_FALSE(stat(path, &st) == 0, ESP_ERR_NOT_FOUND, TAG, "%s not found", path);
+    if (bsp_audio_mute_is_enable())
+    {
+        return ESP_OK;
+    }
+
+    audio_play_filepath(path);
+    int64_t start = esp_timer_get_time();
+    bool started = false;
+    while (1)
+    {
+        bool idle = audio_player_get_state() == AUDIO_PLAYER_STATE_IDLE;
+        if (started && idle)
+        {
+            return ESP_OK;
+        }
+        started |= !idle;
+
+        int64_t elapsed_ms = (esp_timer_get_time() - start) / 1000;
+        ESP_RETURN_ON_FALSE(started || elapsed_ms < AUDIO_BANK_START_TIMEOUT_MS, ESP_FAIL, TAG, "%s did not start", path);
+        ESP_RETURN_ON_FALSE(elapsed_ms < AUDIO_BANK_SYNC_TIMEOUT_MS, ESP_ERR_TIMEOUT, TAG, "%s is still playing", path);
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+esp_err_t audio_bank_play_sync(audio_prompt_t id)
+{
+    ESP_RETURN_ON_FALSE(id < AUDIO_PROMPT_MAX, ESP_ERR_INVALID_ARG, TAG, "invalid prompt");
+
+    audio_bank_item_t *item = &s_bank[id];
+    if (NULL == item->image)
+    {
+        return audio_bank_play_file_sync(s_prompt_path[id]);
+    }
+
+    bsp_codec_set_fs(AUDIO_PLAY_SAMPLE_RATE, 16, I2S_SLOT_MODE_STEREO);
+    bsp_codec_mute_set(false);
+    bsp_codec_volume_set(AUDIO_BANK_VOLUME_LEVEL, NULL);
+
+    // 分块写入, 让 AEC 参考信号与实际播放保持同步
+    esp_err_t ret = ESP_OK;
+    const size_t chunk = AUDIO_BANK_WRITE_FRAMES * 2 * sizeof(int16_t);
+    uint8_t *pcm = item->image + sizeof(wav_header_t);
+    size_t left = item->len - sizeof(wav_header_t);
+    while (left > 0 && ret == ESP_OK)
+    {
+        size_t cnt = 0;
+        size_t n = left < chunk ? left : chunk;
+        ret = audio_ref_i2s_write(pcm, n, &cnt, portMAX_DELAY);
+        pcm += n;
+        left -= n;
+    }
+    return ret;
+}
+
+esp_err_t audio_bank_get_pcm(audio_prompt_t id, const int16_t **pcm, size_t *frames, uint32_t *rate)
+{
+    ESP_RETURN_ON_FALSE(id < AUDIO_PROMPT_MAX, ESP_ERR_INVALID_ARG, TAG, "invalid prompt");
+
+    audio_bank_item_t *item = &s_bank[id];
+    ESP_RETURN_ON_FALSE(NULL != item->image, ESP_ERR_NOT_FOUND, TAG, "%s is not loaded", s_prompt_path[id]);
+
+    *pcm = (const int16_t *)(item->image + sizeof(wav_header_t));
+    *frames = (item->len - sizeof(wav_header_t)) / (2 * sizeof(int16_t));
+    *rate = item->rate;
+    return ESP_OK;
+}
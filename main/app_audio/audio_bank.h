@@ -0,0 +1,57 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef enum
+    {
+        AUDIO_PROMPT_POWER_ON = 0, // 开机
+        AUDIO_PROMPT_POWER_OFF,    // 关机
+        AUDIO_PROMPT_WAKE_EN,      // 叮...
+        AUDIO_PROMPT_WAKE_CN,      // 我在
+        AUDIO_PROMPT_THINKING,     // 录音结束, 等待云端
+        AUDIO_PROMPT_SORRY,        // 请求失败
+        AUDIO_PROMPT_DONE,         // 语音输入完成
+        AUDIO_PROMPT_BOING,        // 正忙
+        AUDIO_PROMPT_MAX,
+    } audio_prompt_t;
+
+    /**
+     * @brief 开机时把提示音一次性解码为 PCM 并常驻 PSRAM.
+     *
+     * 每条提示音转换为总线采样率, 保存为 "WAV 头 + 16bit 双声道 PCM" 的完整镜像, 播放时不再访问 SPIFFS,
+     * 也不再分配数据缓冲. 没有 WAV 头的文件当作总线采样率的 16bit 双声道 PCM.
+     * 文件缺失或解码失败的提示音在播放时退回到按文件播放.
+     */
+    esp_err_t audio_bank_init(void);
+
+    /// @brief 通过 audio_player 异步播放提示音, 静音时不播放
+    esp_err_t audio_bank_play(audio_prompt_t id);
+
+    /// @brief 在调用者任务中直接写 I2S 播放提示音, 返回时已播放完毕; 没有载入的提示音按文件播放并等待结束
+    esp_err_t audio_bank_play_sync(audio_prompt_t id);
+
+    /**
+     * @brief 获取提示音的 PCM 数据
+     *
+     * @param pcm      16bit 双声道交织采样
+     * @param frames   帧数(每帧左右两个采样)
+     * @param rate     采样率
+     */
+    esp_err_t audio_bank_get_pcm(audio_prompt_t id, const int16_t **pcm, size_t *frames, uint32_t *rate);
+
+#ifdef __cplusplus
+}
+#endif
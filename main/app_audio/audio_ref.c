@@ -0,0 +1,124 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+#include "bsp_keyboard.h"
+#include "audio_ref.h"
+
+static const char *TAG = "audio_ref";
+
+typedef struct
+{
+    int16_t *buf;
+    uint32_t head;     // 写入的总帧数
+    uint32_t tail;     // 读出的总帧数
+    uint32_t preroll;  // 还需插入的对齐帧
+    bool active;       // 播放段进行中
+    int64_t read_us;   // 上一次读取的时间
+    uint32_t read_frames; // 上一次读取的帧数
+    portMUX_TYPE lock;
+    audio_ref_stats_t stats;
+} audio_ref_t;
+
+static audio_ref_t s_ref = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+esp_err_t audio_ref_init(void)
+{
+    if (s_ref.buf)
+    {
+        return ESP_OK;
+    }
+    s_ref.buf = heap_caps_calloc(AUDIO_REF_RING_FRAMES, sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(NULL != s_ref.buf, ESP_ERR_NO_MEM, TAG, "Failed create reference ring");
+    return ESP_OK;
+}
+
+void audio_ref_push(const int16_t *stereo, size_t frames)
+{
+    if (NULL == s_ref.buf)
+    {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_ref.lock);
+    if (!s_ref.active)
+    {
+        // 补上从上一次读取到现在的帧数; feed 任务停住时不再对齐, 最多补两块
+        int64_t elapsed = s_ref.read_us ? (now - s_ref.read_us) * AUDIO_REF_SAMPLE_RATE / 1000000 : 0;
+        elapsed = elapsed < 2 * s_ref.read_frames ? elapsed : 2 * s_ref.read_frames;
+        s_ref.active = true;
+        s_ref.preroll = (elapsed > 0 ? elapsed : 0) + AUDIO_REF_DELAY_FRAMES;
+        s_ref.stats.bursts++;
+    }
+    for (size_t i = 0; i < frames; i++)
+    {
+        if (s_ref.head - s_ref.tail == AUDIO_REF_RING_FRAMES)
+        {
+            s_ref.tail++;
+            s_ref.stats.overruns++;
+        }
+        s_ref.buf[s_ref.head % AUDIO_REF_RING_FRAMES] = ((int32_t)stereo[i * 2] + stereo[i * 2 + 1]) >> 1;
+        s_ref.head++;
+    }
+    portEXIT_CRITICAL(&s_ref.lock);
+}
+
+void audio_ref_read(int16_t *ref, size_t frames)
+{
+    size_t n = 0;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_ref.lock);
+    s_ref.read_us = now;
+    s_ref.read_frames = frames;
+    while (n < frames && s_ref.preroll > 0)
+    {
+        ref[n++] = 0;
+        s_ref.preroll--;
+    }
+    while (n < frames && s_ref.tail != s_ref.head)
+    {
+        ref[n++] = s_ref.buf[s_ref.tail % AUDIO_REF_RING_FRAMES];
+        s_ref.tail++;
+    }
+    if (n < frames && s_ref.active)
+    {
+        // 播放结束或写端跟不上(此时 DMA 也在输出静音), 下一段重新对齐
+        s_ref.active = false;
+        s_ref.stats.underruns++;
+    }
+    portEXIT_CRITICAL(&s_ref.lock);
+
+    if (n < frames)
+    {
+        memset(ref + n, 0, (frames - n) * sizeof(int16_t));
+    }
+}
+
+esp_err_t audio_ref_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms)
+{
+    audio_ref_push((const int16_t *)audio_buffer, len / (2 * sizeof(int16_t)));
+    return bsp_i2s_write(audio_buffer, len, bytes_written, timeout_ms);
+}
+
+void audio_ref_get_stats(audio_ref_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_ref.lock);
+    *stats = s_ref.stats;
+    stats->level = s_ref.head - s_ref.tail;
+    portEXIT_CRITICAL(&s_ref.lock);
+}
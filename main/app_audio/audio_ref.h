@@ -0,0 +1,54 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define AUDIO_REF_SAMPLE_RATE  (16000)    // 与 AUDIO_PLAY_SAMPLE_RATE 相同
+#define AUDIO_REF_RING_FRAMES  (8 * 1024) // 参考信号环形缓冲, 16K 下约 512ms
+#define AUDIO_REF_DELAY_FRAMES (16)       // DAC/ADC 群延时中确定的部分, 参考信号推后这么多帧; 超过实际延时会使参考信号晚于回声
+
+    typedef struct
+    {
+        uint32_t bursts;    // 播放段数(每次从空到有数据算一段)
+        uint32_t underruns; // 参考信号耗尽(播放结束或写端跟不上)
+        uint32_t overruns;  // 读端跟不上, 丢弃最旧的数据
+        uint32_t level;     // 当前缓冲的帧数
+    } audio_ref_stats_t;
+
+    /**
+     * @brief AEC 参考信号.
+     *
+     * 播放路径在写 I2S 之前把同一段数据(下混为单声道)压入环形缓冲, audio_feed_task 每读一块麦克风数据
+     * 就取出同样帧数作为第 3 通道. 播放与录音共用同一组 I2S 时钟, 两端速率完全一致, 只需在每段播放开始时
+     * 对齐一次: 此时 TX DMA 为空, 第一帧不早于写入时刻播出, 它的回声只会落在上一次读取之后的麦克风数据中.
+     * 参考信号的第一帧放在下一块数据中距块首 (写入时刻 - 上一次读取时刻) 处, 再推后 AUDIO_REF_DELAY_FRAMES,
+     * 参考信号总是不晚于回声, 提前量只取决于 DMA 描述符和读取延迟, 与写入落在 feed 块中的位置无关.
+     */
+    esp_err_t audio_ref_init(void);
+
+    /// @brief 压入 16bit 双声道播放数据
+    void audio_ref_push(const int16_t *stereo, size_t frames);
+
+    /// @brief 取出与麦克风数据对齐的参考信号, 没有播放时填 0
+    void audio_ref_read(int16_t *ref, size_t frames);
+
+    /// @brief 先压入参考信号再写 I2S, 所有 16K 播放都应通过这里输出
+    esp_err_t audio_ref_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms);
+
+    void audio_ref_get_stats(audio_ref_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,286 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_cpu.h"
+
+#include "audio_resampler.h"
+
+static const char *TAG = "audio_resampler";
+
+#define RESAMPLER_KAISER_BETA (8.0)
+#define RESAMPLER_PASSBAND    (0.45) // 截止频率 = 0.45 * min(in_rate, out_rate)
+
+struct audio_resampler_s
+{
+    uint32_t in_rate;
+    uint32_t out_rate;
+    int in_channels;
+    uint32_t L;        // 插值倍数
+    uint32_t M;        // 抽取倍数
+    uint32_t phase;    // 当前相位, 0..L-1 表示还要输出, >= L 表示需要新输入
+    uint32_t pos;      // 延迟线写位置
+    int16_t *coef;     // [L][TAPS], 已按延迟线顺序排列
+    int16_t delay[2][AUDIO_RESAMPLER_TAPS * 2]; // 双写延迟线, 保证窗口连续
+};
+
+static uint32_t gcd_u32(uint32_t a, uint32_t b)
+{
+    while (b)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1e-12 * sum)
+        {
+            break;
+        }
+    }
+    return sum;
+}
+
+static void resampler_design(audio_resampler_t *rs)
+{
+    const uint32_t L = rs->L;
+    const int N = L * AUDIO_RESAMPLER_TAPS;
+    const double center = (N - 1) / 2.0;
+    const double min_rate = rs->in_rate < rs->out_rate ? rs->in_rate : rs->out_rate;
+    // 原型滤波器工作在 L * in_rate 上
+    const double fc = RESAMPLER_PASSBAND * min_rate / ((double)L * rs->in_rate);
+    const double i0_beta = bessel_i0(RESAMPLER_KAISER_BETA);
+
+    for (int n = 0; n < N; n++)
+    {
+        double t = n - center;
+        double x = 2.0 * fc * t;
+        double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+        double r = t / (center + 0.5);
+        double w = bessel_i0(RESAMPLER_KAISER_BETA * sqrt(fmax(0.0, 1.0 - r * r))) / i0_beta;
+        double h = 2.0 * fc * sinc * w * L; // 乘 L 补偿插零带来的增益损失
+
+        int32_t q = (int32_t)lrint(h * 32768.0);
+        q = q > INT16_MAX ? INT16_MAX : (q < INT16_MIN ? INT16_MIN : q);
+
+        // h[p + k*L] 作用于 x[n-k], 延迟线窗口中最新的采样在末尾
+        uint32_t p = n % L;
+        uint32_t k = n / L;
+        rs->coef[p * AUDIO_RESAMPLER_TAPS + (AUDIO_RESAMPLER_TAPS - 1 - k)] = q;
+    }
+}
+
+esp_err_t audio_resampler_create(uint32_t in_rate, uint32_t out_rate, int in_channels, audio_resampler_t **ret_rs)
+{
+    ESP_RETURN_ON_FALSE(ret_rs && in_rate && out_rate && (in_channels == 1 || in_channels == 2),
+                        ESP_ERR_INVALID_ARG, TAG, "invalid args");
+
+    uint32_t g = gcd_u32(in_rate, out_rate);
+    uint32_t L = out_rate / g;
+    uint32_t M = in_rate / g;
+    ESP_RETURN_ON_FALSE(L <= AUDIO_RESAMPLER_MAX_PHASES, ESP_ERR_NOT_SUPPORTED, TAG,
+                        "%" PRIu32 " -> %" PRIu32 " needs %" PRIu32 " phases", in_rate, out_rate, L);
+
+    audio_resampler_t *rs = heap_caps_calloc(1, sizeof(audio_resampler_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(NULL != rs, ESP_ERR_NO_MEM, TAG, "no mem for resampler");
+
+    // 相位少时系数放在内部 RAM, 否则放 PSRAM
+    size_t coef_size = L * AUDIO_RESAMPLER_TAPS * sizeof(int16_t);
+    rs->coef = heap_caps_malloc(coef_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (NULL == rs->coef || coef_size > 8 * 1024)
+    {
+        free(rs->coef);
+        rs->coef = heap_caps_malloc(coef_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (NULL == rs->coef)
+    {
+        free(rs);
+        ESP_LOGE(TAG, "no mem for coefficients");
+        return ESP_ERR_NO_MEM;
+    }
+
+    rs->in_rate = in_rate;
+    rs->out_rate = out_rate;
+    rs->in_channels = in_channels;
+    rs->L = L;
+    rs->M = M;
+    resampler_design(rs);
+    audio_resampler_reset(rs);
+
+    ESP_LOGI(TAG, "%" PRIu32 " -> %" PRIu32 " Hz, ch %d, L=%" PRIu32 " M=%" PRIu32,
+             in_rate, out_rate, in_channels, L, M);
+    *ret_rs = rs;
+    return ESP_OK;
+}
+
+void audio_resampler_delete(audio_resampler_t *rs)
+{
+    if (rs)
+    {
+        free(rs->coef);
+        free(rs);
+    }
+}
+
+void audio_resampler_reset(audio_resampler_t *rs)
+{
+    memset(rs->delay, 0, sizeof(rs->delay));
+    rs->pos = 0;
+    rs->phase = 0;
+}
+
+size_t audio_resampler_max_output(audio_resampler_t *rs, size_t in_frames)
+{
+    return ((uint64_t)in_frames * rs->L + rs->M - 1) / rs->M + 1;
+}
+
+static inline int16_t resampler_dot(const int16_t *coef, const int16_t *x)
+{
+    // 4 路展开, 让编译器生成连续的 MULA 指令
+    int32_t acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+    for (int i = 0; i < AUDIO_RESAMPLER_TAPS; i += 4)
+    {
+        acc0 += coef[i + 0] * x[i + 0];
+        acc1 += coef[i + 1] * x[i + 1];
+        acc2 += coef[i + 2] * x[i + 2];
+        acc3 += coef[i + 3] * x[i + 3];
+    }
+    int32_t acc = (acc0 + acc1 + acc2 + acc3 + (1 << 14)) >> 15;
+    return acc > INT16_MAX ? INT16_MAX : (acc < INT16_MIN ? INT16_MIN : acc);
+}
+
+size_t audio_resampler_process(audio_resampler_t *rs, const int16_t *in, size_t *in_frames, int16_t *out, size_t out_frames)
+{
+    const uint32_t L = rs->L;
+    const uint32_t M = rs->M;
+    const size_t max_burst = (L + M - 1) / M; // 每个输入帧最多产生的输出帧
+    size_t consumed = 0;
+    size_t produced = 0;
+
+    while (consumed < *in_frames && produced + max_burst <= out_frames)
+    {
+        int16_t l = in[consumed * rs->in_channels];
+        int16_t r = (rs->in_channels == 2) ? in[consumed * 2 + 1] : l;
+        consumed++;
+
+        uint32_t pos = rs->pos;
+        rs->delay[0][pos] = rs->delay[0][pos + AUDIO_RESAMPLER_TAPS] = l;
+        rs->delay[1][pos] = rs->delay[1][pos + AUDIO_RESAMPLER_TAPS] = r;
+        pos = (pos + 1 == AUDIO_RESAMPLER_TAPS) ? 0 : pos + 1;
+        rs->pos = pos;
+
+        const int16_t *xl = &rs->delay[0][pos];
+        const int16_t *xr = &rs->delay[1][pos];
+        while (rs->phase < L)
+        {
+            const int16_t *coef = &rs->coef[rs->phase * AUDIO_RESAMPLER_TAPS];
+            out[produced * 2 + 0] = resampler_dot(coef, xl);
+            out[produced * 2 + 1] = (rs->in_channels == 2) ? resampler_dot(coef, xr) : out[produced * 2 + 0];
+            produced++;
+            rs->phase += M;
+        }
+        rs->phase -= L;
+    }
+
+    *in_frames = consumed;
+    return produced;
+}
+
+#if AUDIO_RESAMPLER_BENCHMARK
+
+static double goertzel_power(const int16_t *pcm, size_t frames, uint32_t rate, double freq)
+{
+    double w = 2.0 * M_PI * freq / rate;
+    double coeff = 2.0 * cos(w);
+    double s1 = 0, s2 = 0;
+    for (size_t i = 0; i < frames; i++)
+    {
+        double s = pcm[i * 2] + coeff * s1 - s2;
+        s2 = s1;
+        s1 = s;
+    }
+    return s1 * s1 + s2 * s2 - coeff * s1 * s2;
+}
+
+static void audio_resampler_bench_one(uint32_t in_rate, uint32_t out_rate, int channels)
+{
+    const size_t in_frames = in_rate / 2; // 0.5s
+    const double tone = 1000.0;
+    audio_resampler_t *rs = NULL;
+    int16_t *in = heap_caps_malloc(in_frames * channels * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    int16_t *out = NULL;
+
+    if (NULL == in || audio_resampler_create(in_rate, out_rate, channels, &rs) != ESP_OK)
+    {
+        goto _exit;
+    }
+    size_t out_cap = audio_resampler_max_output(rs, in_frames);
+    out = heap_caps_malloc(out_cap * 2 * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (NULL == out)
+    {
+        goto _exit;
+    }
+
+    for (size_t i = 0; i < in_frames; i++)
+    {
+        int16_t v = (int16_t)lrint(16384.0 * sin(2.0 * M_PI * tone * i / in_rate));
+        for (int c = 0; c < channels; c++)
+        {
+            in[i * channels + c] = v;
+        }
+    }
+
+    size_t n = in_frames;
+    uint32_t start = esp_cpu_get_cycle_count();
+    size_t produced = audio_resampler_process(rs, in, &n, out, out_cap);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    // 跳过滤波器建立时间, 取整数个周期做 Goertzel
+    size_t skip = AUDIO_RESAMPLER_TAPS * 2;
+    size_t len = (size_t)((produced - skip) / (out_rate / tone)) * (out_rate / tone);
+    double fund = goertzel_power(out + skip * 2, len, out_rate, tone);
+    double harm = 0;
+    for (int h = 2; h * tone < out_rate / 2; h++)
+    {
+        harm += goertzel_power(out + skip * 2, len, out_rate, h * tone);
+    }
+
+    ESP_LOGI(TAG, "bench %" PRIu32 "->%" PRIu32 " ch%d: %.1f cycles/out sample, THD %.4f%% (%.1f dB)",
+             in_rate, out_rate, channels, (double)cycles / produced, 100.0 * sqrt(harm / fund),
+             10.0 * log10(harm / fund));
+
+_exit:
+    audio_resampler_delete(rs);
+    free(in);
+    free(out);
+}
+
+void audio_resampler_benchmark(void)
+{
+    audio_resampler_bench_one(44100, 16000, 2);
+    audio_resampler_bench_one(48000, 16000, 2);
+    audio_resampler_bench_one(22050, 16000, 1);
+    audio_resampler_bench_one(24000, 16000, 1);
+    audio_resampler_bench_one(8000, 16000, 1);
+}
+
+#endif
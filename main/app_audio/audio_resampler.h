@@ -0,0 +1,58 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define AUDIO_RESAMPLER_TAPS       (32)   // 每个相位的抽头数
+#define AUDIO_RESAMPLER_MAX_PHASES (640)  // 11025 -> 16000 需要 640 个相位
+#define AUDIO_RESAMPLER_BENCHMARK  (0)    // 开机时打印性能与 THD 测试结果
+
+    typedef struct audio_resampler_s audio_resampler_t;
+
+    /**
+     * @brief 创建定点多相重采样器.
+     *
+     * 输入为 16bit 单声道或双声道交织 PCM, 输出固定为 16bit 双声道交织 PCM.
+     * 系数为 Q15 的 Kaiser 窗 sinc 原型滤波器, 按 out/in 的最简分数拆成多相.
+     */
+    esp_err_t audio_resampler_create(uint32_t in_rate, uint32_t out_rate, int in_channels, audio_resampler_t **ret_rs);
+
+    void audio_resampler_delete(audio_resampler_t *rs);
+
+    /// @brief 清空历史数据, 开始新的音频流
+    void audio_resampler_reset(audio_resampler_t *rs);
+
+    /**
+     * @brief 重采样一段数据
+     *
+     * @param in         输入 PCM
+     * @param in_frames  输入帧数, 返回实际消耗的帧数(输出缓冲不足时会少于输入)
+     * @param out        输出 PCM, 双声道
+     * @param out_frames 输出缓冲可容纳的帧数
+     * @return 输出的帧数
+     */
+    size_t audio_resampler_process(audio_resampler_t *rs, const int16_t *in, size_t *in_frames, int16_t *out, size_t out_frames);
+
+    /// @brief 给定输入帧数时最多输出的帧数
+    size_t audio_resampler_max_output(audio_resampler_t *rs, size_t in_frames);
+
+#if AUDIO_RESAMPLER_BENCHMARK
+    /// @brief 测量常见采样率转换的每输出采样周期数与 1kHz 正弦的 THD
+    void audio_resampler_benchmark(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
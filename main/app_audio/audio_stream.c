@@ -0,0 +1,263 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#define _GNU_SOURCE // fopencookie
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/stream_buffer.h"
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "audio_player.h"
+#include "audio_stream.h"
+
+static const char *TAG = "audio_stream";
+
+typedef struct
+{
+    StreamBufferHandle_t sb;
+    StaticStreamBuffer_t sb_struct;
+    uint8_t *sb_storage;
+    uint8_t *replay;          // 已读出的文件头副本
+    size_t replay_len;
+    size_t read_pos;          // 读端的逻辑位置
+    size_t buffered;          // 本次会话写入的总字节数
+    volatile bool writing;    // 写端会话进行中
+    volatile bool eof;        // 写端已结束
+    volatile bool aborted;    // 会话被中止
+    volatile bool reader_open;// audio_player 持有 FILE
+    bool playing;             // 已交给 audio_player
+} audio_stream_t;
+
+static audio_stream_t *s_stream = NULL;
+
+static ssize_t audio_stream_cookie_read(void *cookie, char *buf, size_t size)
+{
+    audio_stream_t *s = (audio_stream_t *)cookie;
+
+    // 播放器探测格式后会 fseek 回到开头, 先回放保留的文件头
+    if (s->read_pos < s->replay_len)
+    {
+        size_t n = MIN(size, s->replay_len - s->read_pos);
+        memcpy(buf, s->replay + s->read_pos, n);
+        s->read_pos += n;
+        return n;
+    }
+
+    // 文件头内的读取不越过 AUDIO_STREAM_REPLAY_SIZE, stdio 缓冲再大, 探测之后也能回到开头
+    if (s->read_pos < AUDIO_STREAM_REPLAY_SIZE)
+    {
+        size = MIN(size, AUDIO_STREAM_REPLAY_SIZE - s->read_pos);
+    }
+
+    while (!s->aborted)
+    {
+        size_t got = xStreamBufferReceive(s->sb, buf, size, pdMS_TO_TICKS(100));
+        if (got > 0)
+        {
+            if (s->read_pos < AUDIO_STREAM_REPLAY_SIZE)
+            {
+                memcpy(s->replay + s->read_pos, buf, got);
+                s->replay_len += got;
+            }
+            s->read_pos += got;
+            return got;
+        }
+        if (s->eof && xStreamBufferIsEmpty(s->sb))
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+static int audio_stream_cookie_seek(void *cookie, off_t *offset, int whence)
+{
+    audio_stream_t *s = (audio_stream_t *)cookie;
+    off_t target;
+
+    switch (whence)
+    {
+    case SEEK_SET:
+        target = *offset;
+        break;
+    case SEEK_CUR:
+        target = (off_t)s->read_pos + *offset;
+        break;
+    default:
+        return -1; // 流没有长度, 不支持 SEEK_END
+    }
+
+    if (target < 0)
+    {
+        return -1;
+    }
+
+    if (target < (off_t)s->read_pos)
+    {
+        // 向后跳转只能回放保留的文件头: 读端已经读过文件头之后的数据时, 中间的数据已经丢弃, 无法精确回到 target
+        if (s->read_pos > s->replay_len)
+        {
+            return -1;
+        }
+        s->read_pos = target;
+        *offset = target;
+        return 0;
+    }
+
+    // 向前跳转: 读取并丢弃
+    char scratch[128];
+    while ((off_t)s->read_pos < target)
+    {
+        size_t n = MIN(sizeof(scratch), (size_t)(target - s->read_pos));
+        if (audio_stream_cookie_read(s, scratch, n) <= 0)
+        {
+            return -1;
+        }
+    }
+    *offset = s->read_pos;
+    return 0;
+}
+
+static int audio_stream_cookie_close(void *cookie)
+{
+    audio_stream_t *s = (audio_stream_t *)cookie;
+    s->reader_open = false;
+    return 0;
+}
+
+static void audio_stream_start_playback(audio_stream_t *s)
+{
+    cookie_io_functions_t funcs = {
+        .read = audio_stream_cookie_read,
+        .write = NULL,
+        .seek = audio_stream_cookie_seek,
+        .close = audio_stream_cookie_close,
+    };
+
+    s->playing = true;
+    FILE *fp = fopencookie(s, "rb", funcs);
+    if (fp == NULL)
+    {
+        ESP_LOGE(TAG, "fopencookie failed");
+        return;
+    }
+    s->reader_open = true;
+    ESP_LOGI(TAG, "start playback, buffered %zu bytes", s->buffered);
+    if (audio_player_play(fp) != ESP_OK)
+    {
+        fclose(fp);
+    }
+}
+
+esp_err_t audio_stream_init(void)
+{
+    if (s_stream)
+    {
+        return ESP_OK;
+    }
+
+    s_stream = heap_caps_calloc(1, sizeof(audio_stream_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(NULL != s_stream, ESP_ERR_NO_MEM, TAG, "Failed create audio stream");
+
+    s_stream->sb_storage = heap_caps_malloc(AUDIO_STREAM_BUFFER_SIZE + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    s_stream->replay = heap_caps_malloc(AUDIO_STREAM_REPLAY_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    assert(s_stream->sb_storage && s_stream->replay);
+
+    s_stream->sb = xStreamBufferCreateStatic(AUDIO_STREAM_BUFFER_SIZE, 1, s_stream->sb_storage, &s_stream->sb_struct);
+    assert(s_stream->sb);
+    ESP_LOGI(TAG, "successfully created audio stream with a size: %d", AUDIO_STREAM_BUFFER_SIZE);
+    return ESP_OK;
+}
+
+esp_err_t audio_stream_open(void)
+{
+    ESP_RETURN_ON_FALSE(NULL != s_stream, ESP_ERR_INVALID_STATE, TAG, "audio stream is not initialized");
+    audio_stream_t *s = s_stream;
+
+    // 上一个会话仍在播放, 让读端返回 EOF 并等待播放器关闭 FILE
+    if (s->reader_open)
+    {
+        s->aborted = true;
+        audio_player_stop();
+        for (int i = 0; i < 100 && s->reader_open; i++)
+        {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        ESP_RETURN_ON_FALSE(!s->reader_open, ESP_ERR_TIMEOUT, TAG, "previous stream still in use");
+    }
+
+    xStreamBufferReset(s->sb);
+    s->replay_len = 0;
+    s->read_pos = 0;
+    s->buffered = 0;
+    s->eof = false;
+    s->aborted = false;
+    s->playing = false;
+    s->writing = true;
+    return ESP_OK;
+}
+
+esp_err_t audio_stream_write(const void *data, size_t len)
+{
+    ESP_RETURN_ON_FALSE(NULL != s_stream && s_stream->writing, ESP_ERR_INVALID_STATE, TAG, "audio stream is not open");
+    audio_stream_t *s = s_stream;
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len > 0)
+    {
+        // 播放被停止(如录音开始), 剩余数据直接丢弃
+        if (s->aborted || (s->playing && !s->reader_open))
+        {
+            return ESP_FAIL;
+        }
+
+        size_t sent = xStreamBufferSend(s->sb, p, len, pdMS_TO_TICKS(100));
+        p += sent;
+        len -= sent;
+        s->buffered += sent;
+
+        if (!s->playing && s->buffered >= AUDIO_STREAM_PREBUFFER)
+        {
+            audio_stream_start_playback(s);
+        }
+    }
+    return ESP_OK;
+}
+
+void audio_stream_finish(void)
+{
+    if (NULL == s_stream || !s_stream->writing)
+    {
+        return;
+    }
+    s_stream->writing = false;
+    s_stream->eof = true;
+    if (!s_stream->playing && s_stream->buffered > 0)
+    {
+        audio_stream_start_playback(s_stream);
+    }
+}
+
+void audio_stream_abort(void)
+{
+    if (NULL == s_stream)
+    {
+        return;
+    }
+    s_stream->writing = false;
+    s_stream->eof = true;
+    s_stream->aborted = true;
+}
+
+bool audio_stream_is_open(void)
+{
+    return s_stream && s_stream->writing;
+}
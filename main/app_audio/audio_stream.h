@@ -0,0 +1,48 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define AUDIO_STREAM_BUFFER_SIZE (64 * 1024) // 环形缓冲区大小(PSRAM)
+#define AUDIO_STREAM_PREBUFFER   (4 * 1024)  // 缓冲到该字节数后开始解码播放
+#define AUDIO_STREAM_REPLAY_SIZE (4 * 1024)  // 保留的文件头, 供播放器探测格式时 fseek 回退
+
+    /**
+     * @brief 为 audio_player 提供一个边下载边播放的 FILE 源.
+     *
+     * 写端(HTTP 事件回调)调用 audio_stream_write() 写入数据, 缓冲区满时阻塞,
+     * 以此对 HTTP 读取形成反压; 读端是 audio_player 的解码任务, 通过 fopencookie
+     * 得到的 FILE 读取数据. 缓冲达到 AUDIO_STREAM_PREBUFFER 或写端结束时自动开始播放.
+     */
+    esp_err_t audio_stream_init(void);
+
+    /// @brief 开始一个新的播放会话, 会停止仍在播放的上一个会话
+    esp_err_t audio_stream_open(void);
+
+    /// @brief 写入编码后的音频数据(MP3/WAV), 缓冲区满时阻塞
+    esp_err_t audio_stream_write(const void *data, size_t len);
+
+    /// @brief 写端结束, 读端读完剩余数据后返回 EOF
+    void audio_stream_finish(void);
+
+    /// @brief 丢弃剩余数据, 立即结束当前会话
+    void audio_stream_abort(void);
+
+    /// @brief 当前是否有会话处于写入状态
+    bool audio_stream_is_open(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,250 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "voice_sched.h"
+#include "wifi_power.h"
+
+static const char *TAG = "voice_sched";
+
+typedef struct
+{
+    const char *name;
+    audio_chat_mode_t mode;
+    UBaseType_t priority;
+    wifi_power_hold_t hold;  // 有请求排队或执行时保持 Wi-Fi 不省电
+    QueueHandle_t queue;
+    TaskHandle_t task;
+    StaticTask_t task_buffer;
+    StackType_t *task_stack;
+    voice_job_t *current;
+    http_arena_t arena;
+} voice_lane_t;
+
+// 听写优先级高于聊天; 都低于键盘(8)和按键发送(9)任务
+static voice_lane_t s_lanes[] = {
+    {.name = "Voice Dictation", .mode = AUDIO_CHAT_MODE_ASR, .priority = 4, .hold = WIFI_POWER_HOLD_DICTATION},
+    {.name = "Voice Chat",      .mode = AUDIO_CHAT_MODE_GPT, .priority = 3, .hold = WIFI_POWER_HOLD_CHAT},
+};
+#define VOICE_LANE_NUM (sizeof(s_lanes) / sizeof(s_lanes[0]))
+
+static voice_job_handler_t s_handler = NULL;
+static voice_sched_stats_t s_stats;
+static uint32_t s_next_id = 1;
+static portMUX_TYPE s_sched_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static voice_lane_t *voice_sched_lane(audio_chat_mode_t mode)
+{
+    for (int i = 0; i < VOICE_LANE_NUM; i++)
+    {
+        if (s_lanes[i].mode == mode)
+        {
+            return &s_lanes[i];
+        }
+    }
+    return NULL;
+}
+
+static void voice_job_free(voice_job_t *job)
+{
+    free(job->audio);
+    free(job);
+}
+
+static void voice_lane_task(void *pvParam)
+{
+    voice_lane_t *lane = (voice_lane_t *)pvParam;
+    while (true)
+    {
+        voice_job_t *job = NULL;
+        if (xQueueReceive(lane->queue, &job, portMAX_DELAY) != pdTRUE || job == NULL)
+        {
+            continue;
+        }
+
+        portENTER_CRITICAL(&s_sched_lock);
+        lane->current = job;
+        portEXIT_CRITICAL(&s_sched_lock);
+        wifi_power_hold(lane->hold, true);
+
+        int64_t start = esp_timer_get_time();
+        if (!job->cancelled)
+        {
+            http_arena_reset(&lane->arena);
+            job->arena = &lane->arena;
+            ESP_LOGI(TAG, "%s: job %" PRIu32 " start, waited %lld ms", lane->name, job->id, (start - job->submit_us) / 1000);
+            s_handler(job);
+        }
+        int64_t end = esp_timer_get_time();
+
+        portENTER_CRITICAL(&s_sched_lock);
+        lane->current = NULL;
+        if (job->cancelled)
+        {
+            s_stats.cancelled++;
+        }
+        else
+        {
+            s_stats.completed++;
+        }
+        s_stats.wait_us += start - job->submit_us;
+        s_stats.run_us += end - start;
+        portEXIT_CRITICAL(&s_sched_lock);
+
+        ESP_LOGI(TAG, "%s: job %" PRIu32 " %s, %lld ms", lane->name, job->id, job->cancelled ? "cancelled" : "done", (end - start) / 1000);
+        voice_job_free(job);
+        if (uxQueueMessagesWaiting(lane->queue) == 0)
+        {
+            wifi_power_hold(lane->hold, false);
+        }
+        voice_sched_log_stats();
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t voice_sched_init(voice_job_handler_t handler)
+{
+    ESP_RETURN_ON_FALSE(NULL != handler, ESP_ERR_INVALID_ARG, TAG, "handler is NULL");
+    ESP_RETURN_ON_FALSE(NULL == s_handler, ESP_ERR_INVALID_STATE, TAG, "already initialized");
+    s_handler = handler;
+
+    for (int i = 0; i < VOICE_LANE_NUM; i++)
+    {
+        voice_lane_t *lane = &s_lanes[i];
+        http_arena_init(&lane->arena, HTTP_ARENA_CHUNK_SIZE);
+        lane->queue = xQueueCreate(VOICE_SCHED_QUEUE_LEN, sizeof(voice_job_t *));
+        ESP_RETURN_ON_FALSE(NULL != lane->queue, ESP_ERR_NO_MEM, TAG, "Failed create %s queue", lane->name);
+        lane->task_stack = (StackType_t *)heap_caps_malloc(VOICE_SCHED_STACK_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        assert(lane->task_stack);
+        lane->task = xTaskCreateStaticPinnedToCore(&voice_lane_task, lane->name, VOICE_SCHED_STACK_SIZE, lane, lane->priority, lane->task_stack, &lane->task_buffer, 1);
+        ESP_RETURN_ON_FALSE(NULL != lane->task, ESP_FAIL, TAG, "Failed create %s task", lane->name);
+    }
+    return ESP_OK;
+}
+
+esp_err_t voice_sched_submit(audio_chat_mode_t mode, const uint8_t *audio, size_t audio_len)
+{
+    voice_lane_t *lane = voice_sched_lane(mode);
+    ESP_RETURN_ON_FALSE(NULL != lane && NULL != lane->queue, ESP_ERR_INVALID_ARG, TAG, "no lane for mode %d", mode);
+
+    voice_job_t *job = heap_caps_calloc(1, sizeof(voice_job_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    uint8_t *copy = heap_caps_malloc(audio_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (job == NULL || copy == NULL)
+    {
+        free(job);
+        free(copy);
+        ESP_LOGE(TAG, "no memory for %zu bytes of audio", audio_len);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, audio, audio_len);
+    job->mode = mode;
+    job->audio = copy;
+    job->audio_len = audio_len;
+    job->submit_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_sched_lock);
+    job->id = s_next_id++;
+    portEXIT_CRITICAL(&s_sched_lock);
+
+    // 上传前就切回 PS_NONE; 通道空闲后由执行任务释放
+    wifi_power_hold(lane->hold, true);
+    if (xQueueSend(lane->queue, &job, 0) != pdTRUE)
+    {
+        portENTER_CRITICAL(&s_sched_lock);
+        s_stats.rejected++;
+        portEXIT_CRITICAL(&s_sched_lock);
+        ESP_LOGW(TAG, "%s: queue full, job rejected", lane->name);
+        voice_job_free(job);
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&s_sched_lock);
+    s_stats.submitted++;
+    portEXIT_CRITICAL(&s_sched_lock);
+    ESP_LOGI(TAG, "%s: job %" PRIu32 " queued, %zu bytes", lane->name, job->id, audio_len);
+    return ESP_OK;
+}
+
+void voice_sched_cancel(audio_chat_mode_t mode)
+{
+    voice_lane_t *lane = voice_sched_lane(mode);
+    if (lane == NULL || lane->queue == NULL)
+    {
+        return;
+    }
+
+    // 排队中的直接丢弃
+    voice_job_t *job = NULL;
+    while (xQueueReceive(lane->queue, &job, 0) == pdTRUE)
+    {
+        ESP_LOGI(TAG, "%s: job %" PRIu32 " dropped", lane->name, job->id);
+        portENTER_CRITICAL(&s_sched_lock);
+        s_stats.cancelled++;
+        portEXIT_CRITICAL(&s_sched_lock);
+        voice_job_free(job);
+    }
+
+    portENTER_CRITICAL(&s_sched_lock);
+    if (lane->current)
+    {
+        lane->current->cancelled = true;
+    }
+    portEXIT_CRITICAL(&s_sched_lock);
+}
+
+bool voice_sched_cancelled(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    bool cancelled = false;
+    portENTER_CRITICAL(&s_sched_lock);
+    for (int i = 0; i < VOICE_LANE_NUM; i++)
+    {
+        if (s_lanes[i].task == self && s_lanes[i].current)
+        {
+            cancelled = s_lanes[i].current->cancelled;
+        }
+    }
+    portEXIT_CRITICAL(&s_sched_lock);
+    return cancelled;
+}
+
+bool voice_sched_busy(audio_chat_mode_t mode)
+{
+    voice_lane_t *lane = voice_sched_lane(mode);
+    if (lane == NULL || lane->queue == NULL)
+    {
+        return false;
+    }
+    return lane->current != NULL || uxQueueMessagesWaiting(lane->queue) > 0;
+}
+
+void voice_sched_get_stats(voice_sched_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_sched_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_sched_lock);
+}
+
+void voice_sched_log_stats(void)
+{
+    voice_sched_stats_t st;
+    voice_sched_get_stats(&st);
+    uint32_t done = st.completed + st.cancelled;
+    ESP_LOGI(TAG, "jobs: submitted %" PRIu32 ", rejected %" PRIu32 ", cancelled %" PRIu32 ", completed %" PRIu32 ", avg wait %" PRIu64 " ms, avg run %" PRIu64 " ms",
+             st.submitted, st.rejected, st.cancelled, st.completed,
+             done ? st.wait_us / done / 1000 : 0, done ? st.run_us / done / 1000 : 0);
+}
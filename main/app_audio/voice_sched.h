@@ -0,0 +1,73 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "app_sr.h"
+#include "http_arena.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define VOICE_SCHED_QUEUE_LEN    (2)          // 每条通道最多排队的请求数
+#define VOICE_SCHED_STACK_SIZE   (10 * 1024)
+
+    typedef struct
+    {
+        uint32_t id;
+        audio_chat_mode_t mode;
+        uint8_t *audio;          // 录音的副本, 提交后录音缓冲区可以立即复用
+        size_t audio_len;
+        http_arena_t *arena;     // 所在通道的 arena, 每个请求开始前已复位
+        volatile bool cancelled;
+        int64_t submit_us;
+    } voice_job_t;
+
+    typedef void (*voice_job_handler_t)(voice_job_t *job);
+
+    typedef struct
+    {
+        uint32_t submitted;
+        uint32_t rejected;   // 队列满
+        uint32_t cancelled;
+        uint32_t completed;
+        uint64_t wait_us;    // 排队总耗时
+        uint64_t run_us;     // 执行总耗时
+    } voice_sched_stats_t;
+
+    /**
+     * @brief 语音请求调度器.
+     *
+     * 每种请求(聊天 / 听写)一条通道, 每条通道一个工作任务和一个队列. 同一通道的请求共享状态
+     * (聊天的播放会话, 听写的键盘输入), 按顺序执行; 不同通道并行, 例如聊天在播放回答时听写照常识别输入.
+     * 听写通道的任务优先级高于聊天, 不会排在耗时的聊天后面.
+     */
+    esp_err_t voice_sched_init(voice_job_handler_t handler);
+
+    /// @brief 提交一个请求, 复制录音数据, 队列满或内存不足时返回错误
+    esp_err_t voice_sched_submit(audio_chat_mode_t mode, const uint8_t *audio, size_t audio_len);
+
+    /// @brief 取消某种请求: 丢弃排队的, 标记正在执行的, 由执行者在各阶段之间检查后退出
+    void voice_sched_cancel(audio_chat_mode_t mode);
+
+    /// @brief 当前任务正在执行的请求是否已被取消, 不在工作任务中调用时返回 false
+    bool voice_sched_cancelled(void);
+
+    /// @brief 是否有某种请求在排队或执行
+    bool voice_sched_busy(audio_chat_mode_t mode);
+
+    void voice_sched_get_stats(voice_sched_stats_t *stats);
+    void voice_sched_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,50 +1,381 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <inttypes.h>
+#include <sys/param.h>
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
+#include "esp_now.h"
 #include "esp_mac.h"
-#include "espnow.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "app_wifi.h"
 #include "app_espnow.h"
+#include "key_link.h"
 
 static const char *TAG = "app_espnow";
 
-void app_espnow_send_data(uint8_t *data, size_t data_len)
+#define ESPNOW_NVS_NAMESPACE   "espnow_peer"
+#define ESPNOW_NVS_KEY         "peer"
+#define ESPNOW_DISCOVER_US     100000  // 没有配对时广播 DISCOVER 的间隔, 没有连接 AP 时每次换一个信道
+#define ESPNOW_CHANNEL_MAX     13
+#define ESPNOW_PENDING_NUM     16      // 等待发送回调的帧, 必须是 2 的幂
+#define ESPNOW_START_WAIT_MS   100     // 等待 Wi-Fi 启动的轮询间隔
+
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t channel;
+} espnow_peer_t;
+
+static const uint8_t s_broadcast_mac[ESP_NOW_ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+// 以下状态只在 keyboard_tx 任务中访问
+static key_link_tx_t s_link;
+static bool s_enabled = false;          // ESP-NOW 模式
+static bool s_inited = false;           // Wi-Fi 启动后才能初始化 ESP-NOW
+static espnow_peer_t s_peer;            // 配对的接收器
+static espnow_peer_t s_peer_saved;      // NVS 中保存的接收器
+static bool s_paired = false;
+static int64_t s_peer_reply_us = 0;
+static int64_t s_discover_us = 0;
+static uint8_t s_scan_channel = 0;
+
+// 接收回调(Wi-Fi 任务)收到 ANNOUNCE 后放在这里, 由 keyboard_tx 任务处理
+static espnow_peer_t s_announce;
+static int64_t s_announce_us = 0;
+static int64_t s_ack_us = 0;            // 最后一次单播收到 MAC 层 ACK 的时间, 说明接收器在线且在同一信道
+static portMUX_TYPE s_announce_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// 发送时间, 按发送顺序在发送回调中取出, 计算到收到 MAC 层 ACK 的时间
+static int64_t s_pending_us[ESPNOW_PENDING_NUM];
+static volatile uint32_t s_pending_head = 0;
+static volatile uint32_t s_pending_tail = 0;
+
+static app_espnow_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/// @brief 估算一帧 ESP-NOW 的空中时间 (OFDM), 包括 MAC 头, 厂商元素和 FCS 共 43 字节
+static uint32_t app_espnow_airtime_us(size_t payload)
+{
+    uint32_t bits = 16 + 8 * (43 + payload) + 6;
+    uint32_t bits_per_symbol = 4 * APP_ESPNOW_RATE_MBPS;
+    return 20 + 4 * ((bits + bits_per_symbol - 1) / bits_per_symbol);
+}
+
+static void app_espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t tail = s_pending_tail;
+    if (tail == s_pending_head)
+    {
+        return;
+    }
+    int64_t sent_us = s_pending_us[tail & (ESPNOW_PENDING_NUM - 1)];
+    s_pending_tail = tail + 1;
+
+    uint32_t latency_us = now - sent_us;
+    if (status == ESP_NOW_SEND_SUCCESS && memcmp(mac_addr, s_broadcast_mac, ESP_NOW_ETH_ALEN) != 0)
+    {
+        portENTER_CRITICAL(&s_announce_lock);
+        s_ack_us = now;
+        portEXIT_CRITICAL(&s_announce_lock);
+    }
+    portENTER_CRITICAL(&s_stats_lock);
+    if (status == ESP_NOW_SEND_SUCCESS)
+    {
+        s_stats.acked++;
+    }
+    else
+    {
+        s_stats.failed++;
+    }
+    s_stats.latency_total_us += latency_us;
+    if (latency_us > s_stats.latency_max_us)
+    {
+        s_stats.latency_max_us = latency_us;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void app_espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
+{
+    key_frame_t frame;
+    if (!key_link_frame_parse(data, len, &frame) || frame.type != KEY_FRAME_ANNOUNCE)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&s_announce_lock);
+    memcpy(s_announce.mac, recv_info->src_addr, ESP_NOW_ETH_ALEN);
+    s_announce.channel = frame.report[0];
+    s_announce_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_announce_lock);
+}
+
+static void app_espnow_peer_load(void)
 {
-    if (app_wifi_connected_already() != WIFI_STATUS_CONNECTED_OK)
+    nvs_handle_t handle = 0;
+    size_t len = sizeof(s_peer_saved);
+    if (nvs_open(ESPNOW_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
         return;
+    }
+    if (nvs_get_blob(handle, ESPNOW_NVS_KEY, &s_peer_saved, &len) != ESP_OK || len != sizeof(s_peer_saved))
+    {
+        memset(&s_peer_saved, 0, sizeof(s_peer_saved));
+    }
+    nvs_close(handle);
+}
 
-    if (data_len > 8)
+static void app_espnow_peer_save(const espnow_peer_t *peer)
+{
+    if (memcmp(peer, &s_peer_saved, sizeof(espnow_peer_t)) == 0)
+    {
+        return;
+    }
+    nvs_handle_t handle = 0;
+    esp_err_t err = nvs_open(ESPNOW_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, ESPNOW_NVS_KEY, peer, sizeof(espnow_peer_t));
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error (%s) saving receiver!", esp_err_to_name(err));
         return;
+    }
+    s_peer_saved = *peer;
+}
 
-    // 按键状态改变, 发送数据
-    uint8_t key_changed = 0;
-    static uint8_t key_buffer_last[8] = {0};
-    uint8_t key_buffer[8] = {0};
-    memcpy(key_buffer, data, data_len);
-    for (uint8_t i = 0; i < 8; i++)
+/// @brief 没有连接 AP 时把信道固定在接收器的信道上; 连接 AP 后由 AP 决定信道
+static void app_espnow_set_channel(uint8_t channel)
+{
+    if (channel == 0 || app_wifi_connected_already() == WIFI_STATUS_CONNECTED_OK)
+    {
+        return;
+    }
+    uint8_t primary = 0;
+    wifi_second_chan_t second = WIFI_SECOND_CHAN_NONE;
+    if (esp_wifi_get_channel(&primary, &second) == ESP_OK && primary == channel)
+    {
+        return;
+    }
+    // 正在扫描或连接时会失败, 下一次发送前再设置
+    esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+}
+
+static void app_espnow_pair(const espnow_peer_t *peer, int64_t now_us)
+{
+    if (s_paired && memcmp(s_peer.mac, peer->mac, ESP_NOW_ETH_ALEN) != 0)
+    {
+        esp_now_del_peer(s_peer.mac);
+    }
+    // 信道填 0 表示使用当前信道, 连接 AP 后不会因为信道不同而发送失败
+    esp_now_peer_info_t peer_info = {
+        .channel = 0,
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+    memcpy(peer_info.peer_addr, peer->mac, ESP_NOW_ETH_ALEN);
+    if (!esp_now_is_peer_exist(peer->mac) && esp_now_add_peer(&peer_info) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "add peer " MACSTR " failed", MAC2STR(peer->mac));
+        return;
+    }
+    if (!s_paired || memcmp(&s_peer, peer, sizeof(espnow_peer_t)) != 0)
     {
-        if (key_buffer[i] != key_buffer_last[i])
-            key_changed++;
+        ESP_LOGI(TAG, "paired with " MACSTR " on channel %d", MAC2STR(peer->mac), peer->channel);
     }
-    if (key_changed == 0)
+    s_peer = *peer;
+    s_paired = true;
+    s_peer_reply_us = now_us;
+    app_espnow_set_channel(s_peer.channel);
+    app_espnow_peer_save(&s_peer);
+}
+
+static void app_espnow_unpair(int64_t now_us)
+{
+    ESP_LOGW(TAG, "receiver " MACSTR " silent, back to discovery", MAC2STR(s_peer.mac));
+    esp_now_del_peer(s_peer.mac);
+    s_paired = false;
+    s_discover_us = now_us;
+    s_scan_channel = s_peer.channel ? s_peer.channel - 1 : 0;   // 先在原来的信道上寻找
+}
+
+static void app_espnow_send_frame(const key_frame_t *frame)
+{
+    const uint8_t *dest = s_paired ? s_peer.mac : s_broadcast_mac;
+    uint32_t head = s_pending_head;
+    if (head - s_pending_tail >= ESPNOW_PENDING_NUM)
+    {
+        // 发送队列满, 丢弃这一帧, 由副本和心跳补上
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.send_err++;
+        portEXIT_CRITICAL(&s_stats_lock);
         return;
-    memcpy(key_buffer_last, key_buffer, sizeof(key_buffer));
+    }
+    s_pending_us[head & (ESPNOW_PENDING_NUM - 1)] = esp_timer_get_time();
+    s_pending_head = head + 1;
 
-    espnow_frame_head_t frame_head = {
-        .retransmit_count = 5,
-        .broadcast = true,
+    // esp_now_send 只把帧交给 Wi-Fi 驱动, 不等待 ACK; 不需要 wifi 锁
+    esp_err_t err = esp_now_send(dest, (const uint8_t *)frame, sizeof(key_frame_t));
+    portENTER_CRITICAL(&s_stats_lock);
+    if (err == ESP_OK)
+    {
+        s_stats.sent++;
+    }
+    else
+    {
+        s_stats.send_err++;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+    if (err != ESP_OK)
+    {
+        // 没有发出去就不会有回调
+        s_pending_head = head;
+    }
+    if (err == ESP_OK && s_stats.sent % 1000 == 0)
+    {
+        app_espnow_log_stats();
+    }
+}
+
+static bool app_espnow_start(void)
+{
+    if (!app_wifi_started())
+    {
+        return false;
+    }
+    ESP_ERROR_CHECK(esp_now_init());
+    ESP_ERROR_CHECK(esp_now_register_send_cb(app_espnow_send_cb));
+    ESP_ERROR_CHECK(esp_now_register_recv_cb(app_espnow_recv_cb));
+    // 默认 1 Mbps, 一帧要占用约 700 us 空中时间; 提高速率缩短占用时间
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_wifi_config_espnow_rate(WIFI_IF_STA, APP_ESPNOW_RATE));
+
+    esp_now_peer_info_t peer_info = {
+        .channel = 0,
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
     };
-    app_wifi_lock(0);
-    espnow_send(ESPNOW_DATA_TYPE_DATA, ESPNOW_ADDR_BROADCAST, key_buffer_last, sizeof(key_buffer_last), &frame_head, portMAX_DELAY);
-    app_wifi_unlock();
+    memcpy(peer_info.peer_addr, s_broadcast_mac, ESP_NOW_ETH_ALEN);
+    ESP_ERROR_CHECK(esp_now_add_peer(&peer_info));
+
+    app_espnow_peer_load();
+    if (s_peer_saved.channel)
+    {
+        // 先直接单播给上次的接收器, 没有回复再重新寻找
+        app_espnow_pair(&s_peer_saved, esp_timer_get_time());
+    }
+    s_inited = true;
+    return true;
+}
+
+uint32_t app_espnow_poll(void)
+{
+    if (!s_enabled)
+    {
+        return KEY_LINK_HEARTBEAT_IDLE_US / 1000;
+    }
+    if (!s_inited && !app_espnow_start())
+    {
+        return ESPNOW_START_WAIT_MS;
+    }
+
+    int64_t now = esp_timer_get_time();
+    espnow_peer_t announce;
+    int64_t announce_us;
+    int64_t ack_us;
+    portENTER_CRITICAL(&s_announce_lock);
+    announce = s_announce;
+    announce_us = s_announce_us;
+    s_announce_us = 0;
+    ack_us = s_ack_us;
+    portEXIT_CRITICAL(&s_announce_lock);
+    if (announce_us && (!s_paired || memcmp(announce.mac, s_peer.mac, ESP_NOW_ETH_ALEN) == 0))
+    {
+        app_espnow_pair(&announce, announce_us);
+    }
+    // 单播只发给配对的接收器, 收到 ACK 与收到 ANNOUNCE 一样说明它在线
+    if (s_paired && ack_us > s_peer_reply_us)
+    {
+        s_peer_reply_us = ack_us;
+    }
+    if (s_paired && now - s_peer_reply_us > KEY_LINK_PEER_TIMEOUT_US)
+    {
+        app_espnow_unpair(now);
+    }
+
+    key_frame_t frame;
+    int64_t wait_us = 0;
+    if (s_paired)
+    {
+        app_espnow_set_channel(s_peer.channel);
+    }
+    while (key_link_tx_next(&s_link, now, &frame, &wait_us))
+    {
+        app_espnow_send_frame(&frame);
+    }
+
+    if (!s_paired)
+    {
+        if (now >= s_discover_us)
+        {
+            // 没有连接 AP 时轮流在各信道上寻找接收器
+            if (app_wifi_connected_already() != WIFI_STATUS_CONNECTED_OK)
+            {
+                s_scan_channel = s_scan_channel % ESPNOW_CHANNEL_MAX + 1;
+                app_espnow_set_channel(s_scan_channel);
+            }
+            key_link_frame_init(&frame, KEY_FRAME_DISCOVER, s_link.seq, now);
+            app_espnow_send_frame(&frame);
+            s_discover_us = now + ESPNOW_DISCOVER_US;
+        }
+        wait_us = MIN(wait_us, s_discover_us - now);
+    }
+    return (wait_us + 999) / 1000;
+}
+
+void app_espnow_send_data(uint8_t *data, size_t data_len)
+{
+    if (!s_enabled || data_len > KEY_LINK_REPORT_LEN)
+        return;
+
+    // 按键状态改变, 立即发送第一帧, 副本和心跳由 app_espnow_poll 发送
+    if (key_link_tx_update(&s_link, data, data_len, esp_timer_get_time()))
+    {
+        app_espnow_poll();
+    }
+}
+
+void app_espnow_get_stats(app_espnow_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+    stats->airtime_us = app_espnow_airtime_us(sizeof(key_frame_t));
+}
+
+void app_espnow_log_stats(void)
+{
+    app_espnow_stats_t st;
+    app_espnow_get_stats(&st);
+    uint32_t done = st.acked + st.failed;
+    ESP_LOGI(TAG, "sent %" PRIu32 ", acked %" PRIu32 ", failed %" PRIu32 ", send err %" PRIu32 ", airtime %" PRIu32 " us/frame @%dM, "
+                  "send->cb avg %" PRIu32 " us max %" PRIu32 " us",
+             st.sent, st.acked, st.failed, st.send_err, st.airtime_us, APP_ESPNOW_RATE_MBPS,
+             done ? (uint32_t)(st.latency_total_us / done) : 0, st.latency_max_us);
 }
 
 void app_espnow_init(void)
 {
-    espnow_config_t espnow_config = ESPNOW_INIT_CONFIG_DEFAULT();
-    espnow_init(&espnow_config);
+    // ESP-NOW 在 keyboard_tx 任务中 Wi-Fi 启动后初始化
+    key_link_tx_init(&s_link);
+    s_enabled = true;
 }
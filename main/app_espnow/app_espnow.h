@@ -2,11 +2,34 @@
 #define _APP_ESPNOW_H_
 
 #include <stdint.h>
+#include <stddef.h>
+
+#define APP_ESPNOW_RATE        WIFI_PHY_RATE_24M  // ESP-NOW 发送速率
+#define APP_ESPNOW_RATE_MBPS   24
+
+typedef struct
+{
+    uint32_t sent;              // 交给 Wi-Fi 驱动的帧
+    uint32_t acked;             // 收到 MAC 层 ACK (广播总是成功)
+    uint32_t failed;            // 重传后仍没有 ACK
+    uint32_t send_err;          // esp_now_send 返回错误或等待回调的帧太多
+    uint32_t airtime_us;        // 一帧的估算空中时间
+    uint32_t latency_max_us;    // esp_now_send 到发送回调的时间
+    uint64_t latency_total_us;
+} app_espnow_stats_t;
 
 // void app_espnow_bind(void);
 // void app_espnow_unbind(void);
 // void app_espnow_send_wifi_config(void);
+
+/// @brief 提交新的按键状态, 状态改变时立即发送
 void app_espnow_send_data(uint8_t *data, size_t data_len);
+
+/// @brief 发送到期的副本, 心跳和 DISCOVER, 返回距下一帧的毫秒数; 与 app_espnow_send_data 在同一任务中调用
+uint32_t app_espnow_poll(void);
+
+void app_espnow_get_stats(app_espnow_stats_t *stats);
+void app_espnow_log_stats(void);
 void app_espnow_init(void);
 
 #endif /* _APP_ESPNOW_H_ */
@@ -0,0 +1,477 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_crt_bundle.h"
+
+#include "app_http_pool.h"
+#include "app_tls_session.h"
+#include "cloud_config.h"
+
+static const char *TAG = "app_http_pool";
+
+#define APP_HTTP_POOL_DEFAULT_TIMEOUT_MS (5000)
+#define APP_HTTP_POOL_HEADER_MAX         (6)  // 每个请求通过 app_http_pool_set_header 设置的请求头个数
+#define APP_HTTP_POOL_HEADER_KEY_LEN     (32)
+
+typedef struct
+{
+    esp_http_client_handle_t client;
+    esp_transport_handle_t transport; // https 使用带会话缓存的 TLS transport, 由连接池负责销毁
+    char host[APP_HTTP_POOL_HOST_LEN]; // scheme://host:port
+    bool busy;
+    bool connected;   // 当前持有已建立的连接
+    bool transient;   // 池满时临时创建, 归还时释放
+    bool responded;   // 本次请求已收到响应头或响应体, 出错后不能重试
+    bool cancelled;   // 本次请求被 app_http_pool_cancel() 中止, 出错后不重试
+    char headers[APP_HTTP_POOL_HEADER_MAX][APP_HTTP_POOL_HEADER_KEY_LEN]; // 上一个使用者设置的请求头, 复用前删除
+    int64_t last_used_us;
+    http_event_handle_cb event_handler;
+    void *user_data;
+} app_http_pool_entry_t;
+
+static app_http_pool_entry_t s_entries[APP_HTTP_POOL_MAX_ENTRIES];
+static app_http_pool_stats_t s_stats;
+static SemaphoreHandle_t s_pool_mux = NULL;
+static portMUX_TYPE s_pool_init_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void app_http_pool_lock(void)
+{
+    if (NULL == s_pool_mux)
+    {
+        SemaphoreHandle_t mux = xSemaphoreCreateMutex();
+        assert(mux);
+        portENTER_CRITICAL(&s_pool_init_lock);
+        if (NULL == s_pool_mux)
+        {
+            s_pool_mux = mux;
+            mux = NULL;
+        }
+        portEXIT_CRITICAL(&s_pool_init_lock);
+        if (mux)
+        {
+            vSemaphoreDelete(mux);
+        }
+    }
+    xSemaphoreTake(s_pool_mux, portMAX_DELAY);
+}
+
+static void app_http_pool_unlock(void)
+{
+    xSemaphoreGive(s_pool_mux);
+}
+
+/// @brief 从 url 中取出 scheme://host:port 作为连接池的键
+static void app_http_pool_host_key(const char *url, char *key, size_t key_len)
+{
+    const char *p = strstr(url, "://");
+    const char *host = p ? p + 3 : url;
+    const char *end = host;
+    while (*end && *end != '/' && *end != '?')
+    {
+        end++;
+    }
+
+    int scheme_len = p ? (int)(p - url) : 4;
+    const char *scheme = p ? url : "http";
+    const char *colon = memchr(host, ':', end - host);
+    if (colon)
+    {
+        snprintf(key, key_len, "%.*s://%.*s", scheme_len, scheme, (int)(end - host), host);
+    }
+    else
+    {
+        bool https = (scheme_len == 5 && strncmp(scheme, "https", 5) == 0);
+        snprintf(key, key_len, "%.*s://%.*s:%d", scheme_len, scheme, (int)(end - host), host, https ? 443 : 80);
+    }
+}
+
+static esp_err_t app_http_pool_event_handler(esp_http_client_event_t *evt)
+{
+    app_http_pool_entry_t *entry = (app_http_pool_entry_t *)evt->user_data;
+
+    if (HTTP_EVENT_ON_CONNECTED == evt->event_id)
+    {
+        entry->connected = true;
+    }
+    else if (HTTP_EVENT_DISCONNECTED == evt->event_id)
+    {
+        entry->connected = false;
+    }
+    else if (HTTP_EVENT_ON_HEADER == evt->event_id || HTTP_EVENT_ON_DATA == evt->event_id)
+    {
+        // 响应已经交给调用者 (例如 TTS 已写入播放器和缓存), 之后失败不能再重发
+        entry->responded = true;
+    }
+
+    // 转发给本次请求的处理函数
+    evt->user_data = entry->user_data;
+    return entry->event_handler ? entry->event_handler(evt) : ESP_OK;
+}
+
+static void app_http_pool_entry_free(app_http_pool_entry_t *entry)
+{
+    entry->event_handler = NULL;
+    if (entry->client)
+    {
+        esp_http_client_cleanup(entry->client);
+        entry->client = NULL;
+    }
+    // esp_http_client_cleanup 不会销毁外部传入的 transport
+    if (entry->transport)
+    {
+        esp_transport_destroy(entry->transport);
+        entry->transport = NULL;
+    }
+    entry->connected = false;
+    entry->host[0] = '\0';
+    memset(entry->headers, 0, sizeof(entry->headers));
+}
+
+static esp_err_t app_http_pool_entry_init(app_http_pool_entry_t *entry, const char *host, const esp_http_client_config_t *config)
+{
+    esp_http_client_config_t cfg = *config;
+    cfg.event_handler = app_http_pool_event_handler;
+    cfg.user_data = entry;
+    cfg.keep_alive_enable = true;
+    if (strncmp(host, "https", 5) == 0)
+    {
+#if CLOUD_MOCK_ENABLE && CLOUD_MOCK_TLS
+        // 模拟服务使用自签名证书, 不在证书包里
+        cfg.crt_bundle_attach = NULL;
+        cfg.cert_pem = CLOUD_MOCK_CERT_PEM;
+        cfg.cert_len = 0;
+#else
+        if (NULL == cfg.crt_bundle_attach && NULL == cfg.cert_pem)
+        {
+            cfg.crt_bundle_attach = esp_crt_bundle_attach;
+        }
+#endif
+#if CONFIG_ESP_HTTP_CLIENT_ENABLE_CUSTOM_TRANSPORT
+        // 所有 https 连接都复用 TLS 会话, 重连时走简短握手; 服务器校验方式沿用调用者的设置
+        entry->transport = app_tls_session_transport_new(cfg.crt_bundle_attach, cfg.cert_pem, cfg.cert_len);
+        cfg.transport = entry->transport;
+#endif
+    }
+
+    entry->client = esp_http_client_init(&cfg);
+    if (NULL == entry->client && entry->transport)
+    {
+        esp_transport_destroy(entry->transport);
+        entry->transport = NULL;
+    }
+    ESP_RETURN_ON_FALSE(NULL != entry->client, ESP_FAIL, TAG, "Error creating http client");
+    strlcpy(entry->host, host, sizeof(entry->host));
+    entry->connected = false;
+    return ESP_OK;
+}
+
+/// @brief 复用前恢复为新建 client 的状态: 方法, 请求体和上一个使用者设置的请求头
+static void app_http_pool_entry_reset(app_http_pool_entry_t *entry, const esp_http_client_config_t *config)
+{
+    esp_http_client_set_method(entry->client, config->method);
+    // 清空请求体, 同时删除 Content-Type
+    esp_http_client_set_post_field(entry->client, NULL, 0);
+    for (int i = 0; i < APP_HTTP_POOL_HEADER_MAX; i++)
+    {
+        if (entry->headers[i][0])
+        {
+            esp_http_client_delete_header(entry->client, entry->headers[i]);
+            entry->headers[i][0] = '\0';
+        }
+    }
+}
+
+static app_http_pool_entry_t *app_http_pool_find(esp_http_client_handle_t client)
+{
+    void *data = NULL;
+    esp_http_client_get_user_data(client, &data);
+    return (app_http_pool_entry_t *)data;
+}
+
+esp_http_client_handle_t app_http_pool_acquire(const esp_http_client_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->url, NULL, TAG, "invalid config");
+
+    char host[APP_HTTP_POOL_HOST_LEN];
+    app_http_pool_host_key(config->url, host, sizeof(host));
+    int64_t now = esp_timer_get_time();
+
+    app_http_pool_lock();
+    app_http_pool_entry_t *entry = NULL;
+    app_http_pool_entry_t *lru = NULL;
+    for (int i = 0; i < APP_HTTP_POOL_MAX_ENTRIES; i++)
+    {
+        app_http_pool_entry_t *e = &s_entries[i];
+        if (e->busy || !APP_HTTP_POOL_ENABLE)
+        {
+            continue;
+        }
+        if (e->client && strcmp(e->host, host) == 0)
+        {
+            entry = e;
+            break;
+        }
+        if (NULL == lru || NULL == e->client || (lru->client && e->last_used_us < lru->last_used_us))
+        {
+            lru = e;
+        }
+    }
+
+    if (entry)
+    {
+        // 空闲太久的连接大概率已被服务器关闭, 直接断开重建, 避免一次失败的写入
+        if (entry->connected && now - entry->last_used_us > APP_HTTP_POOL_IDLE_MAX_MS * 1000LL)
+        {
+            esp_http_client_close(entry->client);
+            entry->connected = false;
+            s_stats.expired++;
+        }
+        esp_http_client_set_url(entry->client, config->url);
+        esp_http_client_set_timeout_ms(entry->client, config->timeout_ms ? config->timeout_ms : APP_HTTP_POOL_DEFAULT_TIMEOUT_MS);
+        app_http_pool_entry_reset(entry, config);
+    }
+    else
+    {
+        if (NULL == lru)
+        {
+            // 所有连接都在使用中 (或连接池已关闭), 临时建一个, 用完即释放
+            lru = calloc(1, sizeof(app_http_pool_entry_t));
+            if (lru)
+            {
+                lru->transient = true;
+            }
+        }
+        else if (lru->client)
+        {
+            app_http_pool_entry_free(lru);
+        }
+
+        if (lru && app_http_pool_entry_init(lru, host, config) == ESP_OK)
+        {
+            entry = lru;
+        }
+        else if (lru && lru->transient)
+        {
+            free(lru);
+        }
+    }
+
+    if (entry)
+    {
+        entry->busy = true;
+        entry->cancelled = false;
+        entry->event_handler = config->event_handler;
+        entry->user_data = config->user_data;
+        app_tls_session_abort(entry->transport, false);
+    }
+    app_http_pool_unlock();
+
+    return entry ? entry->client : NULL;
+}
+
+/**
+ * @brief 复用的连接出错时判断能否在新连接上重试一次.
+ *
+ * 只有还没收到任何响应时才重试 (服务器已关闭空闲连接的典型情况);
+ * 已经收到响应头或数据时重试会让调用者收到两份数据, 直接把错误返回给调用者.
+ */
+static bool app_http_pool_should_retry(app_http_pool_entry_t *entry, esp_err_t err, bool reused)
+{
+    if (err == ESP_OK || !reused || entry->cancelled)
+    {
+        return false;
+    }
+    if (entry->responded)
+    {
+        ESP_LOGW(TAG, "%s: reused connection failed (%s) after response started, not retrying", entry->host, esp_err_to_name(err));
+        return false;
+    }
+    ESP_LOGW(TAG, "%s: reused connection failed (%s), reconnect", entry->host, esp_err_to_name(err));
+    esp_http_client_close(entry->client);
+    entry->connected = false;
+    app_http_pool_lock();
+    s_stats.stale++;
+    app_http_pool_unlock();
+    return true;
+}
+
+esp_err_t app_http_pool_perform(esp_http_client_handle_t client)
+{
+    app_http_pool_entry_t *entry = app_http_pool_find(client);
+    ESP_RETURN_ON_FALSE(NULL != entry, ESP_ERR_INVALID_ARG, TAG, "client is not from pool");
+
+    bool reused = entry->connected;
+    int64_t start = esp_timer_get_time();
+    entry->responded = false;
+    esp_err_t err = esp_http_client_perform(client);
+    if (app_http_pool_should_retry(entry, err, reused))
+    {
+        reused = false;
+        err = esp_http_client_perform(client);
+    }
+    int64_t cost = esp_timer_get_time() - start;
+
+    app_http_pool_lock();
+    if (reused)
+    {
+        s_stats.hits++;
+        s_stats.hit_us += cost;
+    }
+    else
+    {
+        s_stats.misses++;
+        s_stats.miss_us += cost;
+    }
+    app_http_pool_unlock();
+
+    ESP_LOGI(TAG, "%s: %s connection, %lld ms", entry->host, reused ? "reused" : "new", cost / 1000);
+    return err;
+}
+
+static esp_err_t app_http_pool_request(esp_http_client_handle_t client, const char *post_data, int post_len)
+{
+    esp_err_t err = esp_http_client_open(client, post_len);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (post_len > 0 && esp_http_client_write(client, post_data, post_len) != post_len)
+    {
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+    return esp_http_client_fetch_headers(client) < 0 ? ESP_ERR_HTTP_FETCH_HEADER : ESP_OK;
+}
+
+esp_err_t app_http_pool_open(esp_http_client_handle_t client, const char *post_data, int post_len)
+{
+    app_http_pool_entry_t *entry = app_http_pool_find(client);
+    ESP_RETURN_ON_FALSE(NULL != entry, ESP_ERR_INVALID_ARG, TAG, "client is not from pool");
+
+    bool reused = entry->connected;
+    int64_t start = esp_timer_get_time();
+    entry->responded = false;
+    esp_err_t err = app_http_pool_request(client, post_data, post_len);
+    if (app_http_pool_should_retry(entry, err, reused))
+    {
+        reused = false;
+        err = app_http_pool_request(client, post_data, post_len);
+    }
+    int64_t cost = esp_timer_get_time() - start;
+
+    // 流式请求只统计到收到响应头
+    app_http_pool_lock();
+    if (reused)
+    {
+        s_stats.hits++;
+        s_stats.hit_us += cost;
+    }
+    else
+    {
+        s_stats.misses++;
+        s_stats.miss_us += cost;
+    }
+    app_http_pool_unlock();
+
+    ESP_LOGI(TAG, "%s: %s connection, headers after %lld ms", entry->host, reused ? "reused" : "new", cost / 1000);
+    return err;
+}
+
+esp_err_t app_http_pool_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    app_http_pool_entry_t *entry = app_http_pool_find(client);
+    ESP_RETURN_ON_FALSE(NULL != entry, ESP_ERR_INVALID_ARG, TAG, "client is not from pool");
+
+    int slot = -1;
+    for (int i = 0; i < APP_HTTP_POOL_HEADER_MAX; i++)
+    {
+        if (strcasecmp(entry->headers[i], key) == 0)
+        {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && entry->headers[i][0] == '\0')
+        {
+            slot = i;
+        }
+    }
+    ESP_RETURN_ON_FALSE(slot >= 0 && strlen(key) < APP_HTTP_POOL_HEADER_KEY_LEN, ESP_ERR_NO_MEM, TAG, "too many headers");
+    strlcpy(entry->headers[slot], key, sizeof(entry->headers[slot]));
+    return esp_http_client_set_header(client, key, value);
+}
+
+void app_http_pool_cancel(esp_http_client_handle_t client)
+{
+    app_http_pool_entry_t *entry = app_http_pool_find(client);
+    if (NULL == entry)
+    {
+        return;
+    }
+
+    app_http_pool_lock();
+    if (entry->busy)
+    {
+        entry->cancelled = true;
+        app_tls_session_abort(entry->transport, true);
+    }
+    app_http_pool_unlock();
+}
+
+void app_http_pool_release(esp_http_client_handle_t client, esp_err_t result)
+{
+    app_http_pool_entry_t *entry = app_http_pool_find(client);
+    if (NULL == entry)
+    {
+        return;
+    }
+
+    app_http_pool_lock();
+    entry->event_handler = NULL;
+    entry->user_data = NULL;
+    entry->last_used_us = esp_timer_get_time();
+    if (result != ESP_OK && entry->connected)
+    {
+        // 出错后连接状态未知, 关闭后下次重建
+        esp_http_client_close(client);
+        entry->connected = false;
+    }
+    if (entry->transient)
+    {
+        app_http_pool_entry_free(entry);
+        free(entry);
+    }
+    else
+    {
+        entry->busy = false;
+    }
+    app_http_pool_unlock();
+}
+
+void app_http_pool_get_stats(app_http_pool_stats_t *stats)
+{
+    app_http_pool_lock();
+    *stats = s_stats;
+    app_http_pool_unlock();
+}
+
+void app_http_pool_log_stats(void)
+{
+    app_http_pool_stats_t st;
+    app_http_pool_get_stats(&st);
+    ESP_LOGI(TAG, "pool: hit %" PRIu32 " (avg %" PRIu64 " ms), miss %" PRIu32 " (avg %" PRIu64 " ms), stale %" PRIu32 ", expired %" PRIu32,
+             st.hits, st.hits ? st.hit_us / st.hits / 1000 : 0,
+             st.misses, st.misses ? st.miss_us / st.misses / 1000 : 0,
+             st.stale, st.expired);
+}
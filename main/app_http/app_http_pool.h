@@ -0,0 +1,75 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define APP_HTTP_POOL_ENABLE      (1)         // 0: 每个请求新建连接, 用完即关闭, 用于对比连接池省下的时间
+#define APP_HTTP_POOL_MAX_ENTRIES (4)         // 最多保持的连接数
+#define APP_HTTP_POOL_IDLE_MAX_MS (30 * 1000) // 空闲超过该时间的连接不再复用, 服务器一般在 60s 左右断开
+#define APP_HTTP_POOL_HOST_LEN    (64)
+
+    typedef struct
+    {
+        uint32_t hits;        // 复用已建立的连接
+        uint32_t misses;      // 新建连接
+        uint32_t stale;       // 复用失败(连接已被服务器关闭)后重连; 已收到响应后失败不重连
+        uint32_t expired;     // 空闲超时被关闭
+        uint64_t hit_us;      // 复用连接时请求的总耗时
+        uint64_t miss_us;     // 新建连接时请求的总耗时
+    } app_http_pool_stats_t;
+
+    /**
+     * @brief 按 scheme://host:port 复用 esp_http_client 连接.
+     *
+     * 同一主机的请求共用一个 client 及其 TCP/TLS 会话, 命中时跳过 DNS、TCP 和 TLS 握手.
+     * 池内 client 的 event_handler 是一个分发器, 每次请求时转发到 config 中的 event_handler,
+     * evt->user_data 为 config 中的 user_data. 连接复用时不会再收到 HTTP_EVENT_ON_CONNECTED,
+     * 调用者需在 app_http_pool_perform() 之前自行复位接收计数.
+     *
+     * 复用的 client 恢复为 config 中的 method, 清空请求体, 并删除上一个使用者通过
+     * app_http_pool_set_header() 设置的请求头; 请求头必须通过该函数设置.
+     */
+    esp_http_client_handle_t app_http_pool_acquire(const esp_http_client_config_t *config);
+
+    /// @brief 执行请求, 复用的连接在收到任何响应之前失败时 (已被服务器关闭) 自动重连一次
+    esp_err_t app_http_pool_perform(esp_http_client_handle_t client);
+
+    /**
+     * @brief 以流式方式发送请求: 写入请求体并读取响应头, 之后由调用者 esp_http_client_read() 读取响应体.
+     *
+     * 复用的连接在收到响应头之前失败时自动重连一次. 响应体需读完才能继续复用连接, 中途放弃时以错误码归还.
+     */
+    esp_err_t app_http_pool_open(esp_http_client_handle_t client, const char *post_data, int post_len);
+
+    /// @brief 设置请求头并记录下来, 连接被下一个使用者取走前删除
+    esp_err_t app_http_pool_set_header(esp_http_client_handle_t client, const char *key, const char *value);
+
+    /**
+     * @brief 中止进行中的 app_http_pool_open() / app_http_pool_perform(), 可以在其他任务中调用.
+     *
+     * 只对 https (带会话缓存的 TLS transport) 有效: 等待中的读写最多 50 ms 内返回错误, 不再重连重试;
+     * 明文 http 的请求照常进行到结束. 连接仍由使用者以错误码归还, 只能在使用者归还之前调用.
+     */
+    void app_http_pool_cancel(esp_http_client_handle_t client);
+
+    /// @brief 归还连接, 请求失败时关闭连接, 下次重新建立
+    void app_http_pool_release(esp_http_client_handle_t client, esp_err_t result);
+
+    void app_http_pool_get_stats(app_http_pool_stats_t *stats);
+    void app_http_pool_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,560 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/select.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_check.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "esp_crt_bundle.h"
+#include "esp_transport.h"
+#include "nvs.h"
+#include "mbedtls/ssl.h"
+
+#include "app_tls_session.h"
+
+static const char *TAG = "app_tls_session";
+
+#if CONFIG_ESP_HTTP_CLIENT_ENABLE_CUSTOM_TRANSPORT && CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+
+#define APP_TLS_HOST_LEN (64)
+#define APP_TLS_ABORT_POLL_MS (50) // 等待读写时每隔这么久检查一次是否被中止
+#define APP_TLS_NVS_NAMESPACE "tls_sess"
+
+// esp-tls 只声明了 esp_tls_client_session_t, mbedTLS 后端中它的定义就是一个 mbedtls_ssl_session.
+// 在这里补全类型, 以便读取会话的建立时间和序列化到 NVS; esp-tls 公开定义后这里会重复定义而编译失败, 届时删除即可
+struct esp_tls_client_session
+{
+    mbedtls_ssl_session saved_session;
+};
+
+typedef struct
+{
+    char host[APP_TLS_HOST_LEN];
+    int port;
+    esp_tls_client_session_t *session;
+    bool loaded;           // 已尝试从 NVS 读取
+    int64_t last_used_us;
+} app_tls_session_entry_t;
+
+#if APP_TLS_SESSION_PERSIST
+// NVS 中每个主机一项, 会话序列化后接在后面
+typedef struct
+{
+    char host[APP_TLS_HOST_LEN];
+    int32_t port;
+} app_tls_session_nvs_t;
+#endif
+
+typedef struct
+{
+    esp_tls_t *tls;
+    esp_err_t (*crt_bundle_attach)(void *conf); // 创建时传入的服务器校验方式
+    const char *cert_pem;
+    size_t cert_len;
+    volatile bool aborted; // 由其他任务设置, 使用者的任务在等待中发现后返回错误
+} app_tls_transport_t;
+
+static app_tls_session_entry_t s_sessions[APP_TLS_SESSION_MAX_HOSTS];
+static app_tls_session_stats_t s_stats;
+static portMUX_TYPE s_session_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/// @brief 查找主机对应的缓存项, 不存在时占用最久未使用的一项, 被挤出的会话通过 evicted 返回, 由调用者在锁外释放
+static app_tls_session_entry_t *app_tls_session_slot(const char *host, int port, esp_tls_client_session_t **evicted)
+{
+    app_tls_session_entry_t *lru = &s_sessions[0];
+    *evicted = NULL;
+    for (int i = 0; i < APP_TLS_SESSION_MAX_HOSTS; i++)
+    {
+        app_tls_session_entry_t *e = &s_sessions[i];
+        if (e->host[0] && e->port == port && strcmp(e->host, host) == 0)
+        {
+            return e;
+        }
+        if (!e->host[0] || (lru->host[0] && e->last_used_us < lru->last_used_us))
+        {
+            lru = e;
+        }
+    }
+
+    // 替换最久未使用的主机
+    *evicted = lru->session;
+    memset(lru, 0, sizeof(app_tls_session_entry_t));
+    strlcpy(lru->host, host, sizeof(lru->host));
+    lru->port = port;
+    return lru;
+}
+
+/**
+ * @brief 当前连接的会话建立时间.
+ *
+ * 服务器接受缓存会话 (简短握手) 时沿用原会话的建立时间, 完整握手时为本次握手的时间.
+ * 不能比较会话 ID: 携带 session ticket 时 mbedTLS 在 ClientHello 中放一个新的随机 ID, 服务器原样返回 (RFC 5077 3.4).
+ */
+static mbedtls_time_t app_tls_session_start(esp_tls_t *tls)
+{
+    mbedtls_ssl_context *ssl = (mbedtls_ssl_context *)esp_tls_get_ssl_context(tls);
+    const mbedtls_ssl_session *session = ssl ? mbedtls_ssl_get_session_pointer(ssl) : NULL;
+    return session ? session->MBEDTLS_PRIVATE(start) : 0;
+}
+
+#if APP_TLS_SESSION_PERSIST
+/// @brief NVS 键最长 15 个字符, 用 host:port 的 FNV-1a 哈希
+static void app_tls_session_nvs_key(const char *host, int port, char *key, size_t key_len)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *p = host; *p; p++)
+    {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    hash = (hash ^ (uint32_t)port) * 16777619u;
+    snprintf(key, key_len, "s%08" PRIx32, hash);
+}
+
+static esp_tls_client_session_t *app_tls_session_nvs_load(const char *host, int port)
+{
+    char key[16];
+    app_tls_session_nvs_key(host, port, key, sizeof(key));
+    nvs_handle_t handle = 0;
+    if (nvs_open(APP_TLS_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return NULL;
+    }
+
+    esp_tls_client_session_t *session = NULL;
+    uint8_t *buf = NULL;
+    size_t len = 0;
+    if (nvs_get_blob(handle, key, NULL, &len) == ESP_OK && len > sizeof(app_tls_session_nvs_t))
+    {
+        buf = malloc(len);
+    }
+    if (buf && nvs_get_blob(handle, key, buf, &len) == ESP_OK)
+    {
+        const app_tls_session_nvs_t *hdr = (const app_tls_session_nvs_t *)buf;
+        if (hdr->port == port && strncmp(hdr->host, host, sizeof(hdr->host)) == 0)
+        {
+            session = calloc(1, sizeof(esp_tls_client_session_t));
+        }
+    }
+    if (session)
+    {
+        mbedtls_ssl_session_init(&session->saved_session);
+        int ret = mbedtls_ssl_session_load(&session->saved_session, buf + sizeof(app_tls_session_nvs_t), len - sizeof(app_tls_session_nvs_t));
+        if (ret != 0)
+        {
+            // 固件升级后 mbedTLS 配置不同时无法读取, 下次完整握手后覆盖
+            ESP_LOGW(TAG, "%s:%d saved session unusable: -0x%04x", host, port, -ret);
+            esp_tls_free_client_session(session);
+            session = NULL;
+        }
+    }
+    free(buf);
+    nvs_close(handle);
+    return session;
+}
+
+static void app_tls_session_nvs_save(const char *host, int port, esp_tls_client_session_t *session)
+{
+    size_t len = 0;
+    mbedtls_ssl_session_save(&session->saved_session, NULL, 0, &len);
+    uint8_t *buf = len ? calloc(1, sizeof(app_tls_session_nvs_t) + len) : NULL;
+    if (NULL == buf)
+    {
+        return;
+    }
+    app_tls_session_nvs_t *hdr = (app_tls_session_nvs_t *)buf;
+    strlcpy(hdr->host, host, sizeof(hdr->host));
+    hdr->port = port;
+
+    char key[16];
+    app_tls_session_nvs_key(host, port, key, sizeof(key));
+    nvs_handle_t handle = 0;
+    esp_err_t err = ESP_FAIL;
+    if (mbedtls_ssl_session_save(&session->saved_session, buf + sizeof(app_tls_session_nvs_t), len, &len) == 0)
+    {
+        err = nvs_open(APP_TLS_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, key, buf, sizeof(app_tls_session_nvs_t) + len);
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    free(buf);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "%s:%d save session failed: %s", host, port, esp_err_to_name(err));
+    }
+}
+
+static void app_tls_session_nvs_erase(const char *host, int port)
+{
+    nvs_handle_t handle = 0;
+    if (nvs_open(APP_TLS_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        return;
+    }
+    if (host)
+    {
+        char key[16];
+        app_tls_session_nvs_key(host, port, key, sizeof(key));
+        nvs_erase_key(handle, key);
+    }
+    else
+    {
+        nvs_erase_all(handle);
+    }
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+#endif
+
+static int app_tls_poll(esp_transport_handle_t t, int timeout_ms, bool read)
+{
+    app_tls_transport_t *ctx = esp_transport_get_context_data(t);
+    int sockfd = -1;
+    if (NULL == ctx->tls || esp_tls_get_conn_sockfd(ctx->tls, &sockfd) != ESP_OK || sockfd < 0)
+    {
+        return -1;
+    }
+    // mbedtls 中可能还有已解密未读出的数据
+    if (read && esp_tls_get_bytes_avail(ctx->tls) > 0)
+    {
+        return 1;
+    }
+
+    // 分段等待, 其他任务调用 app_tls_session_abort() 后最多 APP_TLS_ABORT_POLL_MS 返回
+    int ret = 0;
+    while (!ctx->aborted)
+    {
+        int wait_ms = (timeout_ms < 0 || timeout_ms > APP_TLS_ABORT_POLL_MS) ? APP_TLS_ABORT_POLL_MS : timeout_ms;
+        fd_set fds;
+        fd_set errfds;
+        FD_ZERO(&fds);
+        FD_ZERO(&errfds);
+        FD_SET(sockfd, &fds);
+        FD_SET(sockfd, &errfds);
+        struct timeval tv = {
+            .tv_sec = wait_ms / 1000,
+            .tv_usec = (wait_ms % 1000) * 1000,
+        };
+        ret = select(sockfd + 1, read ? &fds : NULL, read ? NULL : &fds, &errfds, &tv);
+        if (ret > 0 && FD_ISSET(sockfd, &errfds))
+        {
+            return -1;
+        }
+        if (ret != 0)
+        {
+            return ret;
+        }
+        if (timeout_ms >= 0)
+        {
+            timeout_ms -= wait_ms;
+            if (timeout_ms <= 0)
+            {
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+static int app_tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    return app_tls_poll(t, timeout_ms, true);
+}
+
+static int app_tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return app_tls_poll(t, timeout_ms, false);
+}
+
+static int app_tls_close(esp_transport_handle_t t)
+{
+    app_tls_transport_t *ctx = esp_transport_get_context_data(t);
+    if (ctx->tls)
+    {
+        esp_tls_conn_destroy(ctx->tls);
+        ctx->tls = NULL;
+    }
+    return 0;
+}
+
+static int app_tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    app_tls_transport_t *ctx = esp_transport_get_context_data(t);
+    app_tls_close(t);
+    ESP_RETURN_ON_FALSE(!ctx->aborted, -1, TAG, "%s:%d aborted", host, port);
+
+    ctx->tls = esp_tls_init();
+    ESP_RETURN_ON_FALSE(NULL != ctx->tls, -1, TAG, "esp_tls_init failed");
+
+    esp_tls_cfg_t cfg = {
+        .crt_bundle_attach = ctx->crt_bundle_attach,
+        .cacert_buf = (const unsigned char *)ctx->cert_pem,
+        .cacert_bytes = ctx->cert_len,
+        .timeout_ms = timeout_ms,
+    };
+
+    // 取出缓存会话交给本次握手, 握手结束后由新会话替换
+    esp_tls_client_session_t *evicted = NULL;
+    portENTER_CRITICAL(&s_session_lock);
+    app_tls_session_entry_t *entry = app_tls_session_slot(host, port, &evicted);
+    cfg.client_session = entry->session;
+    entry->session = NULL;
+    bool load = !entry->loaded && NULL == cfg.client_session;
+    entry->loaded = true;
+    entry->last_used_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_session_lock);
+
+    if (evicted)
+    {
+        esp_tls_free_client_session(evicted);
+    }
+#if APP_TLS_SESSION_PERSIST
+    // 重启后第一次连接该主机时使用 NVS 中保存的会话
+    if (load)
+    {
+        cfg.client_session = app_tls_session_nvs_load(host, port);
+    }
+#else
+    (void)load;
+#endif
+
+    esp_tls_client_session_t *offered = cfg.client_session;
+    mbedtls_time_t offered_start = offered ? offered->saved_session.MBEDTLS_PRIVATE(start) : 0;
+    int64_t start = esp_timer_get_time();
+    int ret = esp_tls_conn_new_sync(host, strlen(host), port, &cfg, ctx->tls);
+    int64_t cost = esp_timer_get_time() - start;
+    if (offered)
+    {
+        esp_tls_free_client_session(offered);
+    }
+    if (ret <= 0)
+    {
+        ESP_LOGE(TAG, "%s:%d handshake failed", host, port);
+        esp_tls_conn_destroy(ctx->tls);
+        ctx->tls = NULL;
+        return -1;
+    }
+
+    // 建立时间只精确到秒, 完整握手与被替换的会话在同一秒内建立时会被误计为简短握手
+    bool resumed = offered && app_tls_session_start(ctx->tls) == offered_start;
+    esp_tls_client_session_t *session = esp_tls_get_client_session(ctx->tls);
+
+    portENTER_CRITICAL(&s_session_lock);
+    entry = app_tls_session_slot(host, port, &evicted);
+    esp_tls_client_session_t *old = entry->session;
+    entry->session = session;
+    entry->loaded = true;
+    if (offered)
+    {
+        s_stats.offered++;
+    }
+    if (resumed)
+    {
+        s_stats.resumed++;
+        s_stats.resumed_us += cost;
+    }
+    else
+    {
+        s_stats.full++;
+        s_stats.full_us += cost;
+    }
+    portEXIT_CRITICAL(&s_session_lock);
+
+    if (old)
+    {
+        esp_tls_free_client_session(old);
+    }
+    if (evicted)
+    {
+        esp_tls_free_client_session(evicted);
+    }
+#if APP_TLS_SESSION_PERSIST
+    // 只保存完整握手得到的新会话, 简短握手沿用的会话 NVS 中已经有了, 避免每次连接都写 flash
+    if (session && !resumed)
+    {
+        app_tls_session_nvs_save(host, port, session);
+    }
+#endif
+
+    app_tls_session_stats_t st;
+    app_tls_session_get_stats(&st);
+    ESP_LOGI(TAG, "%s:%d %s handshake %lld ms, resumed %" PRIu32 "/%" PRIu32 " offered",
+             host, port, resumed ? "resumed" : "full", cost / 1000, st.resumed, st.offered);
+    return 0;
+}
+
+static int app_tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    app_tls_transport_t *ctx = esp_transport_get_context_data(t);
+    int poll = app_tls_poll_read(t, timeout_ms);
+    if (poll <= 0)
+    {
+        return poll;
+    }
+
+    ssize_t ret = esp_tls_conn_read(ctx->tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE)
+    {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret == 0)
+    {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    return ret < 0 ? ERR_TCP_TRANSPORT_CONNECTION_FAILED : ret;
+}
+
+static int app_tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    app_tls_transport_t *ctx = esp_transport_get_context_data(t);
+    int poll = app_tls_poll_write(t, timeout_ms);
+    if (poll <= 0)
+    {
+        return poll;
+    }
+
+    ssize_t ret = esp_tls_conn_write(ctx->tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE)
+    {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    return ret < 0 ? ERR_TCP_TRANSPORT_CONNECTION_FAILED : ret;
+}
+
+static int app_tls_destroy(esp_transport_handle_t t)
+{
+    app_tls_close(t);
+    free(esp_transport_get_context_data(t));
+    esp_transport_set_context_data(t, NULL);
+    return 0;
+}
+
+esp_transport_handle_t app_tls_session_transport_new(esp_err_t (*crt_bundle_attach)(void *conf),
+                                                     const char *cert_pem, size_t cert_len)
+{
+    esp_transport_handle_t t = esp_transport_init();
+    ESP_RETURN_ON_FALSE(NULL != t, NULL, TAG, "esp_transport_init failed");
+
+    app_tls_transport_t *ctx = calloc(1, sizeof(app_tls_transport_t));
+    if (NULL == ctx)
+    {
+        esp_transport_destroy(t);
+        return NULL;
+    }
+    if (cert_pem)
+    {
+        ctx->cert_pem = cert_pem;
+        ctx->cert_len = cert_len ? cert_len : strlen(cert_pem) + 1;
+    }
+    ctx->crt_bundle_attach = crt_bundle_attach;
+    if (NULL == crt_bundle_attach && NULL == cert_pem)
+    {
+        ctx->crt_bundle_attach = esp_crt_bundle_attach;
+    }
+    esp_transport_set_context_data(t, ctx);
+    esp_transport_set_func(t, app_tls_connect, app_tls_read, app_tls_write, app_tls_close,
+                           app_tls_poll_read, app_tls_poll_write, app_tls_destroy);
+    esp_transport_set_default_port(t, 443);
+    return t;
+}
+
+void app_tls_session_abort(esp_transport_handle_t t, bool abort)
+{
+    app_tls_transport_t *ctx = t ? esp_transport_get_context_data(t) : NULL;
+    if (ctx)
+    {
+        ctx->aborted = abort;
+    }
+}
+
+void app_tls_session_forget(const char *host)
+{
+    for (int i = 0; i < APP_TLS_SESSION_MAX_HOSTS; i++)
+    {
+        esp_tls_client_session_t *session = NULL;
+        int port = 0;
+        bool found = false;
+        portENTER_CRITICAL(&s_session_lock);
+        app_tls_session_entry_t *e = &s_sessions[i];
+        if (e->host[0] && (NULL == host || strcmp(e->host, host) == 0))
+        {
+            session = e->session;
+            port = e->port;
+            found = true;
+            memset(e, 0, sizeof(app_tls_session_entry_t));
+        }
+        portEXIT_CRITICAL(&s_session_lock);
+        if (session)
+        {
+            esp_tls_free_client_session(session);
+        }
+#if APP_TLS_SESSION_PERSIST
+        if (found && host)
+        {
+            app_tls_session_nvs_erase(host, port);
+        }
+#else
+        (void)port;
+        (void)found;
+#endif
+    }
+#if APP_TLS_SESSION_PERSIST
+    if (NULL == host)
+    {
+        app_tls_session_nvs_erase(NULL, 0);
+    }
+#endif
+}
+
+#else
+
+esp_transport_handle_t app_tls_session_transport_new(esp_err_t (*crt_bundle_attach)(void *conf),
+                                                     const char *cert_pem, size_t cert_len)
+{
+    ESP_LOGW(TAG, "custom transport or session tickets disabled, TLS session cache unused");
+    return NULL;
+}
+
+void app_tls_session_abort(esp_transport_handle_t t, bool abort)
+{
+}
+
+void app_tls_session_forget(const char *host)
+{
+}
+
+static app_tls_session_stats_t s_stats;
+static portMUX_TYPE s_session_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#endif
+
+void app_tls_session_get_stats(app_tls_session_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_session_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_session_lock);
+}
+
+void app_tls_session_log_stats(void)
+{
+    app_tls_session_stats_t st;
+    app_tls_session_get_stats(&st);
+    ESP_LOGI(TAG, "tls: full %" PRIu32 " (avg %" PRIu64 " ms), resumed %" PRIu32 "/%" PRIu32 " offered, hit rate %" PRIu32 "%% (avg %" PRIu64 " ms)",
+             st.full, st.full ? st.full_us / st.full / 1000 : 0,
+             st.resumed, st.offered, st.offered ? st.resumed * 100 / st.offered : 0,
+             st.resumed ? st.resumed_us / st.resumed / 1000 : 0);
+}
@@ -0,0 +1,62 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_transport.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define APP_TLS_SESSION_MAX_HOSTS (4)
+#define APP_TLS_SESSION_PERSIST   (1) // 完整握手得到的会话保存到 NVS, 重启后第一次连接也能简短握手
+
+    typedef struct
+    {
+        uint32_t full;        // 完整握手次数
+        uint32_t offered;     // 携带缓存会话发起的握手次数
+        uint32_t resumed;     // 服务器接受了缓存会话(简短握手)
+        uint64_t full_us;     // 完整握手总耗时
+        uint64_t resumed_us;  // 简短握手总耗时
+    } app_tls_session_stats_t;
+
+    /**
+     * @brief 创建带 TLS 会话缓存的 esp_transport, 通过 esp_http_client_config_t.transport 使用.
+     *
+     * 每个主机在 RAM 中保存最近一次握手得到的会话(含 session ticket), 重新连接时交给 esp-tls
+     * 尝试简短握手, 省去证书链校验和密钥交换. APP_TLS_SESSION_PERSIST 为 1 时完整握手得到的会话
+     * 用 mbedtls_ssl_session_save() 序列化后写入 NVS, 重启后第一次连接该主机时读出使用. 返回的 transport 由调用者在 esp_http_client_cleanup() 之后销毁.
+     * 未开启 CONFIG_ESP_HTTP_CLIENT_ENABLE_CUSTOM_TRANSPORT 或 CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS 时返回 NULL.
+     *
+     * @param crt_bundle_attach 证书包, 与 cert_pem 都为 NULL 时使用 esp_crt_bundle_attach
+     * @param cert_pem 服务器 CA 证书, 需要在 transport 销毁前一直有效
+     * @param cert_len cert_pem 的长度, 0 表示 PEM 字符串, 按 strlen + 1 计算
+     */
+    esp_transport_handle_t app_tls_session_transport_new(esp_err_t (*crt_bundle_attach)(void *conf),
+                                                         const char *cert_pem, size_t cert_len);
+
+    /**
+     * @brief 中止或恢复 transport 上的读写, 可以在其他任务中调用.
+     *
+     * 中止后正在等待的读写最多 50 ms 内返回错误, 之后的建立连接和读写都直接失败, 直到以 false 再次调用.
+     * 只设置标志, 连接由使用者的任务自己关闭.
+     */
+    void app_tls_session_abort(esp_transport_handle_t t, bool abort);
+
+    /// @brief 丢弃某个主机的缓存会话 (包括 NVS 中保存的), host 为 NULL 时清空全部
+    void app_tls_session_forget(const char *host);
+
+    void app_tls_session_get_stats(app_tls_session_stats_t *stats);
+    void app_tls_session_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
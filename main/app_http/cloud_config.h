@@ -0,0 +1,45 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+/**
+ * 云端服务地址.
+ *
+ * CLOUD_MOCK_ENABLE 为 1 时所有请求发往 tools/mock_cloud 的本地模拟服务,
+ * 用于在没有真实 API Key 的情况下重复测量语音流水线的延迟.
+ * CLOUD_MOCK_TLS 为 1 时走 HTTPS (mock_cloud.py --tls), 服务器证书为 CLOUD_MOCK_CERT_PEM,
+ * 与 app_http_pool.h 的 APP_HTTP_POOL_ENABLE 配合可以对比连接池在 TLS 下省下的握手时间.
+ */
+#define CLOUD_MOCK_ENABLE  (0)
+#define CLOUD_MOCK_TLS     (0)
+#define CLOUD_MOCK_HOST    "192.168.1.100:8000" // 运行 mock_cloud.py 的电脑地址
+
+#if CLOUD_MOCK_TLS
+#define CLOUD_MOCK_BASE "https://" CLOUD_MOCK_HOST
+// 替换为 mock_cloud.py --tls --tls-name <电脑的IP> 启动时打印的定义
+#define CLOUD_MOCK_CERT_PEM \
+    "-----BEGIN CERTIFICATE-----\n" \
+    "-----END CERTIFICATE-----\n"
+#else
+#define CLOUD_MOCK_BASE "http://" CLOUD_MOCK_HOST
+#endif
+
+#if CLOUD_MOCK_ENABLE
+#define CLOUD_BAIDU_AUTH_URL CLOUD_MOCK_BASE "/oauth/2.0/token?grant_type=client_credentials"
+#define CLOUD_BAIDU_ASR_URL  CLOUD_MOCK_BASE "/server_api"
+#define CLOUD_BAIDU_TTS_URL  CLOUD_MOCK_BASE "/text2audio"
+#define CLOUD_CHAT_URL       CLOUD_MOCK_BASE "/v1/chat/completions"
+#define CLOUD_CHAT_KIMI_URL    CLOUD_MOCK_BASE "/v1/chat/completions"
+#define CLOUD_CHAT_CLOSEAI_URL CLOUD_MOCK_BASE "/v1/chat/completions"
+#else
+#define CLOUD_BAIDU_AUTH_URL "https://aip.baidubce.com/oauth/2.0/token?grant_type=client_credentials"
+#define CLOUD_BAIDU_ASR_URL  "http://vop.baidu.com/server_api"
+#define CLOUD_BAIDU_TTS_URL  "http://tsn.baidu.com/text2audio"
+#define CLOUD_CHAT_URL       "https://api.deepseek.com/v1/chat/completions"
+#define CLOUD_CHAT_KIMI_URL    "https://api.moonshot.cn/v1/chat/completions"
+#define CLOUD_CHAT_CLOSEAI_URL "https://api.closeai-proxy.xyz/v1/chat/completions"
+#endif
@@ -0,0 +1,235 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "http_arena.h"
+
+static const char *TAG = "http_arena";
+
+#define HTTP_ARENA_ALIGN(x) (((x) + 3) & ~(size_t)3)
+
+struct http_arena_chunk
+{
+    struct http_arena_chunk *next;
+    size_t size;
+    size_t used;
+    uint8_t data[];
+};
+
+static http_arena_chunk_t *http_arena_chunk_new(http_arena_t *arena, size_t size)
+{
+    size = size > arena->chunk_size ? size : arena->chunk_size;
+    http_arena_chunk_t *chunk = heap_caps_malloc(sizeof(http_arena_chunk_t) + size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (chunk == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate %zu bytes", size);
+        return NULL;
+    }
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    return chunk;
+}
+
+void http_arena_init(http_arena_t *arena, size_t chunk_size)
+{
+    memset(arena, 0, sizeof(http_arena_t));
+    arena->chunk_size = chunk_size ? chunk_size : HTTP_ARENA_CHUNK_SIZE;
+}
+
+void http_arena_reset(http_arena_t *arena)
+{
+    // 只保留最大的块, 稳定后每次请求不再申请内存
+    http_arena_chunk_t *keep = NULL;
+    for (http_arena_chunk_t *c = arena->chunks; c; c = c->next)
+    {
+        if (keep == NULL || c->size > keep->size)
+        {
+            keep = c;
+        }
+    }
+    http_arena_chunk_t *c = arena->chunks;
+    while (c)
+    {
+        http_arena_chunk_t *next = c->next;
+        if (c != keep)
+        {
+            free(c);
+        }
+        c = next;
+    }
+    if (keep)
+    {
+        keep->used = 0;
+        keep->next = NULL;
+    }
+    arena->chunks = keep;
+    arena->body_off = 0;
+    arena->body_len = 0;
+    arena->body_open = false;
+    arena->overflow = false;
+}
+
+void http_arena_free(http_arena_t *arena)
+{
+    http_arena_chunk_t *c = arena->chunks;
+    while (c)
+    {
+        http_arena_chunk_t *next = c->next;
+        free(c);
+        c = next;
+    }
+    arena->chunks = NULL;
+    arena->body_open = false;
+}
+
+void *http_arena_alloc(http_arena_t *arena, size_t size)
+{
+    if (arena->body_open)
+    {
+        ESP_LOGE(TAG, "alloc while body is open");
+        return NULL;
+    }
+    size = HTTP_ARENA_ALIGN(size);
+    http_arena_chunk_t *chunk = arena->chunks;
+    if (chunk == NULL || chunk->size - chunk->used < size)
+    {
+        chunk = http_arena_chunk_new(arena, size);
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+    }
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+char *http_arena_strdup(http_arena_t *arena, const char *str)
+{
+    size_t len = strlen(str);
+    char *copy = http_arena_alloc(arena, len + 1);
+    if (copy)
+    {
+        memcpy(copy, str, len + 1);
+    }
+    return copy;
+}
+
+void http_arena_body_begin(http_arena_t *arena)
+{
+    if (arena->body_open && arena->chunks)
+    {
+        // 丢弃未完成的响应体
+        arena->chunks->used = arena->body_off;
+    }
+    arena->body_off = arena->chunks ? arena->chunks->used : 0;
+    arena->body_len = 0;
+    arena->body_open = true;
+    arena->overflow = false;
+}
+
+esp_err_t http_arena_body_append(http_arena_t *arena, const void *data, size_t len)
+{
+    if (!arena->body_open)
+    {
+        http_arena_body_begin(arena);
+    }
+    if (arena->overflow)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    http_arena_chunk_t *chunk = arena->chunks;
+    size_t need = arena->body_len + len + 1; // 预留 '\0'
+    if (chunk == NULL || chunk->size - arena->body_off < need)
+    {
+        // 响应体必须连续, 搬到一个足够大的新块中, 按两倍增长减少搬移次数
+        http_arena_chunk_t *old = chunk;
+        chunk = http_arena_chunk_new(arena, need * 2);
+        if (chunk == NULL)
+        {
+            arena->overflow = true;
+            return ESP_ERR_NO_MEM;
+        }
+        if (old)
+        {
+            memcpy(chunk->data, old->data + arena->body_off, arena->body_len);
+            old->used = arena->body_off;
+        }
+        arena->body_off = 0;
+    }
+
+    memcpy(chunk->data + arena->body_off + arena->body_len, data, len);
+    arena->body_len += len;
+    chunk->used = arena->body_off + arena->body_len;
+    return ESP_OK;
+}
+
+char *http_arena_body_end(http_arena_t *arena, size_t *len)
+{
+    if (!arena->body_open)
+    {
+        http_arena_body_begin(arena);
+    }
+    // 空响应也返回一个空字符串
+    if (arena->body_len == 0 && http_arena_body_append(arena, "", 0) != ESP_OK)
+    {
+        arena->body_open = false;
+        return NULL;
+    }
+
+    arena->body_open = false;
+    if (arena->overflow)
+    {
+        return NULL;
+    }
+    http_arena_chunk_t *chunk = arena->chunks;
+    char *body = (char *)chunk->data + arena->body_off;
+    body[arena->body_len] = '\0';
+    chunk->used = HTTP_ARENA_ALIGN(arena->body_off + arena->body_len + 1);
+    if (chunk->used > chunk->size)
+    {
+        chunk->used = chunk->size;
+    }
+    if (len)
+    {
+        *len = arena->body_len;
+    }
+    return body;
+}
+
+esp_err_t http_arena_event_handler(esp_http_client_event_t *evt)
+{
+    http_arena_t *arena = (http_arena_t *)evt->user_data;
+    if (arena == NULL)
+    {
+        return ESP_OK;
+    }
+
+    switch (evt->event_id)
+    {
+    case HTTP_EVENT_ON_CONNECTED:
+        http_arena_body_begin(arena);
+        break;
+    case HTTP_EVENT_ON_DATA:
+        ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=(%zu + %d)", arena->body_len, evt->data_len);
+        if (http_arena_body_append(arena, evt->data, evt->data_len) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "response truncated at %zu bytes", arena->body_len);
+        }
+        break;
+    default:
+        break;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,67 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define HTTP_ARENA_CHUNK_SIZE (4 * 1024) // 默认块大小, 响应更大时按需加倍
+
+    typedef struct http_arena_chunk http_arena_chunk_t;
+
+    /**
+     * @brief 每个请求一个的 PSRAM 线性分配器.
+     *
+     * 响应体通过 http_arena_body_begin()/append()/end() 连续写入, 空间不够时申请更大的块并搬移,
+     * 不会截断; end() 返回以 '\0' 结尾的完整响应体, 可以直接交给解析器. 解析结果(字符串等)
+     * 也从同一个 arena 分配, 下一个请求开始前调用一次 http_arena_reset() 整体回收,
+     * 保留最大的块以免每次请求重新申请内存.
+     */
+    typedef struct
+    {
+        http_arena_chunk_t *chunks;  // 当前块在链表头
+        size_t chunk_size;
+        size_t body_off;             // 正在写入的响应体在当前块中的偏移
+        size_t body_len;
+        bool body_open;
+        bool overflow;               // 内存不足, 响应体不完整
+    } http_arena_t;
+
+    void http_arena_init(http_arena_t *arena, size_t chunk_size);
+
+    /// @brief 回收本次请求的全部分配, 之前返回的指针全部失效
+    void http_arena_reset(http_arena_t *arena);
+
+    /// @brief 释放全部内存
+    void http_arena_free(http_arena_t *arena);
+
+    void *http_arena_alloc(http_arena_t *arena, size_t size);
+    char *http_arena_strdup(http_arena_t *arena, const char *str);
+
+    /// @brief 开始写入响应体, 丢弃尚未结束的上一个响应体
+    void http_arena_body_begin(http_arena_t *arena);
+    esp_err_t http_arena_body_append(http_arena_t *arena, const void *data, size_t len);
+    /// @brief 结束响应体, 返回以 '\0' 结尾的内容, 内存不足截断过时返回 NULL
+    char *http_arena_body_end(http_arena_t *arena, size_t *len);
+
+    /**
+     * @brief 通用的 esp_http_client 事件处理函数, user_data 为 http_arena_t, 把响应体写入 arena.
+     *
+     * 在 HTTP_EVENT_ON_CONNECTED 时重新开始响应体, 连接池重连重试时丢弃上一次收到的部分数据.
+     */
+    esp_err_t http_arena_event_handler(esp_http_client_event_t *evt);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,5 +4,6 @@
 #include "settings.h"
 
 void app_uart_init(void);
+void appUartSetHidMode(uint8_t cmd);
 
 #endif /* APP_UART_H_ */
\ No newline at end of file
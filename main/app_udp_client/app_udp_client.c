@@ -15,7 +15,9 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
@@ -24,6 +26,7 @@
 
 #include "app_wifi.h"
 #include "app_udp_client.h"
+#include "key_link.h"
 
 static const char *TAG = "UPD CLIENT";
 
@@ -31,6 +34,9 @@ static const char *TAG = "UPD CLIENT";
 #define CONFIG_EXAMPLE_IPV4_ADDR "255.255.255.255"
 #define CONFIG_EXAMPLE_PORT      3333
 
+#define UDP_PEER_NVS_NAMESPACE   "udp_peer"
+#define UDP_PEER_NVS_KEY         "ip"
+
 #if defined(CONFIG_EXAMPLE_IPV4)
 #define HOST_IP_ADDR CONFIG_EXAMPLE_IPV4_ADDR
 #elif defined(CONFIG_EXAMPLE_IPV6)
@@ -48,6 +54,118 @@ static struct sockaddr_in  sg_dest_addr = {0};
 static struct sockaddr_in6 sg_dest_addr = {0};
 #endif
 
+// 按键状态的副本和心跳, 只在 keyboard_tx 任务中访问
+static key_link_tx_t sg_link;
+static bool sg_link_inited = false;
+
+// 配对的接收器, 以下变量也只在 keyboard_tx 任务中访问
+static uint32_t sg_peer_ip = 0;         // 网络字节序, 0 表示没有配对, 发送广播
+static uint32_t sg_peer_saved = 0;      // NVS 中保存的地址
+static int64_t sg_peer_reply_us = 0;    // 最后一次收到接收器回复的时间
+static int64_t sg_discover_us = 0;      // 下一次广播 DISCOVER 的时间
+
+static void app_udp_client_peer_load(void)
+{
+    nvs_handle_t handle = 0;
+    if (nvs_open(UDP_PEER_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return;
+    }
+    if (nvs_get_u32(handle, UDP_PEER_NVS_KEY, &sg_peer_saved) == ESP_OK && sg_peer_saved)
+    {
+        // 先直接单播, 接收器在 KEY_LINK_PEER_TIMEOUT_US 内没有回复再回到广播
+        sg_peer_ip = sg_peer_saved;
+        sg_peer_reply_us = esp_timer_get_time();
+        ESP_LOGI(TAG, "paired receiver " IPSTR, IP2STR((esp_ip4_addr_t *)&sg_peer_ip));
+    }
+    nvs_close(handle);
+}
+
+static void app_udp_client_peer_save(uint32_t ip)
+{
+    if (ip == sg_peer_saved)
+    {
+        return;
+    }
+    nvs_handle_t handle = 0;
+    esp_err_t err = nvs_open(UDP_PEER_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_u32(handle, UDP_PEER_NVS_KEY, ip);
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error (%s) saving receiver address!", esp_err_to_name(err));
+        return;
+    }
+    sg_peer_saved = ip;
+}
+
+static void app_udp_client_link_init(void)
+{
+    if (!sg_link_inited)
+    {
+        key_link_tx_init(&sg_link);
+        app_udp_client_peer_load();
+        sg_link_inited = true;
+    }
+}
+
+/// @brief 配对后单播, 走正常速率并有 MAC 层重传; 没有配对时广播
+static void app_udp_client_set_dest(void)
+{
+    sg_dest_addr.sin_addr.s_addr = sg_peer_ip ? sg_peer_ip : inet_addr(HOST_IP_ADDR);
+}
+
+/// @brief 读取接收器的回复, 没有配对时和第一个 ANNOUNCE 的接收器配对; 配对的接收器发来的任何有效帧都说明它在线
+static void app_udp_client_recv(int64_t now_us)
+{
+    uint8_t buffer[32];
+    struct sockaddr_in source_addr;
+    socklen_t socklen = sizeof(source_addr);
+    key_frame_t frame;
+    int len;
+    while ((len = recvfrom(sg_sock, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr *)&source_addr, &socklen)) > 0)
+    {
+        socklen = sizeof(source_addr);
+        if (!key_link_frame_parse(buffer, len, &frame))
+        {
+            continue;
+        }
+        if (sg_peer_ip == 0 && frame.type == KEY_FRAME_ANNOUNCE)
+        {
+            sg_peer_ip = source_addr.sin_addr.s_addr;
+            app_udp_client_set_dest();
+            ESP_LOGI(TAG, "paired with receiver " IPSTR, IP2STR((esp_ip4_addr_t *)&sg_peer_ip));
+            // 只在配对或接收器地址改变时写一次 flash
+            app_udp_client_peer_save(sg_peer_ip);
+        }
+        if (source_addr.sin_addr.s_addr == sg_peer_ip)
+        {
+            sg_peer_reply_us = now_us;
+        }
+    }
+}
+
+static void app_udp_client_send_frame(const key_frame_t *frame)
+{
+    // 只在 keyboard_tx 任务中调用, 套接字由该任务独占, 不需要 wifi 锁
+    int err = sendto(sg_sock, frame, sizeof(key_frame_t), 0, (struct sockaddr *)&sg_dest_addr, sizeof(sg_dest_addr));
+    if (err < 0)
+    {
+        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+        ESP_LOGE(TAG, "Shutting down socket and restarting...");
+        shutdown(sg_sock, 0);
+        close(sg_sock);
+        sg_sock = -1;
+    }
+}
+
 /// @brief 创建 UDP 客户端套接字
 /// @param
 static void app_udp_client_create_socket(void)
@@ -56,7 +174,7 @@ static void app_udp_client_create_socket(void)
         return;
 
 #if defined(CONFIG_EXAMPLE_IPV4)
-    sg_dest_addr.sin_addr.s_addr = inet_addr(HOST_IP_ADDR);
+    app_udp_client_set_dest();
     sg_dest_addr.sin_family = AF_INET;
     sg_dest_addr.sin_port = htons(CONFIG_EXAMPLE_PORT);
     sg_addr_family = AF_INET;
@@ -83,47 +201,68 @@ static void app_udp_client_create_socket(void)
     ESP_LOGI(TAG, "Socket created, sending to %s:%d", HOST_IP_ADDR, CONFIG_EXAMPLE_PORT);
 }
 
-/// @brief udp client 发送数据
-/// @param data
-/// @param len
-void app_udp_client_send_data(uint8_t *data, int len)
+/// @brief 发送到期的帧(状态变化的副本, 心跳, DISCOVER), 处理接收器的回复
+/// @return 距下一帧的毫秒数
+uint32_t app_udp_client_poll(void)
 {
-    if (app_wifi_connected_already() != WIFI_STATUS_CONNECTED_OK)
-        return;
+    app_udp_client_link_init();
 
-    app_udp_client_create_socket();
-    if (sg_sock == -1)
-        return;
+    key_frame_t frame;
+    int64_t wait_us = 0;
+    bool online = app_wifi_connected_already() == WIFI_STATUS_CONNECTED_OK;
+    if (online)
+    {
+        app_udp_client_create_socket();
+        online = sg_sock != -1;
+    }
+    int64_t now = esp_timer_get_time();
+    if (online)
+    {
+        app_udp_client_recv(now);
+        if (sg_peer_ip && now - sg_peer_reply_us > KEY_LINK_PEER_TIMEOUT_US)
+        {
+            // 接收器没有回复, 可能已关机或换了地址, 回到广播重新寻找
+            ESP_LOGW(TAG, "receiver " IPSTR " silent, back to broadcast", IP2STR((esp_ip4_addr_t *)&sg_peer_ip));
+            sg_peer_ip = 0;
+            sg_discover_us = now;
+            app_udp_client_set_dest();
+        }
+    }
 
-    if (len > 8)
-        return;
-    
-    // 按键状态改变, 发送数据
-    uint8_t key_changed = 0;
-    static uint8_t key_buffer_last[8] = {0};
-    uint8_t key_buffer[8] = {0};
-    memcpy(key_buffer, data, len);
-    for (uint8_t i = 0; i < 8; i++)
+    while (key_link_tx_next(&sg_link, now, &frame, &wait_us))
     {
-        if (key_buffer[i] != key_buffer_last[i])
-            key_changed++;
+        if (online && sg_sock != -1)
+        {
+            app_udp_client_send_frame(&frame);
+        }
     }
-    if (key_changed == 0)
-        return;
-    memcpy(key_buffer_last, key_buffer, sizeof(key_buffer));
 
-    app_wifi_lock(0);
-    int err = sendto(sg_sock, (const uint8_t *)key_buffer, sizeof(key_buffer), 0, (struct sockaddr *)&sg_dest_addr, sizeof(sg_dest_addr));
-    app_wifi_unlock();
-    if (err < 0)
+    if (online && sg_sock != -1 && sg_peer_ip == 0)
     {
-        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
-        if (sg_sock != -1)
+        if (now >= sg_discover_us)
         {
-            ESP_LOGE(TAG, "Shutting down socket and restarting...");
-            shutdown(sg_sock, 0);
-            close(sg_sock);
-            sg_sock = -1;
+            key_link_frame_init(&frame, KEY_FRAME_DISCOVER, sg_link.seq, now);
+            app_udp_client_send_frame(&frame);
+            sg_discover_us = now + KEY_LINK_DISCOVER_US;
         }
+        wait_us = MIN(wait_us, sg_discover_us - now);
+    }
+    return (wait_us + 999) / 1000;
+}
+
+/// @brief udp client 发送数据
+/// @param data
+/// @param len
+void app_udp_client_send_data(uint8_t *data, int len)
+{
+    if (len > KEY_LINK_REPORT_LEN)
+        return;
+
+    app_udp_client_link_init();
+
+    // 按键状态改变, 立即发送第一帧, 副本和心跳由 app_udp_client_poll 发送
+    if (key_link_tx_update(&sg_link, data, len, esp_timer_get_time()))
+    {
+        app_udp_client_poll();
     }
-}
\ No newline at end of file
+}
@@ -1,6 +1,12 @@
 #ifndef APP_UDP_H
 #define APP_UDP_H
 
+#include <stdint.h>
+
+/// @brief 提交新的按键状态, 状态改变时立即发送
 void app_udp_client_send_data(uint8_t *data, int len);
 
+/// @brief 发送到期的副本和心跳, 返回距下一帧的毫秒数; 与 app_udp_client_send_data 在同一任务中调用
+uint32_t app_udp_client_poll(void);
+
 #endif /* APP_UDP_H */
\ No newline at end of file
@@ -14,12 +14,18 @@
 #include "esp_check.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_timer.h"
+#include "esp_netif_sntp.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
 #include "app_wifi.h"
+#include "wifi_power.h"
 #include "baidu_api.h"
+#include "llm_provider.h"
+#include "settings.h"
 
 #define SSID     "ssid"
 #define PASSWORD "password"
@@ -51,6 +57,18 @@
 
 #define CONFIG_ESPNOW_CHANNEL 1
 
+// 上次连接的 AP, 开机时直接在该信道上连接该 BSSID, 不做全信道扫描
+#define WIFI_FAST_CONNECT_ENABLE (1)
+#define WIFI_FAST_NVS_NAMESPACE  "wifi_fast"
+#define WIFI_FAST_NVS_KEY        "ap"
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_fast_cache_t;
+
 /* FreeRTOS event group to signal when we are connected*/
 static EventGroupHandle_t s_wifi_event_group;
 
@@ -67,14 +85,25 @@ static const char *TAG = "wifi station";
 static int s_retry_num = 0;
 static bool s_reconnect = true;
 static bool s_wifi_connected = false;
+static bool s_wifi_started = false; // 收到 WIFI_EVENT_STA_START 后才能使用 ESP-NOW
 
 static QueueHandle_t wifi_event_queue = NULL;
 
+static wifi_fast_cache_t s_fast_cache;
+static bool s_fast_connecting = false;  // 正在用缓存的 BSSID/信道连接, 失败时改为扫描后连接
+static bool s_fast_used = false;
+static int64_t s_wifi_start_us = 0;
+
 scan_info_t scan_info_result = {
     .scan_done = WIFI_SCAN_IDLE,
     .ap_count = 0,
 };
 
+bool app_wifi_started(void)
+{
+    return s_wifi_started;
+}
+
 WiFi_Connect_Status app_wifi_connected_already(void)
 {
     WiFi_Connect_Status status;
@@ -121,6 +150,150 @@ esp_err_t send_network_event(net_event_t event)
     return ESP_OK;
 }
 
+static void wifi_scan(void);
+
+/// @brief ESP-NOW 模式下键盘固定在接收器的信道上, 全信道扫描和反复重连都会把射频切走
+static bool wifi_espnow_mode(void)
+{
+    return settings_get_parameter()->mode_hid == MODE_HID_ESPNOW;
+}
+
+static void wifi_sta_config_default(wifi_config_t *wifi_config)
+{
+    memset(wifi_config, 0, sizeof(wifi_config_t));
+    memcpy(wifi_config->sta.ssid, (char *)SSID, strlen((char *)SSID));
+    memcpy(wifi_config->sta.password, (char *)PASSWORD, strlen((char *)PASSWORD));
+}
+
+/**
+ * @brief 写入 STA 配置, 与已保存的配置相同时跳过.
+ *
+ * 配置保存在 flash 中 (WIFI_STORAGE_FLASH), 每次 esp_wifi_set_config 都会写 flash.
+ * @param ssid_only 只比较 SSID 和密码, 保留已保存的 BSSID 和信道
+ */
+static void wifi_sta_config_apply(const wifi_config_t *wifi_config, bool ssid_only)
+{
+    wifi_config_t stored;
+    if (esp_wifi_get_config(WIFI_IF_STA, &stored) == ESP_OK &&
+        memcmp(stored.sta.ssid, wifi_config->sta.ssid, sizeof(stored.sta.ssid)) == 0 &&
+        memcmp(stored.sta.password, wifi_config->sta.password, sizeof(stored.sta.password)) == 0 &&
+        (ssid_only ||
+         (stored.sta.bssid_set == wifi_config->sta.bssid_set &&
+          (!wifi_config->sta.bssid_set || memcmp(stored.sta.bssid, wifi_config->sta.bssid, sizeof(stored.sta.bssid)) == 0) &&
+          stored.sta.channel == wifi_config->sta.channel &&
+          stored.sta.scan_method == wifi_config->sta.scan_method)))
+    {
+        return;
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, (wifi_config_t *)wifi_config));
+}
+
+static bool wifi_fast_cache_load(void)
+{
+    nvs_handle_t handle = 0;
+    size_t len = sizeof(s_fast_cache);
+    bool valid = false;
+    if (nvs_open(WIFI_FAST_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        valid = (nvs_get_blob(handle, WIFI_FAST_NVS_KEY, &s_fast_cache, &len) == ESP_OK && len == sizeof(s_fast_cache));
+        nvs_close(handle);
+    }
+    // 更换了 SSID 的缓存不能用
+    uint8_t ssid[32] = {0};
+    memcpy(ssid, SSID, strlen(SSID));
+    return valid && s_fast_cache.channel != 0 && memcmp(ssid, s_fast_cache.ssid, sizeof(ssid)) == 0;
+}
+
+static void wifi_fast_cache_write(const wifi_fast_cache_t *cache)
+{
+    nvs_handle_t handle = 0;
+    esp_err_t err = nvs_open(WIFI_FAST_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+        return;
+    }
+    if (cache)
+    {
+        err = nvs_set_blob(handle, WIFI_FAST_NVS_KEY, cache, sizeof(wifi_fast_cache_t));
+    }
+    else
+    {
+        err = nvs_erase_key(handle, WIFI_FAST_NVS_KEY);
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+    {
+        ESP_LOGE(TAG, "Error (%s) writing AP cache!", esp_err_to_name(err));
+    }
+}
+
+/// @brief 连接成功后记录 AP 的 BSSID 和信道, 没有变化时不写 flash
+static void wifi_fast_cache_update(void)
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+    {
+        return;
+    }
+    wifi_fast_cache_t cache = {0};
+    memcpy(cache.ssid, ap.ssid, sizeof(cache.ssid));
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    cache.channel = ap.primary;
+    if (memcmp(&cache, &s_fast_cache, sizeof(cache)) == 0)
+    {
+        return;
+    }
+    s_fast_cache = cache;
+    wifi_fast_cache_write(&cache);
+    ESP_LOGI(TAG, "cache AP " MACSTR " on channel %d", MAC2STR(cache.bssid), cache.channel);
+}
+
+/// @brief 用缓存的 BSSID 和信道直接连接, 没有缓存时返回 false
+static bool wifi_fast_connect(void)
+{
+    if (!WIFI_FAST_CONNECT_ENABLE || !wifi_fast_cache_load())
+    {
+        return false;
+    }
+
+    wifi_config_t wifi_config;
+    wifi_sta_config_default(&wifi_config);
+    memcpy(wifi_config.sta.bssid, s_fast_cache.bssid, sizeof(wifi_config.sta.bssid));
+    wifi_config.sta.bssid_set = true;
+    wifi_config.sta.channel = s_fast_cache.channel;
+    wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+    wifi_sta_config_apply(&wifi_config, false);
+
+    ESP_LOGI(TAG, "fast connect to " MACSTR " on channel %d", MAC2STR(s_fast_cache.bssid), s_fast_cache.channel);
+    s_fast_connecting = true;
+    s_fast_used = true;
+    esp_wifi_connect();
+    return true;
+}
+
+/// @brief 全信道扫描后按 SSID 连接
+static void wifi_scan_connect(void)
+{
+    if (s_fast_used)
+    {
+        // 缓存的 AP 连不上, 作废, 连接成功后重新记录
+        memset(&s_fast_cache, 0, sizeof(s_fast_cache));
+        wifi_fast_cache_write(NULL);
+    }
+    wifi_config_t wifi_config;
+    wifi_sta_config_default(&wifi_config);
+    wifi_sta_config_apply(&wifi_config, false);
+    s_fast_used = false;
+    wifi_scan();
+    esp_wifi_connect();
+    s_wifi_connected = false;
+}
+
 /* Initialize Wi-Fi as sta and set scan method */
 static void wifi_scan(void)
 {
@@ -159,12 +332,45 @@ static void event_handler(void *arg, esp_event_base_t event_base,
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
     {
-        send_network_event(NET_EVENT_POWERON_SCAN);
-        ESP_LOGI(TAG, "start connect to the AP");
+        s_wifi_started = true;
+        if (wifi_espnow_mode() && !wifi_fast_cache_load())
+        {
+            // 没有连接过 AP, 不扫描, 信道由 ESP-NOW 决定
+            s_reconnect = false;
+            ESP_LOGI(TAG, "ESP-NOW mode without a stored AP, stay on the ESP-NOW channel");
+        }
+        else
+        {
+            send_network_event(NET_EVENT_FAST_CONNECT);
+            ESP_LOGI(TAG, "start connect to the AP");
+        }
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
-        if (s_reconnect)
+        if (s_fast_connecting)
+        {
+            // AP 换了信道或已不存在, 改为扫描后连接
+            wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+            s_fast_connecting = false;
+            if (wifi_espnow_mode())
+            {
+                // 不做全信道扫描, 只在缓存的信道上重试有限次数
+                ESP_LOGW(TAG, "fast connect failed, reason %d, ESP-NOW mode, no scan", event->reason);
+                esp_wifi_connect();
+                ++s_retry_num;
+            }
+            else
+            {
+                ESP_LOGW(TAG, "fast connect failed, reason %d, fall back to scan", event->reason);
+                send_network_event(NET_EVENT_POWERON_SCAN);
+            }
+        }
+        else if (s_reconnect && wifi_espnow_mode() && s_retry_num >= APP_ESP_MAXIMUM_RETRY)
+        {
+            // 连不上 AP 时停止重连, 每次重连都会离开 ESP-NOW 的信道
+            ESP_LOGW(TAG, "sta disconnected, ESP-NOW mode, stop retrying after %d attempts", s_retry_num);
+        }
+        else if (s_reconnect)
         {
             esp_wifi_connect();
             ESP_LOGI(TAG, "sta disconnect, retry attempt %d...", ++s_retry_num);
@@ -182,9 +388,16 @@ static void event_handler(void *arg, esp_event_base_t event_base,
         wifi_second_chan_t second = 0;
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        int64_t now = esp_timer_get_time();
+        ESP_LOGI(TAG, "connected %lld ms after boot, %lld ms after wifi start (%s)", now / 1000,
+                 (now - s_wifi_start_us) / 1000, s_fast_used ? "cached AP" : "full scan");
+        s_fast_connecting = false;
         s_retry_num = 0;
         s_wifi_connected = true;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        send_network_event(NET_EVENT_CONNECTED);
+        // 校时后才能判断 token 是否到期
+        send_network_event(NET_EVENT_NTP);
     }
 }
 
@@ -192,9 +405,8 @@ static void wifi_reconnect_sta(void)
 {
     int bits = xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, 0, 1, 0);
 
-    wifi_config_t wifi_config = {0};
-    memcpy(wifi_config.sta.ssid, (char *)SSID, strlen((char *)SSID));
-    memcpy(wifi_config.sta.password, (char *)PASSWORD, strlen((char *)PASSWORD));
+    wifi_config_t wifi_config;
+    wifi_sta_config_default(&wifi_config);
 
     if (bits & WIFI_CONNECTED_BIT)
     {
@@ -207,7 +419,7 @@ static void wifi_reconnect_sta(void)
     s_reconnect = true;
     s_retry_num = 0;
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    wifi_sta_config_apply(&wifi_config, false);
     esp_wifi_connect();
 
     ESP_LOGI(TAG, "wifi_reconnect_sta finished.%s, %s", wifi_config.sta.ssid, wifi_config.sta.password);
@@ -262,18 +474,39 @@ static void wifi_init_sta(void)
                                                         NULL,
                                                         NULL)); // &instance_got_ip
 
-    wifi_config_t wifi_config = {0};
-    memcpy(wifi_config.sta.ssid, (char *)SSID, strlen((char *)SSID));
-    memcpy(wifi_config.sta.password, (char *)PASSWORD, strlen((char *)PASSWORD));
-    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+    // 配置保存在 flash 中, 驱动同时缓存由密码计算出的 PMK, 开机连接时不用重新计算
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_FLASH));
+    // 已保存的 SSID 相同时不写 flash, 保留上次的 BSSID 配置, 快速连接时配置不变也不会再写
+    wifi_config_t wifi_config;
+    wifi_sta_config_default(&wifi_config);
+    wifi_sta_config_apply(&wifi_config, true);
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+    s_wifi_start_us = esp_timer_get_time();
     ESP_ERROR_CHECK(esp_wifi_start());
+    // 空闲时切换到 modem sleep, 有按键或语音时立即切回 PS_NONE
+    ESP_ERROR_CHECK_WITHOUT_ABORT(wifi_power_init());
 
     ESP_LOGI(TAG, "wifi_init_sta finished.%s, %s", wifi_config.sta.ssid, wifi_config.sta.password);
 }
 
+static void wifi_sntp_start(void)
+{
+    static bool started = false;
+    if (started)
+    {
+        return;
+    }
+
+    // 校时在后台进行, 不阻塞网络任务
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG("cn.pool.ntp.org");
+    config.wait_for_sync = false;
+    if (esp_netif_sntp_init(&config) == ESP_OK)
+    {
+        started = true;
+    }
+}
+
 static void network_task(void *args)
 {
     net_event_t net_event;
@@ -296,33 +529,41 @@ static void network_task(void *args)
                 break;
             case NET_EVENT_NTP:
                 ESP_LOGI(TAG, "NET_EVENT_NTP");
+                wifi_sntp_start();
                 break;
             case NET_EVENT_WEATHER:
                 ESP_LOGI(TAG, "NET_EVENT_WEATHER");
                 break;
             case NET_EVENT_POWERON_SCAN:
                 ESP_LOGI(TAG, "NET_EVENT_POWERON_SCAN");
-                wifi_scan();
-                esp_wifi_connect();
-                s_wifi_connected = false;
+                wifi_scan_connect();
+                break;
+            case NET_EVENT_FAST_CONNECT:
+                ESP_LOGI(TAG, "NET_EVENT_FAST_CONNECT");
+                if (!wifi_fast_connect() && !wifi_espnow_mode())
+                {
+                    wifi_scan_connect();
+                }
+                break;
+            case NET_EVENT_CONNECTED:
+                ESP_LOGI(TAG, "NET_EVENT_CONNECTED");
+                wifi_fast_cache_update();
                 break;
             default:
                 break;
             }
         }
 
-        // 获取token
+        // 没有 token 或即将到期时刷新, 不持有 wifi 锁, 避免与等待 token 的语音请求互相阻塞
         if (app_wifi_connected_already() == WIFI_STATUS_CONNECTED_OK)
         {
-            app_wifi_lock(0);
             baidu_update_access_token();
-            app_wifi_unlock();
         }
     }
     vTaskDelete(NULL);
 }
 
-/// @brief 获取互斥量
+/// @brief 获取互斥量, 只保护扫描结果 scan_info_result, 不要在持有期间发起网络请求
 /// @param timeout_ms 
 /// @return 
 bool app_wifi_lock(uint32_t timeout_ms)
@@ -361,6 +602,11 @@ void app_network_start(void)
     wifi_event_queue = xQueueCreate(4, sizeof(net_event_t));
     ESP_ERROR_CHECK_WITHOUT_ABORT((wifi_event_queue) ? ESP_OK : ESP_FAIL);
 
+    // 开机即可使用 NVS 中保存的 token
+    baidu_token_init();
+    // 大模型服务列表
+    ESP_ERROR_CHECK_WITHOUT_ABORT(llm_provider_init());
+
     // ret_val = xTaskCreatePinnedToCore(network_task, "network_task", 4 * 1024, NULL, 2, NULL, 0);
     // ESP_ERROR_CHECK_WITHOUT_ABORT((pdPASS == ret_val) ? ESP_OK : ESP_FAIL);
 
@@ -41,6 +41,8 @@ extern "C"
         NET_EVENT_NTP,
         NET_EVENT_WEATHER,
         NET_EVENT_POWERON_SCAN,
+        NET_EVENT_FAST_CONNECT,   // 开机时用缓存的 AP 直接连接, 失败时转为 NET_EVENT_POWERON_SCAN
+        NET_EVENT_CONNECTED,      // 获得 IP, 记录 AP 供下次开机使用
         NET_EVENT_MAX,
     } net_event_t;
 
@@ -55,6 +57,7 @@ extern "C"
 
     esp_err_t send_network_event(net_event_t event);
     WiFi_Connect_Status app_wifi_connected_already(void);
+    bool app_wifi_started(void);
     esp_err_t app_wifi_get_wifi_ssid(char *ssid, size_t len);
 
     void app_network_start(void);
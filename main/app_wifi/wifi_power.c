@@ -0,0 +1,217 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "wifi_power.h"
+
+static const char *TAG = "wifi_power";
+
+#define WIFI_POWER_STACK_SIZE (3 * 1024)
+
+static TaskHandle_t s_task = NULL;
+static volatile TickType_t s_last_kick = 0;
+static volatile int64_t s_kick_us = 0;   // 省电模式下第一次按键的时间, 0 表示没有待处理的唤醒
+static volatile uint32_t s_holds = 0;
+static volatile wifi_ps_type_t s_mode = WIFI_PS_NONE;
+static int64_t s_mode_since_us = 0;
+static wifi_power_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *wifi_power_mode_name(wifi_ps_type_t mode)
+{
+    switch (mode)
+    {
+    case WIFI_PS_NONE:
+        return "NONE";
+    case WIFI_PS_MIN_MODEM:
+        return "MIN_MODEM";
+    case WIFI_PS_MAX_MODEM:
+        return "MAX_MODEM";
+    default:
+        return "?";
+    }
+}
+
+/// @brief 把当前模式持续的时间计入统计, 调用者持有 s_stats_lock
+static void wifi_power_account(int64_t now)
+{
+    uint64_t elapsed = now - s_mode_since_us;
+    switch (s_mode)
+    {
+    case WIFI_PS_NONE:
+        s_stats.none_us += elapsed;
+        break;
+    case WIFI_PS_MIN_MODEM:
+        s_stats.min_modem_us += elapsed;
+        break;
+    case WIFI_PS_MAX_MODEM:
+        s_stats.max_modem_us += elapsed;
+        break;
+    default:
+        break;
+    }
+    s_mode_since_us = now;
+}
+
+static wifi_ps_type_t wifi_power_policy(void)
+{
+    if (s_holds)
+    {
+        return WIFI_PS_NONE;
+    }
+    uint32_t idle_ms = pdTICKS_TO_MS(xTaskGetTickCount() - s_last_kick);
+    if (idle_ms < WIFI_POWER_IDLE_MS)
+    {
+        return WIFI_PS_NONE;
+    }
+    if (idle_ms < WIFI_POWER_DEEP_IDLE_MS)
+    {
+        return WIFI_PS_MIN_MODEM;
+    }
+    return WIFI_PS_MAX_MODEM;
+}
+
+static void wifi_power_apply(wifi_ps_type_t mode)
+{
+    esp_err_t err = esp_wifi_set_ps(mode);
+    int64_t now = esp_timer_get_time();
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "set %s failed: %s", wifi_power_mode_name(mode), esp_err_to_name(err));
+        return;
+    }
+
+    int64_t kick_us = s_kick_us;
+    s_kick_us = 0;
+
+    portENTER_CRITICAL(&s_stats_lock);
+    wifi_power_account(now);
+    if (mode == WIFI_PS_NONE)
+    {
+        s_stats.wakeups++;
+        if (kick_us)
+        {
+            s_stats.key_wakeups++;
+            uint32_t wake_us = now - kick_us;
+            s_stats.wake_total_us += wake_us;
+            if (wake_us > s_stats.wake_max_us)
+            {
+                s_stats.wake_max_us = wake_us;
+            }
+        }
+    }
+    else if (s_mode == WIFI_PS_NONE)
+    {
+        s_stats.sleeps++;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    ESP_LOGI(TAG, "%s -> %s%s", wifi_power_mode_name(s_mode), wifi_power_mode_name(mode), kick_us ? " (key)" : "");
+    s_mode = mode;
+    if (mode == WIFI_PS_MAX_MODEM)
+    {
+        wifi_power_log_stats();
+    }
+}
+
+static void wifi_power_task(void *arg)
+{
+    while (1)
+    {
+        // 按键唤醒立即处理, 否则定时检查空闲时间
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WIFI_POWER_POLL_MS));
+        wifi_ps_type_t mode = wifi_power_policy();
+        if (mode != s_mode)
+        {
+            wifi_power_apply(mode);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t wifi_power_init(void)
+{
+    ESP_RETURN_ON_FALSE(NULL == s_task, ESP_ERR_INVALID_STATE, TAG, "already initialized");
+    s_last_kick = xTaskGetTickCount();
+    s_mode_since_us = esp_timer_get_time();
+    s_mode = WIFI_PS_NONE;
+#if WIFI_POWER_ENABLE
+    // 优先级高于语音任务, 低于键盘扫描(8)和按键发送(9)
+    BaseType_t ret = xTaskCreatePinnedToCore(wifi_power_task, "WiFi Power", WIFI_POWER_STACK_SIZE, NULL, 5, &s_task, 0);
+    ESP_RETURN_ON_FALSE(pdPASS == ret, ESP_FAIL, TAG, "Failed create power task");
+#endif
+    return ESP_OK;
+}
+
+void wifi_power_kick(void)
+{
+    s_last_kick = xTaskGetTickCount();
+    if (s_task == NULL || s_mode == WIFI_PS_NONE)
+    {
+        return;
+    }
+    if (s_kick_us == 0)
+    {
+        s_kick_us = esp_timer_get_time();
+    }
+    xTaskNotifyGive(s_task);
+}
+
+void wifi_power_hold(wifi_power_hold_t hold, bool on)
+{
+    if (on)
+    {
+        __atomic_fetch_or(&s_holds, (uint32_t)hold, __ATOMIC_RELAXED);
+        s_last_kick = xTaskGetTickCount();
+        if (s_task && s_mode != WIFI_PS_NONE)
+        {
+            xTaskNotifyGive(s_task);
+        }
+    }
+    else
+    {
+        // 释放后从现在开始计算空闲时间
+        s_last_kick = xTaskGetTickCount();
+        __atomic_fetch_and(&s_holds, ~(uint32_t)hold, __ATOMIC_RELAXED);
+    }
+}
+
+wifi_ps_type_t wifi_power_get_mode(void)
+{
+    return s_mode;
+}
+
+void wifi_power_get_stats(wifi_power_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    wifi_power_account(esp_timer_get_time());
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+void wifi_power_log_stats(void)
+{
+    wifi_power_stats_t stats;
+    wifi_power_get_stats(&stats);
+    uint64_t total = stats.none_us + stats.min_modem_us + stats.max_modem_us;
+    if (total == 0)
+    {
+        return;
+    }
+    ESP_LOGI(TAG, "mode %s, holds 0x%02" PRIx32 ", wakeups %" PRIu32 " (key %" PRIu32 "), sleeps %" PRIu32 ", wake avg %" PRIu32 " us max %" PRIu32 " us",
+             wifi_power_mode_name(s_mode), s_holds, stats.wakeups, stats.key_wakeups, stats.sleeps,
+             stats.key_wakeups ? (uint32_t)(stats.wake_total_us / stats.key_wakeups) : 0, stats.wake_max_us);
+    ESP_LOGI(TAG, "time NONE %llu%%, MIN_MODEM %llu%%, MAX_MODEM %llu%%",
+             stats.none_us * 100 / total, stats.min_modem_us * 100 / total, stats.max_modem_us * 100 / total);
+}
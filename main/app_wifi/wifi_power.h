@@ -0,0 +1,63 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_wifi.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define WIFI_POWER_ENABLE         (1)     // 0: 始终 WIFI_PS_NONE, 与原来的行为一致
+#define WIFI_POWER_IDLE_MS        (3000)  // 最后一次按键后保持 PS_NONE 的时间, 之后进入 MIN_MODEM
+#define WIFI_POWER_DEEP_IDLE_MS   (60000) // 空闲超过该时间进入 MAX_MODEM
+#define WIFI_POWER_POLL_MS        (500)
+
+    /// @brief 语音相关的占用标志, 任意一位置位时保持 PS_NONE
+    typedef enum
+    {
+        WIFI_POWER_HOLD_RECORD    = (1 << 0), // 唤醒后录音中
+        WIFI_POWER_HOLD_DICTATION = (1 << 1), // 听写请求排队或执行中
+        WIFI_POWER_HOLD_CHAT      = (1 << 2), // 对话请求排队或执行中(包括播放回答)
+    } wifi_power_hold_t;
+
+    typedef struct
+    {
+        uint32_t wakeups;         // 从省电模式切回 PS_NONE 的次数
+        uint32_t key_wakeups;     // 其中由按键触发的次数
+        uint32_t sleeps;          // 进入 MIN/MAX_MODEM 的次数
+        uint32_t wake_max_us;     // 按键到 PS_NONE 生效的最大耗时
+        uint64_t wake_total_us;
+        uint64_t none_us;         // 各模式累计时间
+        uint64_t min_modem_us;
+        uint64_t max_modem_us;
+    } wifi_power_stats_t;
+
+    /// @brief 启动省电策略任务, 在 esp_wifi_start() 之后调用
+    esp_err_t wifi_power_init(void);
+
+    /**
+     * @brief 报告一次按键活动, 由键盘扫描任务调用, 不会阻塞.
+     *
+     * 处于省电模式时唤醒策略任务立即切回 PS_NONE.
+     */
+    void wifi_power_kick(void);
+
+    /// @brief 设置或清除占用标志
+    void wifi_power_hold(wifi_power_hold_t hold, bool on);
+
+    wifi_ps_type_t wifi_power_get_mode(void);
+    void wifi_power_get_stats(wifi_power_stats_t *stats);
+    void wifi_power_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
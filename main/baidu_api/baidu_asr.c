@@ -1,61 +1,25 @@
 #include "esp_log.h"
 #include "esp_crt_bundle.h"
 #include "esp_http_client.h"
-#include "cJSON.h"
 #include "json_utils.h"
+#include "app_http_pool.h"
+#include "http_arena.h"
+#include "cloud_config.h"
 
 #include "baidu_api.h"
 
 
 static char *TAG = "BaiduAsr";
 
-#define MAX_BUFFER_SIZE (1024 * 8)
-static char *response_data = NULL;
-static uint32_t  file_total_len = 0;
-
-// http客户端的事件处理回调函数
-static esp_err_t http_client_event_handler(esp_http_client_event_t *evt)
-{
-    switch (evt->event_id)
-    {
-    case HTTP_EVENT_ERROR:
-        break;
-    case HTTP_EVENT_ON_CONNECTED:
-        file_total_len = 0;
-        break;
-    case HTTP_EVENT_HEADER_SENT:
-        break;
-    case HTTP_EVENT_ON_HEADER:
-        break;
-    case HTTP_EVENT_ON_DATA:
-        ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA, len=(%" PRIu32 " + %d) [%d]", file_total_len, evt->data_len, MAX_BUFFER_SIZE);
-        if ((file_total_len + evt->data_len) < MAX_BUFFER_SIZE)
-        {
-            if (evt->user_data)
-            {
-                memcpy(evt->user_data + file_total_len, evt->data, evt->data_len);
-            }
-            file_total_len += evt->data_len;
-        }
-        break;
-    case HTTP_EVENT_ON_FINISH:
-        break;
-    case HTTP_EVENT_DISCONNECTED:
-        break;
-    case HTTP_EVENT_REDIRECT:
-        break;
-    default:
-        break;
-    }
-
-    return ESP_OK;
-}
+// 响应体和识别结果都放在 arena 中, 每次请求开始时整体回收; 调用者没有提供 arena 时使用模块内部的
+static http_arena_t s_asr_arena;
 
 /// @brief 语音转文字
 /// @param audio_data 
 /// @param audio_len 
-/// @return 
-char *baidu_get_asr_result(uint8_t *audio_data, int audio_len)
+/// @param arena 响应体所在的 arena, 每次调用开始时复位; NULL 使用模块内部的, 并发调用时每个调用者传入自己的
+/// @return 识别结果, 在 arena 中, 在 arena 下一次复位前有效, 调用者不要释放
+char *baidu_get_asr_result(uint8_t *audio_data, int audio_len, http_arena_t *arena)
 {
     char *asr_data = NULL;
     char url[256];
@@ -68,41 +32,55 @@ char *baidu_get_asr_result(uint8_t *audio_data, int audio_len)
         return NULL;
     }
 
-    if (response_data == NULL)
+    if (arena == NULL)
     {
-        response_data = heap_caps_calloc(1, MAX_BUFFER_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        assert(response_data);
-        ESP_LOGI(TAG, "successfully created response_data with a size: %zu", MAX_BUFFER_SIZE);
+        if (s_asr_arena.chunk_size == 0)
+        {
+            http_arena_init(&s_asr_arena, HTTP_ARENA_CHUNK_SIZE);
+        }
+        arena = &s_asr_arena;
     }
-    
-    sprintf(url, "http://vop.baidu.com/server_api?dev_pid=%s&cuid=%s&token=%s", dev_pid, cuid, access_token);
+    http_arena_reset(arena);
+
+    snprintf(url, sizeof(url), CLOUD_BAIDU_ASR_URL "?dev_pid=%s&cuid=%s&token=%s", dev_pid, cuid, access_token);
 
     esp_http_client_config_t config = {
         .url = url,
-        .event_handler = http_client_event_handler,
-        .user_data = response_data,
+        .event_handler = http_arena_event_handler,
+        .user_data = arena,
     };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
+    esp_http_client_handle_t client = app_http_pool_acquire(&config);
+    if (client == NULL)
+    {
+        return NULL;
+    }
 
     esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "audio/wav;rate=16000");
+    app_http_pool_set_header(client, "Content-Type", "audio/wav;rate=16000");
     esp_http_client_set_post_field(client, (const char *)audio_data, audio_len);
-    esp_err_t err = esp_http_client_perform(client);
+    // 复用连接时不会收到 HTTP_EVENT_ON_CONNECTED, 在这里开始接收响应体
+    http_arena_body_begin(arena);
+    esp_err_t err = app_http_pool_perform(client);
+    size_t response_len = 0;
+    char *response_data = http_arena_body_end(arena, &response_len);
+    if (err == ESP_OK && response_data == NULL)
+    {
+        err = ESP_ERR_NO_MEM;
+    }
     if (err == ESP_OK)
     {
-        cJSON *json = cJSON_Parse(response_data);
-        if (json != NULL)
+        // 识别结果直接指向 arena 中的响应体, 不建树也不拷贝
+        static const char *const paths[] = {"result[0]", "err_no", "err_msg"};
+        json_view_t views[3];
+        json_extract(response_data, response_len, paths, views, 3);
+        if (views[0].found && views[0].is_string)
+        {
+            asr_data = views[0].ptr;
+        }
+        else if (views[1].found)
         {
-            cJSON *result_json = cJSON_GetObjectItem(json, "result");
-            if (result_json != NULL && cJSON_IsArray(result_json))
-            {
-                cJSON *result_array = cJSON_GetArrayItem(result_json, 0);
-                if (result_array != NULL && cJSON_IsString(result_array))
-                {
-                    asr_data = strdup(result_array->valuestring);
-                }
-            }
-            cJSON_Delete(json);
+            ESP_LOGE(TAG, "asr error %.*s: %.*s", (int)views[1].len, views[1].ptr,
+                     views[2].found ? (int)views[2].len : 0, views[2].ptr);
         }
     }
     else
@@ -110,7 +88,7 @@ char *baidu_get_asr_result(uint8_t *audio_data, int audio_len)
         ESP_LOGE(TAG, "HTTP POST request failed: %s", esp_err_to_name(err));
     }
     
-    esp_http_client_cleanup(client);
+    app_http_pool_release(client, err);
 
     return asr_data;
 }
@@ -1,12 +1,19 @@
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
 #include "esp_mac.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_crt_bundle.h"
 #include "esp_http_client.h"
-#include "cJSON.h"
+#include "nvs.h"
 #include "json_utils.h"
+#include "app_http_pool.h"
+#include "cloud_config.h"
 
 #include "app_wifi.h"
 #include "baidu_api.h"
@@ -18,115 +25,235 @@
 #define SECRET_KEY "secretkey"
 
 #define BAIDU_URI_LENGTH    (200)
-#define BAIDU_AUTH_ENDPOINT "https://aip.baidubce.com/oauth/2.0/token?grant_type=client_credentials"
+#define BAIDU_AUTH_ENDPOINT CLOUD_BAIDU_AUTH_URL
 
+#define BAIDU_TOKEN_NVS_NAMESPACE  "baidu"
+#define BAIDU_TOKEN_NVS_KEY        "token"
+#define BAIDU_TOKEN_NVS_EXPIRES    "expires"
+#define BAIDU_TOKEN_MAX_LEN        (128)
+#define BAIDU_TOKEN_REFRESH_MARGIN (24 * 3600)         // 到期前一天刷新
+#define BAIDU_TOKEN_RETRY_US       (30 * 1000 * 1000)  // 刷新失败后的重试间隔
+#define BAIDU_TOKEN_WAIT_MS        (3000)              // 首次开机没有 token 时请求最多等待的时间
+#define BAIDU_TIME_VALID           (1700000000)        // 早于该时间说明还没有完成 SNTP 校时
+
+#define BAIDU_TOKEN_READY_BIT      BIT0
+
+#define BAIDU_TOKEN_RESPONSE_SIZE (2 * 1024)
+
+typedef struct
+{
+    char *data;
+    int len;
+} baidu_token_response_t;
+
+// 双缓冲: 刷新时写入另一个缓冲区再切换, 正在使用旧 token 的请求不受影响
+static char sg_token_buf[2][BAIDU_TOKEN_MAX_LEN];
 static char *sg_access_token = NULL;
 static char sg_mac_str[32] = {'\0'};
-static bool token_updated_flag = false;
+static int64_t sg_expires_at = 0;        // 到期的 unix 时间, 0 表示未知
+static int64_t sg_expires_in = 0;        // 本次开机获取的 token 的有效期(秒)
+static int64_t sg_obtained_us = 0;       // 本次开机获取 token 时的 esp_timer 时间, 0 表示来自 NVS
+static int64_t sg_next_try_us = 0;
+static EventGroupHandle_t sg_token_event = NULL;
 
-/// @brief 获取 access_token
-/// @param  
-/// @return 
-void baidu_update_access_token(void)
+static esp_err_t baidu_token_event_handler(esp_http_client_event_t *evt)
 {
-    if (token_updated_flag)
+    baidu_token_response_t *resp = (baidu_token_response_t *)evt->user_data;
+    if (HTTP_EVENT_ON_DATA == evt->event_id && resp)
     {
+        int n = evt->data_len;
+        if (resp->len + n > BAIDU_TOKEN_RESPONSE_SIZE - 1)
+        {
+            n = BAIDU_TOKEN_RESPONSE_SIZE - 1 - resp->len;
+        }
+        memcpy(resp->data + resp->len, evt->data, n);
+        resp->len += n;
+        resp->data[resp->len] = '\0';
+    }
+    return ESP_OK;
+}
+
+static bool baidu_time_valid(void)
+{
+    return time(NULL) > BAIDU_TIME_VALID;
+}
+
+static void baidu_token_set(const char *token, size_t len)
+{
+    char *buf = (sg_access_token == sg_token_buf[0]) ? sg_token_buf[1] : sg_token_buf[0];
+    if (len >= BAIDU_TOKEN_MAX_LEN)
+    {
+        len = BAIDU_TOKEN_MAX_LEN - 1;
+    }
+    memcpy(buf, token, len);
+    buf[len] = '\0';
+    sg_access_token = buf;
+    xEventGroupSetBits(sg_token_event, BAIDU_TOKEN_READY_BIT);
+}
+
+static void baidu_token_save(void)
+{
+    nvs_handle_t handle = 0;
+    esp_err_t err = nvs_open(BAIDU_TOKEN_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
         return;
     }
-    
+    err = nvs_set_str(handle, BAIDU_TOKEN_NVS_KEY, sg_access_token);
+    err |= nvs_set_i64(handle, BAIDU_TOKEN_NVS_EXPIRES, sg_expires_at);
+    err |= nvs_commit(handle);
+    nvs_close(handle);
+    ESP_LOGI(TAG, "token saved, expires at %lld (%s)", sg_expires_at, err == ESP_OK ? "ok" : "failed");
+}
+
+/// @brief 开机时从 NVS 读取上次的 token, 不用等联网即可使用
+void baidu_token_init(void)
+{
+    if (sg_token_event == NULL)
+    {
+        sg_token_event = xEventGroupCreate();
+        assert(sg_token_event);
+    }
+
     // 获取芯片 MAC 地址
     uint8_t mac_hex[6];
     esp_read_mac(mac_hex, ESP_MAC_WIFI_STA);
     for (int i = 0; i < sizeof(mac_hex); i++)
         sprintf(sg_mac_str + (i * 2), "%02X", mac_hex[i]);
     ESP_LOGI(TAG, "Baidu cuid = %s", sg_mac_str);
-    
-    // 获取百度云 access_token
-    char *token = NULL;
+
+    nvs_handle_t handle = 0;
+    if (nvs_open(BAIDU_TOKEN_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        ESP_LOGI(TAG, "no saved token");
+        return;
+    }
+    char token[BAIDU_TOKEN_MAX_LEN];
+    size_t len = sizeof(token);
+    int64_t expires_at = 0;
+    if (nvs_get_str(handle, BAIDU_TOKEN_NVS_KEY, token, &len) == ESP_OK && len > 1)
+    {
+        nvs_get_i64(handle, BAIDU_TOKEN_NVS_EXPIRES, &expires_at);
+        sg_expires_at = expires_at;
+        baidu_token_set(token, len - 1);
+        ESP_LOGI(TAG, "loaded token from NVS, expires at %lld", expires_at);
+    }
+    nvs_close(handle);
+}
+
+/// @brief 判断是否需要刷新 token
+static bool baidu_token_need_refresh(void)
+{
+    if (sg_access_token == NULL)
+    {
+        return true;
+    }
+    if (!baidu_time_valid())
+    {
+        // 还没校时, 先用现有的 token
+        return false;
+    }
+
+    int64_t now = time(NULL);
+    if (sg_expires_at == 0 && sg_obtained_us != 0)
+    {
+        // 本次开机在校时前获取的 token, 校时后补记到期时间
+        sg_expires_at = now - (esp_timer_get_time() - sg_obtained_us) / 1000000 + sg_expires_in;
+        baidu_token_save();
+    }
+    // 到期时间未知(旧版本保存的 token)或即将到期
+    return sg_expires_at == 0 || now >= sg_expires_at - BAIDU_TOKEN_REFRESH_MARGIN;
+}
+
+/// @brief 从百度云获取新的 access_token
+static esp_err_t baidu_token_fetch(void)
+{
+    esp_err_t err = ESP_FAIL;
     char *url = calloc(1, BAIDU_URI_LENGTH);
-    if (url == NULL)
+    baidu_token_response_t resp = {
+        .data = malloc(BAIDU_TOKEN_RESPONSE_SIZE),
+        .len = 0,
+    };
+    if (url == NULL || resp.data == NULL)
     {
         ESP_LOGE(TAG, "Memory allocation failed");
-        return;
+        err = ESP_ERR_NO_MEM;
+        goto _exit;
     }
+    resp.data[0] = '\0';
 
     snprintf(url, BAIDU_URI_LENGTH, BAIDU_AUTH_ENDPOINT "&client_id=%s&client_secret=%s", API_KEY, SECRET_KEY);
 
     esp_http_client_config_t config = {
         .url = url,
-        .event_handler = NULL,
+        .event_handler = baidu_token_event_handler,
+        .user_data = &resp,
         .crt_bundle_attach = esp_crt_bundle_attach,
     };
-    esp_http_client_handle_t http_client = esp_http_client_init(&config);
+    esp_http_client_handle_t http_client = app_http_pool_acquire(&config);
     if (http_client == NULL)
     {
         ESP_LOGE(TAG, "Error creating http client");
-        free(url);
-        return;
+        goto _exit;
     }
-    if (esp_http_client_open(http_client, 0) != ESP_OK)
+    err = app_http_pool_perform(http_client);
+    app_http_pool_release(http_client, err);
+    if (err != ESP_OK)
     {
         ESP_LOGE(TAG, "Error open http request to baidu auth server");
         goto _exit;
     }
-    esp_http_client_fetch_headers(http_client);
-    int max_len = 2 * 1024;
-    char *data = malloc(max_len);
-    if (data == NULL)
+
+    if (resp.len <= 0)
     {
-        ESP_LOGE(TAG, "Memory allocation failed");
+        ESP_LOGE(TAG, "Invalid length of the response");
+        err = ESP_FAIL;
         goto _exit;
     }
 
-    int read_index = 0, total_len = 0;
-    while (1)
+    static const char *const paths[] = {"access_token", "expires_in"};
+    json_view_t views[2];
+    json_extract(resp.data, resp.len, paths, views, 2);
+    if (!views[0].found || !views[0].is_string || views[0].len == 0)
     {
-        int read_len = esp_http_client_read(http_client, data + read_index, max_len - read_index);
-        if (read_len <= 0)
-        {
-            break;
-        }
-        read_index += read_len;
-        total_len += read_len;
-        data[read_index] = 0;
+        ESP_LOGE(TAG, "Invalid access_token: %s", resp.data);
+        err = ESP_FAIL;
+        goto _exit;
     }
 
-    if (total_len <= 0)
+    sg_expires_in = views[1].found ? strtoll(views[1].ptr, NULL, 10) : 0;
+    sg_obtained_us = esp_timer_get_time();
+    sg_expires_at = (baidu_time_valid() && sg_expires_in > 0) ? time(NULL) + sg_expires_in : 0;
+    baidu_token_set(views[0].ptr, views[0].len);
+    baidu_token_save();
+    ESP_LOGI(TAG, "Baidu access token = %s, expires in %lld s", sg_access_token, sg_expires_in);
+    err = ESP_OK;
+
+_exit:
+    free(url);
+    free(resp.data);
+    return err;
+}
+
+/// @brief 由网络任务在联网后周期调用, 没有 token 或即将到期时在后台刷新
+/// @param  
+/// @return 
+void baidu_update_access_token(void)
+{
+    if (sg_token_event == NULL)
     {
-        ESP_LOGE(TAG, "Invalid length of the response");
-        free(data);
-        goto _exit;
+        baidu_token_init();
     }
-
-    printf("%s: Data=%s", TAG, data);
-    token = json_get_token_value(data, "access_token");
-    free(data);
-    if (token == NULL)
+    if (esp_timer_get_time() < sg_next_try_us || !baidu_token_need_refresh())
     {
-        ESP_LOGE(TAG, "Invalid access_token");
-        goto _exit;
+        return;
     }
 
-    if (sg_access_token)
-        free(sg_access_token);
-    int token_len = strlen(token) + 1;
-    sg_access_token = malloc(token_len);
-    if (sg_access_token == NULL)
+    if (baidu_token_fetch() != ESP_OK)
     {
-        ESP_LOGE(TAG, "Memory allocation failed");
-        goto _exit;
+        sg_next_try_us = esp_timer_get_time() + BAIDU_TOKEN_RETRY_US;
     }
-    memset(sg_access_token, '\0', token_len);
-    snprintf(sg_access_token, "%s", token);
-    token_updated_flag = true;
-    ESP_LOGI(TAG, "Baidu access token = %s", sg_access_token);
-
-_exit:
-    free(url);
-    esp_http_client_close(http_client);
-    esp_http_client_cleanup(http_client);
-    if (token)
-        free(token);
 }
 
 /// @brief 获取 access token
@@ -134,6 +261,11 @@ _exit:
 /// @return 
 char *baidu_get_access_token(void)
 {
+    // 首次开机还没有 token 时, 等待后台获取完成
+    if (sg_access_token == NULL && sg_token_event)
+    {
+        xEventGroupWaitBits(sg_token_event, BAIDU_TOKEN_READY_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(BAIDU_TOKEN_WAIT_MS));
+    }
     return sg_access_token;
 }
 
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 #include "esp_err.h"
 #include "esp_log.h"
@@ -8,12 +9,20 @@
 #include "inttypes.h"
 
 #include "app_audio.h"
+#include "audio_stream.h"
 #include "app_wifi.h"
 #include "baidu_api.h"
+#include "tts_cache.h"
+#include "app_http_pool.h"
+#include "cloud_config.h"
 
 static const char *TAG = "BaiduTts";
 
+// 发音参数, 同时作为缓存键的一部分
+#define BAIDU_TTS_VOICE_PARAMS "spd=5&pit=5&vol=5&per=1"
+
 static uint32_t file_total_len = 0;
+static bool tts_is_audio = false;
 
 /* Define a function to handle HTTP events during an HTTP request */
 static esp_err_t http_event_handler(esp_http_client_event_t *evt)
@@ -23,27 +32,32 @@ static esp_err_t http_event_handler(esp_http_client_event_t *evt)
     case HTTP_EVENT_ERROR:
         break;
     case HTTP_EVENT_ON_CONNECTED:
-        file_total_len = 0;
         break;
     case HTTP_EVENT_HEADER_SENT:
         break;
     case HTTP_EVENT_ON_HEADER:
+        // 合成失败时返回的是 json 错误信息, 不能送给播放器
+        if (strcasecmp(evt->header_key, "Content-Type") == 0)
+        {
+            tts_is_audio = (strncmp(evt->header_value, "audio/", 6) == 0);
+        }
         break;
     case HTTP_EVENT_ON_DATA:
-        ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA, len=(%" PRIu32 " + %d) [%d]", file_total_len, evt->data_len, MAX_FILE_SIZE);
-        if ((file_total_len + evt->data_len) < MAX_FILE_SIZE)
+        ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=(%" PRIu32 " + %d)", file_total_len, evt->data_len);
+        if (!tts_is_audio)
+        {
+            ESP_LOGE(TAG, "TTS error: %.*s", evt->data_len, (char *)evt->data);
+            break;
+        }
+        // 边下载边播放, 缓冲区满时在这里阻塞, 对 HTTP 读取形成反压
+        if (audio_stream_write(evt->data, evt->data_len) == ESP_OK)
         {
-            memcpy(audio_rx_buffer + file_total_len, (char *)evt->data, evt->data_len);
             file_total_len += evt->data_len;
         }
+        tts_cache_append(evt->data, evt->data_len);
         break;
     case HTTP_EVENT_ON_FINISH:
         ESP_LOGI(TAG, "HTTP_EVENT_ON_FINISH: %" PRIu32 ", %" PRIu32 " K", file_total_len, file_total_len / 1024);
-        // 接收完成, 开始播放
-        FILE *fp = NULL;
-        fp = fmemopen((void *)audio_rx_buffer, file_total_len, "rb");
-        if (fp)
-            audio_player_play(fp);
         break;
     case HTTP_EVENT_DISCONNECTED:
         break;
@@ -57,53 +71,94 @@ static esp_err_t http_event_handler(esp_http_client_event_t *evt)
 
 esp_err_t baidu_get_tts_result(char *audio_data, int audio_len)
 {
+    // 调用者已打开流时(多段合成)由调用者负责结束, 否则本次请求独占一个播放会话
+    bool own_stream = !audio_stream_is_open();
+    if (own_stream)
+    {
+        audio_stream_open();
+    }
+
+    // 命中缓存时直接播放, 不访问网络; 播放被停止时也不再请求云端
+    uint64_t cache_key = tts_cache_key(audio_data, BAIDU_TTS_VOICE_PARAMS);
+    esp_err_t err = tts_cache_read(cache_key, audio_stream_write);
+    if (err != ESP_ERR_NOT_FOUND)
+    {
+        ESP_LOGI(TAG, "TTS cache hit: %016" PRIx64 ", %s", cache_key, esp_err_to_name(err));
+        if (own_stream)
+        {
+            audio_stream_finish();
+        }
+        tts_cache_log_stats();
+        return err;
+    }
+
+    err = ESP_FAIL;
+    char *body = NULL;
     char *cuid = baidu_get_cuid_by_mac();
     char *access_token = baidu_get_access_token();
     if (access_token == NULL)
     {
         ESP_LOGE(TAG, "access token is NULL");
-        return ESP_FAIL;
+        goto _exit;
     }
 
-    int body_size = snprintf(NULL, 0, "tex=&tok=%s&cuid=%s&ctp=1&lan=zh&spd=5&pit=5&vol=5&per=1&aue=3",
+    int body_size = snprintf(NULL, 0, "tex=&tok=%s&cuid=%s&ctp=1&lan=zh&" BAIDU_TTS_VOICE_PARAMS "&aue=3",
                              access_token,
                              cuid);
     body_size += audio_len;
-    char *body = heap_caps_malloc((body_size + 1), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    body = heap_caps_malloc((body_size + 1), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     if (body == NULL)
     {
         ESP_LOGE(TAG, "Failed to allocate memory for body");
-        return ESP_ERR_NO_MEM;
+        err = ESP_ERR_NO_MEM;
+        goto _exit;
     }
 
-    snprintf(body, body_size + 1, "tex=%s&tok=%s&cuid=%s&ctp=1&lan=zh&spd=5&pit=5&vol=5&per=1&aue=3",
+    snprintf(body, body_size + 1, "tex=%s&tok=%s&cuid=%s&ctp=1&lan=zh&" BAIDU_TTS_VOICE_PARAMS "&aue=3",
              audio_data,
              access_token,
              cuid);
 
     esp_http_client_config_t config = {
-        .url            = "http://tsn.baidu.com/text2audio",
-        .buffer_size    = 128000,
+        .url            = CLOUD_BAIDU_TTS_URL,
+        .buffer_size    = 8 * 1024,
         .buffer_size_tx = 4000,
         .timeout_ms     = 4000,
         .event_handler  = http_event_handler,
     };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
+    esp_http_client_handle_t client = app_http_pool_acquire(&config);
+    if (client == NULL)
+    {
+        goto _exit;
+    }
     esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/x-www-form-urlencoded");
-    esp_http_client_set_header(client, "Accept", "*/*");
+    app_http_pool_set_header(client, "Content-Type", "application/x-www-form-urlencoded");
+    app_http_pool_set_header(client, "Accept", "*/*");
     esp_http_client_set_post_field(client, (const char *)body, body_size);
-    esp_err_t err = esp_http_client_perform(client);
-    if (err == ESP_OK)
+
+    file_total_len = 0;
+    tts_is_audio = false;
+    tts_cache_begin(cache_key);
+    err = app_http_pool_perform(client);
+    if (err == ESP_OK && tts_is_audio && esp_http_client_get_status_code(client) == 200)
     {
         ESP_LOGE(TAG, "HTTP POST request success");
+        tts_cache_commit();
     }
     else
     {
         ESP_LOGE(TAG, "HTTP POST request failed: %s", esp_err_to_name(err));
+        tts_cache_discard();
     }
+    tts_cache_log_stats();
     
-    esp_http_client_cleanup(client);
+    app_http_pool_release(client, err);
+
+_exit:
+    if (own_stream)
+    {
+        audio_stream_finish();
+    }
     if (body)
     {
         free(body);
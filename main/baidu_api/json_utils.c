@@ -25,12 +25,15 @@
 #include "freertos/FreeRTOS.h"
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "esp_log.h"
-#include "jsmn.h"
 #include "json_utils.h"
 
 static const char *TAG = "JSON_UTILS";
 
+#if JSON_UTILS_JSMN
+#include "jsmn.h"
+
 static bool jsoneq(const char *json, jsmntok_t *tok, const char *s)
 {
     if (tok->type == JSMN_STRING && (int)strlen(s) == tok->end - tok->start &&
@@ -44,33 +47,513 @@ static bool jsoneq(const char *json, jsmntok_t *tok, const char *s)
 char *json_get_token_value(const char *json_string, const char *token_name)
 {
     jsmn_parser parser;
-    jsmn_init(&parser);
-    jsmntok_t t[20];
-    int i;
-
-    int r = jsmn_parse(&parser, json_string, strlen(json_string), t, 20);
+    size_t len = strlen(json_string);
 
+    // 先数出 token 个数, 再按需分配, 不再受固定数组大小限制
+    jsmn_init(&parser);
+    int r = jsmn_parse(&parser, json_string, len, NULL, 0);
     if (r < 0)
     {
         ESP_LOGE(TAG, "Failed to parse JSON: %d", r);
         return NULL;
     }
     /* Assume the top-level element is an object */
-    if (r < 1 || t[0].type != JSMN_OBJECT)
+    if (r < 1)
     {
         ESP_LOGE(TAG, "Object expected");
         return NULL;
     }
-    for (i = 1; i < r; i++)
+
+    jsmntok_t *t = calloc(r, sizeof(jsmntok_t));
+    AUDIO_MEM_CHECK(TAG, t, return NULL);
+    jsmn_init(&parser);
+    r = jsmn_parse(&parser, json_string, len, t, r);
+
+    char *tok = NULL;
+    if (r < 1 || t[0].type != JSMN_OBJECT)
     {
-        if (jsoneq(json_string, &t[i], token_name) && i < r)
+        ESP_LOGE(TAG, "Object expected");
+        goto _exit;
+    }
+    for (int i = 1; i + 1 < r; i++)
+    {
+        if (jsoneq(json_string, &t[i], token_name))
         {
             int tok_len = t[i + 1].end - t[i + 1].start;
-            char *tok = calloc(1, tok_len + 1);
-            AUDIO_MEM_CHECK(TAG, tok, return NULL);
+            tok = calloc(1, tok_len + 1);
+            AUDIO_MEM_CHECK(TAG, tok, goto _exit);
             memcpy(tok, json_string + t[i + 1].start, tok_len);
-            return tok;
+            if (t[i + 1].type == JSMN_STRING)
+            {
+                json_view_t view = {.ptr = tok, .len = tok_len, .found = true, .is_string = true};
+                json_view_unescape(&view);
+            }
+            break;
+        }
+    }
+
+_exit:
+    free(t);
+    return tok;
+}
+#endif
+
+typedef struct {
+    char seg_key[JSON_PATH_MAX_SEGMENTS][32];
+    int seg_index[JSON_PATH_MAX_SEGMENTS];   // 数组下标, -1 表示对象的键
+    int nseg;
+} json_path_t;
+
+typedef struct {
+    const char *end;
+    json_path_t path[JSON_PATH_MAX_COUNT];
+    json_view_t *views;
+    int count;
+    int found;
+    int depth;
+} json_scan_t;
+
+static bool json_path_parse(const char *str, json_path_t *path)
+{
+    memset(path, 0, sizeof(json_path_t));
+    const char *p = str;
+    while (*p)
+    {
+        if (path->nseg >= JSON_PATH_MAX_SEGMENTS)
+        {
+            return false;
+        }
+        if (*p == '[')
+        {
+            char *end = NULL;
+            long index = strtol(p + 1, &end, 10);
+            if (end == p + 1 || *end != ']' || index < 0)
+            {
+                return false;
+            }
+            path->seg_index[path->nseg++] = (int)index;
+            p = end + 1;
+        }
+        else
+        {
+            if (*p == '.')
+            {
+                p++;
+            }
+            size_t n = strcspn(p, ".[");
+            if (n == 0 || n >= sizeof(path->seg_key[0]))
+            {
+                return false;
+            }
+            memcpy(path->seg_key[path->nseg], p, n);
+            path->seg_index[path->nseg++] = -1;
+            p += n;
+        }
+    }
+    return true;
+}
+
+static const char *json_skip_ws(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    {
+        p++;
+    }
+    return p;
+}
+
+/// @brief 跳过一个字符串, p 指向开头的引号, 返回结尾引号之后的位置
+static const char *json_skip_string(const char *p, const char *end)
+{
+    for (p++; p < end; p++)
+    {
+        if (*p == '\\')
+        {
+            p++;
+        }
+        else if (*p == '"')
+        {
+            return p + 1;
         }
     }
     return NULL;
 }
+
+static const char *json_scan_value(json_scan_t *s, const char *p, uint32_t on);
+
+/// @brief 从 on 中筛选出下一层仍在路径上的, key 为对象的键(不含引号), index 为数组下标
+static uint32_t json_scan_child(json_scan_t *s, uint32_t on, const char *key, size_t key_len, int index)
+{
+    uint32_t child = 0;
+    for (int i = 0; i < s->count; i++)
+    {
+        json_path_t *path = &s->path[i];
+        // 子节点位于第 depth 层, 对应路径的第 depth - 1 段
+        int seg = s->depth - 1;
+        if (!(on & (1u << i)) || seg >= path->nseg)
+        {
+            continue;
+        }
+        if (key ? (path->seg_index[seg] < 0 && strlen(path->seg_key[seg]) == key_len && memcmp(path->seg_key[seg], key, key_len) == 0)
+                : (path->seg_index[seg] == index))
+        {
+            child |= 1u << i;
+        }
+    }
+    return child;
+}
+
+static const char *json_scan_container(json_scan_t *s, const char *p, uint32_t on, bool object)
+{
+    const char *end = s->end;
+    char close = object ? '}' : ']';
+    if (++s->depth > JSON_SCAN_MAX_DEPTH)
+    {
+        return NULL;
+    }
+
+    p = json_skip_ws(p + 1, end);
+    for (int index = 0; p && p < end && *p != close; index++)
+    {
+        uint32_t child;
+        if (object)
+        {
+            if (*p != '"')
+            {
+                return NULL;
+            }
+            const char *key = p + 1;
+            p = json_skip_string(p, end);
+            if (p == NULL)
+            {
+                return NULL;
+            }
+            child = on ? json_scan_child(s, on, key, p - 1 - key, 0) : 0;
+            p = json_skip_ws(p, end);
+            if (p >= end || *p != ':')
+            {
+                return NULL;
+            }
+            p = json_skip_ws(p + 1, end);
+        }
+        else
+        {
+            child = on ? json_scan_child(s, on, NULL, 0, index) : 0;
+        }
+
+        p = json_scan_value(s, p, child);
+        // 所有路径都已找到, 不再扫描剩余内容
+        if (p == NULL || s->found == s->count)
+        {
+            return p;
+        }
+        p = json_skip_ws(p, end);
+        if (p < end && *p == ',')
+        {
+            p = json_skip_ws(p + 1, end);
+        }
+        else if (p < end && *p != close)
+        {
+            return NULL;
+        }
+    }
+    s->depth--;
+    return (p && p < end) ? p + 1 : NULL;
+}
+
+static const char *json_scan_value(json_scan_t *s, const char *p, uint32_t on)
+{
+    const char *end = s->end;
+    if (p >= end)
+    {
+        return NULL;
+    }
+
+    const char *start = p;
+    if (*p == '{' || *p == '[')
+    {
+        p = json_scan_container(s, p, on, *p == '{');
+    }
+    else if (*p == '"')
+    {
+        p = json_skip_string(p, end);
+    }
+    else
+    {
+        // 数字, true, false, null
+        while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\r' && *p != '\n' && *p != '\t')
+        {
+            p++;
+        }
+    }
+    if (p == NULL)
+    {
+        return NULL;
+    }
+
+    for (int i = 0; on && i < s->count; i++)
+    {
+        if ((on & (1u << i)) && s->path[i].nseg == s->depth && !s->views[i].found)
+        {
+            json_view_t *view = &s->views[i];
+            view->found = true;
+            view->is_string = (*start == '"');
+            view->ptr = (char *)start + (view->is_string ? 1 : 0);
+            view->len = (p - start) - (view->is_string ? 2 : 0);
+            s->found++;
+        }
+    }
+    return p;
+}
+
+static void json_utf8_put(char **out, uint32_t cp)
+{
+    char *o = *out;
+    if (cp < 0x80)
+    {
+        *o++ = (char)cp;
+    }
+    else if (cp < 0x800)
+    {
+        *o++ = (char)(0xC0 | (cp >> 6));
+        *o++ = (char)(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000)
+    {
+        *o++ = (char)(0xE0 | (cp >> 12));
+        *o++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *o++ = (char)(0x80 | (cp & 0x3F));
+    }
+    else
+    {
+        *o++ = (char)(0xF0 | (cp >> 18));
+        *o++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+        *o++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *o++ = (char)(0x80 | (cp & 0x3F));
+    }
+    *out = o;
+}
+
+static bool json_hex4(const char *p, const char *end, uint32_t *cp)
+{
+    if (end - p < 4)
+    {
+        return false;
+    }
+    *cp = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        char c = p[i];
+        uint32_t v = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : 16;
+        if (v > 15)
+        {
+            return false;
+        }
+        *cp = (*cp << 4) | v;
+    }
+    return true;
+}
+
+void json_view_unescape(json_view_t *view)
+{
+    // 转义序列总是比解码后的 UTF-8 长, 可以原地写回
+    const char *p = view->ptr;
+    const char *end = view->ptr + view->len;
+    char *o = view->ptr;
+    while (p < end)
+    {
+        if (*p != '\\' || p + 1 >= end)
+        {
+            *o++ = *p++;
+            continue;
+        }
+        p++;
+        switch (*p)
+        {
+        case 'n': *o++ = '\n'; p++; break;
+        case 'r': *o++ = '\r'; p++; break;
+        case 't': *o++ = '\t'; p++; break;
+        case 'b': *o++ = '\b'; p++; break;
+        case 'f': *o++ = '\f'; p++; break;
+        case 'u':
+        {
+            uint32_t cp;
+            if (!json_hex4(p + 1, end, &cp))
+            {
+                *o++ = *p++;
+                break;
+            }
+            p += 5;
+            // 代理对
+            uint32_t low;
+            if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' && json_hex4(p + 2, end, &low) && low >= 0xDC00 && low < 0xE000)
+            {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            json_utf8_put(&o, cp);
+            break;
+        }
+        default: // \" \\ \/
+            *o++ = *p++;
+            break;
+        }
+    }
+    *o = '\0';
+    view->len = o - view->ptr;
+}
+
+int json_extract(char *json, size_t len, const char *const *paths, json_view_t *views, int count)
+{
+    if (count <= 0 || count > JSON_PATH_MAX_COUNT)
+    {
+        return -1;
+    }
+
+    json_scan_t s = {
+        .end = json + len,
+        .views = views,
+        .count = count,
+    };
+    uint32_t on = 0;
+    for (int i = 0; i < count; i++)
+    {
+        memset(&views[i], 0, sizeof(json_view_t));
+        if (!json_path_parse(paths[i], &s.path[i]))
+        {
+            ESP_LOGE(TAG, "invalid path: %s", paths[i]);
+            return -1;
+        }
+        on |= 1u << i;
+    }
+
+    const char *p = json_scan_value(&s, json_skip_ws(json, s.end), on);
+    if (p == NULL && s.found < count)
+    {
+        ESP_LOGE(TAG, "Failed to parse JSON");
+        return -1;
+    }
+
+    // 全部扫描完再反转义, 扫描期间缓冲区不能被修改
+    for (int i = 0; i < count; i++)
+    {
+        if (views[i].found && views[i].is_string)
+        {
+            json_view_unescape(&views[i]);
+        }
+    }
+    return s.found;
+}
+
+char *json_extract_string(char *json, size_t len, const char *path)
+{
+    json_view_t view;
+    if (json_extract(json, len, &path, &view, 1) != 1 || !view.is_string)
+    {
+        return NULL;
+    }
+    return view.ptr;
+}
+
+#if JSON_UTILS_BENCHMARK
+#include <inttypes.h>
+#include "esp_cpu.h"
+#include "cJSON.h"
+
+static const char *bench_asr =
+    "{\"corpus_no\":\"7393036489466346542\",\"err_msg\":\"success.\",\"err_no\":0,"
+    "\"result\":[\"\\u6253\\u5f00\\u952e\\u76d8\\u7684\\u80cc\\u5149\\u706f\\u3002\"],\"sn\":\"843318353911721197567\"}";
+
+static const char *bench_chat =
+    "{\"id\":\"930c60df-bf64-41c9-a88e-3ec75f81e00e\",\"object\":\"chat.completion\",\"created\":1705651092,"
+    "\"model\":\"deepseek-chat\",\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\","
+    "\"content\":\"\\u673a\\u68b0\\u952e\\u76d8\\u7684\\u8f74\\u4f53\\u5206\\u4e3a\\u7ebf\\u6027\\u8f74\\u3001"
+    "\\u6bb5\\u843d\\u8f74\\u548c\\u9752\\u8f74\\u3002Linear switches are smooth, tactile ones have a bump, "
+    "and clicky ones add an audible click.\\n\\u9009\\u62e9\\u65f6\\u53ef\\u4ee5\\u5148\\u8bd5\\u6253\\u3002\"},"
+    "\"logprobs\":null,\"finish_reason\":\"stop\"}],\"usage\":{\"prompt_tokens\":16,\"completion_tokens\":10,"
+    "\"total_tokens\":26,\"prompt_cache_hit_tokens\":0,\"prompt_cache_miss_tokens\":16},"
+    "\"system_fingerprint\":\"fp_44709d6fcb\"}";
+
+static size_t bench_heap_cur;
+static size_t bench_heap_peak;
+
+static void *bench_malloc(size_t size)
+{
+    size_t *p = malloc(size + sizeof(size_t));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    *p = size;
+    bench_heap_cur += size;
+    if (bench_heap_cur > bench_heap_peak)
+    {
+        bench_heap_peak = bench_heap_cur;
+    }
+    return p + 1;
+}
+
+static void bench_free(void *ptr)
+{
+    if (ptr)
+    {
+        size_t *p = (size_t *)ptr - 1;
+        bench_heap_cur -= *p;
+        free(p);
+    }
+}
+
+static void json_utils_benchmark_one(const char *name, const char *sample, const char *path)
+{
+    const int rounds = 100;
+    size_t len = strlen(sample);
+    char *buf = malloc(len + 1);
+    AUDIO_MEM_CHECK(TAG, buf, return);
+
+    // cJSON: 建树 + 按路径取值 + strdup
+    cJSON_Hooks hooks = {.malloc_fn = bench_malloc, .free_fn = bench_free};
+    cJSON_InitHooks(&hooks);
+    bench_heap_cur = 0;
+    bench_heap_peak = 0;
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < rounds; i++)
+    {
+        cJSON *json = cJSON_ParseWithLength(sample, len);
+        cJSON *item = json;
+        json_path_t p;
+        json_path_parse(path, &p);
+        for (int seg = 0; item && seg < p.nseg; seg++)
+        {
+            item = p.seg_index[seg] < 0 ? cJSON_GetObjectItem(item, p.seg_key[seg]) : cJSON_GetArrayItem(item, p.seg_index[seg]);
+        }
+        char *copy = (item && cJSON_IsString(item)) ? strdup(item->valuestring) : NULL;
+        free(copy);
+        cJSON_Delete(json);
+    }
+    uint32_t cjson_cycles = (esp_cpu_get_cycle_count() - start) / rounds;
+    size_t cjson_peak = bench_heap_peak;
+    cJSON_InitHooks(NULL);
+
+    // 路径提取: 原地扫描, 不申请内存(拷贝样本只是为了每轮都从原始数据开始)
+    uint32_t extract_cycles = 0;
+    char *value = NULL;
+    for (int i = 0; i < rounds; i++)
+    {
+        memcpy(buf, sample, len + 1);
+        start = esp_cpu_get_cycle_count();
+        value = json_extract_string(buf, len, path);
+        extract_cycles += esp_cpu_get_cycle_count() - start;
+    }
+    extract_cycles /= rounds;
+
+    ESP_LOGI(TAG, "%s (%zu bytes): cJSON %" PRIu32 " cycles, peak heap %zu B; json_extract %" PRIu32 " cycles, 0 B, value %s",
+             name, len, cjson_cycles, cjson_peak, extract_cycles, value ? value : "(null)");
+    free(buf);
+}
+
+void json_utils_benchmark(void)
+{
+    json_utils_benchmark_one("baidu asr", bench_asr, "result[0]");
+    json_utils_benchmark_one("deepseek chat", bench_chat, "choices[0].message.content");
+}
+#endif
@@ -25,6 +25,9 @@
 #ifndef _JSON_UTILS_H_
 #define _JSON_UTILS_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -37,6 +40,22 @@ extern "C" {
     }
 #define AUDIO_MEM_CHECK(TAG, a, action) AUDIO_CHECK(TAG, a, action, "Memory exhausted")
 
+#define JSON_PATH_MAX_SEGMENTS (8)  // 路径最多的层数
+#define JSON_PATH_MAX_COUNT    (8)  // 一次最多提取的路径数
+#define JSON_SCAN_MAX_DEPTH    (16) // 最大嵌套深度
+#define JSON_UTILS_BENCHMARK   (0)  // 启动时对比 cJSON 的解析耗时和内存峰值
+#ifndef JSON_UTILS_JSMN
+#define JSON_UTILS_JSMN        (1)  // json_get_token_value 依赖 jsmn 组件, tools/ 下电脑上的测试定义为 0
+#endif
+
+typedef struct {
+    char *ptr;      // 指向原始 json 中的值, 字符串不含引号
+    size_t len;
+    bool found;
+    bool is_string;
+} json_view_t;
+
+#if JSON_UTILS_JSMN
 /**
  * @brief      This function returns the string value of the token in json_string.
  *             The returning string is allocated and must be free as soon as it is used
@@ -47,6 +66,37 @@ extern "C" {
  * @return     The token value
  */
 char *json_get_token_value(const char *json_string, const char *token_name);
+#endif
+
+/**
+ * @brief      按路径从 json 中提取值, 只扫描一遍, 不构建 cJSON 树, 不申请内存.
+ *
+ *             路径形如 "choices[0].message.content", "result[0]". 返回的 view 指向 json 缓冲区内部,
+ *             字符串值会被原地反转义并以 '\0' 结尾, 因此 json 缓冲区会被修改(通常是 http_arena 中的响应体).
+ *
+ * @param[in]  json   json 缓冲区, 提取后内容被修改
+ * @param[in]  len    json 长度
+ * @param[in]  paths  要提取的路径
+ * @param[out] views  每个路径的提取结果
+ * @param[in]  count  路径数, 不超过 JSON_PATH_MAX_COUNT
+ *
+ * @return     找到的路径数, json 格式错误时返回 -1
+ */
+int json_extract(char *json, size_t len, const char *const *paths, json_view_t *views, int count);
+
+/**
+ * @brief      原地反转义 view 指向的字符串并以 '\0' 结尾, 更新 len
+ */
+void json_view_unescape(json_view_t *view);
+
+/**
+ * @brief      提取单个路径的字符串值, 失败或值不是字符串时返回 NULL
+ */
+char *json_extract_string(char *json, size_t len, const char *path);
+
+#if JSON_UTILS_BENCHMARK
+void json_utils_benchmark(void);
+#endif
 
 #ifdef __cplusplus
 }
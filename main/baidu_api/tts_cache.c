@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_check.h"
+#include "esp_log.h"
+
+#include "tts_cache.h"
+
+static const char *TAG = "TtsCache";
+
+typedef struct
+{
+    uint64_t key;
+    uint8_t *data;      // PSRAM 中的副本, NULL 表示只在 storage 分区
+    size_t len;
+    uint32_t last_use;  // LRU 时钟
+    uint8_t readers;    // 正在交给 sink 的读者数, 不为 0 时不能释放 data 或复用条目
+    bool used;
+    bool on_disk;
+} tts_cache_entry_t;
+
+static tts_cache_entry_t s_entries[TTS_CACHE_MAX_ENTRIES];
+static SemaphoreHandle_t s_cache_mux = NULL;
+static uint32_t s_use_clock = 0;
+static tts_cache_stats_t s_stats = {0};
+
+// 正在下载的合成结果
+static uint8_t *s_stage = NULL;
+static size_t s_stage_len = 0;
+static size_t s_stage_cap = 0;
+static uint64_t s_stage_key = 0;
+static bool s_stage_active = false;
+
+static void tts_cache_path(uint64_t key, char *path, size_t size)
+{
+    snprintf(path, size, TTS_CACHE_FILE_PREFIX "%016" PRIx64 ".mp3", key);
+}
+
+static tts_cache_entry_t *tts_cache_find(uint64_t key)
+{
+    for (int i = 0; i < TTS_CACHE_MAX_ENTRIES; i++)
+    {
+        if (s_entries[i].used && s_entries[i].key == key)
+        {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+/// @brief 找到最久未使用的条目
+/// @param in_ram true: 只考虑 PSRAM 中的条目, false: 只考虑 storage 分区中的条目
+static tts_cache_entry_t *tts_cache_lru(bool in_ram, const tts_cache_entry_t *exclude)
+{
+    tts_cache_entry_t *victim = NULL;
+    for (int i = 0; i < TTS_CACHE_MAX_ENTRIES; i++)
+    {
+        tts_cache_entry_t *e = &s_entries[i];
+        if (!e->used || e == exclude || e->readers)
+            continue;
+        if (in_ram ? (e->data == NULL) : !e->on_disk)
+            continue;
+        if (victim == NULL || e->last_use < victim->last_use)
+            victim = e;
+    }
+    return victim;
+}
+
+static void tts_cache_drop(tts_cache_entry_t *e)
+{
+    if (e->on_disk)
+    {
+        char path[48];
+        tts_cache_path(e->key, path, sizeof(path));
+        remove(path);
+        s_stats.disk_bytes -= e->len;
+    }
+    if (e->data)
+    {
+        heap_caps_free(e->data);
+        s_stats.ram_bytes -= e->len;
+    }
+    memset(e, 0, sizeof(tts_cache_entry_t));
+    s_stats.evictions++;
+}
+
+static void tts_cache_remove_from_disk(tts_cache_entry_t *e)
+{
+    char path[48];
+    tts_cache_path(e->key, path, sizeof(path));
+    remove(path);
+    e->on_disk = false;
+    s_stats.disk_bytes -= e->len;
+    if (e->data == NULL)
+    {
+        memset(e, 0, sizeof(tts_cache_entry_t));
+        s_stats.evictions++;
+    }
+}
+
+/// @brief 把 PSRAM 中的条目溢出到 storage 分区
+static void tts_cache_spill(tts_cache_entry_t *e)
+{
+    if (!e->on_disk && e->len <= TTS_CACHE_DISK_BYTES)
+    {
+        while (s_stats.disk_bytes + e->len > TTS_CACHE_DISK_BYTES)
+        {
+            tts_cache_entry_t *victim = tts_cache_lru(false, e);
+            if (victim == NULL)
+                break;
+            tts_cache_remove_from_disk(victim);
+        }
+
+        char path[48];
+        tts_cache_path(e->key, path, sizeof(path));
+        FILE *fp = fopen(path, "wb");
+        if (fp)
+        {
+            size_t written = fwrite(e->data, 1, e->len, fp);
+            fclose(fp);
+            if (written == e->len)
+            {
+                e->on_disk = true;
+                s_stats.disk_bytes += e->len;
+                s_stats.spills++;
+            }
+            else
+            {
+                remove(path);
+            }
+        }
+    }
+
+    if (!e->on_disk)
+    {
+        tts_cache_drop(e);
+        return;
+    }
+    heap_caps_free(e->data);
+    e->data = NULL;
+    s_stats.ram_bytes -= e->len;
+}
+
+static void tts_cache_make_room(size_t len)
+{
+    while (s_stats.ram_bytes + len > TTS_CACHE_RAM_BYTES)
+    {
+        tts_cache_entry_t *victim = tts_cache_lru(true, NULL);
+        if (victim == NULL)
+            break;
+        tts_cache_spill(victim);
+    }
+}
+
+/// @return 空闲条目, 所有条目都在被读取时返回 NULL
+static tts_cache_entry_t *tts_cache_alloc_entry(void)
+{
+    tts_cache_entry_t *oldest = NULL;
+    for (int i = 0; i < TTS_CACHE_MAX_ENTRIES; i++)
+    {
+        if (!s_entries[i].used)
+            return &s_entries[i];
+        if (s_entries[i].readers)
+            continue;
+        if (oldest == NULL || s_entries[i].last_use < oldest->last_use)
+            oldest = &s_entries[i];
+    }
+    if (oldest)
+        tts_cache_drop(oldest);
+    return oldest;
+}
+
+/// @brief 初始化缓存, 登记 storage 分区中上次留下的条目
+esp_err_t tts_cache_init(void)
+{
+    if (s_cache_mux)
+    {
+        return ESP_OK;
+    }
+    s_cache_mux = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(NULL != s_cache_mux, ESP_ERR_NO_MEM, TAG, "Failed create cache mutex");
+
+    const char *prefix = strrchr(TTS_CACHE_FILE_PREFIX, '/') + 1;
+    DIR *dir = opendir(TTS_CACHE_DIR);
+    if (dir == NULL)
+    {
+        return ESP_OK;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (strncmp(ent->d_name, prefix, strlen(prefix)) != 0)
+            continue;
+        uint64_t key = strtoull(ent->d_name + strlen(prefix), NULL, 16);
+        char path[48];
+        struct stat st;
+        tts_cache_path(key, path, sizeof(path));
+        if (stat(path, &st) != 0 || st.st_size <= 0)
+            continue;
+        tts_cache_entry_t *e = tts_cache_alloc_entry();
+        if (e == NULL)
+            break;
+        e->key = key;
+        e->len = st.st_size;
+        e->used = true;
+        e->on_disk = true;
+        s_stats.disk_bytes += e->len;
+    }
+    closedir(dir);
+    ESP_LOGI(TAG, "%" PRIu32 " bytes restored from storage", (uint32_t)s_stats.disk_bytes);
+    return ESP_OK;
+}
+
+/// @brief 以 (文本, 发音参数) 计算缓存键, FNV-1a 64
+uint64_t tts_cache_key(const char *text, const char *voice_params)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const char *parts[2] = {text, voice_params};
+    for (int i = 0; i < 2; i++)
+    {
+        for (const uint8_t *p = (const uint8_t *)parts[i]; p && *p; p++)
+        {
+            hash ^= *p;
+            hash *= 0x100000001b3ULL;
+        }
+        hash ^= 0xff; // 分隔符, 避免 "ab"+"c" 与 "a"+"bc" 冲突
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/// @brief 查找缓存, 命中时把数据交给 sink (如 audio_stream_write)
+/// @note sink 可能阻塞到播放器取走数据, 调用 sink 时不持有 s_cache_mux, 期间条目被钉住不会被淘汰
+/// @return ESP_OK 命中, ESP_ERR_NOT_FOUND 未命中, 其他值为 sink 返回的错误
+esp_err_t tts_cache_read(uint64_t key, tts_cache_sink_t sink)
+{
+    ESP_RETURN_ON_FALSE(NULL != s_cache_mux, ESP_ERR_INVALID_STATE, TAG, "cache is not initialized");
+    xSemaphoreTake(s_cache_mux, portMAX_DELAY);
+
+    tts_cache_entry_t *e = tts_cache_find(key);
+    if (e == NULL)
+    {
+        s_stats.misses++;
+        xSemaphoreGive(s_cache_mux);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // 钉住条目: 腾空间和调用 sink 期间都不会被溢出或淘汰
+    e->readers++;
+    if (e->data == NULL)
+    {
+        // 从 storage 分区读回 PSRAM
+        tts_cache_make_room(e->len);
+        uint8_t *buf = heap_caps_malloc(e->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        char path[48];
+        tts_cache_path(key, path, sizeof(path));
+        FILE *fp = buf ? fopen(path, "rb") : NULL;
+        size_t len = fp ? fread(buf, 1, e->len, fp) : 0;
+        if (fp)
+            fclose(fp);
+        if (len != e->len)
+        {
+            ESP_LOGW(TAG, "failed to load %s", path);
+            if (buf)
+                heap_caps_free(buf);
+            e->readers--;
+            tts_cache_drop(e);
+            s_stats.misses++;
+            xSemaphoreGive(s_cache_mux);
+            return ESP_ERR_NOT_FOUND;
+        }
+        e->data = buf;
+        s_stats.ram_bytes += e->len;
+        s_stats.hits_disk++;
+    }
+    else
+    {
+        s_stats.hits_ram++;
+    }
+    e->last_use = ++s_use_clock;
+
+    const uint8_t *data = e->data;
+    size_t len = e->len;
+    xSemaphoreGive(s_cache_mux);
+
+    esp_err_t err = sink ? sink(data, len) : ESP_OK;
+
+    xSemaphoreTake(s_cache_mux, portMAX_DELAY);
+    e->readers--;
+    xSemaphoreGive(s_cache_mux);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "sink failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+/// @brief 开始记录一次合成结果
+void tts_cache_begin(uint64_t key)
+{
+    s_stage_key = key;
+    s_stage_len = 0;
+    s_stage_active = true;
+}
+
+void tts_cache_append(const void *data, size_t len)
+{
+    if (!s_stage_active)
+        return;
+
+    if (s_stage_len + len > TTS_CACHE_ITEM_MAX)
+    {
+        tts_cache_discard();
+        return;
+    }
+
+    if (s_stage_len + len > s_stage_cap)
+    {
+        size_t cap = s_stage_cap ? s_stage_cap : (32 * 1024);
+        while (cap < s_stage_len + len)
+            cap *= 2;
+        uint8_t *buf = heap_caps_realloc(s_stage, cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (buf == NULL)
+        {
+            tts_cache_discard();
+            return;
+        }
+        s_stage = buf;
+        s_stage_cap = cap;
+    }
+    memcpy(s_stage + s_stage_len, data, len);
+    s_stage_len += len;
+}
+
+/// @brief 下载完整, 把记录的数据加入缓存
+void tts_cache_commit(void)
+{
+    if (!s_stage_active || s_stage_len == 0 || s_cache_mux == NULL)
+    {
+        tts_cache_discard();
+        return;
+    }
+    s_stage_active = false;
+
+    xSemaphoreTake(s_cache_mux, portMAX_DELAY);
+    if (tts_cache_find(s_stage_key) == NULL)
+    {
+        tts_cache_make_room(s_stage_len);
+        tts_cache_entry_t *e = tts_cache_alloc_entry();
+        if (e == NULL)
+        {
+            // 所有条目都在被读取, 这次不缓存
+            s_stage_len = 0;
+            xSemaphoreGive(s_cache_mux);
+            return;
+        }
+        // 暂存区直接交给缓存条目, 避免再拷贝一次
+        uint8_t *data = heap_caps_realloc(s_stage, s_stage_len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        e->data = data ? data : s_stage;
+        e->key = s_stage_key;
+        e->len = s_stage_len;
+        e->used = true;
+        e->on_disk = false;
+        e->last_use = ++s_use_clock;
+        s_stats.ram_bytes += e->len;
+        s_stats.inserts++;
+        s_stage = NULL;
+        s_stage_cap = 0;
+    }
+    s_stage_len = 0;
+    xSemaphoreGive(s_cache_mux);
+}
+
+void tts_cache_discard(void)
+{
+    s_stage_active = false;
+    s_stage_len = 0;
+}
+
+void tts_cache_get_stats(tts_cache_stats_t *stats)
+{
+    if (s_cache_mux == NULL)
+    {
+        memset(stats, 0, sizeof(tts_cache_stats_t));
+        return;
+    }
+    xSemaphoreTake(s_cache_mux, portMAX_DELAY);
+    memcpy(stats, &s_stats, sizeof(tts_cache_stats_t));
+    xSemaphoreGive(s_cache_mux);
+}
+
+void tts_cache_log_stats(void)
+{
+    tts_cache_stats_t st;
+    tts_cache_get_stats(&st);
+    ESP_LOGI(TAG, "hit ram/disk: %" PRIu32 "/%" PRIu32 ", miss: %" PRIu32 ", insert: %" PRIu32 ", spill: %" PRIu32 ", evict: %" PRIu32 ", ram: %uK, disk: %uK",
+             st.hits_ram, st.hits_disk, st.misses, st.inserts, st.spills, st.evictions,
+             (unsigned)(st.ram_bytes / 1024), (unsigned)(st.disk_bytes / 1024));
+}
@@ -0,0 +1,41 @@
+#ifndef TTS_CACHE_H
+#define TTS_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define TTS_CACHE_MAX_ENTRIES  (64)               // 最多缓存的语句数
+#define TTS_CACHE_RAM_BYTES    (512 * 1024)       // PSRAM 中热数据的上限
+#define TTS_CACHE_DISK_BYTES   (512 * 1024)       // storage 分区中溢出数据的上限
+#define TTS_CACHE_ITEM_MAX     (256 * 1024)       // 单条合成结果的上限, 超过则不缓存
+#ifndef TTS_CACHE_DIR
+#define TTS_CACHE_DIR          "/spiffs"           // storage 分区的挂载点
+#endif
+#define TTS_CACHE_FILE_PREFIX  TTS_CACHE_DIR "/ttsc_"
+
+typedef struct
+{
+    uint32_t hits_ram;   // PSRAM 命中
+    uint32_t hits_disk;  // 从 storage 分区读回
+    uint32_t misses;     // 未命中, 需要请求云端
+    uint32_t inserts;    // 新加入的条目
+    uint32_t spills;     // 从 PSRAM 溢出到 storage 分区
+    uint32_t evictions;  // 从缓存中彻底删除
+    size_t ram_bytes;
+    size_t disk_bytes;
+} tts_cache_stats_t;
+
+typedef esp_err_t (*tts_cache_sink_t)(const void *data, size_t len);
+
+esp_err_t tts_cache_init(void);
+uint64_t tts_cache_key(const char *text, const char *voice_params);
+esp_err_t tts_cache_read(uint64_t key, tts_cache_sink_t sink);
+void tts_cache_begin(uint64_t key);
+void tts_cache_append(const void *data, size_t len);
+void tts_cache_commit(void);
+void tts_cache_discard(void);
+void tts_cache_get_stats(tts_cache_stats_t *stats);
+void tts_cache_log_stats(void);
+
+#endif // TTS_CACHE_H
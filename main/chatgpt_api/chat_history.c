@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "chat_history.h"
+
+static const char *TAG = "chat_history";
+
+#define CHAT_MESSAGE_TOKENS (4) // 每条消息的角色和分隔符
+
+typedef struct
+{
+    chat_role_t role;
+    uint16_t off;       // 在 s_text 中的偏移
+    uint16_t len;
+    uint16_t tokens;
+} chat_turn_t;
+
+static char *s_text = NULL;
+static size_t s_text_used = 0;
+static chat_turn_t s_turns[CHAT_HISTORY_MAX_TURNS];
+static int s_turn_count = 0;
+static bool s_reply_open = false;   // 最后一轮是正在接收的回答
+static int64_t s_last_us = 0;
+static uint32_t s_evicted = 0;
+
+esp_err_t chat_history_init(void)
+{
+    if (s_text)
+    {
+        return ESP_OK;
+    }
+    s_text = heap_caps_malloc(CHAT_HISTORY_TEXT_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(NULL != s_text, ESP_ERR_NO_MEM, TAG, "no memory for chat history");
+    chat_history_clear();
+    return ESP_OK;
+}
+
+void chat_history_clear(void)
+{
+    s_text_used = 0;
+    s_turn_count = 0;
+    s_reply_open = false;
+}
+
+uint32_t chat_history_estimate_tokens(const char *text, size_t len)
+{
+    uint32_t wide = 0;
+    uint32_t ascii = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t c = (uint8_t)text[i];
+        if (c < 0x80)
+        {
+            ascii++;
+        }
+        else if ((c & 0xC0) != 0x80)
+        {
+            wide++; // 只数多字节字符的首字节
+        }
+    }
+    return wide + (ascii + 3) / 4;
+}
+
+/// @brief 淘汰最早的一轮, 后面的文字整体前移
+static void chat_history_evict(void)
+{
+    if (s_turn_count == 0)
+    {
+        return;
+    }
+    size_t drop = s_turns[0].len;
+    memmove(s_text, s_text + drop, s_text_used - drop);
+    s_text_used -= drop;
+    memmove(&s_turns[0], &s_turns[1], (s_turn_count - 1) * sizeof(chat_turn_t));
+    s_turn_count--;
+    for (int i = 0; i < s_turn_count; i++)
+    {
+        s_turns[i].off -= drop;
+    }
+    s_evicted++;
+}
+
+/// @brief 截断时不能切开多字节字符
+static size_t chat_history_utf8_floor(const char *text, size_t len)
+{
+    while (len > 0 && ((uint8_t)text[len] & 0xC0) == 0x80)
+    {
+        len--;
+    }
+    return len;
+}
+
+/// @brief 为新的一轮或正在追加的回答腾出 len 字节, 最后 keep 轮不淘汰, 空间仍然不够时返回可用的字节数
+static size_t chat_history_reserve(size_t len, int keep)
+{
+    while (s_text_used + len > CHAT_HISTORY_TEXT_SIZE && s_turn_count > keep)
+    {
+        chat_history_evict();
+    }
+    size_t room = CHAT_HISTORY_TEXT_SIZE - s_text_used;
+    return len < room ? len : room;
+}
+
+static chat_turn_t *chat_history_push(chat_role_t role, const char *text, size_t len)
+{
+    if (s_turn_count == CHAT_HISTORY_MAX_TURNS)
+    {
+        chat_history_evict();
+    }
+    size_t room = chat_history_reserve(len, 0);
+    len = room < len ? chat_history_utf8_floor(text, room) : len;
+    chat_turn_t *turn = &s_turns[s_turn_count++];
+    turn->role = role;
+    turn->off = s_text_used;
+    turn->len = len;
+    turn->tokens = chat_history_estimate_tokens(text, len) + CHAT_MESSAGE_TOKENS;
+    memcpy(s_text + s_text_used, text, len);
+    s_text_used += len;
+    return turn;
+}
+
+esp_err_t chat_history_add_user(const char *text, size_t len)
+{
+    ESP_RETURN_ON_FALSE(NULL != s_text, ESP_ERR_INVALID_STATE, TAG, "chat history not initialized");
+    int64_t now = esp_timer_get_time();
+    if (s_turn_count > 0 && now - s_last_us > CHAT_HISTORY_IDLE_MS * 1000LL)
+    {
+        ESP_LOGI(TAG, "idle for %lld s, start a new conversation", (now - s_last_us) / 1000000);
+        chat_history_clear();
+    }
+    s_last_us = now;
+    s_reply_open = false;
+    chat_history_push(CHAT_ROLE_USER, text, len);
+    return ESP_OK;
+}
+
+void chat_history_reply_begin(void)
+{
+    if (s_text == NULL || s_turn_count == 0)
+    {
+        return;
+    }
+    chat_history_push(CHAT_ROLE_ASSISTANT, "", 0);
+    s_reply_open = true;
+}
+
+void chat_history_reply_append(const char *text, size_t len)
+{
+    if (!s_reply_open)
+    {
+        return;
+    }
+    // 问题和正在接收的回答不淘汰, 空间不够时截断回答
+    size_t room = chat_history_reserve(len, 2);
+    len = room < len ? chat_history_utf8_floor(text, room) : len;
+    chat_turn_t *turn = &s_turns[s_turn_count - 1];
+    memcpy(s_text + s_text_used, text, len);
+    s_text_used += len;
+    turn->len += len;
+    turn->tokens += chat_history_estimate_tokens(text, len);
+}
+
+void chat_history_reply_end(bool ok)
+{
+    if (s_text == NULL)
+    {
+        return;
+    }
+    if (!ok || (s_reply_open && s_turns[s_turn_count - 1].len == 0))
+    {
+        // 回答失败: 问题和回答都丢弃, 只回退最后的用户问题及其后的内容
+        while (s_turn_count > 0)
+        {
+            chat_turn_t *turn = &s_turns[--s_turn_count];
+            s_text_used = turn->off;
+            if (turn->role == CHAT_ROLE_USER)
+            {
+                break;
+            }
+        }
+    }
+    s_reply_open = false;
+    s_last_us = esp_timer_get_time();
+}
+
+typedef struct
+{
+    char *buf;
+    size_t size;
+    size_t len;   // 需要的总长度, 可能超过 size
+} json_writer_t;
+
+static void json_put(json_writer_t *w, const char *s, size_t n)
+{
+    if (w->len < w->size)
+    {
+        size_t room = w->size - w->len;
+        memcpy(w->buf + w->len, s, n < room ? n : room);
+    }
+    w->len += n;
+}
+
+static void json_put_str(json_writer_t *w, const char *s)
+{
+    json_put(w, s, strlen(s));
+}
+
+static void json_put_escaped(json_writer_t *w, const char *s, size_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+    json_put(w, "\"", 1);
+    size_t run = 0; // 不需要转义的连续字节一次写入
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t c = (uint8_t)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        json_put(w, s + run, i - run);
+        run = i + 1;
+        switch (c)
+        {
+        case '"':
+            json_put(w, "\\\"", 2);
+            break;
+        case '\\':
+            json_put(w, "\\\\", 2);
+            break;
+        case '\n':
+            json_put(w, "\\n", 2);
+            break;
+        case '\r':
+            json_put(w, "\\r", 2);
+            break;
+        case '\t':
+            json_put(w, "\\t", 2);
+            break;
+        default:
+        {
+            char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            json_put(w, u, sizeof(u));
+            break;
+        }
+        }
+    }
+    json_put(w, s + run, n - run);
+    json_put(w, "\"", 1);
+}
+
+static void json_put_message(json_writer_t *w, const char *role, const char *text, size_t len)
+{
+    json_put_str(w, "{\"role\":\"");
+    json_put_str(w, role);
+    json_put_str(w, "\",\"content\":");
+    json_put_escaped(w, text, len);
+    json_put_str(w, "}");
+}
+
+/// @brief 从最新的一轮往前, 找出预算内最早的一轮; 最后一轮(当前问题)总是包含在内
+static int chat_history_first_turn(void)
+{
+    int last = s_turn_count - (s_reply_open ? 1 : 0);
+    uint32_t tokens = 0;
+    int first = last;
+    while (first > 0)
+    {
+        uint32_t t = s_turns[first - 1].tokens;
+        if (first < last && tokens + t > CHAT_HISTORY_TOKEN_BUDGET)
+        {
+            break;
+        }
+        tokens += t;
+        first--;
+    }
+    // 对话从用户的问题开始
+    while (first < last && s_turns[first].role != CHAT_ROLE_USER)
+    {
+        first++;
+    }
+    return first;
+}
+
+size_t chat_history_serialize(const chat_request_opts_t *opts, char *buf, size_t size)
+{
+    json_writer_t w = {.buf = buf, .size = size, .len = 0};
+    char num[32];
+
+    json_put_str(&w, "{\"model\":");
+    json_put_escaped(&w, opts->model, strlen(opts->model));
+    json_put_str(&w, ",\"messages\":[");
+    json_put_message(&w, "system", opts->system, strlen(opts->system));
+    if (s_text)
+    {
+        int last = s_turn_count - (s_reply_open ? 1 : 0);
+        for (int i = chat_history_first_turn(); i < last; i++)
+        {
+            json_put_str(&w, ",");
+            json_put_message(&w, s_turns[i].role == CHAT_ROLE_USER ? "user" : "assistant", s_text + s_turns[i].off, s_turns[i].len);
+        }
+    }
+    json_put_str(&w, "],\"temperature\":");
+    snprintf(num, sizeof(num), "%g", opts->temperature);
+    json_put_str(&w, num);
+    json_put_str(&w, ",\"presence_penalty\":0,\"frequency_penalty\":0");
+    if (opts->stream)
+    {
+        json_put_str(&w, ",\"stream\":true");
+    }
+    json_put_str(&w, "}");
+
+    if (size > 0)
+    {
+        buf[w.len < size ? w.len : size - 1] = '\0';
+    }
+    return w.len;
+}
+
+void chat_history_log_stats(void)
+{
+    uint32_t tokens = 0;
+    for (int i = 0; i < s_turn_count; i++)
+    {
+        tokens += s_turns[i].tokens;
+    }
+    ESP_LOGI(TAG, "%d turns, %zu/%d bytes, ~%lu tokens, %lu evicted", s_turn_count, s_text_used, CHAT_HISTORY_TEXT_SIZE,
+             (unsigned long)tokens, (unsigned long)s_evicted);
+}
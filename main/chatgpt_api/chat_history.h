@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define CHAT_HISTORY_TEXT_SIZE     (8 * 1024)          // 所有轮次的文字共用一块 PSRAM
+#define CHAT_HISTORY_MAX_TURNS     (16)
+#define CHAT_HISTORY_TOKEN_BUDGET  (1024)              // 请求中历史对话(含当前问题)的 token 上限
+#define CHAT_HISTORY_IDLE_MS       (5 * 60 * 1000)     // 超过该时间没有对话, 下一个问题开始新的会话
+
+    typedef enum
+    {
+        CHAT_ROLE_USER = 0,
+        CHAT_ROLE_ASSISTANT,
+    } chat_role_t;
+
+    /// @brief 请求中除对话外的参数
+    typedef struct
+    {
+        const char *model;
+        const char *system;
+        float temperature;
+        bool stream;
+    } chat_request_opts_t;
+
+    /**
+     * @brief 多轮对话记录.
+     *
+     * 各轮的文字连续存放在一块固定的 PSRAM 中, 空间或轮数不够时淘汰最早的轮次, 不产生堆碎片.
+     * 请求体直接由记录序列化为 JSON, 从最新的一轮往前取, 直到估计的 token 数达到预算.
+     * 只在聊天任务中使用, 不加锁.
+     */
+    esp_err_t chat_history_init(void);
+    void chat_history_clear(void);
+
+    /// @brief 记录用户的问题, 距上一轮超过 CHAT_HISTORY_IDLE_MS 时先清空记录
+    esp_err_t chat_history_add_user(const char *text, size_t len);
+
+    /// @brief 流式接收回答: 开始, 逐段追加, 结束
+    void chat_history_reply_begin(void);
+    void chat_history_reply_append(const char *text, size_t len);
+    /// @brief ok 为 false 时丢弃回答和对应的问题, 避免连续两个没有回答的问题
+    void chat_history_reply_end(bool ok);
+
+    /**
+     * @brief 把 system 提示和预算内的对话序列化为 chat/completions 请求体.
+     * @return 完整请求体的长度(不含结尾的 0), 大于等于 size 时 buf 中的内容被截断, 需要更大的缓冲重新调用
+     */
+    size_t chat_history_serialize(const chat_request_opts_t *opts, char *buf, size_t size);
+
+    /// @brief 粗略估计 token 数: 非 ASCII 字符每个算 1 个, ASCII 每 4 个字节算 1 个
+    uint32_t chat_history_estimate_tokens(const char *text, size_t len);
+
+    void chat_history_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
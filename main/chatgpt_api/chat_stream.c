@@ -0,0 +1,211 @@
+#include <string.h>
+#include "json_utils.h"
+
+#include "chat_stream.h"
+
+// 句末标点, 中文标点为 UTF-8 编码
+static const char *const sentence_ends[] = {"。", "！", "？", "；", "…", "\n", "!", "?", ";"};
+static const char *const clause_ends[] = {"，", "、", "：", ","};
+
+void chat_stream_init(chat_stream_t *cs, chat_stream_sentence_cb_t on_sentence, void *arg)
+{
+    memset(cs, 0, sizeof(chat_stream_t));
+    cs->on_sentence = on_sentence;
+    cs->arg = arg;
+}
+
+static size_t chat_stream_match(const char *p, const char *end, const char *const *marks, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t n = strlen(marks[i]);
+        if ((size_t)(end - p) >= n && memcmp(p, marks[i], n) == 0)
+        {
+            return n;
+        }
+    }
+    return 0;
+}
+
+/// @brief 回调前 len 个字节并从句子缓冲中移除, 只有空白时不回调
+static void chat_stream_emit(chat_stream_t *cs, size_t len)
+{
+    char saved = cs->sentence[len];
+    cs->sentence[len] = '\0';
+
+    const char *p = cs->sentence;
+    while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')
+    {
+        p++;
+    }
+    if (*p && cs->on_sentence)
+    {
+        cs->on_sentence(cs->sentence, p - cs->sentence, cs->arg);
+        cs->sentences++;
+    }
+
+    cs->sentence[len] = saved;
+    memmove(cs->sentence, cs->sentence + len, cs->sentence_len - len);
+    cs->sentence_len -= len;
+}
+
+/// @brief 在 UTF-8 字符边界上回退, 避免把一个汉字切成两半
+static size_t chat_stream_utf8_floor(const char *s, size_t len)
+{
+    while (len > 0 && ((unsigned char)s[len] & 0xC0) == 0x80)
+    {
+        len--;
+    }
+    return len;
+}
+
+/// @brief 从句子缓冲中切出所有完整的句子
+static void chat_stream_split(chat_stream_t *cs)
+{
+    size_t i = 0;
+    size_t last_clause = 0;
+    bool blank = true; // [0, i) 只有空白
+    while (i < cs->sentence_len)
+    {
+        const char *p = cs->sentence + i;
+        const char *end = cs->sentence + cs->sentence_len;
+        size_t n = chat_stream_match(p, end, sentence_ends, sizeof(sentence_ends) / sizeof(sentence_ends[0]));
+        // 英文句号后面跟空白才算句末, 避免切开小数和缩写
+        if (0 == n && *p == '.' && p + 1 < end && (p[1] == ' ' || p[1] == '\n'))
+        {
+            n = 1;
+        }
+        // 句子前面的换行不单独成句, 留给下一句作为开头的空白
+        if (n && blank && *p == '\n')
+        {
+            i += n;
+            continue;
+        }
+        if (n)
+        {
+            chat_stream_emit(cs, i + n);
+            i = 0;
+            last_clause = 0;
+            blank = true;
+            continue;
+        }
+
+        n = chat_stream_match(p, end, clause_ends, sizeof(clause_ends) / sizeof(clause_ends[0]));
+        if (n)
+        {
+            last_clause = i + n;
+            if (last_clause >= CHAT_STREAM_COMMA_SPLIT)
+            {
+                chat_stream_emit(cs, last_clause);
+                i = 0;
+                last_clause = 0;
+                blank = true;
+                continue;
+            }
+            i += n;
+            blank = false;
+            continue;
+        }
+        if (*p != ' ' && *p != '\n' && *p != '\r' && *p != '\t')
+        {
+            blank = false;
+        }
+        i++;
+    }
+
+    // 一直没有标点, 缓冲快满时强制切分
+    if (cs->sentence_len >= CHAT_STREAM_SENTENCE_MAX - 64)
+    {
+        size_t cut = last_clause ? last_clause : chat_stream_utf8_floor(cs->sentence, cs->sentence_len - 1);
+        chat_stream_emit(cs, cut);
+    }
+}
+
+static void chat_stream_append(chat_stream_t *cs, const char *text, size_t len)
+{
+    cs->content_len += len;
+    while (len > 0)
+    {
+        size_t room = CHAT_STREAM_SENTENCE_MAX - 1 - cs->sentence_len;
+        size_t n = len < room ? len : room;
+        memcpy(cs->sentence + cs->sentence_len, text, n);
+        cs->sentence_len += n;
+        text += n;
+        len -= n;
+        chat_stream_split(cs);
+    }
+}
+
+static void chat_stream_line(chat_stream_t *cs, char *line, size_t len)
+{
+    // 空行是事件分隔符, ':' 开头的是注释(心跳)
+    if (len < 5 || strncmp(line, "data:", 5) != 0)
+    {
+        return;
+    }
+    line += 5;
+    len -= 5;
+    while (len > 0 && *line == ' ')
+    {
+        line++;
+        len--;
+    }
+
+    if (strncmp(line, "[DONE]", 6) == 0)
+    {
+        cs->done = true;
+        return;
+    }
+
+    // 在行缓冲中原地提取并反转义, 每个事件不再构建 cJSON 树
+    char *content = json_extract_string(line, len, "choices[0].delta.content");
+    if (content)
+    {
+        chat_stream_append(cs, content, strlen(content));
+    }
+}
+
+void chat_stream_feed(chat_stream_t *cs, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = data[i];
+        if (c == '\n')
+        {
+            if (!cs->line_overflow)
+            {
+                size_t n = cs->line_len;
+                if (n > 0 && cs->line[n - 1] == '\r')
+                {
+                    n--;
+                }
+                cs->line[n] = '\0';
+                chat_stream_line(cs, cs->line, n);
+            }
+            cs->line_len = 0;
+            cs->line_overflow = false;
+        }
+        else if (cs->line_len < CHAT_STREAM_LINE_MAX - 1)
+        {
+            cs->line[cs->line_len++] = c;
+        }
+        else
+        {
+            // 超长的行丢弃
+            cs->line_overflow = true;
+        }
+    }
+}
+
+void chat_stream_finish(chat_stream_t *cs)
+{
+    // 最后一行可能没有换行符
+    if (cs->line_len > 0 && !cs->line_overflow)
+    {
+        chat_stream_feed(cs, "\n", 1);
+    }
+    if (cs->sentence_len > 0)
+    {
+        chat_stream_emit(cs, cs->sentence_len);
+    }
+}
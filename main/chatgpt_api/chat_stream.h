@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define CHAT_STREAM_LINE_MAX      (2 * 1024) // 单行 SSE 事件的最大长度
+#define CHAT_STREAM_SENTENCE_MAX  (512)      // 单句的最大长度, 超出时强制切分
+#define CHAT_STREAM_COMMA_SPLIT   (60)       // 句子超过该字节数时在逗号处切分, 尽早送去合成
+
+    /**
+     * @brief 切分出一个完整句子时的回调, text 只在回调期间有效
+     *
+     * @param text 原文, 包含句子前面的空白(英文句子之间的空格), 保存对话历史时使用
+     * @param lead text 开头空白的字节数, text + lead 是送去合成的句子
+     */
+    typedef void (*chat_stream_sentence_cb_t)(const char *text, size_t lead, void *arg);
+
+    /**
+     * @brief 流式(SSE)聊天回复的增量解析器.
+     *
+     * 不依赖 HTTP 和 FreeRTOS, 按任意大小的数据块喂入 "data: {...}" 事件流,
+     * 取出 choices[0].delta.content 拼接, 遇到句末标点时回调一个完整句子.
+     */
+    typedef struct
+    {
+        char line[CHAT_STREAM_LINE_MAX];
+        size_t line_len;
+        bool line_overflow;
+        char sentence[CHAT_STREAM_SENTENCE_MAX];
+        size_t sentence_len;
+        size_t sentences;    // 已回调的句子数
+        size_t content_len;  // 收到的回复总字节数
+        bool done;           // 收到 data: [DONE]
+        chat_stream_sentence_cb_t on_sentence;
+        void *arg;
+    } chat_stream_t;
+
+    void chat_stream_init(chat_stream_t *cs, chat_stream_sentence_cb_t on_sentence, void *arg);
+
+    /// @brief 喂入收到的数据, 可以在任意位置切断
+    void chat_stream_feed(chat_stream_t *cs, const char *data, size_t len);
+
+    /// @brief 数据结束, 回调剩余的不完整句子
+    void chat_stream_finish(chat_stream_t *cs);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,136 +1,345 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_check.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_crt_bundle.h"
 #include "esp_http_client.h"
-#include "cJSON.h"
 
 #include "baidu_api.h"
 #include "chatgpt_api.h"
+#include "chat_stream.h"
+#include "audio_stream.h"
+#include "app_http_pool.h"
+#include "app_tls_session.h"
+#include "http_arena.h"
+#include "json_utils.h"
+#include "voice_sched.h"
+#include "llm_provider.h"
+#include "chat_history.h"
 
 static char *TAG = "chatgpt_api";
 
-// chatgpt API配置: https://www.closeai-asia.com/
-// const char *url    = "https://api.closeai-proxy.xyz/v1/chat/completions";
-// const char *apiKey = "apikey";
-// const char *model  = "gpt-3.5-turbo";
+// 服务地址, API Key 和模型见 llm_provider.c, 可以配置多个服务, 保存在 NVS
 
-// kimi API配置: https://platform.moonshot.cn/docs/api/chat#chat-completion
-// const char *url    = "https://api.moonshot.cn/v1/chat/completions";
-// const char *apiKey = "apikey";
-// const char *model  = "moonshot-v1-8k"; // moonshot-v1-32k, moonshot-v1-128k
+// 响应体和回答都放在 arena 中, 每次请求开始时整体回收; 调用者没有提供 arena 时使用模块内部的
+static http_arena_t s_chat_arena;
 
-// DeepSeek API配置: https://platform.deepseek.com/usage
-const char *url    = "https://api.deepseek.com/v1/chat/completions";
-const char *apiKey = "Bearer 这里是自己的apikey";
-const char *model  = "deepseek-chat";
+#define CHAT_STREAM_ENABLE        (1)          // 流式回复, 每得到一句就送去合成播放
+#define CHAT_STREAM_READ_SIZE     (1024)
+#define CHAT_TTS_QUEUE_LEN        (8)
+#define CHAT_TTS_TASK_STACK_SIZE  (8 * 1024)
 
-#define MAX_BUFFER_SIZE (1024 * 8)
-static char *response_data = NULL;
-static uint32_t file_total_len = 0;
+static QueueHandle_t s_tts_queue = NULL;
+static SemaphoreHandle_t s_tts_done = NULL;
+static StaticTask_t s_tts_task_buffer;
+static StackType_t *s_tts_task_stack = NULL;
+
+typedef struct
+{
+    int64_t start_us;
+    int sentences;
+    bool cancelled; // 播放被打断(新的唤醒)或请求被调度器取消, 不再合成剩余的句子
+} chat_stream_ctx_t;
 
 static const char *system_content = "你是一个乐于助人的个人助手,请简短且准确的回答用户问题.";
 
-// http客户端的事件处理回调函数
-static esp_err_t http_client_event_handler(esp_http_client_event_t *evt)
+static http_arena_t *chat_arena_get(http_arena_t *arena)
+{
+    if (arena != NULL)
+    {
+        return arena;
+    }
+    if (s_chat_arena.chunk_size == 0)
+    {
+        http_arena_init(&s_chat_arena, HTTP_ARENA_CHUNK_SIZE);
+    }
+    return &s_chat_arena;
+}
+
+/// @brief 由对话记录直接生成请求体, 各服务只有模型名不同
+static size_t chat_build_body(const llm_provider_config_t *provider, void *arg, char *buf, size_t size)
+{
+    chat_request_opts_t opts = *(const chat_request_opts_t *)arg;
+    opts.model = provider->model;
+    size_t len = chat_history_serialize(&opts, buf, size);
+    if (len < size)
+    {
+        ESP_LOGI(TAG, "Chat request to %s: %s", provider->name, buf);
+    }
+    return len;
+}
+
+/// @brief 非流式获得回答
+/// @param arena 响应体所在的 arena, NULL 使用模块内部的
+/// @return 回答内容, 在 arena 中, 在 arena 下一次复位前有效, 调用者不要释放
+char *chatgpt_get_answer(chat_request_opts_t *request, http_arena_t *arena)
+{
+    if (request == NULL)
+    {
+        return NULL;
+    }
+
+    char *answer = NULL;
+
+    arena = chat_arena_get(arena);
+    http_arena_reset(arena);
+    // 读取缓冲先于响应体分配, 响应体才能在 arena 中连续增长
+    char *buffer = http_arena_alloc(arena, CHAT_STREAM_READ_SIZE);
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+
+    llm_conn_t conn = {0};
+    esp_err_t err = llm_open(chat_build_body, request, NULL, &conn);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Chat HTTP Post failed: %s", esp_err_to_name(err));
+        return NULL;
+    }
+
+    http_arena_body_begin(arena);
+    while (err == ESP_OK)
+    {
+        int len = esp_http_client_read(conn.client, buffer, CHAT_STREAM_READ_SIZE);
+        if (len < 0)
+        {
+            err = ESP_FAIL;
+            break;
+        }
+        if (len == 0)
+        {
+            if (!esp_http_client_is_complete_data_received(conn.client))
+            {
+                err = ESP_ERR_HTTP_INCOMPLETE_DATA;
+            }
+            break;
+        }
+        err = http_arena_body_append(arena, buffer, len);
+    }
+    size_t response_len = 0;
+    char *response_data = http_arena_body_end(arena, &response_len);
+    if (err == ESP_OK && response_data == NULL)
+    {
+        err = ESP_ERR_NO_MEM;
+    }
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Chat Response Data: %s", response_data);
+        // 回答直接指向 arena 中的响应体
+        answer = json_extract_string(response_data, response_len, "choices[0].message.content");
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Chat HTTP read failed: %s", esp_err_to_name(err));
+    }
+
+    llm_close(&conn, err, err != ESP_OK && err != ESP_ERR_NO_MEM);
+    app_http_pool_log_stats();
+    app_tls_session_log_stats();
+    llm_provider_log_stats();
+    return answer;
+}
+
+// 逐句合成语音, 与大模型继续生成后面的内容并行
+static void chat_tts_task(void *pvParam)
 {
-    switch (evt->event_id)
-    {
-    case HTTP_EVENT_ERROR:
-        break;
-    case HTTP_EVENT_ON_CONNECTED:
-        file_total_len = 0;
-        break;
-    case HTTP_EVENT_HEADER_SENT:
-        break;
-    case HTTP_EVENT_ON_HEADER:
-        break;
-    case HTTP_EVENT_ON_DATA:
-        ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA, len=(%" PRIu32 " + %d) [%d]", file_total_len, evt->data_len, MAX_BUFFER_SIZE);
-        if ((file_total_len + evt->data_len) < MAX_BUFFER_SIZE)
+    while (true)
+    {
+        char *sentence = NULL;
+        if (xQueueReceive(s_tts_queue, &sentence, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        // NULL 表示本次回答结束
+        if (sentence == NULL)
         {
-            if (evt->user_data)
+            xSemaphoreGive(s_tts_done);
+            continue;
+        }
+        // 会话已被打断时丢弃, 否则 baidu_get_tts_result 会重新打开一个播放会话
+        if (audio_stream_is_open())
+        {
+            esp_err_t err = baidu_get_tts_result(sentence, strlen(sentence));
+            if (err != ESP_OK)
             {
-                memcpy(evt->user_data + file_total_len, evt->data, evt->data_len);
+                ESP_LOGE(TAG, "Error post baidu tts: %s", esp_err_to_name(err));
             }
-            file_total_len += evt->data_len;
         }
-        break;
-    case HTTP_EVENT_ON_FINISH:
-        break;
-    case HTTP_EVENT_DISCONNECTED:
-        break;
-    case HTTP_EVENT_REDIRECT:
-        break;
-    default:
-        break;
+        free(sentence);
+    }
+    vTaskDelete(NULL);
+}
+
+static esp_err_t chat_tts_init(void)
+{
+    if (s_tts_queue)
+    {
+        return ESP_OK;
     }
 
+    s_tts_done = xSemaphoreCreateBinary();
+    ESP_RETURN_ON_FALSE(NULL != s_tts_done, ESP_ERR_NO_MEM, TAG, "Failed create tts semaphore");
+    s_tts_queue = xQueueCreate(CHAT_TTS_QUEUE_LEN, sizeof(char *));
+    ESP_RETURN_ON_FALSE(NULL != s_tts_queue, ESP_ERR_NO_MEM, TAG, "Failed create tts queue");
+    s_tts_task_stack = (StackType_t *)heap_caps_malloc(CHAT_TTS_TASK_STACK_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    assert(s_tts_task_stack);
+    TaskHandle_t task = xTaskCreateStaticPinnedToCore(&chat_tts_task, "Chat TTS Task", CHAT_TTS_TASK_STACK_SIZE, NULL, 3, s_tts_task_stack, &s_tts_task_buffer, 1);
+    ESP_RETURN_ON_FALSE(NULL != task, ESP_FAIL, TAG, "Failed create chat tts task");
     return ESP_OK;
 }
 
-char *chatgpt_get_answer(char *request_params)
+static void chat_on_sentence(const char *text, size_t lead, void *arg)
 {
-    if (request_params == NULL)
+    chat_stream_ctx_t *ctx = (chat_stream_ctx_t *)arg;
+    const char *sentence = text + lead;
+    if (ctx->cancelled || voice_sched_cancelled())
     {
-        return NULL;
+        ctx->cancelled = true;
+        return;
     }
-    
-    char *answer = NULL;
 
-    if (response_data == NULL)
+    if (ctx->sentences == 0)
+    {
+        ESP_LOGI(TAG, "first sentence after %lld ms", (esp_timer_get_time() - ctx->start_us) / 1000);
+        // 所有句子的语音写入同一个播放会话, 连续播放
+        audio_stream_open();
+    }
+    else if (!audio_stream_is_open())
+    {
+        ESP_LOGW(TAG, "playback interrupted, drop the rest of the answer");
+        ctx->cancelled = true;
+        return;
+    }
+    ESP_LOGI(TAG, "sentence %d: %s", ctx->sentences, sentence);
+
+    char *copy = heap_caps_malloc(strlen(sentence) + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (copy != NULL)
+    {
+        strcpy(copy, sentence);
+        // 队列满时阻塞, 语音合成跟不上时暂停读取回复
+        xQueueSend(s_tts_queue, &copy, portMAX_DELAY);
+    }
+    else
     {
-        response_data = heap_caps_calloc(1, MAX_BUFFER_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        assert(response_data);
-        ESP_LOGI(TAG, "successfully created response_data with a size: %zu", MAX_BUFFER_SIZE);
+        // 没有内存复制句子: 等排队的句子合成完, 直接用解析器缓冲中的句子合成, 保持播放顺序
+        ESP_LOGW(TAG, "no mem to queue sentence %d, synthesize it in place", ctx->sentences);
+        char *end = NULL;
+        xQueueSend(s_tts_queue, &end, portMAX_DELAY);
+        xSemaphoreTake(s_tts_done, portMAX_DELAY);
+        if (audio_stream_is_open())
+        {
+            esp_err_t err = baidu_get_tts_result((char *)sentence, strlen(sentence));
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Error post baidu tts: %s", esp_err_to_name(err));
+            }
+        }
     }
+    // 历史中保留句子之间的空白, 英文句子不会连在一起
+    chat_history_reply_append(text, strlen(text));
+    ctx->sentences++;
+}
 
-    // 发送HTTP请求
-    esp_http_client_config_t config = {
-        .url = url,
-        .event_handler = http_client_event_handler,
-        .user_data = response_data,
-        .crt_bundle_attach = esp_crt_bundle_attach,
+/// @brief 发送 "stream": true 的请求, 边接收边切句并交给语音合成任务
+static esp_err_t chatgpt_stream_answer(chat_request_opts_t *request, http_arena_t *arena)
+{
+    esp_err_t err = chat_tts_init();
+    arena = chat_arena_get(arena);
+    http_arena_reset(arena);
+    chat_stream_t *cs = http_arena_alloc(arena, sizeof(chat_stream_t));
+    char *buffer = http_arena_alloc(arena, CHAT_STREAM_READ_SIZE);
+    llm_conn_t conn = {0};
+    chat_stream_ctx_t ctx = {
+        .start_us = esp_timer_get_time(),
     };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Authorization", apiKey);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    esp_http_client_set_post_field(client, request_params, strlen(request_params));
-    esp_http_client_set_timeout_ms(client, 5000);
-    esp_err_t err = esp_http_client_perform(client); // 执行HTTP请求,并等待响应
-    if (err == ESP_OK)
+    if (err != ESP_OK || cs == NULL || buffer == NULL)
     {
-        ESP_LOGI(TAG, "Chat Response Data: %s", response_data);
-        cJSON *json = cJSON_Parse(response_data);
-        if (json != NULL)
+        err = (err != ESP_OK) ? err : ESP_ERR_NO_MEM;
+        goto _exit;
+    }
+    chat_stream_init(cs, chat_on_sentence, &ctx);
+
+    // 首选服务响应慢时对冲到下一个服务, 失败时切换, 返回时响应头已经是 200
+    err = llm_open(chat_build_body, request, "text/event-stream", &conn);
+    if (err != ESP_OK)
+    {
+        goto _exit;
+    }
+    chat_history_reply_begin();
+
+    while (err == ESP_OK && !ctx.cancelled)
+    {
+        int len = esp_http_client_read(conn.client, buffer, CHAT_STREAM_READ_SIZE);
+        if (len < 0)
         {
-            cJSON *choices_array = cJSON_GetObjectItem(json, "choices");
-            if (choices_array != NULL && cJSON_IsArray(choices_array) && cJSON_GetArraySize(choices_array) > 0)
+            err = ESP_FAIL;
+            break;
+        }
+        if (len == 0)
+        {
+            // 未读完就结束说明超时或连接断开
+            if (!esp_http_client_is_complete_data_received(conn.client))
             {
-                cJSON *message_obj = cJSON_GetObjectItem(cJSON_GetArrayItem(choices_array, 0), "message");
-                if (message_obj != NULL)
-                {
-                    answer = strdup(cJSON_GetObjectItem(message_obj, "content")->valuestring);
-                }
+                err = ESP_ERR_HTTP_INCOMPLETE_DATA;
             }
-            cJSON_Delete(json);
+            break;
+        }
+        chat_stream_feed(cs, buffer, len);
+        // 还没有句子可以播放时也要及时响应取消
+        if (voice_sched_cancelled())
+        {
+            ctx.cancelled = true;
         }
     }
-    else
+    if (err == ESP_OK && !ctx.cancelled)
     {
-        answer = "Chat HTTP Post failed";
+        chat_stream_finish(cs);
     }
+    ESP_LOGI(TAG, "Chat stream: %s, %zu bytes, %d sentences, %lld ms", esp_err_to_name(err),
+             cs->content_len, ctx.sentences, (esp_timer_get_time() - ctx.start_us) / 1000);
 
-    free(request_params);
-    request_params = NULL;
-    esp_http_client_cleanup(client);
-    return answer;
+    // 等待剩余的句子合成完毕后结束播放会话
+    if (ctx.sentences > 0)
+    {
+        char *end = NULL;
+        xQueueSend(s_tts_queue, &end, portMAX_DELAY);
+        xSemaphoreTake(s_tts_done, portMAX_DELAY);
+        if (audio_stream_is_open())
+        {
+            audio_stream_finish();
+        }
+    }
+    // 打断时回复没有读完, 连接不能复用; 读取中途出错算作服务的失败
+    llm_close(&conn, ctx.cancelled ? ESP_FAIL : err, !ctx.cancelled && err != ESP_OK);
+    app_http_pool_log_stats();
+    app_tls_session_log_stats();
+    llm_provider_log_stats();
+
+    if (ctx.cancelled)
+    {
+        err = ESP_OK;
+    }
+    else if (err == ESP_OK && ctx.sentences == 0)
+    {
+        ESP_LOGE(TAG, "Chat stream returned no content");
+        err = ESP_FAIL;
+    }
+
+_exit:
+    // 被打断时保留已经生成的部分, 下一个问题可以接着问
+    chat_history_reply_end(ctx.sentences > 0 && (err == ESP_OK || ctx.cancelled));
+    chat_history_log_stats();
+    return err;
 }
 
-esp_err_t chatgpt_bot(uint8_t *audio, int audio_len)
+esp_err_t chatgpt_bot(uint8_t *audio, int audio_len, http_arena_t *arena)
 {
     // 1.百度语音转文字
     ESP_LOGE(TAG, "start baidu asr");
-    char *recognition_result = baidu_get_asr_result(audio, audio_len);
+    char *recognition_result = baidu_get_asr_result(audio, audio_len, arena);
     if (recognition_result == NULL)
     {
         ESP_LOGE(TAG, "0. No text recognized");
@@ -150,45 +359,49 @@ esp_err_t chatgpt_bot(uint8_t *audio, int audio_len)
         return ESP_FAIL;
     }
 
-    // 2.构建请求参数
-    cJSON *root = cJSON_CreateObject();
-    cJSON *messages_array = cJSON_CreateArray();
-    // 添加系统信息
-    cJSON *sys_message = cJSON_CreateObject();
-    cJSON_AddStringToObject(sys_message, "role", "system");
-    cJSON_AddStringToObject(sys_message, "content", system_content);
-    cJSON_AddItemToArray(messages_array, sys_message);
-    // 添加当前用户的聊天记录
-    cJSON *user_message = cJSON_CreateObject();
-    cJSON_AddStringToObject(user_message, "role", "user");
-    cJSON_AddStringToObject(user_message, "content", recognition_result);
-    cJSON_AddItemToArray(messages_array, user_message);
-
-    cJSON_AddStringToObject(root, "model", model);
-    cJSON_AddItemToObject(root, "messages", messages_array);
-
-    cJSON_AddNumberToObject(root, "temperature", 1);
-    cJSON_AddNumberToObject(root, "presence_penalty", 0);
-    cJSON_AddNumberToObject(root, "frequency_penalty", 0);
+    if (voice_sched_cancelled())
+    {
+        ESP_LOGW(TAG, "chat cancelled after asr");
+        return ESP_OK;
+    }
 
-    char *request_params = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    ESP_LOGE(TAG, "Chat request: %s\n", request_params);
+    // 2.记录问题, 请求体由对话记录直接序列化, 带上预算内的前几轮对话
+    esp_err_t ret = chat_history_init();
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    chat_history_add_user(recognition_result, strlen(recognition_result));
+    chat_request_opts_t opts = {
+        .system = system_content,
+        .temperature = 1,
+        .stream = CHAT_STREAM_ENABLE,
+    };
 
+#if CHAT_STREAM_ENABLE
+    // 3.流式获得回答, 首句到达即开始合成播放, 不必等待完整回答
+    ESP_LOGE(TAG, "start chatgpt stream");
+    return chatgpt_stream_answer(&opts, arena);
+#else
     // 3.获得chatgpt的回答
     ESP_LOGE(TAG, "start chatgpt");
-    char *response = chatgpt_get_answer(request_params);
+    char *response = chatgpt_get_answer(&opts, arena);
     if (response == NULL)
     {
         ESP_LOGE(TAG, "0. Sorry, I can't understand.");
+        chat_history_reply_end(false);
         return ESP_FAIL;
     }
     ESP_LOGE(TAG, "++++++++++chatgpt response: %s\r\n", response);
     if (strcmp(response, "invalid_request_error") == 0)
     {
         ESP_LOGE(TAG, "1. Sorry, I can't understand.");
+        chat_history_reply_end(false);
         return ESP_FAIL;
     }
+    chat_history_reply_begin();
+    chat_history_reply_append(response, strlen(response));
+    chat_history_reply_end(true);
 
     // 4.文字转语音
     ESP_LOGE(TAG, "start baidu tts");
@@ -198,17 +411,6 @@ esp_err_t chatgpt_bot(uint8_t *audio, int audio_len)
         ESP_LOGE(TAG, "Error post baidu tts: %s", esp_err_to_name(status));
     }
 
-    // 5.释放内存
-    if (recognition_result)
-    {
-        free(recognition_result);
-        recognition_result = NULL;
-    }
-    if (response)
-    {
-        free(response);
-        response = NULL;
-    }
-
     return ESP_OK;
+#endif
 }
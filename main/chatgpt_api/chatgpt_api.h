@@ -1,5 +1,8 @@
 #pragma once
 
 #include "esp_system.h"
+#include "http_arena.h"
 
-esp_err_t chatgpt_bot(uint8_t *audio, int audio_len);
+/// @brief 语音聊天: 识别, 请求大模型, 合成并播放回答
+/// @param arena 请求使用的 arena, NULL 使用模块内部的; 并发调用时每个调用者传入自己的
+esp_err_t chatgpt_bot(uint8_t *audio, int audio_len, http_arena_t *arena);
@@ -0,0 +1,655 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_bit_defs.h"
+#include "esp_crt_bundle.h"
+#include "nvs.h"
+
+#include "app_http_pool.h"
+#include "cloud_config.h"
+#include "llm_provider.h"
+
+static const char *TAG = "llm_provider";
+
+#define LLM_NVS_NAMESPACE       "llm"
+#define LLM_NVS_KEY             "providers"
+#define LLM_ATTEMPT_MAX         (2)          // 同时进行的请求: 首选 + 对冲
+#define LLM_ATTEMPT_STACK_SIZE  (6 * 1024)
+#define LLM_EWMA_SHIFT          (2)          // 新样本的权重为 1/4
+#define LLM_ERROR_BODY_LEN      (256)
+#define LLM_BODY_SIZE_STEP      (1024)       // 请求体缓冲按该大小向上取整扩大
+
+typedef struct
+{
+    llm_provider_stats_t stats;
+    uint32_t samples[LLM_TTFB_SAMPLES];
+    uint8_t sample_count;
+    uint8_t sample_pos;
+    uint8_t consecutive_failures;   // 连续失败的服务排到后面
+} llm_provider_state_t;
+
+// 一个进行中的请求, 在自己的任务中阻塞地建立连接和读取响应头
+typedef struct
+{
+    int index;
+    TaskHandle_t task;
+    StaticTask_t task_buffer;
+    StackType_t *task_stack;
+    bool busy;                      // 被占用, 包括已被取消但还没有返回的请求
+    bool finished;
+    bool cancelled;                 // 输给了另一个请求或超时, 已被中止并记录了结果, 返回后自行关闭连接
+    int provider;
+    llm_provider_config_t config;   // 副本, 请求期间列表被修改不受影响
+    char *body;                     // 请求体缓冲, 在请求之间重复使用
+    size_t body_size;
+    size_t body_len;
+    const char *accept;
+    esp_http_client_handle_t client; // 请求进行中即已设置, 用于中止
+    esp_err_t err;
+    int64_t start_us;
+    uint32_t ttfb_ms;
+} llm_attempt_t;
+
+// 默认的服务列表, 都没有填写 API Key, 默认不启用 (模拟服务除外); 通过 llm_provider_set() 填写 Key 并启用后保存在 NVS
+static const llm_provider_config_t s_default_providers[] = {
+    // DeepSeek: https://platform.deepseek.com/usage
+    {.name = "deepseek", .url = CLOUD_CHAT_URL, .key = "这里是自己的apikey", .model = "deepseek-chat", .timeout_ms = 5000, .enabled = CLOUD_MOCK_ENABLE},
+    // kimi: https://platform.moonshot.cn/docs/api/chat#chat-completion
+    {.name = "kimi", .url = CLOUD_CHAT_KIMI_URL, .key = "apikey", .model = "moonshot-v1-8k", .timeout_ms = 5000, .enabled = CLOUD_MOCK_ENABLE},
+    // chatgpt: https://www.closeai-asia.com/
+    {.name = "closeai", .url = CLOUD_CHAT_CLOSEAI_URL, .key = "apikey", .model = "gpt-3.5-turbo", .timeout_ms = 5000, .enabled = CLOUD_MOCK_ENABLE},
+};
+
+static llm_provider_config_t s_providers[LLM_PROVIDER_MAX];
+static llm_provider_state_t s_state[LLM_PROVIDER_MAX];
+static int s_provider_count = 0;
+static llm_attempt_t s_attempts[LLM_ATTEMPT_MAX];
+static EventGroupHandle_t s_attempt_event = NULL;
+static SemaphoreHandle_t s_llm_mux = NULL;
+
+static void llm_lock(void)
+{
+    xSemaphoreTake(s_llm_mux, portMAX_DELAY);
+}
+
+static void llm_unlock(void)
+{
+    xSemaphoreGive(s_llm_mux);
+}
+
+static esp_err_t llm_provider_save(void)
+{
+    nvs_handle_t handle = 0;
+    esp_err_t err = nvs_open(LLM_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    ESP_RETURN_ON_ERROR(err, TAG, "nvs open failed");
+    err = nvs_set_blob(handle, LLM_NVS_KEY, s_providers, s_provider_count * sizeof(llm_provider_config_t));
+    err |= nvs_commit(handle);
+    nvs_close(handle);
+    return ESP_OK == err ? ESP_OK : ESP_FAIL;
+}
+
+static void llm_provider_load(void)
+{
+    nvs_handle_t handle = 0;
+    size_t len = sizeof(s_providers);
+    if (nvs_open(LLM_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        if (nvs_get_blob(handle, LLM_NVS_KEY, s_providers, &len) == ESP_OK && len % sizeof(llm_provider_config_t) == 0 && len > 0)
+        {
+            s_provider_count = len / sizeof(llm_provider_config_t);
+        }
+        nvs_close(handle);
+    }
+    if (s_provider_count == 0)
+    {
+        ESP_LOGW(TAG, "Not found, Set to default");
+        s_provider_count = sizeof(s_default_providers) / sizeof(s_default_providers[0]);
+        memcpy(s_providers, s_default_providers, sizeof(s_default_providers));
+    }
+    for (int i = 0; i < s_provider_count; i++)
+    {
+        s_providers[i].name[LLM_PROVIDER_NAME_LEN - 1] = '\0';
+        ESP_LOGI(TAG, "provider %d: %s %s (%s)", i, s_providers[i].name, s_providers[i].model, s_providers[i].enabled ? "enabled" : "disabled");
+    }
+}
+
+/// @brief 记录一次请求的结果, 调用者持有锁
+static void llm_provider_record(int index, esp_err_t err, uint32_t ttfb_ms)
+{
+    if (index < 0 || index >= s_provider_count)
+    {
+        return;
+    }
+    llm_provider_state_t *st = &s_state[index];
+    if (err != ESP_OK)
+    {
+        st->stats.failures++;
+        if (st->consecutive_failures < UINT8_MAX)
+        {
+            st->consecutive_failures++;
+        }
+        return;
+    }
+    st->consecutive_failures = 0;
+
+    if (st->stats.ewma_ttfb_ms == 0)
+    {
+        st->stats.ewma_ttfb_ms = ttfb_ms ? ttfb_ms : 1;
+    }
+    else
+    {
+        int32_t diff = (int32_t)ttfb_ms - (int32_t)st->stats.ewma_ttfb_ms;
+        st->stats.ewma_ttfb_ms += diff / (1 << LLM_EWMA_SHIFT);
+    }
+
+    st->samples[st->sample_pos] = ttfb_ms;
+    st->sample_pos = (st->sample_pos + 1) % LLM_TTFB_SAMPLES;
+    if (st->sample_count < LLM_TTFB_SAMPLES)
+    {
+        st->sample_count++;
+    }
+    // 样本很少, 插入排序即可
+    uint32_t sorted[LLM_TTFB_SAMPLES];
+    int n = st->sample_count;
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t v = st->samples[i];
+        int j = i;
+        while (j > 0 && sorted[j - 1] > v)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    st->stats.p95_ttfb_ms = sorted[(n * 95 + 99) / 100 - 1];
+}
+
+/// @brief 排序依据: 首字节耗时的滑动平均, 没有样本时按超时的一半估计, 每次连续失败加一个超时
+static uint32_t llm_provider_score(int index)
+{
+    const llm_provider_state_t *st = &s_state[index];
+    uint32_t timeout = s_providers[index].timeout_ms;
+    uint32_t score = st->stats.ewma_ttfb_ms ? st->stats.ewma_ttfb_ms : timeout / 2;
+    return score + st->consecutive_failures * timeout;
+}
+
+/// @brief 启用的服务按得分从小到大排列, 调用者持有锁
+static int llm_provider_order(int *order)
+{
+    int n = 0;
+    for (int i = 0; i < s_provider_count; i++)
+    {
+        if (!s_providers[i].enabled)
+        {
+            continue;
+        }
+        uint32_t score = llm_provider_score(i);
+        int j = n++;
+        while (j > 0 && llm_provider_score(order[j - 1]) > score)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    return n;
+}
+
+/// @brief 首选服务多久没有响应时发出对冲请求, 调用者持有锁
+static uint32_t llm_hedge_delay_ms(int index)
+{
+    const llm_provider_state_t *st = &s_state[index];
+    uint32_t delay = (st->sample_count >= LLM_TTFB_MIN_SAMPLES) ? st->stats.p95_ttfb_ms : s_providers[index].timeout_ms / 2;
+    return delay > LLM_HEDGE_MIN_MS ? delay : LLM_HEDGE_MIN_MS;
+}
+
+static void llm_attempt_task(void *pvParam)
+{
+    llm_attempt_t *at = (llm_attempt_t *)pvParam;
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        esp_err_t err = ESP_FAIL;
+        esp_http_client_config_t config = {
+            .url = at->config.url,
+            .crt_bundle_attach = esp_crt_bundle_attach,
+            .timeout_ms = at->config.timeout_ms,
+        };
+        esp_http_client_handle_t client = app_http_pool_acquire(&config);
+        llm_lock();
+        at->client = client;
+        bool cancelled = at->cancelled;
+        llm_unlock();
+        if (client && !cancelled)
+        {
+            char auth[LLM_PROVIDER_KEY_LEN + 8];
+            snprintf(auth, sizeof(auth), "Bearer %s", at->config.key);
+            esp_http_client_set_method(client, HTTP_METHOD_POST);
+            app_http_pool_set_header(client, "Authorization", auth);
+            app_http_pool_set_header(client, "Content-Type", "application/json");
+            if (at->accept)
+            {
+                app_http_pool_set_header(client, "Accept", at->accept);
+            }
+            else
+            {
+                esp_http_client_delete_header(client, "Accept");
+            }
+            err = app_http_pool_open(client, at->body, at->body_len);
+            int status = esp_http_client_get_status_code(client);
+            if (err == ESP_OK && status != 200)
+            {
+                char msg[LLM_ERROR_BODY_LEN];
+                int len = esp_http_client_read(client, msg, sizeof(msg) - 1);
+                ESP_LOGE(TAG, "%s: HTTP status %d: %.*s", at->config.name, status, len > 0 ? len : 0, msg);
+                err = ESP_FAIL;
+            }
+        }
+        uint32_t ttfb_ms = (esp_timer_get_time() - at->start_us) / 1000;
+
+        llm_lock();
+        cancelled = at->cancelled;
+        if (!cancelled)
+        {
+            // 被中止的请求在 llm_attempt_drop() 中已经记录
+            llm_provider_record(at->provider, err, ttfb_ms);
+        }
+        at->err = err;
+        at->ttfb_ms = ttfb_ms;
+        at->finished = true;
+        if (cancelled)
+        {
+            // 已有另一个请求胜出, 响应体没有读, 连接不能复用
+            if (client)
+            {
+                app_http_pool_release(client, ESP_FAIL);
+            }
+            at->client = NULL;
+            at->busy = false;
+        }
+        llm_unlock();
+
+        if (cancelled)
+        {
+            ESP_LOGI(TAG, "%s: lost the race, cancelled after %" PRIu32 " ms (%s)", at->config.name, ttfb_ms, esp_err_to_name(err));
+        }
+        else
+        {
+            xEventGroupSetBits(s_attempt_event, BIT(at->index));
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t llm_provider_init(void)
+{
+    if (s_llm_mux)
+    {
+        return ESP_OK;
+    }
+
+    s_llm_mux = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(NULL != s_llm_mux, ESP_ERR_NO_MEM, TAG, "Failed create llm mutex");
+    s_attempt_event = xEventGroupCreate();
+    ESP_RETURN_ON_FALSE(NULL != s_attempt_event, ESP_ERR_NO_MEM, TAG, "Failed create llm event group");
+
+    llm_provider_load();
+
+    for (int i = 0; i < LLM_ATTEMPT_MAX; i++)
+    {
+        llm_attempt_t *at = &s_attempts[i];
+        char name[16];
+        snprintf(name, sizeof(name), "LLM Attempt %d", i);
+        at->index = i;
+        at->task_stack = (StackType_t *)heap_caps_malloc(LLM_ATTEMPT_STACK_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        assert(at->task_stack);
+        at->task = xTaskCreateStaticPinnedToCore(&llm_attempt_task, name, LLM_ATTEMPT_STACK_SIZE, at, 3, at->task_stack, &at->task_buffer, 1);
+        ESP_RETURN_ON_FALSE(NULL != at->task, ESP_FAIL, TAG, "Failed create llm attempt task");
+    }
+    return ESP_OK;
+}
+
+int llm_provider_count(void)
+{
+    return s_provider_count;
+}
+
+esp_err_t llm_provider_get(int index, llm_provider_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(s_llm_mux && config, ESP_ERR_INVALID_STATE, TAG, "llm provider not initialized");
+    llm_lock();
+    esp_err_t err = (index >= 0 && index < s_provider_count) ? ESP_OK : ESP_ERR_INVALID_ARG;
+    if (err == ESP_OK)
+    {
+        *config = s_providers[index];
+    }
+    llm_unlock();
+    return err;
+}
+
+esp_err_t llm_provider_set(int index, const llm_provider_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(s_llm_mux && config, ESP_ERR_INVALID_STATE, TAG, "llm provider not initialized");
+    llm_lock();
+    esp_err_t err = (index >= 0 && index <= s_provider_count && index < LLM_PROVIDER_MAX) ? ESP_OK : ESP_ERR_INVALID_ARG;
+    if (err == ESP_OK)
+    {
+        s_providers[index] = *config;
+        memset(&s_state[index], 0, sizeof(llm_provider_state_t));
+        if (index == s_provider_count)
+        {
+            s_provider_count++;
+        }
+        err = llm_provider_save();
+    }
+    llm_unlock();
+    return err;
+}
+
+esp_err_t llm_provider_remove(int index)
+{
+    ESP_RETURN_ON_FALSE(s_llm_mux, ESP_ERR_INVALID_STATE, TAG, "llm provider not initialized");
+    llm_lock();
+    esp_err_t err = (index >= 0 && index < s_provider_count && s_provider_count > 1) ? ESP_OK : ESP_ERR_INVALID_ARG;
+    if (err == ESP_OK)
+    {
+        int tail = s_provider_count - index - 1;
+        memmove(&s_providers[index], &s_providers[index + 1], tail * sizeof(llm_provider_config_t));
+        memmove(&s_state[index], &s_state[index + 1], tail * sizeof(llm_provider_state_t));
+        s_provider_count--;
+        memset(&s_state[s_provider_count], 0, sizeof(llm_provider_state_t));
+        err = llm_provider_save();
+    }
+    llm_unlock();
+    return err;
+}
+
+/// @brief 在空闲的请求任务中向服务发出请求, 没有空闲的任务时返回 NULL
+static llm_attempt_t *llm_attempt_start(int provider, bool hedge, llm_build_body_t build, void *arg, const char *accept, esp_err_t *err)
+{
+    llm_provider_config_t config;
+    llm_attempt_t *at = NULL;
+
+    llm_lock();
+    config = s_providers[provider];
+    for (int i = 0; i < LLM_ATTEMPT_MAX; i++)
+    {
+        if (!s_attempts[i].busy)
+        {
+            at = &s_attempts[i];
+            at->busy = true;
+            break;
+        }
+    }
+    llm_unlock();
+    if (at == NULL)
+    {
+        *err = ESP_ERR_NOT_FINISHED;
+        return NULL;
+    }
+
+    // 请求体在调用者的任务中生成, build 不需要考虑并发; 缓冲已被占用, 请求任务此时不会访问
+    size_t len = build(&config, arg, at->body, at->body_size);
+    if (len >= at->body_size)
+    {
+        size_t size = (len + LLM_BODY_SIZE_STEP) / LLM_BODY_SIZE_STEP * LLM_BODY_SIZE_STEP;
+        char *body = heap_caps_realloc(at->body, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (body == NULL)
+        {
+            llm_lock();
+            at->busy = false;
+            llm_unlock();
+            *err = ESP_ERR_NO_MEM;
+            return NULL;
+        }
+        at->body = body;
+        at->body_size = size;
+        len = build(&config, arg, at->body, at->body_size);
+    }
+
+    llm_lock();
+    at->finished = false;
+    at->cancelled = false;
+    at->provider = provider;
+    at->config = config;
+    at->body_len = len;
+    at->accept = accept;
+    at->client = NULL;
+    at->err = ESP_OK;
+    at->start_us = esp_timer_get_time();
+    s_state[provider].stats.requests++;
+    if (hedge)
+    {
+        s_state[provider].stats.hedges++;
+    }
+    llm_unlock();
+
+    ESP_LOGI(TAG, "%s%s: request %s", hedge ? "hedge to " : "", config.name, config.model);
+    xEventGroupClearBits(s_attempt_event, BIT(at->index));
+    xTaskNotifyGive(at->task);
+    *err = ESP_OK;
+    return at;
+}
+
+/**
+ * @brief 丢弃一个请求: 已返回的直接关闭连接, 还在进行的中止后由请求任务关闭, 尽快空出请求任务和连接.
+ *
+ * 还在进行的请求此时记录结果: 超时记为失败, 否则把已等待的时间作为首字节耗时的下限,
+ * 一直输给对冲请求的服务也会得到样本, 变慢后排到后面.
+ */
+static void llm_attempt_drop(llm_attempt_t *at, bool timed_out)
+{
+    llm_lock();
+    if (at->finished)
+    {
+        if (at->client)
+        {
+            app_http_pool_release(at->client, ESP_FAIL);
+        }
+        at->client = NULL;
+        at->busy = false;
+    }
+    else
+    {
+        uint32_t waited_ms = (esp_timer_get_time() - at->start_us) / 1000;
+        llm_provider_record(at->provider, timed_out ? ESP_ERR_TIMEOUT : ESP_OK, waited_ms);
+        at->cancelled = true;
+        if (at->client)
+        {
+            app_http_pool_cancel(at->client);
+        }
+    }
+    llm_unlock();
+}
+
+esp_err_t llm_open(llm_build_body_t build, void *arg, const char *accept, llm_conn_t *conn)
+{
+    ESP_RETURN_ON_FALSE(build && conn, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_ERROR(llm_provider_init(), TAG, "llm provider init failed");
+
+    int order[LLM_PROVIDER_MAX];
+    llm_lock();
+    int n = llm_provider_order(order);
+    uint32_t timeout_ms = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (s_providers[order[i]].timeout_ms > timeout_ms)
+        {
+            timeout_ms = s_providers[order[i]].timeout_ms;
+        }
+    }
+    llm_unlock();
+    ESP_RETURN_ON_FALSE(n > 0, ESP_ERR_NOT_FOUND, TAG, "no llm provider enabled, set an API key with llm_provider_set()");
+
+    int64_t now = esp_timer_get_time();
+    int64_t deadline = now + timeout_ms * 1000LL;
+    int64_t hedge_at = now;
+    llm_attempt_t *inflight[LLM_ATTEMPT_MAX] = {0};
+    int inflight_n = 0;
+    int next = 0;
+    llm_attempt_t *winner = NULL;
+    esp_err_t err = ESP_ERR_TIMEOUT;
+    bool timed_out = false;
+
+    while (winner == NULL)
+    {
+        now = esp_timer_get_time();
+        if (now >= deadline)
+        {
+            err = ESP_ERR_TIMEOUT;
+            timed_out = true;
+            break;
+        }
+
+        // 没有进行中的请求 (首个请求或失败切换), 或者首选服务超过 p95 还没有响应时, 发出下一个请求
+        if (next < n && inflight_n < LLM_ATTEMPT_MAX && (inflight_n == 0 || (LLM_HEDGE_ENABLE && now >= hedge_at)))
+        {
+            esp_err_t start_err;
+            llm_attempt_t *at = llm_attempt_start(order[next], inflight_n > 0, build, arg, accept, &start_err);
+            if (at)
+            {
+                inflight[inflight_n++] = at;
+                llm_lock();
+                hedge_at = now + llm_hedge_delay_ms(order[next]) * 1000LL;
+                llm_unlock();
+                next++;
+                continue;
+            }
+            if (start_err != ESP_ERR_NOT_FINISHED)
+            {
+                err = start_err;
+                break;
+            }
+        }
+
+        if (inflight_n == 0)
+        {
+            if (next >= n)
+            {
+                break;
+            }
+            // 上一次被取消的请求还没有返回, 稍后再试
+            vTaskDelay(pdMS_TO_TICKS(20));
+            continue;
+        }
+
+        int64_t wake = deadline;
+        if (LLM_HEDGE_ENABLE && next < n && inflight_n < LLM_ATTEMPT_MAX && hedge_at < wake)
+        {
+            wake = hedge_at;
+        }
+        EventBits_t mask = 0;
+        for (int i = 0; i < inflight_n; i++)
+        {
+            mask |= BIT(inflight[i]->index);
+        }
+        TickType_t ticks = (wake > now) ? pdMS_TO_TICKS((uint32_t)((wake - now + 999) / 1000)) : 0;
+        EventBits_t bits = xEventGroupWaitBits(s_attempt_event, mask, pdTRUE, pdFALSE, ticks > 0 ? ticks : 1);
+
+        for (int i = 0; i < inflight_n; i++)
+        {
+            llm_attempt_t *at = inflight[i];
+            if (!(bits & BIT(at->index)))
+            {
+                continue;
+            }
+            if (at->err == ESP_OK && winner == NULL)
+            {
+                winner = at;
+                continue;
+            }
+            if (at->err != ESP_OK)
+            {
+                ESP_LOGW(TAG, "%s failed (%s), %s", at->config.name, esp_err_to_name(at->err), next < n ? "fail over" : "no more providers");
+                err = at->err;
+                hedge_at = esp_timer_get_time();
+            }
+            llm_attempt_drop(at, false);
+            inflight[i--] = inflight[--inflight_n];
+        }
+    }
+
+    // 其余请求不再需要, 已返回的立即关闭, 进行中的被中止; 超时退出时进行中的都记为失败
+    for (int i = 0; i < inflight_n; i++)
+    {
+        if (inflight[i] != winner)
+        {
+            llm_attempt_drop(inflight[i], timed_out);
+        }
+    }
+    if (winner == NULL)
+    {
+        ESP_LOGE(TAG, "all providers failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    llm_lock();
+    conn->client = winner->client;
+    conn->provider = winner->provider;
+    conn->ttfb_ms = winner->ttfb_ms;
+    s_state[winner->provider].stats.wins++;
+    winner->client = NULL;
+    winner->busy = false;
+    llm_unlock();
+    ESP_LOGI(TAG, "%s: headers after %" PRIu32 " ms", winner->config.name, conn->ttfb_ms);
+    return ESP_OK;
+}
+
+void llm_close(llm_conn_t *conn, esp_err_t result, bool provider_fault)
+{
+    if (conn == NULL || conn->client == NULL)
+    {
+        return;
+    }
+    app_http_pool_release(conn->client, result);
+    conn->client = NULL;
+    if (provider_fault)
+    {
+        llm_lock();
+        llm_provider_record(conn->provider, ESP_FAIL, 0);
+        llm_unlock();
+    }
+}
+
+void llm_provider_get_stats(int index, llm_provider_stats_t *stats)
+{
+    memset(stats, 0, sizeof(llm_provider_stats_t));
+    if (s_llm_mux == NULL)
+    {
+        return;
+    }
+    llm_lock();
+    if (index >= 0 && index < s_provider_count)
+    {
+        *stats = s_state[index].stats;
+    }
+    llm_unlock();
+}
+
+void llm_provider_log_stats(void)
+{
+    for (int i = 0; i < s_provider_count; i++)
+    {
+        llm_provider_stats_t st;
+        llm_provider_get_stats(i, &st);
+        ESP_LOGI(TAG, "%s: requests %" PRIu32 ", wins %" PRIu32 ", hedges %" PRIu32 ", failures %" PRIu32 ", ttfb ewma %" PRIu32 " ms, p95 %" PRIu32 " ms",
+                 s_providers[i].name, st.requests, st.wins, st.hedges, st.failures, st.ewma_ttfb_ms, st.p95_ttfb_ms);
+    }
+}
@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define LLM_PROVIDER_MAX        (4)
+#define LLM_PROVIDER_NAME_LEN   (16)
+#define LLM_PROVIDER_URL_LEN    (128)
+#define LLM_PROVIDER_KEY_LEN    (128)
+#define LLM_PROVIDER_MODEL_LEN  (32)
+
+#define LLM_HEDGE_ENABLE        (1)     // 首选服务迟迟没有响应时, 同时向下一个服务发送请求
+#define LLM_HEDGE_MIN_MS        (300)   // 对冲等待的下限, 避免网络抖动时每次都发两个请求
+#define LLM_TTFB_SAMPLES        (16)    // 每个服务保留的首字节耗时样本, 用于估计 p95
+#define LLM_TTFB_MIN_SAMPLES    (4)     // 样本不足时以超时的一半作为对冲等待
+
+    typedef struct
+    {
+        char name[LLM_PROVIDER_NAME_LEN];
+        char url[LLM_PROVIDER_URL_LEN];     // chat/completions 接口地址
+        char key[LLM_PROVIDER_KEY_LEN];     // API Key, 不含 "Bearer "
+        char model[LLM_PROVIDER_MODEL_LEN];
+        uint32_t timeout_ms;
+        bool enabled;
+    } llm_provider_config_t;
+
+    typedef struct
+    {
+        uint32_t requests;      // 发出的请求, 包括对冲请求
+        uint32_t wins;          // 最先返回响应头而被采用
+        uint32_t failures;
+        uint32_t hedges;        // 作为对冲请求被发出
+        uint32_t ewma_ttfb_ms;  // 首字节耗时的指数滑动平均, 0 表示还没有样本
+        uint32_t p95_ttfb_ms;
+    } llm_provider_stats_t;
+
+    /**
+     * @brief 根据服务和模型把请求体写入 buf, 返回完整请求体的长度(不含结尾的 0).
+     *
+     * 返回值大于等于 size 时表示被截断, 会用更大的缓冲再调用一次. 每个请求任务的缓冲重复使用, 只增不减.
+     */
+    typedef size_t (*llm_build_body_t)(const llm_provider_config_t *provider, void *arg, char *buf, size_t size);
+
+    typedef struct
+    {
+        esp_http_client_handle_t client;    // 已读完响应头, 调用者 esp_http_client_read() 读取响应体
+        int provider;
+        uint32_t ttfb_ms;
+    } llm_conn_t;
+
+    /// @brief 从 NVS 读取服务列表, 没有保存过时使用内置的默认列表
+    esp_err_t llm_provider_init(void);
+
+    int llm_provider_count(void);
+    esp_err_t llm_provider_get(int index, llm_provider_config_t *config);
+    /// @brief 修改或追加 (index == count) 一个服务并保存到 NVS
+    esp_err_t llm_provider_set(int index, const llm_provider_config_t *config);
+    esp_err_t llm_provider_remove(int index);
+
+    /**
+     * @brief 向最快的服务发送请求, 返回第一个响应成功的连接.
+     *
+     * 服务按首字节耗时的滑动平均排序. 首选服务在其 p95 首字节耗时内没有响应时, 向下一个服务发送对冲请求,
+     * 先返回响应头的一方胜出, 另一方被中止 (https 最多 50 ms 内返回) 并关闭连接; 请求失败时立即切换到下一个服务.
+     * 被中止的请求以已等待的时间作为首字节耗时的样本 (下限), 到超时还没有响应的请求记为失败.
+     *
+     * @param build 为每个服务生成请求体 (模型名不同), 在调用者的任务中调用
+     * @param accept Accept 请求头, 可为 NULL
+     */
+    esp_err_t llm_open(llm_build_body_t build, void *arg, const char *accept, llm_conn_t *conn);
+
+    /**
+     * @brief 读完或放弃响应后归还连接
+     * @param result 不是 ESP_OK 时关闭连接
+     * @param provider_fault 服务本身出错(读取超时, 连接断开), 计入失败; 调用者主动放弃时为 false
+     */
+    void llm_close(llm_conn_t *conn, esp_err_t result, bool provider_fault);
+
+    void llm_provider_get_stats(int index, llm_provider_stats_t *stats);
+    void llm_provider_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
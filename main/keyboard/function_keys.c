@@ -9,6 +9,7 @@
 #include "driver/gpio.h"
 #include "esp32s3/rom/ets_sys.h"
 #include "app_audio.h"
+#include "audio_bank.h"
 #include "audio_player.h"
 #include "rgb_matrix.h"
 #include "app_led.h"
@@ -289,7 +290,7 @@ void shutdownByFn(void)
             if (xTaskGetTickCount() - fnPressedTime > 2000)
             {
                 bspWs2812Enable(false);
-                audio_play_filepath("/spiffs/powerOff.mp3");
+                audio_bank_play(AUDIO_PROMPT_POWER_OFF);
                 fnPressedTime = 0xffffffff;
                 shutdownState = 1;
             }
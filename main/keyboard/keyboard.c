@@ -17,6 +17,7 @@
 #include "app_tusb_hid.h"
 #include "app_espnow.h"
 #include "app_udp_client.h"
+#include "keyboard_tx.h"
 #include "settings.h"
 
 SemaphoreHandle_t keyboard_update_mux;
@@ -45,6 +46,10 @@ SemaphoreHandle_t keyboard_update_mux;
 */
 static uint8_t hidReportBuffer[8] = {0};
 
+// 语音命令模拟的单次按键: 下一个扫描周期放在空闲键位上按下, 再下一个周期释放, 不影响正在按住的键
+static volatile uint8_t tapKeyCode = 0;
+static uint8_t tapKeyPressed = 0;
+
 // 自定义按键
 #define CUSTOM_KEY_FN  1000 // FN按键
 #define CUSTOM_KEY_REC 1001 // 录音按键
@@ -279,6 +284,28 @@ static void keyboardTask(void *arg)
         {
         case GBK_TASK_IDLE:
             keyToHidMessage();
+            if (tapKeyCode)
+            {
+                if (!tapKeyPressed)
+                {
+                    // 6 个键位都被按住时下个周期再试; 已按住同一个键时不再重复
+                    for (uint8_t i = 2; i < sizeof(hidReportBuffer) / sizeof(hidReportBuffer[0]); i++)
+                    {
+                        if (hidReportBuffer[i] == 0x00 || hidReportBuffer[i] == tapKeyCode)
+                        {
+                            hidReportBuffer[i] = tapKeyCode;
+                            tapKeyPressed = 1;
+                            break;
+                        }
+                    }
+                }
+                else
+                {
+                    // 本周期的报文只含实际按住的键, 发出即释放模拟的按键
+                    tapKeyCode = 0;
+                    tapKeyPressed = 0;
+                }
+            }
             break;
         case GBK_HEX_TO_NUMPAD:
             gbkHexToHidMessage();
@@ -326,10 +353,13 @@ static void keyboardTask(void *arg)
             app_ble_hid_send_key(hidReportBuffer, sizeof(hidReportBuffer) / sizeof(hidReportBuffer[0]));
             break;
         case MODE_HID_ESPNOW:
-            app_espnow_send_data(hidReportBuffer, sizeof(hidReportBuffer) / sizeof(hidReportBuffer[0]));
-            break;
         case MODE_HID_UDP:
-            app_udp_client_send_data(hidReportBuffer, sizeof(hidReportBuffer) / sizeof(hidReportBuffer[0]));
+#if KEYBOARD_TX_STRESS_TEST
+            // 保留字节不影响主机输入, 每帧都不同, 全部进入发送队列
+            hidReportBuffer[1] ^= 0x01;
+#endif
+            // 网络发送交给独立任务, 扫描任务不会被网络栈阻塞
+            keyboard_tx_send(param->mode_hid, hidReportBuffer, sizeof(hidReportBuffer) / sizeof(hidReportBuffer[0]));
             break;
         default:
             break;
@@ -338,6 +368,14 @@ static void keyboardTask(void *arg)
     vTaskDelete(NULL);
 }
 
+/// @brief 模拟一次按键(按下并释放)
+/// @param keycode HID 键码
+void keyboard_tap_key(uint8_t keycode)
+{
+    tapKeyPressed = 0;
+    tapKeyCode = keycode;
+}
+
 /// @brief 获取互斥量
 /// @param timeout_ms 
 /// @return 
@@ -369,5 +407,6 @@ void keyboardStart(void)
     // Allocate stack memory from PSRAM
     xStack = (StackType_t *)heap_caps_malloc(STACK_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     assert(xStack);
+    keyboard_tx_start();
     xTaskCreateStatic(keyboardTask, "keyboardTask", STACK_SIZE, NULL, 8, xStack, &xTaskBuffer);
 }
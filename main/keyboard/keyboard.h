@@ -19,5 +19,6 @@ void keyboardStart(void);
 uint8_t keyboardGetKeyState(uint8_t keyIndex, uint8_t bitIndex);
 bool keyboard_update_lock(uint32_t timeout_ms);
 void keyboard_update_unlock(void);
+void keyboard_tap_key(uint8_t keycode);
 
 #endif // KEYBOARD_H
\ No newline at end of file
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "keyboard_tx.h"
+#include "app_espnow.h"
+#include "app_udp_client.h"
+#include "settings.h"
+#include "wifi_power.h"
+
+static const char *TAG = "keyboard_tx";
+
+typedef struct
+{
+    uint8_t report[KEYBOARD_TX_REPORT_LEN];
+    uint8_t mode;
+    int64_t enqueue_us;
+} keyboard_tx_item_t;
+
+// 单生产者(键盘扫描任务)单消费者(发送任务)环形队列, 不需要锁
+static keyboard_tx_item_t sg_ring[KEYBOARD_TX_RING_SIZE];
+static volatile uint32_t sg_head = 0; // 生产者写
+static volatile uint32_t sg_tail = 0; // 消费者写
+
+static keyboard_tx_item_t sg_pending;
+static bool sg_pending_valid = false;
+static uint8_t sg_last_report[KEYBOARD_TX_REPORT_LEN];
+static uint8_t sg_last_mode = MODE_HID_MAX;
+
+static keyboard_tx_stats_t sg_stats;
+static portMUX_TYPE sg_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t sg_tx_task = NULL;
+// 副本和心跳的定时: 副本间隔只有 KEY_LINK_REPEAT_US (2 ms), 用 esp_timer 而不是按 tick 等待, 不受 FreeRTOS 节拍影响
+static esp_timer_handle_t sg_tx_timer = NULL;
+
+static bool keyboard_tx_push(const keyboard_tx_item_t *item)
+{
+    uint32_t head = sg_head;
+    uint32_t tail = __atomic_load_n(&sg_tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= KEYBOARD_TX_RING_SIZE)
+    {
+        return false;
+    }
+    sg_ring[head & (KEYBOARD_TX_RING_SIZE - 1)] = *item;
+    __atomic_store_n(&sg_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool keyboard_tx_pop(keyboard_tx_item_t *item)
+{
+    uint32_t tail = sg_tail;
+    uint32_t head = __atomic_load_n(&sg_head, __ATOMIC_ACQUIRE);
+    if (head == tail)
+    {
+        return false;
+    }
+    *item = sg_ring[tail & (KEYBOARD_TX_RING_SIZE - 1)];
+    __atomic_store_n(&sg_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void keyboard_tx_send(uint8_t mode, const uint8_t *report, size_t len)
+{
+    if (sg_tx_task == NULL || len > KEYBOARD_TX_REPORT_LEN)
+    {
+        return;
+    }
+
+    // 先补发队列满时留下的报文
+    if (sg_pending_valid && keyboard_tx_push(&sg_pending))
+    {
+        sg_pending_valid = false;
+        xTaskNotifyGive(sg_tx_task);
+    }
+
+    // 按键状态改变才发送
+    uint8_t buffer[KEYBOARD_TX_REPORT_LEN] = {0};
+    memcpy(buffer, report, len);
+    if (mode == sg_last_mode && memcmp(buffer, sg_last_report, sizeof(buffer)) == 0)
+    {
+        return;
+    }
+    memcpy(sg_last_report, buffer, sizeof(buffer));
+    sg_last_mode = mode;
+    // Wi-Fi 处于省电模式时立即切回 PS_NONE
+    wifi_power_kick();
+
+    keyboard_tx_item_t item = {
+        .mode = mode,
+        .enqueue_us = esp_timer_get_time(),
+    };
+    memcpy(item.report, buffer, sizeof(buffer));
+    if (sg_pending_valid || !keyboard_tx_push(&item))
+    {
+        // 队列满, 只保留最新状态
+        if (sg_pending_valid)
+        {
+            portENTER_CRITICAL(&sg_stats_lock);
+            sg_stats.dropped++;
+            portEXIT_CRITICAL(&sg_stats_lock);
+        }
+        sg_pending = item;
+        sg_pending_valid = true;
+        return;
+    }
+    xTaskNotifyGive(sg_tx_task);
+}
+
+static void keyboard_tx_record(int64_t latency_us)
+{
+    static const uint32_t bounds_us[] = {1000, 2000, 5000, 10000, 50000};
+    int bucket = 0;
+    while (bucket < 5 && latency_us >= bounds_us[bucket])
+    {
+        bucket++;
+    }
+
+    portENTER_CRITICAL(&sg_stats_lock);
+    sg_stats.sent++;
+    sg_stats.total_us += latency_us;
+    if (latency_us > sg_stats.max_us)
+    {
+        sg_stats.max_us = latency_us;
+    }
+    sg_stats.hist[bucket]++;
+    portEXIT_CRITICAL(&sg_stats_lock);
+}
+
+static void keyboard_tx_timer_cb(void *arg)
+{
+    xTaskNotifyGive(sg_tx_task);
+}
+
+static void keyboard_tx_task(void *arg)
+{
+    keyboard_tx_item_t item;
+    while (1)
+    {
+        // 新报文和 sg_tx_timer 到期都会通知
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (keyboard_tx_pop(&item))
+        {
+            switch (item.mode)
+            {
+            case MODE_HID_ESPNOW:
+                app_espnow_send_data(item.report, sizeof(item.report));
+                break;
+            case MODE_HID_UDP:
+                app_udp_client_send_data(item.report, sizeof(item.report));
+                break;
+            default:
+                break;
+            }
+            keyboard_tx_record(esp_timer_get_time() - item.enqueue_us);
+            if (sg_stats.sent % (KEYBOARD_TX_STRESS_TEST ? 500 : 1000) == 0)
+            {
+                keyboard_tx_log_stats();
+            }
+        }
+
+        // UDP / ESP-NOW 报文的副本和心跳
+        esp_timer_stop(sg_tx_timer);
+        uint8_t mode = settings_get_parameter()->mode_hid;
+        if (mode == MODE_HID_UDP || mode == MODE_HID_ESPNOW)
+        {
+            uint32_t wait_ms = mode == MODE_HID_UDP ? app_udp_client_poll() : app_espnow_poll();
+            esp_timer_start_once(sg_tx_timer, wait_ms ? wait_ms * 1000ULL : 500);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+void keyboard_tx_get_stats(keyboard_tx_stats_t *stats)
+{
+    portENTER_CRITICAL(&sg_stats_lock);
+    *stats = sg_stats;
+    portEXIT_CRITICAL(&sg_stats_lock);
+}
+
+void keyboard_tx_log_stats(void)
+{
+    keyboard_tx_stats_t st;
+    keyboard_tx_get_stats(&st);
+    ESP_LOGI(TAG, "sent %" PRIu32 ", dropped %" PRIu32 ", avg %" PRIu32 " us, max %" PRIu32 " us, "
+                  "<1ms %" PRIu32 " <2ms %" PRIu32 " <5ms %" PRIu32 " <10ms %" PRIu32 " <50ms %" PRIu32 " >=50ms %" PRIu32,
+             st.sent, st.dropped, st.sent ? (uint32_t)(st.total_us / st.sent) : 0, st.max_us,
+             st.hist[0], st.hist[1], st.hist[2], st.hist[3], st.hist[4], st.hist[5]);
+}
+
+#define STACK_SIZE (4 * 1024)
+static StaticTask_t xTaskBuffer;
+static StackType_t xStack[STACK_SIZE / sizeof(StackType_t)];
+
+void keyboard_tx_start(void)
+{
+    if (sg_tx_task)
+    {
+        return;
+    }
+    // 栈放在内部 RAM, 发送路径不受 PSRAM/Flash 操作影响; 优先级高于网络和语音任务
+    const esp_timer_create_args_t timer_args = {
+        .callback = keyboard_tx_timer_cb,
+        .name = "keyboard_tx",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &sg_tx_timer));
+    sg_tx_task = xTaskCreateStatic(keyboard_tx_task, "keyboard_tx", STACK_SIZE, NULL, 9, xStack, &xTaskBuffer);
+    assert(sg_tx_task);
+    // 启动后先轮询一次, UDP 和 ESP-NOW 模式下开始寻找接收器
+    xTaskNotifyGive(sg_tx_task);
+}
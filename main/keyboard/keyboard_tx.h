@@ -0,0 +1,34 @@
+#ifndef KEYBOARD_TX_H
+#define KEYBOARD_TX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define KEYBOARD_TX_RING_SIZE     32  // 必须是 2 的幂
+#define KEYBOARD_TX_REPORT_LEN    8
+#define KEYBOARD_TX_STRESS_TEST   (0) // 每个扫描周期翻转保留字节产生新报文, 配合语音对话观察按键延迟
+
+typedef struct
+{
+    uint32_t sent;
+    uint32_t dropped;       // 队列满时被更新的报文覆盖的数量
+    uint32_t max_us;        // 入队到发送完成的最大延迟
+    uint64_t total_us;
+    uint32_t hist[6];       // <1ms, <2ms, <5ms, <10ms, <50ms, >=50ms
+} keyboard_tx_stats_t;
+
+/// @brief 启动 UDP/ESP-NOW 报文发送任务
+void keyboard_tx_start(void);
+
+/**
+ * @brief 把一帧 HID 报文交给发送任务, 由键盘扫描任务调用, 不会阻塞.
+ *
+ * 与上一帧相同的报文不入队; 队列满时保留最新的一帧, 下次调用时再入队.
+ * 报文是完整的按键状态, 丢弃中间帧不会丢失按键的最终状态.
+ */
+void keyboard_tx_send(uint8_t mode, const uint8_t *report, size_t len);
+
+void keyboard_tx_get_stats(keyboard_tx_stats_t *stats);
+void keyboard_tx_log_stats(void);
+
+#endif // KEYBOARD_TX_H
@@ -262,6 +262,24 @@ esp_codec_dev_handle_t bsp_audio_codec_microphone_init(void)
 static esp_codec_dev_handle_t play_dev_handle;
 static esp_codec_dev_handle_t record_dev_handle;
 
+// 编解码器当前配置, 相同的配置不再重复下发(重开设备会打断麦克风数据流)
+typedef struct
+{
+    bool opened;
+    uint32_t rate;
+    uint32_t bits;
+    i2s_slot_mode_t ch;
+    int volume;  // -1: 未知
+    int mute;    // -1: 未知
+    uint32_t reconfig_count;
+} bsp_codec_state_t;
+
+static bsp_codec_state_t sg_codec_state = {
+    .opened = false,
+    .volume = -1,
+    .mute = -1,
+};
+
 esp_err_t bsp_i2s_read(void *audio_buffer, size_t len, size_t *bytes_read)
 {
     esp_err_t ret = ESP_OK;
@@ -282,6 +300,11 @@ esp_err_t bsp_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
 {
     esp_err_t ret = ESP_OK;
 
+    if (bsp_codec_fs_match(rate, bits_cfg, ch))
+    {
+        return ESP_OK;
+    }
+
     esp_codec_dev_sample_info_t fs = {
         .sample_rate = rate,
         .channel = ch,
@@ -309,21 +332,57 @@ esp_err_t bsp_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
         ret |= esp_codec_dev_open(record_dev_handle, &fs);
     }
 
+    sg_codec_state.opened = (ret == ESP_OK);
+    sg_codec_state.rate = rate;
+    sg_codec_state.bits = bits_cfg;
+    sg_codec_state.ch = ch;
+    sg_codec_state.volume = -1;
+    sg_codec_state.mute = -1;
+    sg_codec_state.reconfig_count++;
+    ESP_LOGI(TAG, "codec reconfig #%" PRIu32 ": %" PRIu32 "Hz %" PRIu32 "bit ch%d",
+             sg_codec_state.reconfig_count, rate, bits_cfg, ch);
     return ret;
 }
 
+bool bsp_codec_fs_match(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
+{
+    return sg_codec_state.opened &&
+           sg_codec_state.rate == rate &&
+           sg_codec_state.bits == bits_cfg &&
+           sg_codec_state.ch == ch;
+}
+
+uint32_t bsp_codec_get_sample_rate(void)
+{
+    return sg_codec_state.opened ? sg_codec_state.rate : CODEC_DEFAULT_SAMPLE_RATE;
+}
+
 esp_err_t bsp_codec_volume_set(int volume, int *volume_set)
 {
     esp_err_t ret = ESP_OK;
+    if (volume_set)
+    {
+        *volume_set = volume;
+    }
+    if (sg_codec_state.volume == volume)
+    {
+        return ESP_OK;
+    }
     float v = volume;
     ret = esp_codec_dev_set_out_vol(play_dev_handle, (int)v);
+    sg_codec_state.volume = (ret == ESP_OK) ? volume : -1;
     return ret;
 }
 
 esp_err_t bsp_codec_mute_set(bool enable)
 {
     esp_err_t ret = ESP_OK;
+    if (sg_codec_state.mute == (int)enable)
+    {
+        return ESP_OK;
+    }
     ret = esp_codec_dev_set_out_mute(play_dev_handle, enable);
+    sg_codec_state.mute = (ret == ESP_OK) ? (int)enable : -1;
     return ret;
 }
 
@@ -338,6 +397,7 @@ esp_err_t bsp_codec_dev_stop(void)
     if (record_dev_handle) {
         ret = esp_codec_dev_close(record_dev_handle);
     }
+    sg_codec_state.opened = false;
     return ret;
 }
 
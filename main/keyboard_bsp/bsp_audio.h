@@ -8,6 +8,8 @@
 esp_err_t bsp_codec_mute_set(bool enable);
 esp_err_t bsp_codec_volume_set(int volume, int *volume_set);
 esp_err_t bsp_codec_set_fs(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch);
+bool bsp_codec_fs_match(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch);
+uint32_t bsp_codec_get_sample_rate(void);
 esp_err_t bsp_i2s_read(void *audio_buffer, size_t len, size_t *bytes_read);
 esp_err_t bsp_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms);
 esp_err_t bsp_i2c_init(void);
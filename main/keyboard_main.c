@@ -15,6 +15,7 @@
 #include "nvs_flash.h"
 
 #include "app_audio.h"
+#include "audio_bank.h"
 #include "settings.h"
 #include "app_uart.h"
 #include "app_led.h"
@@ -67,7 +68,7 @@ void app_main(void)
     app_sr_start();
     appLedStart();
     vTaskDelay(pdMS_TO_TICKS(500));
-    audio_play_filepath("/spiffs/powerOn.mp3");
+    audio_bank_play(AUDIO_PROMPT_POWER_ON);
 }
 
 #if 0
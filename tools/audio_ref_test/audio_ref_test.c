@@ -0,0 +1,746 @@
+/*
+ * 在电脑上回放 main/app_audio/audio_ref: 模拟播放与录音共用时钟的 I2S, 把播放内容经回声路径和近端语音混成麦克风信号,
+ * 按 audio_feed_task 的方式取参考信号, 检查参考信号与回声的对齐, 并用 NLMS 回声消除器确认参考信号可用.
+ *
+ * 编译: cc -O2 -Wall -pthread -I. -I../host_shim -I../../main/app_audio audio_ref_test.c -lm -o audio_ref_test
+ * 运行: ./audio_ref_test [--play far.wav] [--near near.wav] [--echo-delay 24] [--dump feed.wav]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+
+// audio_ref 用 esp_timer 记录读写时刻, 换成模拟时间
+#include "esp_timer.h"
+static int64_t sim_time_us(void);
+#define esp_timer_get_time() sim_time_us()
+
+// 直接包含源文件, 每个场景开始前清空其中的静态状态
+#include "../../main/app_audio/audio_ref.c"
+
+#define SIM_RATE       (16000)
+#define FEED_CHUNK     (512)  // 16K 下 AFE 的 feed chunksize
+#define PLAY_CHUNK     (512)  // app_audio 的 AUDIO_PLAY_CHUNK_FRAMES
+#define DMA_DESC_NUM   (6)    // I2S_CHANNEL_DEFAULT_CONFIG
+#define DMA_FRAME_NUM  (240)
+#define TX_DEPTH       (DMA_DESC_NUM * DMA_FRAME_NUM)
+#define FEED_JITTER    (32)   // feed 任务被调度的延迟, 帧
+#define ECHO_IR_LEN    (256)  // 房间冲激响应长度
+#define NLMS_TAPS      (1024) // 代替 AFE 中 AEC 的 NLMS 滤波器长度, 64ms
+#define CODE_MOD       (32767)
+
+typedef struct
+{
+    int64_t start;     // 开始写入的时间, 帧
+    int64_t frames;    // 播放帧数
+    int64_t stall_at;  // 写入这么多帧后写端停顿, -1 表示不停顿
+    int64_t stall_len; // 停顿时长, 帧
+    bool near;         // 这一段有近端语音(双讲)
+} sim_burst_t;
+
+typedef struct
+{
+    int64_t len;         // 模拟总帧数
+    int64_t now;
+    int64_t written;     // 写入 I2S 的总帧数, 即下一帧的编号 g
+    int64_t last_play;   // 最后一帧的播放时间
+    int64_t *play_time;  // [g] 第 g 帧的播放时间
+    int64_t *dac;        // [t] t 时刻播放的帧编号, -1 为静音
+    int16_t *ref_code;   // [t] t 时刻麦克风数据对应的参考信号 (帧编号编码)
+} sim_t;
+
+static sim_t s_sim;
+static int s_failures = 0;
+static int s_echo_delay = 24; // DAC + ADC 群延时和声程, 帧
+static uint32_t s_seed = 1;
+static int64_t s_tx_phase = 0; // 播放与录音 DMA 描述符边界的相位差, 帧
+
+// 远端 (播放) 与近端 (说话人) 信号
+static int16_t *s_far = NULL; // 双声道
+static size_t s_far_frames = 0;
+static int16_t *s_near = NULL;
+static size_t s_near_frames = 0;
+
+static int64_t sim_time_us(void)
+{
+    return s_sim.now * 1000000 / SIM_RATE;
+}
+
+static void check(bool ok, const char *what)
+{
+    printf("  %s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+    {
+        s_failures++;
+    }
+}
+
+static uint32_t rnd(void)
+{
+    s_seed = s_seed * 1103515245 + 12345;
+    return s_seed >> 8;
+}
+
+static int64_t rnd_range(int64_t lo, int64_t hi)
+{
+    return lo + rnd() % (uint32_t)(hi - lo + 1);
+}
+
+static int64_t align_up(int64_t t, int64_t n)
+{
+    return (t + n - 1) / n * n;
+}
+
+/// @brief 播放的第 g 帧在 I2S 上的编码: 左右声道相同, 下混后不变
+static int16_t frame_code(int64_t g)
+{
+    return (int16_t)(g % CODE_MOD + 1);
+}
+
+/// @brief 模拟 I2S 发送: 帧按顺序排在 DMA 后面; DMA 空了之后, 新数据从下一个描述符开始播放
+esp_err_t bsp_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms)
+{
+    const int16_t *pcm = (const int16_t *)audio_buffer;
+    size_t frames = len / (2 * sizeof(int16_t));
+    for (size_t i = 0; i < frames; i++)
+    {
+        int64_t g = s_sim.written++;
+        int64_t p = (s_sim.last_play >= s_sim.now) ? s_sim.last_play + 1 : align_up(s_sim.now - s_tx_phase, DMA_FRAME_NUM) + s_tx_phase;
+        if (pcm[i * 2] != frame_code(g) || p >= s_sim.len)
+        {
+            return ESP_FAIL;
+        }
+        s_sim.play_time[g] = p;
+        s_sim.dac[p] = g;
+        s_sim.last_play = p;
+    }
+    *bytes_written = len;
+    return ESP_OK;
+}
+
+static int64_t tx_pending(void)
+{
+    return s_sim.last_play >= s_sim.now ? s_sim.last_play - s_sim.now + 1 : 0;
+}
+
+static void sim_reset(int64_t len)
+{
+    free(s_sim.play_time);
+    free(s_sim.dac);
+    free(s_sim.ref_code);
+    memset(&s_sim, 0, sizeof(s_sim));
+    s_sim.len = len;
+    s_sim.last_play = -1;
+    s_sim.play_time = calloc(len, sizeof(int64_t));
+    s_sim.dac = malloc(len * sizeof(int64_t));
+    s_sim.ref_code = calloc(len, sizeof(int16_t));
+    for (int64_t t = 0; t < len; t++)
+    {
+        s_sim.dac[t] = -1;
+    }
+
+    // audio_ref 的静态状态回到开机时
+    free(s_ref.buf);
+    portMUX_TYPE lock = s_ref.lock;
+    memset(&s_ref, 0, sizeof(s_ref));
+    s_ref.lock = lock;
+    audio_ref_init();
+}
+
+/// @brief 播放端: 按顺序播放各段, 与阻塞的 i2s_channel_write 一样 DMA 有空间就写入一块
+typedef struct
+{
+    const sim_burst_t *bursts;
+    int count;
+    int cur;
+    int64_t done;      // 当前段已写入的帧数
+    int64_t resume_at; // 停顿结束的时间
+    bool stalled;      // 当前段已经停顿过
+} sim_player_t;
+
+static bool sim_player_step(sim_player_t *pl)
+{
+    int16_t buf[PLAY_CHUNK * 2];
+    while (pl->cur < pl->count && s_sim.now >= pl->bursts[pl->cur].start && s_sim.now >= pl->resume_at)
+    {
+        const sim_burst_t *b = &pl->bursts[pl->cur];
+        if (pl->done == b->frames)
+        {
+            pl->cur++;
+            pl->done = 0;
+            pl->stalled = false;
+            continue;
+        }
+        if (!pl->stalled && b->stall_at >= 0 && pl->done >= b->stall_at)
+        {
+            // 写端停顿, 例如网络卡住或解码器跟不上
+            pl->stalled = true;
+            pl->resume_at = s_sim.now + b->stall_len;
+            continue;
+        }
+        if (tx_pending() + PLAY_CHUNK > TX_DEPTH)
+        {
+            break;
+        }
+        size_t n = (b->frames - pl->done) < PLAY_CHUNK ? (size_t)(b->frames - pl->done) : PLAY_CHUNK;
+        for (size_t i = 0; i < n; i++)
+        {
+            buf[i * 2] = buf[i * 2 + 1] = frame_code(s_sim.written + i);
+        }
+        size_t cnt = 0;
+        if (audio_ref_i2s_write(buf, n * 2 * sizeof(int16_t), &cnt, portMAX_DELAY) != ESP_OK)
+        {
+            return false;
+        }
+        pl->done += n;
+    }
+    return true;
+}
+
+/// @brief 按帧推进时间, feed 端每凑够一块麦克风数据 (加上 DMA 描述符和调度延迟) 取一次参考信号
+static bool sim_run(const sim_burst_t *bursts, int count)
+{
+    sim_player_t pl = {.bursts = bursts, .count = count};
+    int16_t ref_buf[FEED_CHUNK];
+    int64_t chunk_end = FEED_CHUNK;
+    int64_t next_read = align_up(chunk_end, DMA_FRAME_NUM) + rnd_range(0, FEED_JITTER);
+
+    for (s_sim.now = 0; s_sim.now < s_sim.len; s_sim.now++)
+    {
+        // 同一时刻的读和写先后随机
+        bool write_first = rnd() & 1;
+        if (write_first && !sim_player_step(&pl))
+        {
+            return false;
+        }
+        if (s_sim.now == next_read && chunk_end <= s_sim.len)
+        {
+            audio_ref_read(ref_buf, FEED_CHUNK);
+            memcpy(&s_sim.ref_code[chunk_end - FEED_CHUNK], ref_buf, sizeof(ref_buf));
+            chunk_end += FEED_CHUNK;
+            next_read = align_up(chunk_end, DMA_FRAME_NUM) + rnd_range(0, FEED_JITTER);
+        }
+        if (!write_first && !sim_player_step(&pl))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief 参考信号 t 时刻的编码对应的帧编号, 没有参考信号时返回 -1
+static int64_t ref_frame(int64_t t)
+{
+    int code = s_sim.ref_code[t];
+    if (code == 0)
+    {
+        return -1;
+    }
+    // t 时刻附近正在播放的帧, 参考信号与它相差远小于 CODE_MOD / 2
+    int64_t lo = 0, hi = s_sim.written;
+    while (lo < hi)
+    {
+        int64_t mid = (lo + hi) / 2;
+        if (s_sim.play_time[mid] <= t)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    int64_t delta = ((code - 1) - lo % CODE_MOD + CODE_MOD) % CODE_MOD;
+    if (delta > CODE_MOD / 2)
+    {
+        delta -= CODE_MOD;
+    }
+    return lo + delta;
+}
+
+typedef struct
+{
+    int64_t min_lead;
+    int64_t max_lead;
+    int64_t missing;   // 播放了但没有出现在参考信号中的帧
+    int64_t repeated;  // 在参考信号中出现多次的帧
+    int64_t late;      // 参考信号晚于回声的帧 (AEC 无法消除)
+    int64_t too_early; // 参考信号早于回声超过 NLMS_TAPS - ECHO_IR_LEN 的帧
+    int64_t frames;
+} sim_align_t;
+
+/// @brief 逐帧比较参考信号的位置和回声到达麦克风的时间: lead = 播放时间 + 回声延时 - 参考信号时间
+static sim_align_t sim_align(void)
+{
+    sim_align_t a = {.min_lead = INT64_MAX, .max_lead = INT64_MIN};
+    uint8_t *seen = calloc(s_sim.written ? s_sim.written : 1, 1);
+    for (int64_t t = 0; t < s_sim.len; t++)
+    {
+        int64_t g = ref_frame(t);
+        if (g < 0)
+        {
+            continue;
+        }
+        if (g >= s_sim.written)
+        {
+            a.repeated++;
+            continue;
+        }
+        seen[g] = seen[g] < 255 ? seen[g] + 1 : 255;
+        int64_t lead = s_sim.play_time[g] + s_echo_delay - t;
+        a.min_lead = lead < a.min_lead ? lead : a.min_lead;
+        a.max_lead = lead > a.max_lead ? lead : a.max_lead;
+        a.late += lead < 0;
+        a.too_early += lead > NLMS_TAPS - ECHO_IR_LEN;
+    }
+    for (int64_t g = 0; g < s_sim.written; g++)
+    {
+        // 模拟结束时还没读到的帧不算
+        if (s_sim.play_time[g] + s_echo_delay + 2 * FEED_CHUNK + DMA_FRAME_NUM >= s_sim.len)
+        {
+            continue;
+        }
+        a.frames++;
+        a.missing += seen[g] == 0;
+        a.repeated += seen[g] > 1;
+    }
+    free(seen);
+    return a;
+}
+
+/// @brief 生成类似语音的信号: 低通噪声, 按 3~5Hz 的音节起伏
+static int16_t *make_speech(size_t frames, int channels, uint32_t seed, double amp)
+{
+    int16_t *pcm = malloc(frames * channels * sizeof(int16_t));
+    double lp = 0;
+    for (size_t i = 0; i < frames; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        double white = ((int32_t)(seed >> 8) & 0xffff) / 32768.0 - 1.0;
+        lp = 0.6 * lp + 0.4 * white;
+        double env = 0.25 + 0.75 * fabs(sin(2.0 * M_PI * (3.0 + (i / 8000) % 3) * i / SIM_RATE));
+        for (int c = 0; c < channels; c++)
+        {
+            pcm[i * channels + c] = (int16_t)lrint(amp * env * lp);
+        }
+    }
+    return pcm;
+}
+
+/// @brief 读取 16bit PCM WAV, 单声道复制为双声道 (channels == 2) 或双声道下混 (channels == 1)
+static int16_t *load_wav(const char *path, int channels, size_t *frames)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        printf("cannot open %s\n", path);
+        return NULL;
+    }
+    uint8_t hdr[12];
+    uint8_t chunk[8];
+    uint16_t fmt_channels = 0, fmt_bits = 0;
+    uint32_t fmt_rate = 0;
+    int16_t *pcm = NULL;
+    if (fread(hdr, 1, 12, fp) != 12 || memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0)
+    {
+        goto _exit;
+    }
+    while (fread(chunk, 1, 8, fp) == 8)
+    {
+        uint32_t size = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (uint32_t)chunk[7] << 24;
+        if (memcmp(chunk, "fmt ", 4) == 0)
+        {
+            uint8_t fmt[16];
+            if (size < 16 || fread(fmt, 1, 16, fp) != 16)
+            {
+                goto _exit;
+            }
+            fmt_channels = fmt[2] | fmt[3] << 8;
+            fmt_rate = fmt[4] | fmt[5] << 8 | fmt[6] << 16 | (uint32_t)fmt[7] << 24;
+            fmt_bits = fmt[14] | fmt[15] << 8;
+            fseek(fp, size - 16 + (size & 1), SEEK_CUR);
+        }
+        else if (memcmp(chunk, "data", 4) == 0)
+        {
+            if (fmt_bits != 16 || fmt_rate != SIM_RATE || (fmt_channels != 1 && fmt_channels != 2))
+            {
+                printf("%s: need 16 bit %d Hz mono or stereo PCM\n", path, SIM_RATE);
+                goto _exit;
+            }
+            size_t n = size / (fmt_channels * sizeof(int16_t));
+            int16_t *raw = malloc(size);
+            n = fread(raw, fmt_channels * sizeof(int16_t), n, fp);
+            pcm = malloc((n ? n : 1) * channels * sizeof(int16_t));
+            for (size_t i = 0; i < n; i++)
+            {
+                int16_t l = raw[i * fmt_channels];
+                int16_t r = raw[i * fmt_channels + fmt_channels - 1];
+                if (channels == 2)
+                {
+                    pcm[i * 2] = l;
+                    pcm[i * 2 + 1] = r;
+                }
+                else
+                {
+                    pcm[i] = ((int32_t)l + r) >> 1;
+                }
+            }
+            free(raw);
+            *frames = n;
+            break;
+        }
+        else
+        {
+            fseek(fp, size + (size & 1), SEEK_CUR);
+        }
+    }
+_exit:
+    if (pcm == NULL)
+    {
+        printf("%s: not a usable WAV file\n", path);
+    }
+    fclose(fp);
+    return pcm;
+}
+
+static void put_le(FILE *fp, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        fputc((v >> (8 * i)) & 0xff, fp);
+    }
+}
+
+/// @brief 写出 AFE 收到的 3 通道数据 (mic_l, mic_r, ref)
+static void dump_feed(const char *path, const int16_t *mic, const int16_t *ref, int64_t frames)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        printf("cannot create %s\n", path);
+        return;
+    }
+    uint32_t data = frames * 3 * sizeof(int16_t);
+    fwrite("RIFF", 1, 4, fp);
+    put_le(fp, 36 + data, 4);
+    fwrite("WAVEfmt ", 1, 8, fp);
+    put_le(fp, 16, 4);
+    put_le(fp, 1, 2);
+    put_le(fp, 3, 2);
+    put_le(fp, SIM_RATE, 4);
+    put_le(fp, SIM_RATE * 3 * sizeof(int16_t), 4);
+    put_le(fp, 3 * sizeof(int16_t), 2);
+    put_le(fp, 16, 2);
+    fwrite("data", 1, 4, fp);
+    put_le(fp, data, 4);
+    for (int64_t t = 0; t < frames; t++)
+    {
+        int16_t s[3] = {mic[t], mic[t], ref[t]};
+        fwrite(s, sizeof(int16_t), 3, fp);
+    }
+    fclose(fp);
+    printf("  feed channels written to %s\n", path);
+}
+
+static void test_unit(void)
+{
+    printf("ring:\n");
+    sim_reset(1);
+    audio_ref_stats_t st;
+    int16_t ref[AUDIO_REF_DELAY_FRAMES + 8];
+    int16_t stereo[8] = {1000, 3000, -1000, -3001, 32767, 32767, -32768, -32768};
+    audio_ref_read(ref, 8);
+    bool zero = true;
+    for (int i = 0; i < 8; i++)
+    {
+        zero = zero && ref[i] == 0;
+    }
+    check(zero, "reads zeros while nothing is playing");
+
+    audio_ref_push(stereo, 4);
+    audio_ref_read(ref, AUDIO_REF_DELAY_FRAMES + 4);
+    const int16_t *mix = ref + AUDIO_REF_DELAY_FRAMES;
+    check(mix[0] == 2000 && mix[1] == -2001 && mix[2] == 32767 && mix[3] == -32768, "stereo is downmixed to (l + r) / 2 without overflow");
+
+    audio_ref_read(ref, 8);
+    audio_ref_get_stats(&st);
+    check(st.bursts == 1 && st.underruns == 1 && st.level == 0, "running dry ends the burst");
+
+    // 读端停住时只保留最新的 AUDIO_REF_RING_FRAMES 帧
+    int16_t *block = calloc(AUDIO_REF_RING_FRAMES + 100, 2 * sizeof(int16_t));
+    for (int i = 0; i < AUDIO_REF_RING_FRAMES + 100; i++)
+    {
+        block[i * 2] = block[i * 2 + 1] = (int16_t)(i % 1000 + 1);
+    }
+    audio_ref_push(block, AUDIO_REF_RING_FRAMES + 100);
+    audio_ref_get_stats(&st);
+    audio_ref_read(ref, AUDIO_REF_DELAY_FRAMES + 1);
+    check(st.overruns == 100 && st.level == AUDIO_REF_RING_FRAMES && ref[AUDIO_REF_DELAY_FRAMES] == 101, "overrun drops the oldest frames");
+    free(block);
+}
+
+static void print_align(const sim_align_t *a)
+{
+    audio_ref_stats_t st;
+    audio_ref_get_stats(&st);
+    printf("%" PRId64 " frames played, %" PRIu32 " bursts, %" PRIu32 " underruns, %" PRIu32 " overruns\n",
+           a->frames, st.bursts, st.underruns, st.overruns);
+    printf("    reference leads echo by %" PRId64 " .. %" PRId64 " frames (%.1f .. %.1f ms); late %" PRId64 ", too early %" PRId64 ", missing %" PRId64 ", repeated %" PRId64 "\n",
+           a->min_lead, a->max_lead, a->min_lead * 1000.0 / SIM_RATE, a->max_lead * 1000.0 / SIM_RATE,
+           a->late, a->too_early, a->missing, a->repeated);
+}
+
+/// @brief 很多段随机长度, 随机间隔, 部分段中途写端停顿, 覆盖写入时刻相对 feed 块和 DMA 描述符的各种相位
+static void test_alignment(void)
+{
+    printf("alignment (random bursts and stalls, 8 DMA phases):\n");
+    const int count = 60;
+    sim_burst_t *bursts = calloc(count, sizeof(sim_burst_t));
+    sim_align_t total = {.min_lead = INT64_MAX, .max_lead = INT64_MIN};
+    bool ok = true;
+    for (int run = 0; run < 8; run++)
+    {
+        s_tx_phase = run * DMA_FRAME_NUM / 8 + rnd_range(0, DMA_FRAME_NUM / 8 - 1);
+        int64_t t = rnd_range(0, FEED_CHUNK);
+        for (int i = 0; i < count; i++)
+        {
+            bursts[i].start = t;
+            bursts[i].frames = rnd_range(SIM_RATE / 20, SIM_RATE);
+            bursts[i].stall_at = (i % 3 == 0) ? rnd_range(1, 8) * PLAY_CHUNK : -1;
+            bursts[i].stall_len = rnd_range(SIM_RATE / 100, SIM_RATE * 3 / 10);
+            // 下一段可以紧接着开始 (上一段还在 DMA 中), 也可以隔一段静音
+            t += (rnd() & 3) ? bursts[i].frames + rnd_range(SIM_RATE / 100, SIM_RATE / 2) : bursts[i].frames / 2;
+            t += bursts[i].stall_at >= 0 ? bursts[i].stall_len : 0;
+        }
+        sim_reset(t + 2 * SIM_RATE);
+        ok = ok && sim_run(bursts, count);
+        sim_align_t a = sim_align();
+        printf("  phase %3" PRId64 ": ", s_tx_phase);
+        print_align(&a);
+        total.min_lead = a.min_lead < total.min_lead ? a.min_lead : total.min_lead;
+        total.max_lead = a.max_lead > total.max_lead ? a.max_lead : total.max_lead;
+        total.missing += a.missing;
+        total.repeated += a.repeated;
+        total.late += a.late;
+        total.too_early += a.too_early;
+    }
+    s_tx_phase = 0;
+    check(ok, "simulated I2S accepts every write");
+    check(total.missing == 0 && total.repeated == 0, "every played frame appears exactly once in the reference");
+    check(total.late == 0, "reference never lags the echo");
+    check(total.too_early == 0, "reference leads the echo by less than the AEC tail");
+    free(bursts);
+}
+
+/// @brief 第 g 帧远端音频下混后的值, g < 0 为静音
+static int16_t far_mono(int64_t g)
+{
+    if (g < 0)
+    {
+        return 0;
+    }
+    const int16_t *f = &s_far[(g % s_far_frames) * 2];
+    return ((int32_t)f[0] + f[1]) >> 1;
+}
+
+/// @brief 回声路径: 延时后经房间冲激响应, 加上近端语音和底噪
+static void make_mic(int16_t *mic, const int16_t *spk, const uint8_t *near_on, int64_t frames)
+{
+    double h[ECHO_IR_LEN];
+    uint32_t seed = 7;
+    h[0] = 0.6;
+    for (int k = 1; k < ECHO_IR_LEN; k++)
+    {
+        seed = seed * 1103515245 + 12345;
+        h[k] = 0.3 * exp(-k / 40.0) * (((seed >> 8) & 0xffff) / 32768.0 - 1.0);
+    }
+    size_t near_pos = 0;
+    for (int64_t t = 0; t < frames; t++)
+    {
+        double y = 0;
+        for (int k = 0; k < ECHO_IR_LEN; k++)
+        {
+            int64_t i = t - s_echo_delay - k;
+            y += i >= 0 ? h[k] * spk[i] : 0;
+        }
+        if (near_on[t])
+        {
+            y += s_near[near_pos++ % s_near_frames];
+        }
+        seed = seed * 1103515245 + 12345;
+        y += (int)((seed >> 8) % 5) - 2;
+        mic[t] = (int16_t)(y > 32767 ? 32767 : (y < -32768 ? -32768 : y));
+    }
+}
+
+/// @brief NLMS 回声消除, 返回残差
+static void nlms(const int16_t *mic, const int16_t *ref, double *err, int64_t frames)
+{
+    double *w = calloc(NLMS_TAPS, sizeof(double));
+    double power = 0;
+    for (int64_t t = 0; t < frames; t++)
+    {
+        double x0 = ref[t];
+        double x_old = t >= NLMS_TAPS ? ref[t - NLMS_TAPS] : 0;
+        power += x0 * x0 - x_old * x_old;
+        double y = 0;
+        int64_t n = t + 1 < NLMS_TAPS ? t + 1 : NLMS_TAPS;
+        for (int64_t k = 0; k < n; k++)
+        {
+            y += w[k] * ref[t - k];
+        }
+        double e = mic[t] - y;
+        err[t] = e;
+        double mu = 0.5 * e / (power + 1e6);
+        for (int64_t k = 0; k < n; k++)
+        {
+            w[k] += mu * ref[t - k];
+        }
+    }
+    free(w);
+}
+
+/// @brief 把远端内容换成真实音频, 混出麦克风信号, 经 NLMS 消除后测量各段的回声衰减 (ERLE)
+static void test_echo_cancel(const char *dump_path)
+{
+    // 录音的收敛速度取决于内容 (NLMS 对窄带信号收敛慢), 只在合成信号上要求 ERLE, 对齐检查不变
+    bool recorded = s_far || s_near;
+    printf("echo cancellation (%s far end, %s near end):\n", s_far ? "recorded" : "synthetic", s_near ? "recorded" : "synthetic");
+    if (s_far == NULL)
+    {
+        s_far_frames = 8 * SIM_RATE;
+        s_far = make_speech(s_far_frames, 2, 11, 12000);
+    }
+    if (s_near == NULL)
+    {
+        s_near_frames = 4 * SIM_RATE;
+        s_near = make_speech(s_near_frames, 1, 23, 4000);
+    }
+
+    // 6 段 3 秒的播放, 第 2, 4 段开始后不久写端停顿 (之后重新对齐), 第 5 段有近端插话, 段间有近端语音
+    enum { count = 6 };
+    sim_burst_t bursts[count];
+    int64_t t = SIM_RATE / 4;
+    for (int i = 0; i < count; i++)
+    {
+        bursts[i].start = t + rnd_range(0, FEED_CHUNK);
+        bursts[i].frames = 3 * SIM_RATE;
+        bursts[i].stall_at = (i == 1 || i == 3) ? 8 * PLAY_CHUNK : -1;
+        bursts[i].stall_len = SIM_RATE * 3 / 20;
+        bursts[i].near = (i == 4);
+        t = bursts[i].start + bursts[i].frames + (bursts[i].stall_at >= 0 ? bursts[i].stall_len : 0) + SIM_RATE / 2;
+    }
+    int64_t frames = t + SIM_RATE / 2;
+    sim_reset(frames);
+    check(sim_run(bursts, count), "simulated I2S accepts every write");
+    sim_align_t a = sim_align();
+    printf("  ");
+    print_align(&a);
+
+    // 帧编号换成远端音频: 扬声器按下混后的单声道播放, 参考信号由 audio_ref 原样搬运
+    int16_t *spk = calloc(frames, sizeof(int16_t));
+    int16_t *ref = calloc(frames, sizeof(int16_t));
+    int16_t *mic = calloc(frames, sizeof(int16_t));
+    uint8_t *near_on = calloc(frames, 1);
+    double *err = calloc(frames, sizeof(double));
+    for (int64_t i = 0; i < frames; i++)
+    {
+        spk[i] = far_mono(s_sim.dac[i]);
+        ref[i] = far_mono(ref_frame(i));
+    }
+    int64_t prev_end = 0;
+    for (int i = 0; i < count; i++)
+    {
+        // 段间静音处有近端语音
+        for (int64_t k = prev_end + SIM_RATE / 10; k < bursts[i].start; k++)
+        {
+            near_on[k] = 1;
+        }
+        prev_end = bursts[i].start + bursts[i].frames + (bursts[i].stall_at >= 0 ? bursts[i].stall_len : 0) + TX_DEPTH;
+        if (bursts[i].near)
+        {
+            for (int64_t k = bursts[i].start + SIM_RATE; k < bursts[i].start + 2 * SIM_RATE; k++)
+            {
+                near_on[k] = 1;
+            }
+        }
+    }
+    make_mic(mic, spk, near_on, frames);
+    nlms(mic, ref, err, frames);
+
+    // 每段从第 1.5 秒开始 (停顿后重新对齐的滤波器也已收敛), 只在没有近端语音时测量
+    bool ok = true;
+    for (int i = 0; i < count; i++)
+    {
+        double pm = 0, pe = 0;
+        for (int64_t k = bursts[i].start + SIM_RATE * 3 / 2; k < bursts[i].start + bursts[i].frames; k++)
+        {
+            if (!near_on[k] && s_sim.dac[k] >= 0)
+            {
+                pm += (double)mic[k] * mic[k];
+                pe += err[k] * err[k];
+            }
+        }
+        double erle = 10.0 * log10((pm + 1) / (pe + 1));
+        printf("  burst %d%s%s: ERLE %.1f dB\n", i + 1, bursts[i].stall_at >= 0 ? " (writer stall)" : "", bursts[i].near ? " (double talk)" : "", erle);
+        ok = ok && erle > 20.0;
+    }
+    check(a.late == 0 && a.missing == 0 && a.repeated == 0, "reference is complete and never lags the echo");
+    if (!recorded)
+    {
+        check(ok, "echo is attenuated by more than 20 dB in every burst");
+    }
+
+    if (dump_path)
+    {
+        dump_feed(dump_path, mic, ref, frames);
+    }
+    free(spk);
+    free(ref);
+    free(mic);
+    free(near_on);
+    free(err);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dump_path = NULL;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--play") == 0)
+        {
+            s_far = load_wav(argv[++i], 2, &s_far_frames);
+            if (s_far == NULL || s_far_frames == 0)
+            {
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--near") == 0)
+        {
+            s_near = load_wav(argv[++i], 1, &s_near_frames);
+            if (s_near == NULL || s_near_frames == 0)
+            {
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--echo-delay") == 0)
+        {
+            s_echo_delay = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dump") == 0)
+        {
+            dump_path = argv[++i];
+        }
+    }
+
+    test_unit();
+    test_alignment();
+    test_echo_cancel(dump_path);
+    sim_reset(1);
+
+    printf("%s\n", s_failures ? "FAIL" : "PASS");
+    return s_failures ? 1 : 0;
+}
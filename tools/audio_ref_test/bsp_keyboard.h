@@ -0,0 +1,10 @@
+/*
+ * audio_ref_test 用的 bsp_keyboard 替身: 只有 audio_ref.c 用到的 bsp_i2s_write, 实现在 audio_ref_test.c 中.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+esp_err_t bsp_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms);
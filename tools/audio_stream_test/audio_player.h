@@ -0,0 +1,10 @@
+/*
+ * audio_stream_test 用的 audio_player 替身: 只有 audio_stream.c 用到的两个接口, 实现在 audio_stream_test.c 中.
+ */
+#pragma once
+
+#include <stdio.h>
+#include "esp_err.h"
+
+esp_err_t audio_player_play(FILE *fp);
+esp_err_t audio_player_stop(void);
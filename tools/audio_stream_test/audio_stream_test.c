@@ -0,0 +1,377 @@
+/*
+ * 在电脑上测试 main/app_audio/audio_stream: 播放器 fseek 的语义, 以及从限速的本机 HTTP 服务边下载边播放.
+ *
+ * 编译: cc -O2 -Wall -pthread -I. -I../host_shim -I../../main/app_audio audio_stream_test.c -o audio_stream_test
+ * 运行: ./audio_stream_test
+ *       ./audio_stream_test --bandwidth 16000 --size 100000 --play-rate 16000
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "esp_timer.h"
+
+// 直接编译进来, 测试可以调用 static 的 cookie 函数
+#include "../../main/app_audio/audio_stream.c"
+
+static int s_failures = 0;
+static uint8_t *s_payload = NULL;
+static size_t s_payload_len = 0;
+
+static void check(bool ok, const char *what)
+{
+    printf("  %s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+    {
+        s_failures++;
+    }
+}
+
+static void make_payload(size_t len)
+{
+    free(s_payload);
+    s_payload = malloc(len);
+    s_payload_len = len;
+    uint32_t seed = 0x2545f491;
+    for (size_t i = 0; i < len; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        s_payload[i] = seed >> 16;
+    }
+}
+
+static void sleep_until(int64_t deadline_us)
+{
+    int64_t wait = deadline_us - esp_timer_get_time();
+    if (wait > 0)
+    {
+        usleep(wait);
+    }
+}
+
+/* ---------------- cookie seek ---------------- */
+
+/// @brief 把整段数据写入会话, 但不交给播放器, 由测试直接调用 cookie 函数
+static audio_stream_t *seek_session(size_t len)
+{
+    make_payload(len);
+    audio_stream_open();
+    s_stream->playing = true;
+    s_stream->reader_open = true;
+    audio_stream_write(s_payload, len);
+    audio_stream_finish();
+    return s_stream;
+}
+
+static bool read_expect(audio_stream_t *s, size_t len, size_t at)
+{
+    uint8_t buf[1024];
+    while (len > 0)
+    {
+        ssize_t n = audio_stream_cookie_read(s, (char *)buf, len < sizeof(buf) ? len : sizeof(buf));
+        if (n <= 0 || memcmp(buf, s_payload + at, n) != 0)
+        {
+            return false;
+        }
+        at += n;
+        len -= n;
+    }
+    return true;
+}
+
+static int seek(audio_stream_t *s, off_t offset, int whence, off_t *result)
+{
+    int ret = audio_stream_cookie_seek(s, &offset, whence);
+    *result = offset;
+    return ret;
+}
+
+static void test_seek(void)
+{
+    printf("seek:\n");
+    const size_t replay = AUDIO_STREAM_REPLAY_SIZE;
+    off_t pos;
+
+    audio_stream_t *s = seek_session(replay * 4);
+    read_expect(s, 1000, 0);
+    check(seek(s, 0, SEEK_SET, &pos) == 0 && pos == 0 && read_expect(s, 100, 0), "probe then rewind to 0 replays the header");
+    check(seek(s, 500, SEEK_SET, &pos) == 0 && pos == 500 && read_expect(s, 100, 500), "rewind into the header");
+    check(seek(s, 0, SEEK_CUR, &pos) == 0 && pos == 600, "SEEK_CUR 0 reports the position");
+    check(seek(s, 2000, SEEK_SET, &pos) == 0 && pos == 2000 && read_expect(s, replay, 2000), "forward inside the header continues into the stream");
+    check(seek(s, 0, SEEK_END, &pos) == -1, "SEEK_END is rejected");
+    check(seek(s, -1, SEEK_SET, &pos) == -1, "negative offset is rejected");
+
+    // 读端已越过保留的文件头: 文件头和读端之间的数据已经丢弃
+    size_t read_pos = 2000 + replay;
+    check(seek(s, 0, SEEK_SET, &pos) == -1, "rewind to 0 after the header was passed fails");
+    check(seek(s, replay, SEEK_SET, &pos) == -1, "rewind to the end of the header fails");
+    check(seek(s, replay + 100, SEEK_SET, &pos) == -1, "rewind between the header and the read position fails");
+    check(seek(s, -1, SEEK_CUR, &pos) == -1, "SEEK_CUR backwards fails");
+    check(read_expect(s, 100, read_pos), "failed seeks leave the position unchanged");
+    read_pos += 100;
+
+    check(seek(s, read_pos, SEEK_SET, &pos) == 0 && pos == (off_t)read_pos, "seek to the current position");
+    check(seek(s, 3000, SEEK_CUR, &pos) == 0 && pos == (off_t)(read_pos + 3000) && read_expect(s, 100, read_pos + 3000), "forward seek skips exactly");
+    check(seek(s, s_payload_len + 1, SEEK_SET, &pos) == -1, "forward seek past the end fails");
+    s->reader_open = false;
+
+    // 整段都在文件头内时可以任意回退
+    s = seek_session(replay / 2);
+    read_expect(s, replay / 2, 0);
+    check(seek(s, 10, SEEK_SET, &pos) == 0 && read_expect(s, replay / 2 - 10, 10), "short stream rewinds after EOF");
+    s->reader_open = false;
+}
+
+/* ---------------- audio_player 替身 ---------------- */
+
+typedef struct
+{
+    uint32_t play_rate;     // 模拟解码消耗的速度, 字节/秒
+    pthread_t thread;
+    volatile bool stop;
+    volatile bool done;
+    bool probe_ok;          // 探测后 fseek 回到开头成功
+    uint8_t *data;
+    size_t len;
+    int64_t first_read_us;
+    int64_t last_read_us;
+} fake_player_t;
+
+static fake_player_t s_player;
+
+static void *fake_player_task(void *arg)
+{
+    FILE *fp = (FILE *)arg;
+    // 像 audio_player 一样先读一小段判断格式, 再回到开头解码
+    uint8_t probe[512];
+    size_t n = fread(probe, 1, sizeof(probe), fp);
+    s_player.first_read_us = esp_timer_get_time();
+    s_player.probe_ok = n == sizeof(probe) && memcmp(probe, s_payload, n) == 0 && fseek(fp, 0, SEEK_SET) == 0;
+
+    uint8_t buf[1024];
+    while (!s_player.stop && (n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        s_player.data = realloc(s_player.data, s_player.len + n);
+        memcpy(s_player.data + s_player.len, buf, n);
+        s_player.len += n;
+        s_player.last_read_us = esp_timer_get_time();
+        sleep_until(s_player.first_read_us + (int64_t)s_player.len * 1000000 / s_player.play_rate);
+    }
+    fclose(fp);
+    s_player.done = true;
+    return NULL;
+}
+
+esp_err_t audio_player_play(FILE *fp)
+{
+    s_player.stop = false;
+    s_player.done = false;
+    s_player.len = 0;
+    return pthread_create(&s_player.thread, NULL, fake_player_task, fp) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t audio_player_stop(void)
+{
+    s_player.stop = true;
+    return ESP_OK;
+}
+
+/* ---------------- 限速的 HTTP 服务 ---------------- */
+
+typedef struct
+{
+    int listen_fd;
+    uint32_t bandwidth;     // 字节/秒, 0 不限速
+} throttled_server_t;
+
+static void *server_task(void *arg)
+{
+    throttled_server_t *srv = (throttled_server_t *)arg;
+    int fd = accept(srv->listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    char req[1024];
+    size_t got = 0;
+    while (got < sizeof(req) - 1)
+    {
+        ssize_t n = recv(fd, req + got, sizeof(req) - 1 - got, 0);
+        if (n <= 0)
+            break;
+        got += n;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n"))
+            break;
+    }
+
+    char head[128];
+    int head_len = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: audio/mp3\r\nContent-Length: %zu\r\n\r\n", s_payload_len);
+    send(fd, head, head_len, MSG_NOSIGNAL);
+    int64_t start = esp_timer_get_time();
+    for (size_t sent = 0; sent < s_payload_len;)
+    {
+        size_t n = s_payload_len - sent < 1460 ? s_payload_len - sent : 1460;
+        ssize_t w = send(fd, s_payload + sent, n, MSG_NOSIGNAL);
+        if (w <= 0)
+            break;
+        sent += w;
+        if (srv->bandwidth)
+        {
+            sleep_until(start + (int64_t)sent * 1000000 / srv->bandwidth);
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+typedef struct
+{
+    int64_t first_byte_us;  // 以下均相对发出请求的时间
+    int64_t download_us;
+    int64_t play_start_us;
+    int64_t play_end_us;
+} stream_timing_t;
+
+/// @brief 像 baidu_tts 一样把 HTTP 回复的数据块写入 audio_stream, 等待播放结束
+static bool stream_from_server(uint32_t bandwidth, uint32_t play_rate, size_t size, stream_timing_t *t)
+{
+    make_payload(size);
+    memset(&s_player, 0, sizeof(s_player));
+    s_player.play_rate = play_rate;
+
+    throttled_server_t srv = {.bandwidth = bandwidth};
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    srv.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bind(srv.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(srv.listen_fd, 1) != 0)
+    {
+        perror("listen");
+        return false;
+    }
+    getsockname(srv.listen_fd, (struct sockaddr *)&addr, &addr_len);
+    pthread_t server;
+    pthread_create(&server, NULL, server_task, &srv);
+
+    int64_t start = esp_timer_get_time();
+    audio_stream_open();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        perror("connect");
+        return false;
+    }
+    const char *req = "POST /text2audio HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 0\r\n\r\n";
+    send(fd, req, strlen(req), MSG_NOSIGNAL);
+
+    char buf[2048];
+    char head[512];
+    size_t head_len = 0;
+    bool in_body = false;
+    ssize_t n;
+    t->first_byte_us = -1;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+    {
+        char *body = buf;
+        if (!in_body)
+        {
+            // 跳过回复头, 之后的数据等同于 HTTP_EVENT_ON_DATA
+            size_t take = n < (ssize_t)(sizeof(head) - 1 - head_len) ? (size_t)n : sizeof(head) - 1 - head_len;
+            memcpy(head + head_len, buf, take);
+            head_len += take;
+            head[head_len] = '\0';
+            char *end = strstr(head, "\r\n\r\n");
+            if (end == NULL)
+                continue;
+            in_body = true;
+            size_t skip = (end + 4 - head) - (head_len - take);
+            body += skip;
+            n -= skip;
+        }
+        if (n > 0)
+        {
+            if (t->first_byte_us < 0)
+                t->first_byte_us = esp_timer_get_time() - start;
+            if (audio_stream_write(body, n) != ESP_OK)
+                break;
+        }
+    }
+    close(fd);
+    t->download_us = esp_timer_get_time() - start;
+    audio_stream_finish();
+    pthread_join(server, NULL);
+    close(srv.listen_fd);
+
+    while (!s_player.done)
+    {
+        usleep(1000);
+    }
+    pthread_join(s_player.thread, NULL);
+    t->play_start_us = s_player.first_read_us - start;
+    t->play_end_us = s_player.last_read_us - start;
+    printf("  bandwidth %u B/s, play %u B/s, %zu bytes: first byte %.0f ms, playback starts %.0f ms, download done %.0f ms, playback done %.0f ms\n",
+           (unsigned)bandwidth, (unsigned)play_rate, size,
+           t->first_byte_us / 1000.0, t->play_start_us / 1000.0, t->download_us / 1000.0, t->play_end_us / 1000.0);
+    return s_player.probe_ok && s_player.len == s_payload_len && memcmp(s_player.data, s_payload, s_payload_len) == 0;
+}
+
+static void test_throttled(void)
+{
+    stream_timing_t t;
+    printf("slow network (32 KB/s, 64 KB):\n");
+    bool same = stream_from_server(32000, 48000, 64000, &t);
+    check(same, "player decodes exactly the bytes the server sent");
+    check(t.play_start_us < 500 * 1000, "playback starts after the prebuffer, not the whole download");
+    check(t.play_start_us * 4 < t.download_us, "playback starts well before the download finishes");
+
+    printf("fast network (unlimited, 256 KB, player 128 KB/s):\n");
+    same = stream_from_server(0, 128000, 256000, &t);
+    check(same, "player decodes exactly the bytes the server sent");
+    // 缓冲区满后写端阻塞, 下载只能比播放领先 AUDIO_STREAM_BUFFER_SIZE 左右
+    int64_t min_download = (int64_t)(256000 - AUDIO_STREAM_BUFFER_SIZE - 8 * 1024) * 1000000 / 128000;
+    check(t.download_us >= min_download, "HTTP reader is held back by the full buffer");
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t bandwidth = 0, play_rate = 16000;
+    size_t size = 0;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--bandwidth") == 0)
+            bandwidth = strtoul(argv[i + 1], NULL, 0);
+        else if (strcmp(argv[i], "--size") == 0)
+            size = strtoul(argv[i + 1], NULL, 0);
+        else if (strcmp(argv[i], "--play-rate") == 0)
+            play_rate = strtoul(argv[i + 1], NULL, 0);
+    }
+
+    if (audio_stream_init() != ESP_OK)
+    {
+        printf("FAIL: audio_stream_init\n");
+        return 1;
+    }
+    if (size)
+    {
+        // 只跑一次指定参数的下载播放
+        stream_timing_t t;
+        printf("custom:\n");
+        check(stream_from_server(bandwidth, play_rate, size, &t), "player decodes exactly the bytes the server sent");
+    }
+    else
+    {
+        test_seek();
+        test_throttled();
+    }
+    printf("%s\n", s_failures ? "FAIL" : "PASS");
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,312 @@
+/*
+ * 在电脑上回放流式聊天回复 (SSE), 测试 main/chatgpt_api/chat_stream 的增量解析和切句.
+ *
+ * 编译: cc -O2 -Wall -I../host_shim -I../../main/baidu_api -I../../main/chatgpt_api -DJSON_UTILS_JSMN=0 chat_stream_test.c ../../main/chatgpt_api/chat_stream.c ../../main/baidu_api/json_utils.c -o chat_stream_test
+ * 运行: ./chat_stream_test                 # 回放 streams/ 下的样本并检查
+ *       ./chat_stream_test my_answer.sse   # 回放自己录制的回复, 打印切出的句子
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "chat_stream.h"
+
+#define TEST_SENTENCE_MAX 256
+
+typedef struct
+{
+    char *text[TEST_SENTENCE_MAX]; // 回调收到的原文(含开头空白)
+    size_t lead[TEST_SENTENCE_MAX];
+    size_t offset[TEST_SENTENCE_MAX]; // 回调时已经喂入的字节数
+    int count;
+    size_t fed;
+} sentences_t;
+
+static int s_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    printf("  %s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+    {
+        s_failures++;
+    }
+}
+
+static char *load_file(const char *path, size_t *len)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = malloc(size + 1);
+    *len = fread(data, 1, size, fp);
+    data[*len] = '\0';
+    fclose(fp);
+    return data;
+}
+
+static void on_sentence(const char *text, size_t lead, void *arg)
+{
+    sentences_t *out = (sentences_t *)arg;
+    if (out->count < TEST_SENTENCE_MAX)
+    {
+        out->text[out->count] = strdup(text);
+        out->lead[out->count] = lead;
+        out->offset[out->count] = out->fed;
+        out->count++;
+    }
+}
+
+static void sentences_free(sentences_t *out)
+{
+    for (int i = 0; i < out->count; i++)
+    {
+        free(out->text[i]);
+    }
+    memset(out, 0, sizeof(sentences_t));
+}
+
+/// @brief 按 chunk 字节一块喂入, 模拟 esp_http_client_read 在任意位置切断
+static bool replay(const char *data, size_t len, size_t chunk, sentences_t *out)
+{
+    static chat_stream_t cs;
+    memset(out, 0, sizeof(sentences_t));
+    chat_stream_init(&cs, on_sentence, out);
+    for (size_t off = 0; off < len; off += chunk)
+    {
+        size_t n = len - off < chunk ? len - off : chunk;
+        out->fed = off + n;
+        chat_stream_feed(&cs, data + off, n);
+    }
+    chat_stream_finish(&cs);
+    return cs.done;
+}
+
+static bool utf8_valid(const char *s)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    while (*p)
+    {
+        int n = *p < 0x80 ? 0 : (*p & 0xE0) == 0xC0 ? 1 : (*p & 0xF0) == 0xE0 ? 2 : (*p & 0xF8) == 0xF0 ? 3 : -1;
+        if (n < 0)
+            return false;
+        p++;
+        for (int i = 0; i < n; i++, p++)
+        {
+            if ((*p & 0xC0) != 0x80)
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static void print_sentences(const sentences_t *out)
+{
+    for (int i = 0; i < out->count; i++)
+    {
+        printf("    [%2d] @%6zu  %s\n", i, out->offset[i], out->text[i] + out->lead[i]);
+    }
+}
+
+/// @brief 回放一个样本: 任意切块结果相同, 拼接后与原文一致, 每句都能直接送去合成
+static void test_stream(const char *name)
+{
+    char path[256];
+    size_t len = 0, expect_len = 0;
+    snprintf(path, sizeof(path), "streams/%s.sse", name);
+    char *data = load_file(path, &len);
+    snprintf(path, sizeof(path), "streams/%s.txt", name);
+    char *expect = load_file(path, &expect_len);
+    printf("%s (%zu bytes):\n", name, len);
+    if (data == NULL || expect == NULL)
+    {
+        check(false, "sample files are readable (run from tools/chat_stream_test)");
+        free(data);
+        free(expect);
+        return;
+    }
+
+    // 参考结果按 CHAT_STREAM_READ_SIZE (1 KB) 读取, 与固件一致
+    sentences_t ref, out;
+    check(replay(data, len, 1024, &ref), "data: [DONE] is recognized");
+    print_sentences(&ref);
+
+    const size_t chunks[] = {1, 3, 7, 64, len};
+    bool same = true;
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+    {
+        replay(data, len, chunks[c], &out);
+        same &= out.count == ref.count;
+        for (int i = 0; same && i < ref.count; i++)
+        {
+            same &= strcmp(out.text[i], ref.text[i]) == 0 && out.lead[i] == ref.lead[i];
+        }
+        sentences_free(&out);
+    }
+    check(same, "same sentences whether fed in 1, 3, 7, 64 byte chunks or all at once");
+
+    // 对话历史保存的是原文: 拼接后与回复一致, 只可能少了结尾的空白
+    size_t joined_len = 0;
+    for (int i = 0; i < ref.count; i++)
+    {
+        joined_len += strlen(ref.text[i]);
+    }
+    char *joined = calloc(1, joined_len + 1);
+    for (int i = 0; i < ref.count; i++)
+    {
+        strcat(joined, ref.text[i]);
+    }
+    while (expect_len > 0 && is_space(expect[expect_len - 1]))
+    {
+        expect[--expect_len] = '\0';
+    }
+    check(joined_len == expect_len && memcmp(joined, expect, expect_len) == 0, "joined text equals the answer, separators included");
+    free(joined);
+
+    bool speakable = ref.count > 0;
+    for (int i = 0; i < ref.count; i++)
+    {
+        const char *sentence = ref.text[i] + ref.lead[i];
+        speakable &= *sentence && !is_space(*sentence) && utf8_valid(ref.text[i]) && strlen(ref.text[i]) < CHAT_STREAM_SENTENCE_MAX;
+    }
+    check(speakable, "every sentence is non-empty, trimmed, valid UTF-8 and under CHAT_STREAM_SENTENCE_MAX");
+    if (ref.count > 1)
+    {
+        printf("  first sentence after %zu of %zu bytes (%.0f%%)\n", ref.offset[0], len, 100.0 * ref.offset[0] / len);
+        check(ref.offset[0] * 3 < len, "first sentence is ready within the first third of the stream");
+    }
+    sentences_free(&ref);
+    free(data);
+    free(expect);
+}
+
+static int find_sentence(const sentences_t *out, const char *sentence)
+{
+    for (int i = 0; i < out->count; i++)
+    {
+        if (strcmp(out->text[i] + out->lead[i], sentence) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void test_rules(void)
+{
+    sentences_t out;
+    printf("splitting rules:\n");
+
+    const char *en = "data: {\"choices\":[{\"delta\":{\"content\":\"Pi is about 3.14. Both are irrational! Next?\\n\\nYes.\"}}]}\n";
+    replay(en, strlen(en), strlen(en), &out);
+    check(find_sentence(&out, "Pi is about 3.14.") == 0, "decimal point does not end a sentence");
+    int i = find_sentence(&out, "Both are irrational!");
+    check(i == 1 && strcmp(out.text[i], " Both are irrational!") == 0 && out.lead[i] == 1, "space before a sentence is kept as its lead");
+    i = find_sentence(&out, "Yes.");
+    check(i == 3 && strcmp(out.text[i], "\n\nYes.") == 0, "blank line before a sentence is kept as its lead, not dropped");
+    sentences_free(&out);
+
+    // 逗号分句: 超过 CHAT_STREAM_COMMA_SPLIT 字节后在逗号处切开
+    const char *comma = "data: {\"choices\":[{\"delta\":{\"content\":\"如果预算有限，可以先买一把热插拔键盘，之后再换轴体，这样试错成本最低，也能慢慢找到喜欢的手感。\"}}]}\n";
+    replay(comma, strlen(comma), strlen(comma), &out);
+    bool at_comma = out.count > 1;
+    for (i = 0; i + 1 < out.count; i++)
+    {
+        size_t n = strlen(out.text[i]);
+        at_comma &= n >= CHAT_STREAM_COMMA_SPLIT && strcmp(out.text[i] + n - strlen("，"), "，") == 0;
+    }
+    check(at_comma, "long sentence is split at the first comma after CHAT_STREAM_COMMA_SPLIT bytes");
+    sentences_free(&out);
+
+    // SSE 细节: 注释, 其他字段, "data:" 后没有空格, 超长行丢弃后继续解析
+    char *line = malloc(CHAT_STREAM_LINE_MAX * 2);
+    int n = snprintf(line, CHAT_STREAM_LINE_MAX * 2, ": keep-alive\nevent: message\nid: 7\ndata:{\"choices\":[{\"delta\":{\"content\":\"第一句。\"}}]}\ndata: {\"pad\":\"");
+    while (n < CHAT_STREAM_LINE_MAX + 100)
+    {
+        line[n++] = 'x';
+    }
+    n += snprintf(line + n, CHAT_STREAM_LINE_MAX * 2 - n, "\"}\ndata: {\"choices\":[{\"delta\":{\"content\":\"第二句。\"}}]}\n");
+    replay(line, n, 5, &out);
+    check(out.count == 2 && find_sentence(&out, "第一句。") == 0 && find_sentence(&out, "第二句。") == 1,
+          "comments and other fields are ignored, an overlong line is skipped");
+    sentences_free(&out);
+    free(line);
+
+    // 没有换行结尾, 没有 [DONE]: finish 时送出剩余的半句
+    const char *tail = "data: {\"choices\":[{\"delta\":{\"content\":\"没有句号的结尾\"}}]}";
+    bool done = replay(tail, strlen(tail), 4, &out);
+    check(!done && out.count == 1 && find_sentence(&out, "没有句号的结尾") == 0, "unterminated last line and sentence are flushed by finish");
+    sentences_free(&out);
+
+    // \u 转义和代理对
+    const char *esc = "data: {\"choices\":[{\"delta\":{\"content\":\"\\u4f60\\u597d\\uff01\\ud83d\\ude00 \\\"ok\\\"\\u3002\"}}]}\n";
+    replay(esc, strlen(esc), 2, &out);
+    check(out.count == 2 && find_sentence(&out, "你好！") == 0 && find_sentence(&out, "\xf0\x9f\x98\x80 \"ok\"。") == 1, "escapes and surrogate pairs are decoded");
+    sentences_free(&out);
+}
+
+static void bench(void)
+{
+    size_t len = 0;
+    char *data = load_file("streams/deepseek_zh.sse", &len);
+    if (data == NULL)
+    {
+        return;
+    }
+    sentences_t out;
+    const int rounds = 2000;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < rounds; i++)
+    {
+        replay(data, len, 1024, &out);
+        sentences_free(&out);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("throughput: %.1f MB/s (%.1f us per %zu byte answer), sizeof(chat_stream_t) %zu bytes\n",
+           (double)len * rounds / sec / 1e6, sec * 1e6 / rounds, len, sizeof(chat_stream_t));
+    free(data);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        // 回放录制的回复
+        size_t len = 0;
+        char *data = load_file(argv[1], &len);
+        if (data == NULL)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+        sentences_t out;
+        bool done = replay(data, len, 1024, &out);
+        printf("%s: %zu bytes, %d sentences, %s\n", argv[1], len, out.count, done ? "[DONE]" : "no [DONE]");
+        print_sentences(&out);
+        sentences_free(&out);
+        free(data);
+        return 0;
+    }
+
+    test_stream("deepseek_zh");
+    test_stream("openai_en_crlf");
+    test_stream("long_unpunctuated");
+    test_rules();
+    bench();
+    printf("%s\n", s_failures ? "FAIL" : "PASS");
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+// 电脑上没有 CCOUNT, 返回纳秒计数; 按 1 GHz 换算, 结果是 ns 而不是开发板上的周期数
+static inline uint32_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "esp_err.h"
+
+// 只用来取函数地址, 不校验证书
+static inline esp_err_t esp_crt_bundle_attach(void *conf)
+{
+    (void)conf;
+    return ESP_OK;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdio.h>
+#include <inttypes.h> // 与 ESP-IDF 一样, 日志格式可以直接用 PRIu32
+
+// 默认只输出 W/E, 编译时加 -DHOST_SHIM_LOG_INFO 输出全部日志
+#ifdef HOST_SHIM_LOG_INFO
+#define HOST_SHIM_LOGI(tag, format, ...) fprintf(stderr, "I %s: " format "\n", tag, ##__VA_ARGS__)
+#else
+#define HOST_SHIM_LOGI(tag, format, ...) do { (void)(tag); } while (0)
+#endif
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_SHIM_LOGI(tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_SHIM_LOGI(tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOST_SHIM_LOGI(tag, format, ##__VA_ARGS__)
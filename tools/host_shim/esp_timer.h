@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "esp_err.h"
+
+/// @brief 单调时钟, 微秒
+static inline int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef struct
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    int dispatch_method; // 忽略, 回调总在定时器自己的线程里执行
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+// 每个定时器一个线程, 只实现单次定时
+typedef struct host_shim_timer
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    esp_timer_cb_t callback;
+    void *arg;
+    int64_t expire_us; // -1 表示未启动
+} *esp_timer_handle_t;
+
+static inline void *host_shim_timer_thread(void *arg)
+{
+    esp_timer_handle_t timer = arg;
+    pthread_mutex_lock(&timer->lock);
+    while (1)
+    {
+        if (timer->expire_us < 0)
+        {
+            pthread_cond_wait(&timer->cond, &timer->lock);
+            continue;
+        }
+        int64_t expire_us = timer->expire_us;
+        if (esp_timer_get_time() < expire_us)
+        {
+            struct timespec ts = {.tv_sec = expire_us / 1000000, .tv_nsec = (long)(expire_us % 1000000) * 1000};
+            pthread_cond_timedwait(&timer->cond, &timer->lock, &ts);
+            continue;
+        }
+        timer->expire_us = -1;
+        pthread_mutex_unlock(&timer->lock);
+        timer->callback(timer->arg);
+        pthread_mutex_lock(&timer->lock);
+    }
+    return NULL;
+}
+
+static inline esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    esp_timer_handle_t timer = calloc(1, sizeof(*timer));
+    if (timer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&timer->lock, NULL);
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->expire_us = -1;
+    if (pthread_create(&timer->thread, NULL, host_shim_timer_thread, timer) != 0)
+    {
+        free(timer);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(timer->thread);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&timer->lock);
+    if (timer->expire_us >= 0)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else
+    {
+        timer->expire_us = esp_timer_get_time() + (int64_t)timeout_us;
+        pthread_cond_signal(&timer->cond);
+    }
+    pthread_mutex_unlock(&timer->lock);
+    return ret;
+}
+
+static inline esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&timer->lock);
+    if (timer->expire_us < 0)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    timer->expire_us = -1;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->lock);
+    return ret;
+}
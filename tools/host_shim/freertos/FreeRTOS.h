@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "esp_heap_caps.h" // 与 ESP-IDF 一样经 portmacro.h 引入
+
+// 节拍固定为 1 ms
+#define configTICK_RATE_HZ   (1000)
+#define portTICK_PERIOD_MS   (1)
+#define portMAX_DELAY        ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms)    ((TickType_t)(ms))
+#define pdTRUE               (1)
+#define pdFALSE              (0)
+#define pdPASS               (pdTRUE)
+#define pdFAIL               (pdFALSE)
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+static inline TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/// @brief 把相对等待的节拍数换成 pthread_cond_timedwait 用的绝对时间
+static inline struct timespec host_shim_deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+// 临界区用互斥锁代替, 同一把锁不能嵌套进入
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)      pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)       pthread_mutex_unlock(mux)
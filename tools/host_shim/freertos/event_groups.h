@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+
+typedef uint32_t EventBits_t;
+
+// 事件组用互斥锁加条件变量实现
+typedef struct host_shim_event_group
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+} *EventGroupHandle_t;
+
+static inline EventGroupHandle_t xEventGroupCreate(void)
+{
+    EventGroupHandle_t group = calloc(1, sizeof(*group));
+    if (group)
+    {
+        pthread_mutex_init(&group->lock, NULL);
+        pthread_cond_init(&group->cond, NULL);
+    }
+    return group;
+}
+
+static inline EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t value = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+static inline EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t value = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+static inline EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t value = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+static inline EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                              BaseType_t wait_for_all, TickType_t ticks)
+{
+    struct timespec deadline = host_shim_deadline(ticks);
+    pthread_mutex_lock(&group->lock);
+    while (wait_for_all ? (group->bits & bits) != bits : (group->bits & bits) == 0)
+    {
+        if (ticks == 0)
+        {
+            break;
+        }
+        if (ticks == portMAX_DELAY)
+        {
+            pthread_cond_wait(&group->cond, &group->lock);
+        }
+        else if (pthread_cond_timedwait(&group->cond, &group->lock, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    EventBits_t value = group->bits;
+    bool satisfied = wait_for_all ? (value & bits) == bits : (value & bits) != 0;
+    if (satisfied && clear_on_exit)
+    {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+static inline void vEventGroupDelete(EventGroupHandle_t group)
+{
+    pthread_cond_destroy(&group->cond);
+    pthread_mutex_destroy(&group->lock);
+    free(group);
+}
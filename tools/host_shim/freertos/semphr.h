@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+
+// 只实现互斥锁
+typedef pthread_mutex_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t mux = malloc(sizeof(pthread_mutex_t));
+    if (mux)
+    {
+        pthread_mutex_init(mux, NULL);
+    }
+    return mux;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mux, TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return pthread_mutex_lock(mux) == 0 ? pdTRUE : pdFALSE;
+    }
+    struct timespec deadline = host_shim_deadline(ticks);
+    return pthread_mutex_timedlock(mux, &deadline) == 0 ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mux)
+{
+    return pthread_mutex_unlock(mux) == 0 ? pdTRUE : pdFALSE;
+}
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t mux)
+{
+    pthread_mutex_destroy(mux);
+    free(mux);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+// 单读单写的字节流, 语义与 FreeRTOS 一致: 有数据(不少于触发字节数)即返回, 不必填满
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t *storage;
+    size_t size;
+    size_t head;
+    size_t count;
+    size_t trigger;
+} StaticStreamBuffer_t;
+
+typedef StaticStreamBuffer_t *StreamBufferHandle_t;
+
+static inline StreamBufferHandle_t xStreamBufferCreateStatic(size_t size, size_t trigger, uint8_t *storage, StaticStreamBuffer_t *sb)
+{
+    memset(sb, 0, sizeof(StaticStreamBuffer_t));
+    pthread_mutex_init(&sb->lock, NULL);
+    pthread_cond_init(&sb->cond, NULL);
+    sb->storage = storage;
+    sb->size = size;
+    sb->trigger = trigger ? trigger : 1;
+    return sb;
+}
+
+static inline size_t xStreamBufferSend(StreamBufferHandle_t sb, const void *data, size_t len, TickType_t ticks)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    struct timespec deadline = host_shim_deadline(ticks);
+    size_t sent = 0;
+    pthread_mutex_lock(&sb->lock);
+    while (sent < len)
+    {
+        if (sb->count == sb->size)
+        {
+            if (pthread_cond_timedwait(&sb->cond, &sb->lock, &deadline) == ETIMEDOUT)
+                break;
+            continue;
+        }
+        size_t tail = (sb->head + sb->count) % sb->size;
+        sb->storage[tail] = p[sent++];
+        sb->count++;
+        if (sb->count == sb->size || sent == len)
+            pthread_cond_broadcast(&sb->cond);
+    }
+    pthread_mutex_unlock(&sb->lock);
+    return sent;
+}
+
+static inline size_t xStreamBufferReceive(StreamBufferHandle_t sb, void *buf, size_t len, TickType_t ticks)
+{
+    uint8_t *p = (uint8_t *)buf;
+    struct timespec deadline = host_shim_deadline(ticks);
+    size_t got = 0;
+    pthread_mutex_lock(&sb->lock);
+    while (sb->count < sb->trigger && sb->count < len)
+    {
+        if (pthread_cond_timedwait(&sb->cond, &sb->lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    while (got < len && sb->count > 0)
+    {
+        p[got++] = sb->storage[sb->head];
+        sb->head = (sb->head + 1) % sb->size;
+        sb->count--;
+    }
+    if (got)
+        pthread_cond_broadcast(&sb->cond);
+    pthread_mutex_unlock(&sb->lock);
+    return got;
+}
+
+static inline BaseType_t xStreamBufferIsEmpty(StreamBufferHandle_t sb)
+{
+    pthread_mutex_lock(&sb->lock);
+    BaseType_t empty = sb->count == 0;
+    pthread_mutex_unlock(&sb->lock);
+    return empty;
+}
+
+static inline BaseType_t xStreamBufferReset(StreamBufferHandle_t sb)
+{
+    pthread_mutex_lock(&sb->lock);
+    sb->head = 0;
+    sb->count = 0;
+    pthread_cond_broadcast(&sb->cond);
+    pthread_mutex_unlock(&sb->lock);
+    return pdPASS;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+typedef uint32_t StackType_t;
+
+// 任务用线程代替, 栈和优先级不起作用; 任务通知用计数加条件变量实现
+typedef struct host_shim_task
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+    TaskFunction_t fn;
+    void *arg;
+} StaticTask_t;
+
+typedef StaticTask_t *TaskHandle_t;
+
+static __thread TaskHandle_t host_shim_current_task = NULL;
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {.tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+}
+
+static inline void *host_shim_task_entry(void *arg)
+{
+    TaskHandle_t task = arg;
+    host_shim_current_task = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+static inline TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                             UBaseType_t priority, StackType_t *stack, StaticTask_t *task)
+{
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    task->notify = 0;
+    task->fn = fn;
+    task->arg = arg;
+    if (pthread_create(&task->thread, NULL, host_shim_task_entry, task) != 0)
+    {
+        return NULL;
+    }
+    pthread_detach(task->thread);
+    return task;
+}
+
+static inline TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                                          UBaseType_t priority, StackType_t *stack, StaticTask_t *task,
+                                                          BaseType_t core_id)
+{
+    return xTaskCreateStatic(fn, name, stack_depth, arg, priority, stack, task);
+}
+
+static inline void vTaskDelete(TaskHandle_t task)
+{
+    assert(task == NULL && "only self-deletion is supported");
+    pthread_exit(NULL);
+}
+
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+static inline uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    TaskHandle_t task = host_shim_current_task;
+    assert(task && "must be called from a task created by xTaskCreateStatic");
+    struct timespec deadline = host_shim_deadline(ticks);
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0)
+    {
+        if (ticks == portMAX_DELAY)
+        {
+            pthread_cond_wait(&task->cond, &task->lock);
+        }
+        else if (pthread_cond_timedwait(&task->cond, &task->lock, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    uint32_t value = task->notify;
+    if (value)
+    {
+        task->notify = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
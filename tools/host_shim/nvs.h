@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ESP_ERR_NVS_NOT_FOUND (0x1102)
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum
+{
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+// 相当于一个空的 NVS 分区, 写入直接丢弃
+static inline esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    *handle = 1;
+    return ESP_OK;
+}
+
+static inline esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+static inline esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return ESP_OK;
+}
+
+static inline esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    return ESP_OK;
+}
+
+static inline esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+static inline void nvs_close(nvs_handle_t handle)
+{
+}
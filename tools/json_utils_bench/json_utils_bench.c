@@ -0,0 +1,317 @@
+/*
+ * 在电脑上测试 main/baidu_api/json_utils: json_extract 的路径, 转义, 错误处理, 以及与 cJSON 对比的耗时和内存峰值.
+ *
+ * 编译: cc -O2 -Wall -I../host_shim -I../../main/baidu_api -DJSON_UTILS_JSMN=0 json_utils_bench.c ../../main/baidu_api/json_utils.c -o json_utils_bench
+ * 对比 cJSON 时再加上: -DJSON_BENCH_CJSON -I$IDF_PATH/components/json/cJSON $IDF_PATH/components/json/cJSON/cJSON.c
+ * 运行: ./json_utils_bench --iterations 100000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "json_utils.h"
+#ifdef JSON_BENCH_CJSON
+#include "cJSON.h"
+#endif
+
+static int s_iterations = 100000;
+static int s_failures = 0;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void check(bool ok, const char *what)
+{
+    printf("  %s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+    {
+        s_failures++;
+    }
+}
+
+/// @brief 拷贝到刚好 len 字节, 不带 '\0' 的缓冲区中提取, 与 http_arena 中的响应体一样
+static int extract(const char *json, const char *const *paths, json_view_t *views, int count, char **buf)
+{
+    size_t len = strlen(json);
+    *buf = malloc(len ? len : 1);
+    memcpy(*buf, json, len);
+    return json_extract(*buf, len, paths, views, count);
+}
+
+/// @brief 提取单个路径, 与 expect 比较; expect 为 NULL 表示应当找不到
+static bool value_is(const char *json, const char *path, const char *expect, bool is_string)
+{
+    json_view_t view;
+    char *buf;
+    int found = extract(json, &path, &view, 1, &buf);
+    bool ok;
+    if (expect == NULL)
+    {
+        ok = (found == 0 && !view.found);
+    }
+    else
+    {
+        ok = (found == 1 && view.found && view.is_string == is_string && view.len == strlen(expect) && memcmp(view.ptr, expect, view.len) == 0);
+    }
+    free(buf);
+    return ok;
+}
+
+static bool fails(const char *json, const char *path)
+{
+    json_view_t view;
+    char *buf;
+    int found = extract(json, &path, &view, 1, &buf);
+    free(buf);
+    return found == -1;
+}
+
+static void test_paths(void)
+{
+    printf("paths:\n");
+    const char *doc = "{\"a\":{\"b\":[10,{\"c\":\"deep\"},[true,false]],\"n\":null},\"b\":2,\"results\":[1],\"result\":[\"r0\",\"r1\"]}";
+    check(value_is(doc, "a.b[1].c", "deep", true), "object / array path");
+    check(value_is(doc, "a.b[0]", "10", false) && value_is(doc, "a.b[2][1]", "false", false) && value_is(doc, "a.n", "null", false),
+          "numbers, booleans and null are returned as raw text");
+    check(value_is(doc, "b", "2", false), "same key at another depth is not matched");
+    check(value_is(doc, "result[1]", "r1", true), "key is not matched by prefix (results / result)");
+    check(value_is(doc, "a.b", "[10,{\"c\":\"deep\"},[true,false]]", false), "container value is returned as raw text");
+    check(value_is(doc, "a.b[3]", NULL, false) && value_is(doc, "a.x", NULL, false) && value_is(doc, "b.c", NULL, false),
+          "missing index / key / scalar parent is not found");
+
+    const char *pretty = "{\r\n  \"err_no\" : 0 ,\r\n  \"result\" : [ \"\\u4f60\\u597d\" ]\r\n}\r\n";
+    check(value_is(pretty, "result[0]", "你好", true) && value_is(pretty, "err_no", "0", false), "whitespace and CRLF between tokens");
+
+    const char *tricky = "{\"s\":\"}]{[,:\",\"k\\\"ey\":1,\"k\":\"v\"}";
+    check(value_is(tricky, "k", "v", true), "brackets and escaped quotes inside skipped strings");
+
+    static const char *const paths[] = {"result[0]", "err_no", "err_msg", "missing"};
+    json_view_t views[4];
+    char *buf;
+    int found = extract("{\"err_msg\":\"success.\",\"err_no\":0,\"result\":[\"x\"]}", paths, views, 4, &buf);
+    check(found == 3 && views[0].found && views[1].found && views[2].found && !views[3].found, "several paths in one scan");
+    free(buf);
+
+    check(fails(doc, "a..b") && fails(doc, "a[x]") && fails(doc, "a[-1]") && fails(doc, "a.b.c.d.e.f.g.h.i"), "invalid paths are rejected");
+    check(json_extract(NULL, 0, paths, views, JSON_PATH_MAX_COUNT + 1) == -1, "more than JSON_PATH_MAX_COUNT paths is rejected");
+}
+
+static void test_escapes(void)
+{
+    printf("escapes:\n");
+    check(value_is("{\"t\":\"a\\\"b\\\\c\\/d\\n\\r\\t\\b\\f\"}", "t", "a\"b\\c/d\n\r\t\b\f", true), "simple escapes");
+    check(value_is("{\"t\":\"\\u0041\\u00e9\\u4e2d\\u6587\"}", "t", "Aé中文", true), "\\u escapes to 1~3 byte UTF-8");
+    check(value_is("{\"t\":\"\\ud83d\\ude00!\"}", "t", "\xF0\x9F\x98\x80!", true), "surrogate pair to 4 byte UTF-8");
+    check(value_is("{\"t\":\"\\u12\"}", "t", "u12", true), "short \\u escape is kept as text");
+    check(value_is("{\"t\":\"原样的中文\"}", "t", "原样的中文", true), "raw UTF-8 is unchanged");
+
+    char *value;
+    char json[] = "{\"t\":\"\\u4f60\\u597d\",\"n\":1}";
+    value = json_extract_string(json, strlen(json), "t");
+    check(value && strcmp(value, "你好") == 0 && value == json + 6, "json_extract_string unescapes in place");
+    check(json_extract_string(json, strlen(json), "n") == NULL, "json_extract_string returns NULL for a number");
+}
+
+static void test_malformed(void)
+{
+    printf("malformed input:\n");
+    check(fails("", "a") && fails("   ", "a"), "empty input");
+    check(fails("{\"a\":", "a") && fails("{\"a\":[1,2", "b") && fails("{\"a\":\"unterminated", "a"), "truncated input");
+    check(fails("{\"a\" 1}", "a") && fails("{a:1}", "a") && fails("[1 2]", "[1]"), "missing colon, bare key, missing comma");
+
+    char deep[64] = "";
+    for (int i = 0; i <= JSON_SCAN_MAX_DEPTH; i++)
+    {
+        strcat(deep, "[");
+    }
+    strcat(deep, "1");
+    for (int i = 0; i <= JSON_SCAN_MAX_DEPTH; i++)
+    {
+        strcat(deep, "]");
+    }
+    check(fails(deep, "[0]"), "nesting deeper than JSON_SCAN_MAX_DEPTH");
+    // 找到全部路径后不再扫描, 后面被截断的内容不算错误
+    check(value_is("{\"a\":1,\"b\":", "a", "1", false), "scan stops once every path is found");
+}
+
+typedef struct
+{
+    const char *name;
+    const char *path;
+    char *json;
+} bench_sample_t;
+
+#ifdef JSON_BENCH_CJSON
+static size_t s_heap_cur;
+static size_t s_heap_peak;
+
+static void *bench_malloc(size_t size)
+{
+    size_t *p = malloc(size + sizeof(size_t));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    *p = size;
+    s_heap_cur += size;
+    if (s_heap_cur > s_heap_peak)
+    {
+        s_heap_peak = s_heap_cur;
+    }
+    return p + 1;
+}
+
+static void bench_free(void *ptr)
+{
+    if (ptr)
+    {
+        size_t *p = (size_t *)ptr - 1;
+        s_heap_cur -= *p;
+        free(p);
+    }
+}
+
+/// @brief 与改动前的 baidu_asr / chatgpt_api 一样: 建树, 按路径取值, strdup 结果
+static char *cjson_get_string(const char *json, size_t len, const char *path)
+{
+    cJSON *root = cJSON_ParseWithLength(json, len);
+    cJSON *item = root;
+    const char *p = path;
+    while (item && *p)
+    {
+        if (*p == '[')
+        {
+            item = cJSON_GetArrayItem(item, (int)strtol(p + 1, (char **)&p, 10));
+            p++;
+        }
+        else
+        {
+            char key[32];
+            p += (*p == '.') ? 1 : 0;
+            size_t n = strcspn(p, ".[");
+            snprintf(key, sizeof(key), "%.*s", (int)n, p);
+            item = cJSON_GetObjectItem(item, key);
+            p += n;
+        }
+    }
+    char *copy = (item && cJSON_IsString(item)) ? strdup(item->valuestring) : NULL;
+    cJSON_Delete(root);
+    return copy;
+}
+#endif
+
+static void bench_one(const bench_sample_t *sample)
+{
+    size_t len = strlen(sample->json);
+    char *buf = malloc(len);
+    int64_t extract_ns = 0;
+    char *value = NULL;
+    for (int i = 0; i < s_iterations; i++)
+    {
+        // 每轮从原始数据开始, 拷贝不计入耗时
+        memcpy(buf, sample->json, len);
+        int64_t start = now_ns();
+        value = json_extract_string(buf, len, sample->path);
+        extract_ns += now_ns() - start;
+    }
+    printf("  %-14s %6zu bytes: json_extract %8.1f ns, heap 0 B", sample->name, len, (double)extract_ns / s_iterations);
+
+#ifdef JSON_BENCH_CJSON
+    cJSON_Hooks hooks = {.malloc_fn = bench_malloc, .free_fn = bench_free};
+    cJSON_InitHooks(&hooks);
+    s_heap_cur = 0;
+    s_heap_peak = 0;
+    bool same = true;
+    int64_t start = now_ns();
+    for (int i = 0; i < s_iterations; i++)
+    {
+        char *copy = cjson_get_string(sample->json, len, sample->path);
+        same = same && copy && value && strcmp(copy, value) == 0;
+        free(copy);
+    }
+    int64_t cjson_ns = now_ns() - start;
+    cJSON_InitHooks(NULL);
+    printf("; cJSON %8.1f ns, peak heap %zu B", (double)cjson_ns / s_iterations, s_heap_peak);
+    check(same, "cJSON returns the same value");
+#else
+    (void)value;
+#endif
+    printf("\n");
+    free(buf);
+}
+
+/// @brief 拼出一个 DeepSeek 非流式回复, content 约 content_bytes 字节(\u 转义的中文)
+static char *make_chat(size_t content_bytes)
+{
+    static const char *head = "{\"id\":\"930c60df-bf64-41c9-a88e-3ec75f81e00e\",\"object\":\"chat.completion\",\"created\":1705651092,"
+                              "\"model\":\"deepseek-chat\",\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\",\"content\":\"";
+    static const char *tail = "\"},\"logprobs\":null,\"finish_reason\":\"stop\"}],\"usage\":{\"prompt_tokens\":16,\"completion_tokens\":10,"
+                              "\"total_tokens\":26,\"prompt_cache_hit_tokens\":0,\"prompt_cache_miss_tokens\":16},"
+                              "\"system_fingerprint\":\"fp_44709d6fcb\"}";
+    static const char *piece = "\\u673a\\u68b0\\u952e\\u76d8\\u7684\\u8f74\\u4f53\\u3002Linear switches are smooth.\\n";
+    size_t n = content_bytes / strlen(piece) + 1;
+    char *json = malloc(strlen(head) + n * strlen(piece) + strlen(tail) + 1);
+    strcpy(json, head);
+    for (size_t i = 0; i < n; i++)
+    {
+        strcat(json, piece);
+    }
+    strcat(json, tail);
+    return json;
+}
+
+static void bench(void)
+{
+    bench_sample_t samples[] = {
+        {"baidu asr", "result[0]",
+         strdup("{\"corpus_no\":\"7393036489466346542\",\"err_msg\":\"success.\",\"err_no\":0,"
+                "\"result\":[\"\\u6253\\u5f00\\u952e\\u76d8\\u7684\\u80cc\\u5149\\u706f\\u3002\"],\"sn\":\"843318353911721197567\"}")},
+        {"baidu token", "access_token",
+         strdup("{\"refresh_token\":\"25.b55fe1d287227ca97aab219bb249b8ab.315360000.1798284651.282335-8574074\","
+                "\"expires_in\":2592000,\"session_key\":\"9mzdDZXu3dENdFZQurfg0Vz8slgSgvvOAUebNFzyzcpQ5EnbxbF+hfG9DQkpUVQdh4p6HbQcAiz5RmuBAja1JJGgIdJI\","
+                "\"access_token\":\"24.6c5e1ff107f0e8bcef8c46d3424a0e78.2592000.1485516651.282335-8574074\","
+                "\"scope\":\"public audio_voice_assistant_get audio_tts_post\",\"session_secret\":\"dfac94a3489fe9fca7c3221cbf7525ff\"}")},
+        {"deepseek chat", "choices[0].message.content", make_chat(300)},
+        {"deepseek long", "choices[0].message.content", make_chat(8 * 1024)},
+    };
+    printf("cost (%d iterations):\n", s_iterations);
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+    {
+        bench_one(&samples[i]);
+        free(samples[i].json);
+    }
+#ifndef JSON_BENCH_CJSON
+    printf("  (cJSON not compiled in, see README)\n");
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--iterations") == 0)
+        {
+            s_iterations = atoi(argv[++i]);
+        }
+    }
+    if (s_iterations <= 0)
+    {
+        s_iterations = 1;
+    }
+
+    test_paths();
+    test_escapes();
+    test_malformed();
+    bench();
+
+    printf("%s\n", s_failures ? "FAIL" : "PASS");
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,450 @@
+/*
+ * 在电脑上测试 components/key_link: 发送端 -> 丢包/重复/乱序模拟 -> 接收端, 全部走本机 UDP.
+ *
+ * 编译: cc -O2 -Wall -I../../components/key_link key_link_sim.c ../../components/key_link/key_link.c -o key_link_sim -lpthread -lm
+ * 运行: ./key_link_sim --loss 0.1 --burst 3 --jitter 5 --outage 800
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "key_link.h"
+
+#define SIM_PENDING_MAX   1024
+#define SIM_LATENCY_MAX   200000
+#define SIM_STUCK_LIMIT_MS 100    // 超过该时长的卡键计为一次卡键事件
+
+typedef struct
+{
+    double loss;          // 平均丢包率
+    double burst;         // 平均连续丢包长度 (Gilbert 模型)
+    double dup;
+    int jitter_ms;        // 每个包随机延迟 0..jitter, 产生乱序
+    int duration_s;
+    double rate;          // 每秒按键事件数
+    int outage_ms;        // 在运行中途断开链路的时长, 断开前按住一个键
+    unsigned seed;
+    bool legacy;          // 模拟原来的协议: 每次变化只发一帧, 接收端直接转发
+} sim_config_t;
+
+typedef struct
+{
+    uint8_t data[sizeof(key_frame_t)];
+    size_t len;
+    int64_t release_us;
+} sim_packet_t;
+
+static sim_config_t s_cfg = {
+    .loss = 0.05,
+    .burst = 2,
+    .dup = 0.01,
+    .jitter_ms = 3,
+    .duration_s = 20,
+    .rate = 15,
+    .outage_ms = 800,
+    .seed = 1,
+    .legacy = false,
+};
+
+static int s_tx_sock, s_shim_sock, s_rx_sock;
+static struct sockaddr_in s_shim_addr, s_rx_addr;
+static volatile bool s_running = true;
+static volatile bool s_shim_running = true;
+static int64_t s_start_us;
+
+static pthread_mutex_t s_state_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t s_tx_report[KEY_LINK_REPORT_LEN];
+static uint8_t s_rx_report[KEY_LINK_REPORT_LEN];
+
+static uint32_t s_shim_in, s_shim_dropped, s_shim_dup;
+static uint32_t s_tx_frames, s_tx_changes;
+static uint32_t *s_latency;
+static uint32_t s_latency_count;
+static key_link_rx_t s_rx;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_us(int64_t us)
+{
+    if (us <= 0)
+    {
+        return;
+    }
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+    nanosleep(&ts, NULL);
+}
+
+static double rand_unit(unsigned *seed)
+{
+    return rand_r(seed) / ((double)RAND_MAX + 1.0);
+}
+
+static int udp_socket(struct sockaddr_in *addr, int timeout_us)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in local = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK), .sin_port = 0};
+    if (sock < 0 || bind(sock, (struct sockaddr *)&local, sizeof(local)) < 0)
+    {
+        perror("socket");
+        exit(2);
+    }
+    socklen_t len = sizeof(*addr);
+    getsockname(sock, (struct sockaddr *)addr, &len);
+    struct timeval tv = {.tv_sec = 0, .tv_usec = timeout_us};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return sock;
+}
+
+static bool sim_in_outage(int64_t t)
+{
+    int64_t begin = s_start_us + (int64_t)s_cfg.duration_s * 500000;
+    return s_cfg.outage_ms > 0 && t >= begin && t < begin + (int64_t)s_cfg.outage_ms * 1000;
+}
+
+/// @brief 模拟网络: Gilbert 突发丢包, 重复, 随机延迟
+static void *shim_task(void *arg)
+{
+    (void)arg;
+    unsigned seed = s_cfg.seed * 7919 + 1;
+    static sim_packet_t pending[SIM_PENDING_MAX];
+    int pending_num = 0;
+    bool bad = false;
+    double p_leave = 1.0 / (s_cfg.burst < 1 ? 1 : s_cfg.burst);
+    double p_enter = s_cfg.loss >= 1 ? 1 : s_cfg.loss * p_leave / (1 - s_cfg.loss);
+
+    while (s_shim_running || pending_num)
+    {
+        uint8_t buf[64];
+        ssize_t len = recv(s_shim_sock, buf, sizeof(buf), 0);
+        int64_t t = now_us();
+        if (len > 0)
+        {
+            s_shim_in++;
+            bad = bad ? (rand_unit(&seed) >= p_leave) : (rand_unit(&seed) < p_enter);
+            if (bad || sim_in_outage(t))
+            {
+                s_shim_dropped++;
+            }
+            else
+            {
+                int copies = rand_unit(&seed) < s_cfg.dup ? 2 : 1;
+                s_shim_dup += copies - 1;
+                for (int i = 0; i < copies && pending_num < SIM_PENDING_MAX; i++)
+                {
+                    sim_packet_t *p = &pending[pending_num++];
+                    memcpy(p->data, buf, len < (ssize_t)sizeof(p->data) ? len : (ssize_t)sizeof(p->data));
+                    p->len = len;
+                    p->release_us = t + (int64_t)(rand_unit(&seed) * s_cfg.jitter_ms * 1000);
+                }
+            }
+        }
+
+        // 按到期时间转发, 延迟不同的包自然乱序
+        for (int i = 0; i < pending_num;)
+        {
+            if (pending[i].release_us <= t)
+            {
+                sendto(s_shim_sock, pending[i].data, pending[i].len, 0, (struct sockaddr *)&s_rx_addr, sizeof(s_rx_addr));
+                pending[i] = pending[--pending_num];
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void sim_set_key(uint8_t *report, uint8_t keycode, bool down)
+{
+    for (int i = 2; i < KEY_LINK_REPORT_LEN; i++)
+    {
+        if (down && report[i] == 0)
+        {
+            report[i] = keycode;
+            return;
+        }
+        if (!down && report[i] == keycode)
+        {
+            report[i] = 0;
+            return;
+        }
+    }
+}
+
+static int sim_held_keys(const uint8_t *report, uint8_t *keys)
+{
+    int n = 0;
+    for (int i = 2; i < KEY_LINK_REPORT_LEN; i++)
+    {
+        if (report[i])
+        {
+            keys[n++] = report[i];
+        }
+    }
+    return n;
+}
+
+static void sim_tx_send(key_link_tx_t *tx, bool changed)
+{
+    key_frame_t frame;
+    int64_t wait_us;
+    // 原协议只在变化时发送一次
+    while ((!s_cfg.legacy || changed) && key_link_tx_next(tx, now_us(), &frame, &wait_us))
+    {
+        sendto(s_tx_sock, &frame, sizeof(frame), 0, (struct sockaddr *)&s_shim_addr, sizeof(s_shim_addr));
+        s_tx_frames++;
+        changed = false;
+    }
+}
+
+/// @brief 模拟打字: 随机按下和松开, 最多同时按住 3 个键; 断链前按住一个键, 断链期间松开
+static void *sender_task(void *arg)
+{
+    (void)arg;
+    unsigned seed = s_cfg.seed;
+    key_link_tx_t tx;
+    key_link_tx_init(&tx);
+    uint8_t report[KEY_LINK_REPORT_LEN] = {0};
+    int64_t end_us = s_start_us + (int64_t)s_cfg.duration_s * 1000000;
+    int64_t outage_us = s_start_us + (int64_t)s_cfg.duration_s * 500000;
+    bool outage_armed = s_cfg.outage_ms > 0;
+    int64_t next_event = now_us();
+
+    while (now_us() < end_us + 500000)
+    {
+        int64_t t = now_us();
+        bool changed = false;
+        if (t >= end_us)
+        {
+            // 结束前全部松开, 之后只剩心跳
+            memset(report, 0, sizeof(report));
+            next_event = INT64_MAX;
+        }
+        else if (outage_armed && t >= outage_us - 20000)
+        {
+            memset(report, 0, sizeof(report));
+            sim_set_key(report, 0x04, true);
+            if (t >= outage_us + 20000)
+            {
+                sim_set_key(report, 0x04, false);
+                outage_armed = false;
+                next_event = s_start_us + (int64_t)s_cfg.duration_s * 500000 + (int64_t)s_cfg.outage_ms * 1000 + 100000;
+            }
+        }
+        else if (t >= next_event)
+        {
+            uint8_t keys[6];
+            int n = sim_held_keys(report, keys);
+            if (n == 0 || (n < 3 && rand_unit(&seed) < 0.5))
+            {
+                sim_set_key(report, 0x04 + rand_r(&seed) % 26, true);
+            }
+            else
+            {
+                sim_set_key(report, keys[rand_r(&seed) % n], false);
+            }
+            next_event = t + (int64_t)(-log1p(-rand_unit(&seed)) / s_cfg.rate * 1000000);
+        }
+
+        if (key_link_tx_update(&tx, report, sizeof(report), t))
+        {
+            changed = true;
+            s_tx_changes++;
+            pthread_mutex_lock(&s_state_lock);
+            memcpy(s_tx_report, report, sizeof(report));
+            pthread_mutex_unlock(&s_state_lock);
+        }
+        sim_tx_send(&tx, changed);
+        sleep_us(500);
+    }
+    s_running = false;
+    return NULL;
+}
+
+static void *receiver_task(void *arg)
+{
+    (void)arg;
+    key_link_rx_init(&s_rx);
+    while (s_running || s_shim_running)
+    {
+        uint8_t buf[64];
+        uint8_t report[KEY_LINK_REPORT_LEN];
+        ssize_t len = recv(s_rx_sock, buf, sizeof(buf), 0);
+        int64_t t = now_us();
+        bool changed = false;
+        if (len > 0)
+        {
+            if (s_cfg.legacy)
+            {
+                // 原来的接收端: 收到什么转发什么
+                memcpy(report, ((key_frame_t *)buf)->report, sizeof(report));
+                s_rx.latency_us = (uint32_t)t - ((key_frame_t *)buf)->timestamp_us;
+                changed = true;
+            }
+            else
+            {
+                changed = key_link_rx_input(&s_rx, buf, len, t, report);
+            }
+            if (changed && s_latency_count < SIM_LATENCY_MAX)
+            {
+                s_latency[s_latency_count++] = s_rx.latency_us;
+            }
+        }
+        if (!s_cfg.legacy && key_link_rx_check_timeout(&s_rx, t, report))
+        {
+            changed = true;
+        }
+        if (changed)
+        {
+            pthread_mutex_lock(&s_state_lock);
+            memcpy(s_rx_report, report, sizeof(report));
+            pthread_mutex_unlock(&s_state_lock);
+        }
+    }
+    return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool sim_has_extra_key(const uint8_t *a, const uint8_t *b)
+{
+    // a 中有 b 中没有的键
+    for (int i = 2; i < KEY_LINK_REPORT_LEN; i++)
+    {
+        if (!a[i])
+        {
+            continue;
+        }
+        if (!memchr(b + 2, a[i], KEY_LINK_REPORT_LEN - 2))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [--loss P] [--burst N] [--dup P] [--jitter MS] [--duration S] [--rate N] [--outage MS] [--seed N] [--legacy]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : "0";
+        if (!strcmp(arg, "--legacy"))
+        {
+            s_cfg.legacy = true;
+            continue;
+        }
+        if (!strcmp(arg, "--loss")) s_cfg.loss = atof(val);
+        else if (!strcmp(arg, "--burst")) s_cfg.burst = atof(val);
+        else if (!strcmp(arg, "--dup")) s_cfg.dup = atof(val);
+        else if (!strcmp(arg, "--jitter")) s_cfg.jitter_ms = atoi(val);
+        else if (!strcmp(arg, "--duration")) s_cfg.duration_s = atoi(val);
+        else if (!strcmp(arg, "--rate")) s_cfg.rate = atof(val);
+        else if (!strcmp(arg, "--outage")) s_cfg.outage_ms = atoi(val);
+        else if (!strcmp(arg, "--seed")) s_cfg.seed = atoi(val);
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    struct sockaddr_in tx_addr;
+    s_tx_sock = udp_socket(&tx_addr, 0);
+    s_shim_sock = udp_socket(&s_shim_addr, 1000);
+    s_rx_sock = udp_socket(&s_rx_addr, 10000);
+    s_latency = calloc(SIM_LATENCY_MAX, sizeof(uint32_t));
+
+    printf("%s protocol, loss %.1f%% (burst %.1f), dup %.1f%%, jitter %d ms, outage %d ms, %d s\n",
+           s_cfg.legacy ? "legacy" : "key_link", s_cfg.loss * 100, s_cfg.burst, s_cfg.dup * 100,
+           s_cfg.jitter_ms, s_cfg.outage_ms, s_cfg.duration_s);
+
+    s_start_us = now_us();
+    pthread_t shim, sender, receiver;
+    pthread_create(&shim, NULL, shim_task, NULL);
+    pthread_create(&receiver, NULL, receiver_task, NULL);
+    pthread_create(&sender, NULL, sender_task, NULL);
+
+    // 每毫秒比较两端状态: 接收端多出的键是卡键, 少的键是延迟或丢失
+    uint32_t stuck_ms = 0, stuck_run = 0, stuck_max = 0, stuck_events = 0, missing_ms = 0;
+    while (s_running)
+    {
+        uint8_t tx[KEY_LINK_REPORT_LEN], rx[KEY_LINK_REPORT_LEN];
+        pthread_mutex_lock(&s_state_lock);
+        memcpy(tx, s_tx_report, sizeof(tx));
+        memcpy(rx, s_rx_report, sizeof(rx));
+        pthread_mutex_unlock(&s_state_lock);
+        if (sim_has_extra_key(rx, tx))
+        {
+            stuck_ms++;
+            if (++stuck_run == SIM_STUCK_LIMIT_MS)
+            {
+                stuck_events++;
+            }
+            stuck_max = stuck_run > stuck_max ? stuck_run : stuck_max;
+        }
+        else
+        {
+            stuck_run = 0;
+        }
+        missing_ms += sim_has_extra_key(tx, rx);
+        sleep_us(1000);
+    }
+    pthread_join(sender, NULL);
+    sleep_us(KEY_LINK_TIMEOUT_US + 100000);
+    s_shim_running = false;
+    pthread_join(shim, NULL);
+    pthread_join(receiver, NULL);
+
+    qsort(s_latency, s_latency_count, sizeof(uint32_t), cmp_u32);
+    uint32_t p50 = s_latency_count ? s_latency[s_latency_count / 2] : 0;
+    uint32_t p99 = s_latency_count ? s_latency[s_latency_count * 99 / 100] : 0;
+    uint8_t zero[KEY_LINK_REPORT_LEN] = {0};
+    bool released = memcmp(s_rx_report, zero, sizeof(zero)) == 0;
+
+    printf("sender: %u changes, %u frames\n", s_tx_changes, s_tx_frames);
+    printf("network: %u in, %u dropped, %u duplicated\n", s_shim_in, s_shim_dropped, s_shim_dup);
+    if (!s_cfg.legacy)
+    {
+        const key_link_rx_stats_t *st = &s_rx.stats;
+        printf("receiver: %u frames, %u applied, %u duplicate, %u stale, %u skipped, %u timeouts\n",
+               st->received, st->applied, st->duplicate, st->stale, st->skipped, st->timeouts);
+    }
+    printf("latency: p50 %u us, p99 %u us\n", p50, p99);
+    printf("stuck: total %u ms, longest %u ms, %u events > %d ms; missing %u ms\n",
+           stuck_ms, stuck_max, stuck_events, SIM_STUCK_LIMIT_MS, missing_ms);
+    printf("final state: %s\n", released ? "released" : "STUCK");
+
+    // 卡键不能超过接收端超时加上网络延迟
+    bool pass = released && stuck_max <= (uint32_t)(KEY_LINK_TIMEOUT_US / 1000 + s_cfg.jitter_ms + 50);
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
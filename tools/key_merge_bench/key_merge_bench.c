@@ -0,0 +1,303 @@
+/*
+ * 在电脑上测试 components/key_link/key_merge: 多个键盘合并为一个 NKRO 报文的正确性, 容量和合并耗时.
+ *
+ * 编译: cc -O2 -Wall -I../../components/key_link key_merge_bench.c ../../components/key_link/key_merge.c ../../components/key_link/key_link.c -o key_merge_bench
+ * 运行: ./key_merge_bench --iterations 1000000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "key_link.h"
+#include "key_merge.h"
+
+#define BENCH_KEYS_PER_SOURCE 6
+
+typedef struct
+{
+    uint8_t mac[6];
+    key_link_tx_t tx;
+} bench_source_t;
+
+static int s_iterations = 1000000;
+static int s_failures = 0;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("  FAIL: %s\n", what);
+        s_failures++;
+    }
+}
+
+static bool nkro_key(const key_nkro_report_t *report, uint8_t usage)
+{
+    return report->keys[usage / 8] & (1 << (usage % 8));
+}
+
+static int nkro_count(const key_nkro_report_t *report)
+{
+    int count = 0;
+    for (int i = 0; i < KEY_NKRO_USAGE_NUM; i++)
+    {
+        count += nkro_key(report, i) ? 1 : 0;
+    }
+    return count;
+}
+
+static void source_init(bench_source_t *src, int index)
+{
+    uint8_t mac[6] = {0x7c, 0xdf, 0xa1, 0x00, 0x00, (uint8_t)index};
+    memcpy(src->mac, mac, sizeof(mac));
+    key_link_tx_init(&src->tx);
+}
+
+/// @brief 发送端提交新状态, 取出第一帧交给合并
+static bool source_press(key_merge_t *merge, bench_source_t *src, const uint8_t *report, int64_t now,
+                         key_nkro_report_t *out)
+{
+    key_frame_t frame;
+    int64_t wait_us;
+    key_link_tx_update(&src->tx, report, KEY_LINK_REPORT_LEN, now);
+    key_link_tx_next(&src->tx, now, &frame, &wait_us);
+    return key_merge_input(merge, src->mac, sizeof(src->mac), &frame, sizeof(frame), now, out);
+}
+
+static void test_merge(void)
+{
+    printf("merge:\n");
+    key_merge_t merge;
+    key_merge_init(&merge);
+    bench_source_t a, b;
+    source_init(&a, 1);
+    source_init(&b, 2);
+    key_nkro_report_t out;
+    int64_t now = 1000000;
+
+    uint8_t ra[8] = {0x02, 0, 0x04, 0x05}; // Shift + A B
+    uint8_t rb[8] = {0x01, 0, 0x05, 0x06}; // Ctrl + B C
+    check(source_press(&merge, &a, ra, now, &out), "first source changes report");
+    check(source_press(&merge, &b, rb, now + 1000, &out), "second source changes report");
+    check(out.modifier == 0x03, "modifiers are or-ed");
+    check(nkro_count(&out) == 3 && nkro_key(&out, 0x04) && nkro_key(&out, 0x05) && nkro_key(&out, 0x06), "keys are merged");
+
+    // 两个键盘都按着 B, 一个松开后 B 仍然按下
+    uint8_t none[8] = {0};
+    check(source_press(&merge, &a, none, now + 2000, &out), "release changes report");
+    check(out.modifier == 0x01 && nkro_count(&out) == 2 && nkro_key(&out, 0x05), "key held by other source stays down");
+
+    // 重复帧不产生报文
+    key_frame_t frame;
+    int64_t wait_us;
+    key_link_tx_next(&b.tx, now + 10000, &frame, &wait_us);
+    check(!key_merge_input(&merge, b.mac, sizeof(b.mac), &frame, sizeof(frame), now + 10000, &out), "duplicate is ignored");
+
+    // 另一个键盘的 seq 不影响本键盘的去重
+    uint8_t ra2[8] = {0, 0, 0x07};
+    check(source_press(&merge, &a, ra2, now + 11000, &out), "sources keep separate seq");
+
+    // b 掉线只释放 b 的键
+    check(key_merge_check_timeout(&merge, now + 10000 + KEY_LINK_TIMEOUT_US, &out), "timeout releases silent source");
+    check(out.modifier == 0 && nkro_count(&out) == 1 && nkro_key(&out, 0x07), "only silent source is released");
+}
+
+static void test_announce(void)
+{
+    printf("announce:\n");
+    key_merge_t merge;
+    key_merge_init(&merge);
+    bench_source_t a;
+    source_init(&a, 1);
+    key_nkro_report_t out;
+    int64_t now = 1000000;
+    int64_t last_announce = now;
+    int64_t longest = 0;
+
+    // 每 50 ms 改变一次状态, 没有心跳; 接收器仍需按 KEY_LINK_ANNOUNCE_US 回复
+    for (int i = 0; i < 100; i++, now += 50000)
+    {
+        uint8_t report[8] = {0, 0, (uint8_t)(0x04 + i % 2)};
+        key_frame_t frame;
+        int64_t wait_us;
+        key_link_tx_update(&a.tx, report, sizeof(report), now);
+        key_link_tx_next(&a.tx, now, &frame, &wait_us);
+        key_merge_input(&merge, a.mac, sizeof(a.mac), &frame, sizeof(frame), now, &out);
+        if (key_merge_announce(&merge, a.mac, sizeof(a.mac), &frame, now))
+        {
+            longest = now - last_announce > longest ? now - last_announce : longest;
+            last_announce = now;
+        }
+        check(frame.type == KEY_FRAME_REPORT, "sustained typing sends no heartbeat");
+    }
+    check(longest <= KEY_LINK_ANNOUNCE_US + 50000, "reports are answered at a bounded rate");
+    check(longest < KEY_LINK_PEER_TIMEOUT_US, "keyboard never sees a peer timeout while typing");
+
+    key_frame_t discover;
+    key_link_frame_init(&discover, KEY_FRAME_DISCOVER, 0, now);
+    check(key_merge_announce(&merge, a.mac, sizeof(a.mac), &discover, now), "discover is always answered");
+    printf("  longest gap between announces while typing %lld ms\n", (long long)longest / 1000);
+}
+
+static void test_capacity(void)
+{
+    printf("capacity:\n");
+    key_merge_t merge;
+    key_merge_init(&merge);
+    bench_source_t src[KEY_MERGE_SOURCE_MAX + 1];
+    key_nkro_report_t out;
+    int64_t now = 1000000;
+
+    for (int i = 0; i <= KEY_MERGE_SOURCE_MAX; i++)
+    {
+        source_init(&src[i], i);
+        uint8_t report[8] = {0, 0, (uint8_t)(0x04 + i)};
+        source_press(&merge, &src[i], report, now + i, &out);
+    }
+    check(key_merge_source_count(&merge) == KEY_MERGE_SOURCE_MAX, "table holds KEY_MERGE_SOURCE_MAX sources");
+    check(merge.rejected == 1, "extra source is rejected while all hold keys");
+    check(nkro_count(&merge.report) == KEY_MERGE_SOURCE_MAX, "all sources merged");
+
+    // 第一个键盘松开并超时后, 位置可以给新键盘
+    uint8_t none[8] = {0};
+    int64_t later = now + 1000;
+    source_press(&merge, &src[0], none, later, &out);
+    for (int i = 1; i < KEY_MERGE_SOURCE_MAX; i++)
+    {
+        key_frame_t frame;
+        int64_t wait_us;
+        src[i].tx.next_us = 0;
+        key_link_tx_next(&src[i].tx, later + KEY_LINK_TIMEOUT_US, &frame, &wait_us);
+        key_merge_input(&merge, src[i].mac, sizeof(src[i].mac), &frame, sizeof(frame), later + KEY_LINK_TIMEOUT_US, &out);
+    }
+    key_merge_check_timeout(&merge, later + KEY_LINK_TIMEOUT_US + 1, &out);
+    uint8_t report[8] = {0, 0, 0x20};
+    source_init(&src[KEY_MERGE_SOURCE_MAX], KEY_MERGE_SOURCE_MAX);
+    check(source_press(&merge, &src[KEY_MERGE_SOURCE_MAX], report, later + KEY_LINK_TIMEOUT_US + 2, &out),
+          "idle source slot is reused");
+    check(key_merge_find(&merge, src[0].mac, sizeof(src[0].mac)) == NULL, "oldest idle source evicted");
+    check(nkro_key(&out, 0x20) && nkro_count(&out) == KEY_MERGE_SOURCE_MAX, "new source merged with the others");
+
+    // 旧版本键盘不超时
+    key_merge_init(&merge);
+    uint8_t legacy[8] = {0, 0, 0x04};
+    uint8_t ip[4] = {192, 168, 4, 2};
+    check(key_merge_input(&merge, ip, sizeof(ip), legacy, sizeof(legacy), now, &out), "legacy report merged");
+    check(!key_merge_check_timeout(&merge, now + KEY_LINK_TIMEOUT_US, &out), "legacy source is not released by the key_link timeout");
+    check(key_merge_check_timeout(&merge, now + KEY_MERGE_LEGACY_TIMEOUT_US, &out) && nkro_count(&out) == 0,
+          "silent legacy source is released after KEY_MERGE_LEGACY_TIMEOUT_US");
+
+    // DISCOVER 不占用位置
+    key_frame_t discover;
+    key_link_frame_init(&discover, KEY_FRAME_DISCOVER, 0, now);
+    uint8_t other[6] = {1, 2, 3, 4, 5, 6};
+    key_merge_input(&merge, other, sizeof(other), &discover, sizeof(discover), now, &out);
+    check(key_merge_find(&merge, other, sizeof(other)) == NULL, "discover does not allocate a source");
+
+    printf("  sizeof(key_merge_t) %zu bytes, %d sources, sizeof(key_nkro_report_t) %zu bytes\n",
+           sizeof(key_merge_t), KEY_MERGE_SOURCE_MAX, sizeof(key_nkro_report_t));
+}
+
+static void bench(int sources)
+{
+    key_merge_t merge;
+    key_merge_init(&merge);
+    bench_source_t src[KEY_MERGE_SOURCE_MAX];
+    key_nkro_report_t out;
+    int64_t now = 1000000;
+
+    // 每个键盘按住修饰键和 6 个不同的键, 合并时位图最满
+    for (int i = 0; i < sources; i++)
+    {
+        source_init(&src[i], i);
+        uint8_t report[8] = {(uint8_t)(1 << i), 0};
+        for (int k = 0; k < BENCH_KEYS_PER_SOURCE; k++)
+        {
+            report[2 + k] = 0x04 + i * BENCH_KEYS_PER_SOURCE + k;
+        }
+        source_press(&merge, &src[i], report, now, &out);
+    }
+
+    // 预先生成帧: 每个键盘交替按下/松开最后一个键, 每帧都改变合并结果
+    int frames_num = 2 * sources;
+    key_frame_t *frames = malloc(frames_num * sizeof(key_frame_t));
+    for (int i = 0; i < frames_num; i++)
+    {
+        bench_source_t *s = &src[i % sources];
+        uint8_t report[8];
+        memcpy(report, s->tx.report, sizeof(report));
+        report[7] = report[7] ? 0 : 0x04 + (i % sources) * BENCH_KEYS_PER_SOURCE + 5;
+        int64_t wait_us;
+        key_link_tx_update(&s->tx, report, sizeof(report), now);
+        key_link_tx_next(&s->tx, now, &frames[i], &wait_us);
+    }
+
+    uint32_t changed = 0;
+    int64_t start = now_ns();
+    for (int n = 0; n < s_iterations; n++)
+    {
+        int i = n % frames_num;
+        // seq 每轮加 2, 保持每帧都是新状态
+        frames[i].seq += (n >= frames_num) ? 2 : 0;
+        changed += key_merge_input(&merge, src[i % sources].mac, 6, &frames[i], sizeof(key_frame_t), now + n, &out);
+    }
+    int64_t input_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int n = 0; n < s_iterations; n++)
+    {
+        key_merge_build(&merge, &out);
+    }
+    int64_t build_ns = now_ns() - start;
+
+    start = now_ns();
+    for (int n = 0; n < s_iterations; n++)
+    {
+        key_merge_check_timeout(&merge, now + s_iterations, &out);
+    }
+    int64_t timeout_ns = now_ns() - start;
+
+    printf("  %d sources: input %6.1f ns/frame (%u changes), build %6.1f ns, timeout check %6.1f ns\n",
+           sources, (double)input_ns / s_iterations, changed, (double)build_ns / s_iterations,
+           (double)timeout_ns / s_iterations);
+    check(changed == (uint32_t)s_iterations, "every benchmark frame changes the merged report");
+    free(frames);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            s_iterations = atoi(argv[++i]);
+        }
+        else
+        {
+            printf("usage: %s [--iterations N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    test_merge();
+    test_announce();
+    test_capacity();
+    printf("cost (%d iterations):\n", s_iterations);
+    for (int n = 1; n <= KEY_MERGE_SOURCE_MAX; n *= 2)
+    {
+        bench(n);
+    }
+    printf("%s\n", s_failures ? "FAIL" : "PASS");
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,10 @@
+/*
+ * keyboard_tx_test 用的 app_espnow 替身, 实现在 keyboard_tx_test.c 中.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+void app_espnow_send_data(uint8_t *data, size_t data_len);
+uint32_t app_espnow_poll(void);
@@ -0,0 +1,9 @@
+/*
+ * keyboard_tx_test 用的 app_udp_client 替身, 实现在 keyboard_tx_test.c 中.
+ */
+#pragma once
+
+#include <stdint.h>
+
+void app_udp_client_send_data(uint8_t *data, int len);
+uint32_t app_udp_client_poll(void);
@@ -0,0 +1,349 @@
+/*
+ * 在电脑上压测 main/keyboard/keyboard_tx: 先用两个线程直接对环形队列并发入队/出队, 再让扫描线程按键盘任务的方式调用
+ * keyboard_tx_send, 由真正的发送任务出队, 发送函数可以变慢或停住.
+ *
+ * 编译: cc -O2 -Wall -pthread -I. -I../host_shim -I../../main/keyboard keyboard_tx_test.c -o keyboard_tx_test
+ * 运行: ./keyboard_tx_test [--items 5000000]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sched.h>
+
+// 直接包含源文件, 测试可以访问其中的静态队列
+#include "../../main/keyboard/keyboard_tx.c"
+
+#define SCAN_REPORT_LEN (8)
+
+typedef struct
+{
+    uint32_t id;
+    uint8_t mode;
+} delivered_t;
+
+static int s_failures = 0;
+static uint32_t s_seed = 1;
+static sys_param_t s_params[4] = {{.mode_hid = MODE_HID_UDP}};
+static uint32_t s_param_index = 0; // 每个场景换一份参数, 发送任务读到的总是完整写好的那份
+
+// 发送任务一侧的替身状态
+static delivered_t *s_delivered = NULL;
+static uint32_t s_delivered_cap = 0;
+static uint32_t s_delivered_num = 0;
+static uint32_t s_bad_reports = 0;
+static uint32_t s_send_us = 0;
+static uint32_t s_stall_us = 0; // 非 0 时下一次发送停住这么久
+static uint32_t s_polls = 0;
+static uint32_t s_kicks = 0;
+
+static void check(bool ok, const char *what)
+{
+    printf("  %s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+    {
+        s_failures++;
+    }
+}
+
+static uint32_t rnd(void)
+{
+    s_seed = s_seed * 1103515245 + 12345;
+    return s_seed >> 8;
+}
+
+static void sleep_us(uint32_t us)
+{
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (long)(us % 1000000) * 1000};
+    nanosleep(&ts, NULL);
+}
+
+/// @brief 第 id 次按键状态变化后的报文: 修饰键和 6 个键位都由 id 决定, 字节 2..5 是 id 本身
+static void make_report(uint32_t id, uint8_t *report)
+{
+    report[0] = (uint8_t)(id * 0x9d);
+    report[1] = 0;
+    memcpy(&report[2], &id, sizeof(id));
+    report[6] = (uint8_t)(id >> 3);
+    report[7] = (uint8_t)(id * 7 + 1);
+}
+
+static void record_delivery(uint8_t mode, const uint8_t *data, size_t len)
+{
+    uint8_t expect[SCAN_REPORT_LEN];
+    uint32_t id;
+    memcpy(&id, &data[2], sizeof(id));
+    make_report(id, expect);
+    if (len != SCAN_REPORT_LEN || memcmp(data, expect, sizeof(expect)) != 0)
+    {
+        s_bad_reports++;
+    }
+
+    uint32_t stall_us = __atomic_exchange_n(&s_stall_us, 0, __ATOMIC_ACQ_REL);
+    if (stall_us || s_send_us)
+    {
+        sleep_us(stall_us + s_send_us);
+    }
+    if (s_delivered_num < s_delivered_cap)
+    {
+        s_delivered[s_delivered_num++] = (delivered_t){.id = id, .mode = mode};
+    }
+}
+
+void app_espnow_send_data(uint8_t *data, size_t data_len)
+{
+    record_delivery(MODE_HID_ESPNOW, data, data_len);
+}
+
+void app_udp_client_send_data(uint8_t *data, int len)
+{
+    record_delivery(MODE_HID_UDP, data, len);
+}
+
+uint32_t app_espnow_poll(void)
+{
+    __atomic_add_fetch(&s_polls, 1, __ATOMIC_RELAXED);
+    return 2;
+}
+
+uint32_t app_udp_client_poll(void)
+{
+    __atomic_add_fetch(&s_polls, 1, __ATOMIC_RELAXED);
+    return 2;
+}
+
+void wifi_power_kick(void)
+{
+    s_kicks++;
+}
+
+sys_param_t *settings_get_parameter(void)
+{
+    return &s_params[__atomic_load_n(&s_param_index, __ATOMIC_ACQUIRE)];
+}
+
+/* ---------------- 环形队列本身 ---------------- */
+
+static uint64_t s_ring_items = 5000000;
+static uint64_t s_ring_full = 0;
+static uint64_t s_ring_empty = 0;
+
+static void ring_fill(uint64_t seq, keyboard_tx_item_t *item)
+{
+    for (int i = 0; i < KEYBOARD_TX_REPORT_LEN; i++)
+    {
+        item->report[i] = (uint8_t)(seq * 131 + i * 29);
+    }
+    item->mode = (uint8_t)(seq >> 5);
+    item->enqueue_us = (int64_t)seq;
+}
+
+static void *ring_producer(void *arg)
+{
+    keyboard_tx_item_t item;
+    for (uint64_t seq = 0; seq < s_ring_items; seq++)
+    {
+        ring_fill(seq, &item);
+        while (!keyboard_tx_push(&item))
+        {
+            s_ring_full++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void test_ring(void)
+{
+    printf("ring (one producer thread, one consumer thread, %" PRIu64 " items):\n", s_ring_items);
+    // 从快要回绕的位置开始, 覆盖 32 位计数回绕
+    sg_head = sg_tail = UINT32_MAX - 1000;
+    keyboard_tx_item_t item;
+    check(!keyboard_tx_pop(&item), "empty ring pops nothing");
+
+    pthread_t producer;
+    int64_t start = esp_timer_get_time();
+    pthread_create(&producer, NULL, ring_producer, NULL);
+    uint64_t out_of_order = 0, torn = 0;
+    keyboard_tx_item_t expect;
+    for (uint64_t seq = 0; seq < s_ring_items; seq++)
+    {
+        while (!keyboard_tx_pop(&item))
+        {
+            s_ring_empty++;
+            sched_yield();
+        }
+        if (item.enqueue_us != (int64_t)seq)
+        {
+            out_of_order++;
+            seq = item.enqueue_us;
+        }
+        ring_fill(seq, &expect);
+        if (memcmp(item.report, expect.report, sizeof(item.report)) != 0 || item.mode != expect.mode)
+        {
+            torn++;
+        }
+    }
+    pthread_join(producer, NULL);
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    printf("  %.1f M items/s, producer saw full %" PRIu64 " times, consumer saw empty %" PRIu64 " times\n",
+           s_ring_items / (elapsed / 1e6) / 1e6, s_ring_full, s_ring_empty);
+    check(out_of_order == 0, "items come out in order, none lost or repeated");
+    check(torn == 0, "no item is read while it is being written");
+    check(sg_head == sg_tail && !keyboard_tx_pop(&item), "ring is empty afterwards");
+    check(sg_head < 1000000 + s_ring_items, "head and tail wrap past 2^32");
+
+    // 单线程检查容量
+    int pushed = 0;
+    while (keyboard_tx_push(&item))
+    {
+        pushed++;
+    }
+    check(pushed == KEYBOARD_TX_RING_SIZE, "ring holds exactly KEYBOARD_TX_RING_SIZE items");
+    while (keyboard_tx_pop(&item))
+    {
+    }
+}
+
+/* ---------------- keyboard_tx_send 和发送任务 ---------------- */
+
+typedef struct
+{
+    const char *name;
+    uint8_t mode;
+    uint32_t ticks;     // 扫描次数
+    uint32_t period_us; // 扫描周期, 0 表示不停地调用
+    uint32_t send_us;   // 每次发送的耗时
+    uint32_t stall_at;  // 第几次扫描时让下一次发送停住, 0 表示不停住
+    uint32_t stall_us;
+} scenario_t;
+
+static void test_send(const scenario_t *sc, uint32_t index)
+{
+    printf("%s:\n", sc->name);
+    s_params[index].mode_hid = sc->mode;
+    __atomic_store_n(&s_param_index, index, __ATOMIC_RELEASE);
+    s_send_us = sc->send_us;
+    s_delivered_cap = sc->ticks + 1;
+    s_delivered = calloc(s_delivered_cap, sizeof(delivered_t));
+    s_delivered_num = 0;
+    s_bad_reports = 0;
+    s_kicks = 0;
+    __atomic_store_n(&s_polls, 0, __ATOMIC_RELAXED);
+
+    keyboard_tx_stats_t before, after;
+    keyboard_tx_get_stats(&before);
+
+    // 扫描线程: 每次扫描一半概率按键状态改变, 否则重复上一帧
+    uint8_t report[SCAN_REPORT_LEN];
+    uint32_t changes = 0;
+    make_report(0, report);
+    int64_t next_us = esp_timer_get_time();
+    for (uint32_t tick = 1; tick <= sc->ticks; tick++)
+    {
+        if (changes == 0 || rnd() % 2)
+        {
+            make_report(++changes, report);
+        }
+        if (tick == sc->stall_at)
+        {
+            __atomic_store_n(&s_stall_us, sc->stall_us, __ATOMIC_RELEASE);
+        }
+        keyboard_tx_send(sc->mode, report, sizeof(report));
+        if (sc->period_us)
+        {
+            next_us += sc->period_us;
+            int64_t wait_us = next_us - esp_timer_get_time();
+            if (wait_us > 0)
+            {
+                sleep_us((uint32_t)wait_us);
+            }
+        }
+    }
+
+    // 按键不再变化, 扫描继续, 队列满时留下的最新一帧要在后续扫描中发出
+    int64_t deadline = esp_timer_get_time() + 5000000;
+    while (sg_pending_valid && esp_timer_get_time() < deadline)
+    {
+        sleep_us(1000);
+        keyboard_tx_send(sc->mode, report, sizeof(report));
+    }
+    do
+    {
+        keyboard_tx_get_stats(&after);
+        if (after.sent - before.sent + after.dropped - before.dropped >= changes)
+        {
+            break;
+        }
+        sleep_us(1000);
+    } while (esp_timer_get_time() < deadline);
+
+    uint32_t sent = after.sent - before.sent;
+    uint32_t dropped = after.dropped - before.dropped;
+    uint32_t ordered = 0, wrong_mode = 0;
+    for (uint32_t i = 0; i < s_delivered_num; i++)
+    {
+        if (i > 0 && s_delivered[i].id <= s_delivered[i - 1].id)
+        {
+            ordered++;
+        }
+        if (s_delivered[i].mode != sc->mode)
+        {
+            wrong_mode++;
+        }
+    }
+    uint32_t hist[6];
+    for (int i = 0; i < 6; i++)
+    {
+        hist[i] = after.hist[i] - before.hist[i];
+    }
+    printf("  %" PRIu32 " changes in %" PRIu32 " scans: sent %" PRIu32 ", dropped %" PRIu32 ", polls %" PRIu32 "\n",
+           changes, sc->ticks, sent, dropped, __atomic_load_n(&s_polls, __ATOMIC_RELAXED));
+    printf("  latency avg %" PRIu64 " us; <1ms %" PRIu32 " <2ms %" PRIu32 " <5ms %" PRIu32 " <10ms %" PRIu32
+           " <50ms %" PRIu32 " >=50ms %" PRIu32 "\n",
+           sent ? (after.total_us - before.total_us) / sent : 0, hist[0], hist[1], hist[2], hist[3], hist[4], hist[5]);
+
+    check(!sg_pending_valid, "report left over from a full ring is sent by a later scan");
+    check(sent + dropped == changes, "every change is either sent or replaced by a newer one (sent + dropped)");
+    check(s_delivered_num == sent && s_bad_reports == 0, "every sent report arrives intact");
+    check(ordered == 0 && wrong_mode == 0, "reports arrive in order with no repeats, on the right link");
+    check(s_delivered_num > 0 && s_delivered[s_delivered_num - 1].id == changes, "the last report sent is the final key state");
+    check(s_kicks == changes, "unchanged reports are not queued and do not wake Wi-Fi");
+    if (sc->stall_us)
+    {
+        check(dropped > 0 && hist[5] > 0, "a stalled link fills the ring and only the latest state is kept");
+    }
+    free(s_delivered);
+    s_delivered = NULL;
+    s_delivered_cap = 0;
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--items") == 0)
+        {
+            s_ring_items = strtoull(argv[++i], NULL, 10);
+        }
+    }
+
+    test_ring();
+
+    keyboard_tx_start();
+    static const scenario_t scenarios[] = {
+        {"scan every 1 ms, UDP, 100 us per send", MODE_HID_UDP, 3000, 1000, 100, 0, 0},
+        {"scan every 1 ms, ESP-NOW, link stalls 500 ms", MODE_HID_ESPNOW, 2000, 1000, 50, 500, 500000},
+        {"scan without pause, UDP, no send delay", MODE_HID_UDP, 200000, 0, 0, 0, 0},
+    };
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        test_send(&scenarios[i], i + 1);
+    }
+
+    printf("%s\n", s_failures ? "FAIL" : "PASS");
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * keyboard_tx_test 用的 settings 替身: 与 main/settings.h 相同的模式枚举, settings_get_parameter 由测试实现.
+ */
+#pragma once
+
+#include <stdint.h>
+
+enum
+{
+    MODE_HID_USB = 0,
+    MODE_HID_BLE,
+    MODE_HID_ESPNOW,
+    MODE_HID_UDP,
+    MODE_HID_MAX,
+};
+
+typedef struct
+{
+    uint8_t mode_hid;
+    uint8_t none;
+} sys_param_t;
+
+sys_param_t *settings_get_parameter(void);
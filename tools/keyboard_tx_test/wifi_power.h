@@ -0,0 +1,6 @@
+/*
+ * keyboard_tx_test 用的 wifi_power 替身, 实现在 keyboard_tx_test.c 中.
+ */
+#pragma once
+
+void wifi_power_kick(void);
@@ -0,0 +1,13 @@
+/*
+ * llm_provider_test 用的 app_http_pool 替身: 每个服务的响应头按设定的延迟返回, 实现在 llm_provider_test.c 中.
+ */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+esp_http_client_handle_t app_http_pool_acquire(const esp_http_client_config_t *config);
+esp_err_t app_http_pool_open(esp_http_client_handle_t client, const char *post_data, int post_len);
+esp_err_t app_http_pool_set_header(esp_http_client_handle_t client, const char *key, const char *value);
+void app_http_pool_cancel(esp_http_client_handle_t client);
+void app_http_pool_release(esp_http_client_handle_t client, esp_err_t result);
@@ -0,0 +1,26 @@
+/*
+ * llm_provider_test 用的 esp_http_client 替身, 只有 llm_provider.c 用到的部分, 实现在 llm_provider_test.c 中.
+ */
+#pragma once
+
+#include "esp_err.h"
+
+typedef struct esp_http_client *esp_http_client_handle_t;
+
+typedef enum
+{
+    HTTP_METHOD_GET,
+    HTTP_METHOD_POST,
+} esp_http_client_method_t;
+
+typedef struct
+{
+    const char *url;
+    esp_err_t (*crt_bundle_attach)(void *conf);
+    int timeout_ms;
+} esp_http_client_config_t;
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method);
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key);
+int esp_http_client_get_status_code(esp_http_client_handle_t client);
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len);
@@ -0,0 +1,291 @@
+/*
+ * 在电脑上测试 main/chatgpt_api/llm_provider 的排序和对冲: 首选服务变慢后, 输掉的请求也要留下首字节耗时样本,
+ * 几次请求后排到第二; 所有服务都超时时, 进行中的请求都记为失败.
+ *
+ * 编译: cc -O2 -Wall -pthread -I. -I../host_shim -I../../main/chatgpt_api -I../../main/app_http llm_provider_test.c -o llm_provider_test
+ * 运行: ./llm_provider_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// 直接包含源文件, 测试可以访问其中的统计和请求任务
+#include "../../main/chatgpt_api/llm_provider.c"
+
+#define SERVER_NUM (2)
+
+// 替身服务器, 按 url 区分, 响应头在 delay_ms 后返回
+typedef struct
+{
+    const char *url;
+    uint32_t delay_ms;
+} server_t;
+
+struct esp_http_client
+{
+    server_t *server;
+    bool cancelled;
+};
+
+static int s_failures = 0;
+static server_t s_servers[SERVER_NUM] = {
+    {.url = "http://provider-a/v1/chat/completions"},
+    {.url = "http://provider-b/v1/chat/completions"},
+};
+static pthread_mutex_t s_net_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_net_cond = PTHREAD_COND_INITIALIZER;
+static int s_clients = 0; // 取走还没有归还的连接
+
+static void check(bool ok, const char *what)
+{
+    printf("  %s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+    {
+        s_failures++;
+    }
+}
+
+esp_http_client_handle_t app_http_pool_acquire(const esp_http_client_config_t *config)
+{
+    esp_http_client_handle_t client = calloc(1, sizeof(struct esp_http_client));
+    for (int i = 0; i < SERVER_NUM; i++)
+    {
+        if (strcmp(config->url, s_servers[i].url) == 0)
+        {
+            client->server = &s_servers[i];
+        }
+    }
+    assert(client->server);
+    pthread_mutex_lock(&s_net_lock);
+    s_clients++;
+    pthread_mutex_unlock(&s_net_lock);
+    return client;
+}
+
+esp_err_t app_http_pool_open(esp_http_client_handle_t client, const char *post_data, int post_len)
+{
+    pthread_mutex_lock(&s_net_lock);
+    struct timespec deadline = host_shim_deadline(client->server->delay_ms);
+    int rc = 0;
+    while (!client->cancelled && rc != ETIMEDOUT)
+    {
+        rc = pthread_cond_timedwait(&s_net_cond, &s_net_lock, &deadline);
+    }
+    esp_err_t err = client->cancelled ? ESP_FAIL : ESP_OK;
+    pthread_mutex_unlock(&s_net_lock);
+    return err;
+}
+
+esp_err_t app_http_pool_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    return ESP_OK;
+}
+
+void app_http_pool_cancel(esp_http_client_handle_t client)
+{
+    pthread_mutex_lock(&s_net_lock);
+    client->cancelled = true;
+    pthread_cond_broadcast(&s_net_cond);
+    pthread_mutex_unlock(&s_net_lock);
+}
+
+void app_http_pool_release(esp_http_client_handle_t client, esp_err_t result)
+{
+    pthread_mutex_lock(&s_net_lock);
+    s_clients--;
+    pthread_mutex_unlock(&s_net_lock);
+    free(client);
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key)
+{
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return 200;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
+{
+    return 0;
+}
+
+static size_t build_body(const llm_provider_config_t *provider, void *arg, char *buf, size_t size)
+{
+    return snprintf(buf, size, "{\"model\":\"%s\"}", provider->model);
+}
+
+/// @brief 两个替身服务器作为服务 0 和 1, 第三个默认服务保持关闭; 重新设置会清空统计
+static void setup_providers(uint32_t timeout_ms)
+{
+    for (int i = 0; i < SERVER_NUM; i++)
+    {
+        llm_provider_config_t config = {.timeout_ms = timeout_ms, .enabled = true};
+        snprintf(config.name, sizeof(config.name), "provider-%c", 'a' + i);
+        snprintf(config.url, sizeof(config.url), "%s", s_servers[i].url);
+        snprintf(config.model, sizeof(config.model), "model-%c", 'a' + i);
+        llm_provider_set(i, &config);
+    }
+}
+
+/// @brief 等被中止的请求任务返回并归还连接
+static bool wait_idle(void)
+{
+    for (int n = 0; n < 1000; n++)
+    {
+        bool busy = false;
+        llm_lock();
+        for (int i = 0; i < LLM_ATTEMPT_MAX; i++)
+        {
+            busy |= s_attempts[i].busy;
+        }
+        llm_unlock();
+        pthread_mutex_lock(&s_net_lock);
+        int clients = s_clients;
+        pthread_mutex_unlock(&s_net_lock);
+        if (!busy && clients == 0)
+        {
+            return true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return false;
+}
+
+static int first_ranked(void)
+{
+    int order[LLM_PROVIDER_MAX];
+    llm_lock();
+    int n = llm_provider_order(order);
+    llm_unlock();
+    return n > 0 ? order[0] : -1;
+}
+
+/// @brief 发一次请求并归还连接, 返回胜出的服务, 失败时返回 -1
+static int request(uint32_t *ttfb_ms, esp_err_t *err)
+{
+    llm_conn_t conn = {0};
+    *err = llm_open(build_body, NULL, NULL, &conn);
+    if (*err != ESP_OK)
+    {
+        return -1;
+    }
+    *ttfb_ms = conn.ttfb_ms;
+    llm_close(&conn, ESP_OK, false);
+    return conn.provider;
+}
+
+static void print_state(void)
+{
+    for (int i = 0; i < SERVER_NUM; i++)
+    {
+        llm_provider_stats_t st;
+        llm_provider_get_stats(i, &st);
+        printf("    %s: requests %" PRIu32 ", wins %" PRIu32 ", hedges %" PRIu32 ", failures %" PRIu32 ", samples %d, ewma %" PRIu32 " ms, p95 %" PRIu32 " ms\n",
+               s_providers[i].name, st.requests, st.wins, st.hedges, st.failures, s_state[i].sample_count, st.ewma_ttfb_ms, st.p95_ttfb_ms);
+    }
+}
+
+static void test_slow_first_provider(void)
+{
+    printf("first-ranked provider becomes slow:\n");
+    setup_providers(3000);
+    s_servers[0].delay_ms = 100;
+    s_servers[1].delay_ms = 200;
+
+    bool a_wins = true;
+    for (int i = 0; i < LLM_TTFB_MIN_SAMPLES; i++)
+    {
+        uint32_t ttfb_ms = 0;
+        esp_err_t err;
+        a_wins &= request(&ttfb_ms, &err) == 0;
+    }
+    llm_provider_stats_t b;
+    llm_provider_get_stats(1, &b);
+    print_state();
+    check(a_wins && b.requests == 0, "fast provider a wins every request, b is never hedged");
+    check(first_ranked() == 0, "a ranks first");
+
+    // a 变慢: 每次在 a 的 p95 (下限 300 ms) 后向 b 对冲, b 先返回, a 被中止
+    s_servers[0].delay_ms = 2000;
+    int rounds = 0;
+    int lost = 0;
+    for (rounds = 1; rounds <= 5 && first_ranked() == 0; rounds++)
+    {
+        uint32_t ttfb_ms = 0;
+        esp_err_t err;
+        int winner = request(&ttfb_ms, &err);
+        lost += winner == 1;
+        check(wait_idle(), "cancelled attempt returns and releases its connection");
+        printf("    request %d: winner %s after %" PRIu32 " ms, first ranked now %s\n", rounds, winner >= 0 ? s_providers[winner].name : "none",
+               ttfb_ms, s_providers[first_ranked()].name);
+    }
+    print_state();
+    llm_provider_stats_t a;
+    llm_provider_get_stats(0, &a);
+    llm_provider_get_stats(1, &b);
+    check(first_ranked() == 1 && rounds - 1 <= 3, "a ranks second after a few requests");
+    check(lost == rounds - 1 && b.wins == (uint32_t)lost, "b wins every hedged request");
+    check(s_state[0].sample_count == LLM_TTFB_MIN_SAMPLES + lost, "every lost race leaves exactly one ttfb sample for a");
+    check(a.failures == 0, "a lost race is not counted as a failure");
+    check(a.ewma_ttfb_ms > b.ewma_ttfb_ms, "a's ttfb estimate rises above b's");
+
+    uint32_t ttfb_ms = 0;
+    esp_err_t err;
+    uint32_t hedges = b.hedges;
+    int winner = request(&ttfb_ms, &err);
+    llm_provider_get_stats(1, &b);
+    printf("    next request: winner %s after %" PRIu32 " ms\n", winner >= 0 ? s_providers[winner].name : "none", ttfb_ms);
+    check(winner == 1 && b.hedges == hedges && ttfb_ms < 300, "b is now asked first and answers without a hedge");
+    check(wait_idle(), "no connection is left behind");
+}
+
+static void test_deadline(void)
+{
+    printf("every provider misses the deadline:\n");
+    setup_providers(1000);
+    s_servers[0].delay_ms = 5000;
+    s_servers[1].delay_ms = 5000;
+
+    int64_t start = esp_timer_get_time();
+    uint32_t ttfb_ms = 0;
+    esp_err_t err;
+    int winner = request(&ttfb_ms, &err);
+    uint32_t elapsed_ms = (esp_timer_get_time() - start) / 1000;
+    printf("    llm_open: %s after %" PRIu32 " ms\n", esp_err_to_name(err), elapsed_ms);
+    check(winner < 0 && err == ESP_ERR_TIMEOUT && elapsed_ms < 1200, "llm_open gives up at the timeout");
+    check(wait_idle(), "in-flight attempts return and release their connections");
+    print_state();
+
+    llm_provider_stats_t a, b;
+    llm_provider_get_stats(0, &a);
+    llm_provider_get_stats(1, &b);
+    check(a.requests == 1 && b.requests == 1 && b.hedges == 1, "a is asked first, b is hedged");
+    check(a.failures == 1 && b.failures == 1, "every in-flight attempt is recorded as a timeout failure");
+    check(s_state[0].sample_count == 0 && s_state[1].sample_count == 0, "a timeout leaves no ttfb sample");
+    check(s_state[0].consecutive_failures == 1 && s_state[1].consecutive_failures == 1, "both providers are pushed back in the ranking");
+}
+
+int main(void)
+{
+    if (llm_provider_init() != ESP_OK)
+    {
+        printf("llm_provider_init failed\nFAIL\n");
+        return 1;
+    }
+    test_slow_first_provider();
+    test_deadline();
+    printf("%s\n", s_failures ? "FAIL" : "PASS");
+    return s_failures ? 1 : 0;
+}
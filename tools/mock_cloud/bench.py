@@ -0,0 +1,233 @@
+"""
+语音流水线延迟基准, 按固件的请求顺序访问模拟云端 (或任何兼容的服务):
+
+    token -> asr -> chat (流式, 逐句切分) -> tts (每句一次)
+
+输出每个阶段的首字节 / 总耗时分位数, 以及从录音结束到第一句语音开始下载的端到端时间.
+固件连上模拟云端时, 用 --server-stats 读取服务端记录的同一组统计.
+--no-keepalive 时每个请求新建连接 (DNS, TCP, TLS 握手), 与默认的长连接对比即为连接池省下的时间.
+只依赖 Python 标准库.
+"""
+
+import argparse
+import http.client
+import json
+import ssl
+import struct
+import time
+from urllib.parse import quote, urlencode, urlparse
+
+SENTENCE_END = "。！？；…\n!?;"
+COMMA = "，、,"
+COMMA_SPLIT = 60   # 与固件 chat_stream.c 的 CHAT_STREAM_COMMA_SPLIT 一致, 按字节计
+
+
+def percentile(values, p):
+    v = sorted(values)
+    if not v:
+        return 0.0
+    k = min(len(v) - 1, max(0, int(round(p / 100.0 * (len(v) - 1)))))
+    return v[k]
+
+
+def wav_silence(seconds, rate=16000):
+    """与固件录音相同格式的 wav: 16 kHz, 16 bit, 单声道"""
+    data = bytes(int(seconds * rate) * 2)
+    header = b"RIFF" + struct.pack("<I", 36 + len(data)) + b"WAVE"
+    header += b"fmt " + struct.pack("<IHHIIHH", 16, 1, 1, rate, rate * 2, 2, 16)
+    header += b"data" + struct.pack("<I", len(data))
+    return header + data
+
+
+class Client:
+    """每个主机一个长连接, 和固件的连接池一样复用; keepalive 为 False 时每个请求新建连接, 相当于没有连接池"""
+
+    def __init__(self, base, timeout, keepalive=True, context=None):
+        self.base = urlparse(base)
+        self.timeout = timeout
+        self.keepalive = keepalive
+        self.context = context
+        self.conn = None
+        self.connections = 0
+
+    def connect(self):
+        if self.base.scheme == "https":
+            self.conn = http.client.HTTPSConnection(self.base.hostname, self.base.port, timeout=self.timeout,
+                                                    context=self.context)
+        else:
+            self.conn = http.client.HTTPConnection(self.base.hostname, self.base.port, timeout=self.timeout)
+        self.connections += 1
+
+    def request(self, method, path, body=None, headers=None, on_data=None):
+        """返回 (状态码, 响应体, 首字节 ms, 总耗时 ms)"""
+        for attempt in range(2):
+            if self.conn is None:
+                self.connect()
+            t0 = time.monotonic()
+            headers = dict(headers or {})
+            if not self.keepalive:
+                headers["Connection"] = "close"
+            try:
+                self.conn.request(method, path, body=body, headers=headers)
+                resp = self.conn.getresponse()
+                t_first = None
+                chunks = []
+                while True:
+                    piece = resp.read1(4096)
+                    if not piece:
+                        # read1 读完不会释放响应, 不关闭的话连接无法发送下一个请求
+                        resp.close()
+                        break
+                    if t_first is None:
+                        t_first = time.monotonic()
+                    chunks.append(piece)
+                    if on_data:
+                        on_data(piece, time.monotonic())
+                t_end = time.monotonic()
+                if resp.will_close or not self.keepalive:
+                    self.conn.close()
+                    self.conn = None
+                return resp.status, b"".join(chunks), ((t_first or t_end) - t0) * 1000, (t_end - t0) * 1000
+            except (http.client.HTTPException, ConnectionError, OSError):
+                self.conn.close()
+                self.conn = None
+                if attempt == 1:
+                    raise
+        raise RuntimeError("unreachable")
+
+
+class SentenceSplitter:
+    """流式内容按句切分, 规则与固件的 chat_stream 一致"""
+
+    def __init__(self):
+        self.buf = ""
+        self.sentences = []
+
+    def feed(self, text, now):
+        for ch in text:
+            # 英文句号后面跟空白才算句末
+            if ch in " \n" and self.buf.endswith("."):
+                self.emit(now)
+            self.buf += ch
+            if ch in SENTENCE_END or (ch in COMMA and len(self.buf.encode("utf-8")) >= COMMA_SPLIT):
+                self.emit(now)
+
+    def emit(self, now):
+        s = self.buf.strip()
+        self.buf = ""
+        if s:
+            self.sentences.append((s, now))
+
+    def finish(self, now):
+        self.emit(now)
+
+
+def run_once(args, baidu, chat, stages, audio):
+    t_begin = time.monotonic()
+
+    status, body, ttfb, total = baidu.request(
+        "POST", "/oauth/2.0/token?" + urlencode({"grant_type": "client_credentials", "client_id": "bench", "client_secret": "bench"}))
+    stages["token"].append((ttfb, total))
+    token = json.loads(body)["access_token"]
+
+    path = "/server_api?" + urlencode({"dev_pid": "1537", "cuid": "bench", "token": token})
+    status, body, ttfb, total = baidu.request("POST", path, body=audio, headers={"Content-Type": "audio/wav;rate=16000"})
+    stages["asr"].append((ttfb, total))
+    result = json.loads(body)
+    if result.get("err_no", 0) != 0:
+        raise RuntimeError("asr error: %s" % result)
+    text = result["result"][0]
+
+    request = {"model": args.model, "stream": True,
+               "messages": [{"role": "system", "content": "bench"}, {"role": "user", "content": text}]}
+    splitter = SentenceSplitter()
+    pending = [""]
+
+    def on_sse(piece, now):
+        pending[0] += piece.decode("utf-8", "replace")
+        while "\n" in pending[0]:
+            line, pending[0] = pending[0].split("\n", 1)
+            line = line.strip()
+            if not line.startswith("data:") or line == "data: [DONE]":
+                continue
+            delta = json.loads(line[5:])["choices"][0].get("delta", {})
+            if delta.get("content"):
+                splitter.feed(delta["content"], now)
+
+    t_chat = time.monotonic()
+    status, body, ttfb, total = chat.request(
+        "POST", args.chat_path, body=json.dumps(request, ensure_ascii=False).encode("utf-8"),
+        headers={"Content-Type": "application/json", "Authorization": "Bearer " + args.api_key, "Accept": "text/event-stream"},
+        on_data=on_sse)
+    splitter.finish(time.monotonic())
+    if status != 200 or not splitter.sentences:
+        raise RuntimeError("chat failed: %d %s" % (status, body[:200]))
+    first_sentence_ms = (splitter.sentences[0][1] - t_chat) * 1000
+    stages["chat"].append((ttfb, total))
+    stages["chat_first_sentence"].append((first_sentence_ms, first_sentence_ms))
+
+    # 固件在第一句切出后立即合成, 这里顺序执行, 第一句的首字节时间即为开始出声的时间
+    first_audio = None
+    for sentence, _ in splitter.sentences:
+        form = "tex=%s&tok=%s&cuid=bench&ctp=1&lan=zh&spd=5&pit=5&vol=5&per=1&aue=3" % (quote(quote(sentence)), token)
+        status, body, ttfb, total = baidu.request("POST", "/text2audio", body=form.encode("ascii"),
+                                                  headers={"Content-Type": "application/x-www-form-urlencoded"})
+        stages["tts"].append((ttfb, total))
+        if first_audio is None:
+            first_audio = (splitter.sentences[0][1] - t_begin) * 1000 + ttfb
+    stages["end_to_first_audio"].append((first_audio, first_audio))
+    stages["end_to_end"].append(((time.monotonic() - t_begin) * 1000,) * 2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Voice pipeline latency benchmark")
+    parser.add_argument("--baidu", default="http://127.0.0.1:8000", help="百度接口的地址")
+    parser.add_argument("--chat", default="http://127.0.0.1:8000", help="聊天接口的地址")
+    parser.add_argument("--chat-path", default="/v1/chat/completions")
+    parser.add_argument("--api-key", default="mock")
+    parser.add_argument("--model", default="deepseek-chat")
+    parser.add_argument("-n", "--iterations", type=int, default=20)
+    parser.add_argument("--audio-seconds", type=float, default=3.0, help="上传录音的时长")
+    parser.add_argument("--timeout", type=float, default=10.0)
+    parser.add_argument("--server-stats", action="store_true", help="只读取并打印服务端 /stats")
+    parser.add_argument("--no-keepalive", action="store_true", help="每个请求新建连接, 测量没有连接池时的延迟")
+    parser.add_argument("--cafile", help="https 时校验服务器用的证书, 如 mock_cloud.py --tls 生成的证书")
+    parser.add_argument("--insecure", action="store_true", help="https 时不校验服务器证书")
+    args = parser.parse_args()
+
+    context = ssl.create_default_context(cafile=args.cafile)
+    if args.insecure:
+        context.check_hostname = False
+        context.verify_mode = ssl.CERT_NONE
+    baidu = Client(args.baidu, args.timeout, not args.no_keepalive, context)
+    if args.server_stats:
+        status, body, _, _ = baidu.request("GET", "/stats")
+        print(json.dumps(json.loads(body), ensure_ascii=False, indent=2))
+        return
+
+    chat = baidu if args.chat == args.baidu else Client(args.chat, args.timeout, not args.no_keepalive, context)
+    audio = wav_silence(args.audio_seconds)
+    names = ("token", "asr", "chat", "chat_first_sentence", "tts", "end_to_first_audio", "end_to_end")
+    stages = {name: [] for name in names}
+    failures = 0
+    for i in range(args.iterations):
+        try:
+            run_once(args, baidu, chat, stages, audio)
+        except Exception as e:  # noqa: BLE001 - 统计失败次数, 继续下一轮
+            failures += 1
+            print("iteration %d failed: %s" % (i, e))
+
+    print("%d iterations, %d failed, audio %.1f s (%d bytes), %d connections (%s)"
+          % (args.iterations, failures, args.audio_seconds, len(audio), baidu.connections + (chat.connections if chat is not baidu else 0),
+             "new connection per request" if args.no_keepalive else "keep-alive"))
+    print("%-22s %6s %10s %10s %10s %10s" % ("stage", "n", "ttfb p50", "ttfb p95", "total p50", "total p95"))
+    for name in names:
+        samples = stages[name]
+        ttfb = [s[0] for s in samples]
+        total = [s[1] for s in samples]
+        print("%-22s %6d %10.1f %10.1f %10.1f %10.1f" % (name, len(samples), percentile(ttfb, 50), percentile(ttfb, 95),
+                                                         percentile(total, 50), percentile(total, 95)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,467 @@
+"""
+本地模拟云端服务, 代替百度语音(鉴权/识别/合成)和 OpenAI 兼容的聊天接口.
+
+接口与固件使用的请求格式一致:
+    POST /oauth/2.0/token        百度鉴权, 返回 access_token 和 expires_in
+    POST /server_api             百度语音识别, 请求体为 wav
+    POST /text2audio             百度语音合成, 返回 audio/mp3 (静音帧, 长度与文字数成正比)
+    POST /v1/chat/completions    聊天, 支持 "stream": true 的 SSE 流式回复
+    GET  /stats                  每个接口的请求数, 错误数, 首字节与总耗时分位数, 最近的请求记录
+    POST /stats/reset            清空统计
+    GET  /config  POST /config   查看 / 修改运行参数 (JSON), 不用重启即可切换场景
+
+每个接口都可以配置延迟, 抖动, 带宽, 分块大小和错误注入, 见 --help 和 README.md.
+--tls 时以 HTTPS 提供服务, 自签名证书由 openssl 命令生成, 用于测量连接池省下的 TCP 和 TLS 握手.
+只依赖 Python 标准库 (--tls 需要 openssl 命令).
+"""
+
+import argparse
+import hashlib
+import ipaddress
+import json
+import os
+import random
+import socket
+import ssl
+import subprocess
+import sys
+import threading
+import time
+import uuid
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+ENDPOINTS = ("token", "asr", "tts", "chat")
+
+DEFAULT_ENDPOINT_CONFIG = {
+    "latency_ms": 0,        # 收到请求到开始回复的延迟
+    "jitter_ms": 0,         # 延迟的随机抖动, 均匀分布在 [-jitter, +jitter]
+    "bandwidth": 0,         # 回复的带宽, 字节/秒, 0 不限速
+    "chunk_size": 1024,     # 回复分块写出的大小
+    "error_rate": 0.0,      # 注入错误的概率
+    "error_kind": "http",   # http: 返回 HTTP 错误码; api: 返回接口自己的错误 JSON; drop: 直接断开连接
+    "error_status": 503,
+}
+
+DEFAULT_CONFIG = {
+    "asr_text": "今天天气怎么样",
+    "chat_answer": "今天天气晴朗，气温二十五度，适合出门散步。记得多喝水，注意防晒。祝你有愉快的一天！",
+    "stream_interval_ms": 40,   # 流式回复每个片段之间的间隔, 模拟大模型逐字生成
+    "stream_piece_chars": 2,    # 每个片段的字数
+    "tts_ms_per_char": 220,     # 合成音频的时长, 每个字多少毫秒
+    "token_expires_in": 2592000,
+    "endpoints": {name: dict(DEFAULT_ENDPOINT_CONFIG) for name in ENDPOINTS},
+}
+
+# MPEG-2 Layer III, 32 kbps, 16 kHz, 单声道; 每帧 144 字节, 576 个采样点 (36 ms).
+# 主数据全零的帧解码为静音, 固件的 mp3 解码器可以正常播放
+MP3_FRAME_HEADER = bytes([0xFF, 0xF3, 0x48, 0xC0])
+MP3_FRAME_SIZE = 144
+MP3_FRAME_MS = 36
+MP3_SILENT_FRAME = MP3_FRAME_HEADER + bytes(MP3_FRAME_SIZE - len(MP3_FRAME_HEADER))
+
+
+class Stats:
+    """按接口记录请求耗时, 由 /stats 输出"""
+
+    HISTORY = 64
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.reset()
+
+    def reset(self):
+        with self.lock:
+            self.endpoints = {name: {"requests": 0, "errors": 0, "bytes_in": 0, "bytes_out": 0, "ttfb_ms": [], "total_ms": []}
+                              for name in ENDPOINTS}
+            self.recent = []
+            self.connections = 0
+
+    def record(self, name, status, bytes_in, bytes_out, ttfb_ms, total_ms, error):
+        with self.lock:
+            ep = self.endpoints[name]
+            ep["requests"] += 1
+            ep["errors"] += 1 if error else 0
+            ep["bytes_in"] += bytes_in
+            ep["bytes_out"] += bytes_out
+            ep["ttfb_ms"].append(ttfb_ms)
+            ep["total_ms"].append(total_ms)
+            self.recent.append({"time": round(time.time(), 3), "endpoint": name, "status": status, "error": error,
+                                "bytes_in": bytes_in, "bytes_out": bytes_out,
+                                "ttfb_ms": round(ttfb_ms, 1), "total_ms": round(total_ms, 1)})
+            del self.recent[:-self.HISTORY]
+
+    def new_connection(self):
+        with self.lock:
+            self.connections += 1
+
+    def snapshot(self):
+        with self.lock:
+            out = {"connections": self.connections, "endpoints": {}, "recent": list(self.recent)}
+            for name, ep in self.endpoints.items():
+                out["endpoints"][name] = {
+                    "requests": ep["requests"],
+                    "errors": ep["errors"],
+                    "bytes_in": ep["bytes_in"],
+                    "bytes_out": ep["bytes_out"],
+                    "ttfb_ms": summarize(ep["ttfb_ms"]),
+                    "total_ms": summarize(ep["total_ms"]),
+                }
+            return out
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    k = min(len(sorted_values) - 1, max(0, int(round(p / 100.0 * (len(sorted_values) - 1)))))
+    return sorted_values[k]
+
+
+def summarize(values):
+    v = sorted(values)
+    if not v:
+        return {"n": 0}
+    return {"n": len(v), "min": round(v[0], 1), "p50": round(percentile(v, 50), 1),
+            "p95": round(percentile(v, 95), 1), "max": round(v[-1], 1), "avg": round(sum(v) / len(v), 1)}
+
+
+class MockCloud:
+    def __init__(self, config):
+        self.config_lock = threading.Lock()
+        self.config = config
+        self.stats = Stats()
+        self.tokens = set()
+
+    def endpoint_config(self, name):
+        with self.config_lock:
+            return dict(self.config["endpoints"][name])
+
+    def get(self, key):
+        with self.config_lock:
+            return self.config[key]
+
+    def update_config(self, patch):
+        with self.config_lock:
+            for key, value in patch.items():
+                if key == "endpoints":
+                    for name, ep in value.items():
+                        if name == "all":
+                            for target in self.config["endpoints"].values():
+                                target.update(ep)
+                        elif name in self.config["endpoints"]:
+                            self.config["endpoints"][name].update(ep)
+                elif key in self.config:
+                    self.config[key] = value
+            return json.loads(json.dumps(self.config))
+
+    def issue_token(self):
+        token = "24.mock" + uuid.uuid4().hex + ".2592000.1.282335-mock"
+        with self.config_lock:
+            self.tokens.add(token)
+        return token
+
+    def token_valid(self, token):
+        with self.config_lock:
+            return token in self.tokens
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"   # 支持长连接, 固件的连接池可以复用连接
+    server_version = "MockCloud/1.0"
+    cloud = None                    # MockCloud, 由 main() 设置
+
+    def setup(self):
+        super().setup()
+        self.connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.cloud.stats.new_connection()
+
+    def log_message(self, fmt, *args):
+        if self.server.verbose:
+            super().log_message(fmt, *args)
+
+    # ---------------- 请求分发 ----------------
+
+    def do_GET(self):
+        self.dispatch()
+
+    def do_POST(self):
+        self.dispatch()
+
+    def dispatch(self):
+        self.t_start = time.monotonic()
+        self.t_first = None
+        self.bytes_out = 0
+        self.ep = None
+        url = urlparse(self.path)
+        self.query = {k: v[0] for k, v in parse_qs(url.query).items()}
+        length = int(self.headers.get("Content-Length") or 0)
+        self.body = self.rfile.read(length) if length else b""
+
+        routes = {
+            "/oauth/2.0/token": ("token", self.handle_token),
+            "/server_api": ("asr", self.handle_asr),
+            "/text2audio": ("tts", self.handle_tts),
+            "/v1/chat/completions": ("chat", self.handle_chat),
+            "/chat/completions": ("chat", self.handle_chat),
+        }
+        if url.path == "/stats":
+            return self.send_json(200, self.cloud.stats.snapshot())
+        if url.path == "/stats/reset":
+            self.cloud.stats.reset()
+            return self.send_json(200, {"ok": True})
+        if url.path == "/config":
+            if self.command == "POST":
+                try:
+                    patch = json.loads(self.body or b"{}")
+                except ValueError:
+                    return self.send_json(400, {"error": "invalid json"})
+                return self.send_json(200, self.cloud.update_config(patch))
+            return self.send_json(200, self.cloud.update_config({}))
+        if url.path not in routes:
+            return self.send_json(404, {"error": "not found", "path": url.path})
+
+        name, handler = routes[url.path]
+        ep = self.cloud.endpoint_config(name)
+        self.ep = ep
+        status, error = 200, False
+        try:
+            delay = ep["latency_ms"] + random.uniform(-ep["jitter_ms"], ep["jitter_ms"])
+            if delay > 0:
+                time.sleep(delay / 1000.0)
+            if ep["error_rate"] > 0 and random.random() < ep["error_rate"]:
+                error = True
+                status = self.inject_error(name, ep)
+            else:
+                status = handler()
+        except (BrokenPipeError, ConnectionResetError):
+            error = True
+            status = 0
+        now = time.monotonic()
+        ttfb = ((self.t_first or now) - self.t_start) * 1000.0
+        self.cloud.stats.record(name, status, len(self.body), self.bytes_out, ttfb, (now - self.t_start) * 1000.0,
+                                error or status >= 400)
+
+    # ---------------- 输出 ----------------
+
+    def write_paced(self, data):
+        """按配置的分块大小和带宽写出"""
+        chunk = max(1, int(self.ep["chunk_size"])) if self.ep else len(data) or 1
+        bandwidth = self.ep["bandwidth"] if self.ep else 0
+        for off in range(0, len(data), chunk):
+            piece = data[off:off + chunk]
+            self.wfile.write(piece)
+            self.wfile.flush()
+            if self.t_first is None:
+                self.t_first = time.monotonic()
+            self.bytes_out += len(piece)
+            if bandwidth > 0:
+                time.sleep(len(piece) / float(bandwidth))
+
+    def send_body(self, status, content_type, data):
+        self.send_response(status)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.write_paced(data)
+        return status
+
+    def send_json(self, status, obj):
+        data = json.dumps(obj, ensure_ascii=False).encode("utf-8")
+        return self.send_body(status, "application/json", data)
+
+    def send_chunk(self, data):
+        """HTTP/1.1 分块传输的一块"""
+        self.write_paced(b"%x\r\n" % len(data) + data + b"\r\n")
+
+    def inject_error(self, name, ep):
+        kind = ep["error_kind"]
+        if kind == "drop":
+            # 不回复直接断开, 固件会看到连接被重置
+            self.close_connection = True
+            self.connection.shutdown(socket.SHUT_RDWR)
+            return 0
+        if kind == "api":
+            if name == "token":
+                return self.send_json(401, {"error": "invalid_client", "error_description": "mock injected error"})
+            if name in ("asr", "tts"):
+                return self.send_json(200, {"err_no": 3302, "err_msg": "mock injected error", "sn": uuid.uuid4().hex})
+            return self.send_json(429, {"error": {"message": "mock injected error", "type": "rate_limit_error"}})
+        return self.send_json(int(ep["error_status"]), {"error": "mock injected error"})
+
+    # ---------------- 接口 ----------------
+
+    def handle_token(self):
+        params = dict(self.query)
+        params.update({k: v[0] for k, v in parse_qs(self.body.decode("utf-8", "replace")).items()})
+        if params.get("grant_type") != "client_credentials" or not params.get("client_id"):
+            return self.send_json(401, {"error": "invalid_client", "error_description": "unknown client id"})
+        return self.send_json(200, {
+            "refresh_token": "25.mock" + uuid.uuid4().hex,
+            "expires_in": self.cloud.get("token_expires_in"),
+            "session_key": "mock",
+            "access_token": self.cloud.issue_token(),
+            "scope": "audio_voice_assistant_get audio_tts_post",
+            "session_secret": "",
+        })
+
+    def handle_asr(self):
+        if not self.cloud.token_valid(self.query.get("token", "")):
+            return self.send_json(200, {"err_no": 3302, "err_msg": "Invalid token", "sn": uuid.uuid4().hex})
+        if len(self.body) <= 44 or self.body[:4] != b"RIFF":
+            return self.send_json(200, {"err_no": 3300, "err_msg": "speech quality error.", "sn": uuid.uuid4().hex})
+        return self.send_json(200, {
+            "corpus_no": str(random.randint(10 ** 18, 10 ** 19 - 1)),
+            "err_msg": "success.",
+            "err_no": 0,
+            "result": [self.cloud.get("asr_text")],
+            "sn": uuid.uuid4().hex,
+        })
+
+    def handle_tts(self):
+        form = {k: v[0] for k, v in parse_qs(self.body.decode("utf-8", "replace")).items()}
+        if not self.cloud.token_valid(form.get("tok", "")):
+            return self.send_json(200, {"err_no": 502, "err_msg": "access token invalid or no longer valid"})
+        text = form.get("tex", "")
+        if not text:
+            return self.send_json(200, {"err_no": 500, "err_msg": "text is empty"})
+        duration_ms = len(text) * self.cloud.get("tts_ms_per_char")
+        frames = max(1, duration_ms // MP3_FRAME_MS)
+        return self.send_body(200, "audio/mp3", MP3_SILENT_FRAME * frames)
+
+    def handle_chat(self):
+        if not self.headers.get("Authorization", "").startswith("Bearer"):
+            return self.send_json(401, {"error": {"message": "missing api key", "type": "invalid_request_error"}})
+        try:
+            request = json.loads(self.body or b"{}")
+        except ValueError:
+            return self.send_json(400, {"error": {"message": "invalid json", "type": "invalid_request_error"}})
+        model = request.get("model", "mock-chat")
+        answer = self.cloud.get("chat_answer")
+        completion_id = "chatcmpl-" + uuid.uuid4().hex
+        created = int(time.time())
+        if not request.get("stream"):
+            return self.send_json(200, {
+                "id": completion_id, "object": "chat.completion", "created": created, "model": model,
+                "choices": [{"index": 0, "message": {"role": "assistant", "content": answer}, "finish_reason": "stop"}],
+                "usage": {"prompt_tokens": len(json.dumps(request.get("messages", []))), "completion_tokens": len(answer),
+                          "total_tokens": 0},
+            })
+
+        self.send_response(200)
+        self.send_header("Content-Type", "text/event-stream; charset=utf-8")
+        self.send_header("Cache-Control", "no-cache")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+
+        def event(delta, finish_reason=None):
+            chunk = {"id": completion_id, "object": "chat.completion.chunk", "created": created, "model": model,
+                     "choices": [{"index": 0, "delta": delta, "finish_reason": finish_reason}]}
+            return ("data: " + json.dumps(chunk, ensure_ascii=False) + "\n\n").encode("utf-8")
+
+        interval = self.cloud.get("stream_interval_ms") / 1000.0
+        step = max(1, int(self.cloud.get("stream_piece_chars")))
+        self.send_chunk(event({"role": "assistant", "content": ""}))
+        for off in range(0, len(answer), step):
+            time.sleep(interval)
+            self.send_chunk(event({"content": answer[off:off + step]}))
+        self.send_chunk(event({}, "stop"))
+        self.send_chunk(b"data: [DONE]\n\n")
+        self.wfile.write(b"0\r\n\r\n")
+        self.wfile.flush()
+        return 200
+
+
+class Server(ThreadingHTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+    verbose = False
+    tls = None          # ssl.SSLContext, --tls 时设置
+
+    def get_request(self):
+        sock, addr = super().get_request()
+        if self.tls:
+            # 握手放到处理请求的线程中, 慢的客户端不会阻塞 accept
+            sock = self.tls.wrap_socket(sock, server_side=True, do_handshake_on_connect=False)
+        return sock, addr
+
+    def handle_error(self, request, client_address):
+        # 客户端握手失败或中途断开不打印调用栈
+        if self.tls and isinstance(sys.exc_info()[1], (ssl.SSLError, ConnectionError)):
+            return
+        super().handle_error(request, client_address)
+
+
+def make_cert(cert_dir, names):
+    """生成 (或复用) 自签名的 ECDSA P-256 证书, names 为证书中的主机名 / IP, 返回 (证书, 私钥) 路径"""
+    san = []
+    for name in names:
+        try:
+            ipaddress.ip_address(name)
+            san.append("IP:" + name)
+        except ValueError:
+            san.append("DNS:" + name)
+    san = ",".join(san)
+    tag = hashlib.sha1(san.encode()).hexdigest()[:8]
+    cert = os.path.join(cert_dir, "mock_cloud_%s.pem" % tag)
+    key = os.path.join(cert_dir, "mock_cloud_%s.key" % tag)
+    if not (os.path.exists(cert) and os.path.exists(key)):
+        os.makedirs(cert_dir, exist_ok=True)
+        subprocess.run(["openssl", "req", "-x509", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1",
+                        "-nodes", "-days", "3650", "-subj", "/CN=" + names[0], "-addext", "subjectAltName=" + san,
+                        "-keyout", key, "-out", cert], check=True, capture_output=True)
+    return cert, key
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Mock Baidu speech / OpenAI-compatible chat server")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--config", help="JSON 文件, 内容与 POST /config 相同")
+    parser.add_argument("--latency", type=int, default=None, help="所有接口的延迟, ms")
+    parser.add_argument("--jitter", type=int, default=None, help="所有接口的延迟抖动, ms")
+    parser.add_argument("--bandwidth", type=int, default=None, help="所有接口的带宽, 字节/秒")
+    parser.add_argument("--chunk-size", type=int, default=None, help="所有接口回复的分块大小")
+    parser.add_argument("--error-rate", type=float, default=None, help="所有接口的错误注入概率")
+    parser.add_argument("--error-kind", choices=("http", "api", "drop"), default=None)
+    parser.add_argument("--stream-interval", type=int, default=None, help="流式回复片段间隔, ms")
+    parser.add_argument("-v", "--verbose", action="store_true", help="打印每个请求")
+    parser.add_argument("--tls", action="store_true", help="以 HTTPS 提供服务 (自签名证书)")
+    parser.add_argument("--tls-name", action="append", default=[],
+                        help="证书中的主机名或 IP, 可重复; 填固件 CLOUD_MOCK_HOST 中的地址. 默认 127.0.0.1 和 localhost")
+    parser.add_argument("--cert-dir", default=os.path.join(os.path.expanduser("~"), ".cache", "mock_cloud"),
+                        help="生成的证书和私钥保存的目录")
+    args = parser.parse_args()
+
+    cloud = MockCloud(json.loads(json.dumps(DEFAULT_CONFIG)))
+    if args.config:
+        with open(args.config, encoding="utf-8") as f:
+            cloud.update_config(json.load(f))
+    overrides = {"latency_ms": args.latency, "jitter_ms": args.jitter, "bandwidth": args.bandwidth,
+                 "chunk_size": args.chunk_size, "error_rate": args.error_rate, "error_kind": args.error_kind}
+    overrides = {k: v for k, v in overrides.items() if v is not None}
+    if overrides:
+        cloud.update_config({"endpoints": {"all": overrides}})
+    if args.stream_interval is not None:
+        cloud.update_config({"stream_interval_ms": args.stream_interval})
+
+    Handler.cloud = cloud
+    server = Server((args.host, args.port), Handler)
+    server.verbose = args.verbose
+    if args.tls:
+        cert, key = make_cert(args.cert_dir, args.tls_name or ["127.0.0.1", "localhost"])
+        server.tls = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        server.tls.load_cert_chain(cert, key)
+        print("certificate: %s (bench.py --cafile)" % cert)
+        with open(cert) as f:
+            lines = ['    "%s\\n"' % line for line in f.read().splitlines()]
+        print("#define CLOUD_MOCK_CERT_PEM \\\n" + " \\\n".join(lines))
+    print("mock cloud listening on %s://%s:%d" % ("https" if args.tls else "http", args.host, args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    server.server_close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,369 @@
+/*
+ * 在电脑上测试 main/app_audio/audio_resampler: 分块处理与一次处理结果一致, 声道, 饱和, 频率响应, 997Hz 正弦的 THD / THD+N 和耗时.
+ *
+ * 编译: cc -O2 -Wall -I../host_shim -I../../main/app_audio resampler_bench.c ../../main/app_audio/audio_resampler.c -lm -o resampler_bench
+ * 运行: ./resampler_bench --seconds 10
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "audio_resampler.h"
+
+#define BENCH_OUT_RATE  (16000) // AUDIO_PLAY_SAMPLE_RATE
+#define BENCH_TONE_HZ   (997.0) // 与采样率不成整数比, 覆盖所有相位
+#define BENCH_TONE_AMP  (16384.0)
+
+static int s_seconds = 10;
+static int s_failures = 0;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("  FAIL: %s\n", what);
+        s_failures++;
+    }
+}
+
+/// @brief 生成正弦, 右声道用 freq_r (为 0 时与左声道相同)
+static int16_t *make_tone(uint32_t rate, size_t frames, int channels, double freq, double freq_r, double amp)
+{
+    int16_t *pcm = malloc(frames * channels * sizeof(int16_t));
+    for (size_t i = 0; i < frames; i++)
+    {
+        pcm[i * channels] = (int16_t)lrint(amp * sin(2.0 * M_PI * freq * i / rate));
+        if (channels == 2)
+        {
+            double f = freq_r > 0 ? freq_r : freq;
+            pcm[i * 2 + 1] = (int16_t)lrint(amp * sin(2.0 * M_PI * f * i / rate));
+        }
+    }
+    return pcm;
+}
+
+/// @brief 一次处理全部输入, 返回输出帧数
+static size_t resample_all(uint32_t in_rate, int channels, const int16_t *in, size_t in_frames, int16_t **out)
+{
+    audio_resampler_t *rs = NULL;
+    if (audio_resampler_create(in_rate, BENCH_OUT_RATE, channels, &rs) != ESP_OK)
+    {
+        *out = NULL;
+        return 0;
+    }
+    size_t cap = audio_resampler_max_output(rs, in_frames);
+    *out = malloc(cap * 2 * sizeof(int16_t));
+    size_t n = in_frames;
+    size_t produced = audio_resampler_process(rs, in, &n, *out, cap);
+    check(n == in_frames, "max_output is enough for the whole input");
+    audio_resampler_delete(rs);
+    return produced;
+}
+
+/// @brief 对 out 的一个声道做最小二乘拟合 a*cos + b*sin + c, 返回幅度, residual 中写入拟合残差
+static double fit_tone(const int16_t *out, int ch, size_t frames, double freq, double *residual)
+{
+    double w = 2.0 * M_PI * freq / BENCH_OUT_RATE;
+    double scc = 0, sss = 0, ssc = 0, sc = 0, ss = 0, yc = 0, ys = 0, y1 = 0;
+    for (size_t i = 0; i < frames; i++)
+    {
+        double c = cos(w * i), s = sin(w * i), y = residual ? residual[i] : out[i * 2 + ch];
+        scc += c * c;
+        sss += s * s;
+        ssc += s * c;
+        sc += c;
+        ss += s;
+        yc += y * c;
+        ys += y * s;
+        y1 += y;
+    }
+    // 3x3 正规方程, Cramer 法则
+    double n = frames;
+    double m[3][3] = {{scc, ssc, sc}, {ssc, sss, ss}, {sc, ss, n}};
+    double v[3] = {yc, ys, y1};
+    double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    double x[3];
+    for (int k = 0; k < 3; k++)
+    {
+        double t[3][3];
+        memcpy(t, m, sizeof(t));
+        for (int r = 0; r < 3; r++)
+        {
+            t[r][k] = v[r];
+        }
+        x[k] = (t[0][0] * (t[1][1] * t[2][2] - t[1][2] * t[2][1]) - t[0][1] * (t[1][0] * t[2][2] - t[1][2] * t[2][0]) + t[0][2] * (t[1][0] * t[2][1] - t[1][1] * t[2][0])) / det;
+    }
+    if (residual)
+    {
+        for (size_t i = 0; i < frames; i++)
+        {
+            residual[i] -= x[0] * cos(w * i) + x[1] * sin(w * i) + x[2];
+        }
+    }
+    return sqrt(x[0] * x[0] + x[1] * x[1]);
+}
+
+/// @brief 输出中 freq 分量的幅度 (跳过滤波器建立时间)
+static double tone_amp(const int16_t *out, int ch, size_t frames, double freq)
+{
+    size_t skip = AUDIO_RESAMPLER_TAPS * 4;
+    return fit_tone(out + skip * 2, ch, frames - skip, freq, NULL);
+}
+
+typedef struct
+{
+    double thd_db;   // 谐波
+    double thdn_db;  // 谐波 + 噪声
+    double gain_db;  // 997Hz 增益
+} bench_quality_t;
+
+static bench_quality_t measure_quality(const int16_t *out, size_t frames)
+{
+    bench_quality_t q;
+    size_t skip = AUDIO_RESAMPLER_TAPS * 4;
+    size_t len = frames - skip;
+    double *res = malloc(len * sizeof(double));
+    for (size_t i = 0; i < len; i++)
+    {
+        res[i] = out[(skip + i) * 2];
+    }
+    double fund = fit_tone(NULL, 0, len, BENCH_TONE_HZ, res);
+    double noise = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        noise += res[i] * res[i];
+    }
+    noise /= len;
+    double harm = 0;
+    for (int h = 2; h * BENCH_TONE_HZ < BENCH_OUT_RATE / 2; h++)
+    {
+        double a = fit_tone(NULL, 0, len, h * BENCH_TONE_HZ, res);
+        harm += a * a / 2;
+    }
+    double fund_power = fund * fund / 2;
+    q.thd_db = 10.0 * log10((harm + 1e-12) / fund_power);
+    q.thdn_db = 10.0 * log10(noise / fund_power);
+    q.gain_db = 20.0 * log10(fund / BENCH_TONE_AMP);
+    free(res);
+    return q;
+}
+
+static void test_chunked(uint32_t in_rate, int channels)
+{
+    size_t in_frames = in_rate / 4;
+    int16_t *in = make_tone(in_rate, in_frames, channels, BENCH_TONE_HZ, 3 * BENCH_TONE_HZ, BENCH_TONE_AMP);
+    int16_t *ref;
+    size_t ref_frames = resample_all(in_rate, channels, in, in_frames, &ref);
+
+    // 与 app_audio 一样分块送入, 输出缓冲不足时只消耗一部分输入
+    audio_resampler_t *rs = NULL;
+    audio_resampler_create(in_rate, BENCH_OUT_RATE, channels, &rs);
+    int16_t *out = malloc((ref_frames + 64) * 2 * sizeof(int16_t));
+    size_t pos = 0, produced = 0;
+    unsigned seed = in_rate;
+    while (pos < in_frames)
+    {
+        seed = seed * 1103515245 + 12345;
+        size_t n = 1 + (seed >> 16) % 300;
+        n = n > in_frames - pos ? in_frames - pos : n;
+        size_t cap = audio_resampler_max_output(rs, 1) + (seed >> 8) % 64;
+        produced += audio_resampler_process(rs, in + pos * channels, &n, out + produced * 2, cap);
+        pos += n;
+    }
+    check(produced == ref_frames && memcmp(out, ref, produced * 2 * sizeof(int16_t)) == 0, "chunked output equals one-shot output");
+
+    // reset 之后重新开始, 结果与新建的重采样器相同
+    audio_resampler_reset(rs);
+    size_t n = in_frames;
+    produced = audio_resampler_process(rs, in, &n, out, ref_frames + 64);
+    check(produced == ref_frames && memcmp(out, ref, produced * 2 * sizeof(int16_t)) == 0, "reset clears history");
+
+    double expect = (double)in_frames * BENCH_OUT_RATE / in_rate;
+    check(fabs(ref_frames - expect) <= 1.0, "output frame count follows the rate ratio");
+    if (channels == 1)
+    {
+        bool same = true;
+        for (size_t i = 0; i < ref_frames; i++)
+        {
+            same = same && ref[i * 2] == ref[i * 2 + 1];
+        }
+        check(same, "mono input is duplicated to both channels");
+    }
+    else
+    {
+        // 左声道 997Hz, 右声道 2991Hz, 互不串扰
+        double l_own = tone_amp(ref, 0, ref_frames, BENCH_TONE_HZ), l_other = tone_amp(ref, 0, ref_frames, 3 * BENCH_TONE_HZ);
+        double r_own = tone_amp(ref, 1, ref_frames, 3 * BENCH_TONE_HZ), r_other = tone_amp(ref, 1, ref_frames, BENCH_TONE_HZ);
+        check(l_other < l_own * 1e-3 && r_other < r_own * 1e-3, "stereo channels are independent");
+    }
+
+    audio_resampler_delete(rs);
+    free(out);
+    free(ref);
+    free(in);
+}
+
+static void test_saturation(uint32_t in_rate)
+{
+    // 满幅 100Hz 方波的过冲超出 16bit, 必须饱和而不是回绕
+    size_t in_frames = in_rate / 10;
+    int16_t *in = malloc(in_frames * sizeof(int16_t));
+    for (size_t i = 0; i < in_frames; i++)
+    {
+        in[i] = fmod(100.0 * i / in_rate, 1.0) < 0.5 ? INT16_MAX : INT16_MIN;
+    }
+    int16_t *out;
+    size_t frames = resample_all(in_rate, 1, in, in_frames, &out);
+    // 原型滤波器对称, 群延迟为 TAPS / 2 个输入采样
+    double delay = (double)AUDIO_RESAMPLER_TAPS / 2 / in_rate;
+    bool ok = true;
+    for (size_t i = AUDIO_RESAMPLER_TAPS * 4; i < frames; i++)
+    {
+        // 每个半周期中间的采样符号与输入一致
+        double phase = fmod(100.0 * ((double)i / BENCH_OUT_RATE - delay) + 1.0, 1.0);
+        if (phase > 0.2 && phase < 0.3)
+        {
+            ok = ok && out[i * 2] > 30000;
+        }
+        else if (phase > 0.7 && phase < 0.8)
+        {
+            ok = ok && out[i * 2] < -30000;
+        }
+    }
+    check(ok, "full scale square wave saturates instead of wrapping");
+    free(out);
+    free(in);
+}
+
+/// @brief 输入 freq 的正弦时输出中 out_freq 分量相对输入的电平 (dB)
+static double response_db(uint32_t in_rate, double freq, double out_freq)
+{
+    size_t in_frames = in_rate / 2;
+    int16_t *in = make_tone(in_rate, in_frames, 1, freq, 0, BENCH_TONE_AMP);
+    int16_t *out;
+    size_t frames = resample_all(in_rate, 1, in, in_frames, &out);
+    double amp = tone_amp(out, 0, frames, out_freq);
+    free(out);
+    free(in);
+    return 20.0 * log10(amp / BENCH_TONE_AMP + 1e-9);
+}
+
+static void bench_rate(uint32_t in_rate, int channels)
+{
+    printf("%5u -> %u ch%d:\n", in_rate, BENCH_OUT_RATE, channels);
+    test_chunked(in_rate, channels);
+    test_saturation(in_rate);
+
+    // 质量: 0.5s 997Hz 正弦
+    size_t in_frames = in_rate / 2;
+    int16_t *in = make_tone(in_rate, in_frames, channels, BENCH_TONE_HZ, 0, BENCH_TONE_AMP);
+    int16_t *out;
+    size_t frames = resample_all(in_rate, channels, in, in_frames, &out);
+    bench_quality_t q = measure_quality(out, frames);
+    free(out);
+    free(in);
+
+    // 频率响应: 0.3 和 0.4 倍较低采样率处的增益, 以及降采样时折叠到通带的镜像抑制
+    double min_rate = in_rate < BENCH_OUT_RATE ? in_rate : BENCH_OUT_RATE;
+    double mid = floor(0.3 * min_rate);
+    double mid_db = response_db(in_rate, mid, mid);
+    double edge = floor(0.4 * min_rate);
+    double edge_db = response_db(in_rate, edge, edge);
+    double alias_db = -INFINITY;
+    double alias_in = 0;
+    if (in_rate > BENCH_OUT_RATE)
+    {
+        // 输入高于 16k 的奈奎斯特频率, 折叠到 2kHz
+        alias_in = BENCH_OUT_RATE - 2000.0;
+        alias_in = alias_in < in_rate / 2.0 ? alias_in : BENCH_OUT_RATE / 2.0 + 1500.0;
+        alias_db = response_db(in_rate, alias_in, BENCH_OUT_RATE - alias_in);
+    }
+
+    // 耗时: 分 20ms 一块处理 s_seconds 秒
+    audio_resampler_t *rs = NULL;
+    audio_resampler_create(in_rate, BENCH_OUT_RATE, channels, &rs);
+    size_t chunk = in_rate / 50;
+    in = make_tone(in_rate, chunk, channels, BENCH_TONE_HZ, 0, BENCH_TONE_AMP);
+    size_t cap = audio_resampler_max_output(rs, chunk);
+    out = malloc(cap * 2 * sizeof(int16_t));
+    size_t total = 0;
+    int64_t start = now_ns();
+    for (int i = 0; i < s_seconds * 50; i++)
+    {
+        size_t n = chunk;
+        total += audio_resampler_process(rs, in, &n, out, cap);
+    }
+    int64_t elapsed = now_ns() - start;
+    audio_resampler_delete(rs);
+    free(out);
+    free(in);
+
+    printf("  997Hz gain %+.2f dB, THD %.1f dB, THD+N %.1f dB; %.0fHz %+.2f dB, %.0fHz %+.2f dB",
+           q.gain_db, q.thd_db, q.thdn_db, mid, mid_db, edge, edge_db);
+    if (in_rate > BENCH_OUT_RATE)
+    {
+        printf(", %.0fHz alias %.1f dB", alias_in, alias_db);
+    }
+    printf("\n  %.1f ns per output frame (%.2f%% of real time)\n", (double)elapsed / total, 100.0 * elapsed / (s_seconds * 1e9));
+
+    check(fabs(q.gain_db) < 0.1, "997Hz passes at unity gain");
+    check(q.thd_db < -80.0, "997Hz THD below -80 dB");
+    check(q.thdn_db < -70.0, "997Hz THD+N below -70 dB");
+    // 每相位只有 32 个抽头, 降采样时按输入采样率计的过渡带较宽, 48k 输入在 0.4 倍处约 -3 dB
+    check(mid_db > -1.0, "0.3 x rate within 1 dB");
+    check(edge_db > -4.0, "0.4 x rate within 4 dB");
+    check(in_rate <= BENCH_OUT_RATE || alias_db < -40.0, "aliases attenuated by 40 dB");
+}
+
+static void test_args(void)
+{
+    printf("arguments:\n");
+    audio_resampler_t *rs = NULL;
+    check(audio_resampler_create(0, BENCH_OUT_RATE, 1, &rs) == ESP_ERR_INVALID_ARG, "zero rate is rejected");
+    check(audio_resampler_create(16000, BENCH_OUT_RATE, 3, &rs) == ESP_ERR_INVALID_ARG, "3 channels are rejected");
+    check(audio_resampler_create(44101, BENCH_OUT_RATE, 1, &rs) == ESP_ERR_NOT_SUPPORTED, "ratio over AUDIO_RESAMPLER_MAX_PHASES is rejected");
+    check(rs == NULL, "no resampler is returned on error");
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--seconds") == 0)
+        {
+            s_seconds = atoi(argv[++i]);
+        }
+    }
+    if (s_seconds <= 0)
+    {
+        s_seconds = 1;
+    }
+
+    test_args();
+    static const struct
+    {
+        uint32_t rate;
+        int channels;
+    } cases[] = {
+        {44100, 2}, {48000, 2}, {32000, 2}, {24000, 1}, {22050, 1}, {16000, 2}, {11025, 1}, {8000, 1},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        bench_rate(cases[i].rate, cases[i].channels);
+    }
+
+    printf("%s\n", s_failures ? "FAIL" : "PASS");
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * 在电脑上测试 main/baidu_api/tts_cache: 命中, 未命中, PSRAM 溢出到 storage 分区, 淘汰, 以及 sink 阻塞时不持有缓存锁.
+ *
+ * 编译: cc -O2 -Wall -pthread -I../host_shim -I../../main/baidu_api -DTTS_CACHE_DIR='"ttsc_test"' tts_cache_test.c ../../main/baidu_api/tts_cache.c -o tts_cache_test
+ * 运行: ./tts_cache_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "esp_timer.h"
+#include "tts_cache.h"
+
+#define TEST_ITEM_BYTES (100 * 1024) // 5 条放满 PSRAM 上限, 第 6 条开始溢出
+
+static int s_failures = 0;
+
+// sink 收到的数据
+static uint8_t *s_sink_buf = NULL;
+static size_t s_sink_len = 0;
+static esp_err_t s_sink_result = ESP_OK;
+
+static void check(bool ok, const char *what)
+{
+    printf("  %s: %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+    {
+        s_failures++;
+    }
+}
+
+static void fill(uint8_t *buf, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+static esp_err_t sink_copy(const void *data, size_t len)
+{
+    s_sink_buf = realloc(s_sink_buf, len);
+    memcpy(s_sink_buf, data, len);
+    s_sink_len = len;
+    return s_sink_result;
+}
+
+/// @brief 像 baidu_tts 一样分块写入一条合成结果
+static void insert(uint64_t key, uint32_t seed, size_t len)
+{
+    uint8_t *data = malloc(len);
+    fill(data, len, seed);
+    tts_cache_begin(key);
+    for (size_t off = 0; off < len; off += 1460)
+    {
+        tts_cache_append(data + off, len - off < 1460 ? len - off : 1460);
+    }
+    tts_cache_commit();
+    free(data);
+}
+
+/// @brief 命中并且内容与写入的一致
+static bool read_matches(uint64_t key, uint32_t seed, size_t len)
+{
+    s_sink_len = 0;
+    if (tts_cache_read(key, sink_copy) != ESP_OK || s_sink_len != len)
+    {
+        return false;
+    }
+    uint8_t *expect = malloc(len);
+    fill(expect, len, seed);
+    bool same = memcmp(expect, s_sink_buf, len) == 0;
+    free(expect);
+    return same;
+}
+
+static void clean_dir(void)
+{
+    DIR *dir = opendir(TTS_CACHE_DIR);
+    if (dir)
+    {
+        struct dirent *ent;
+        char path[300];
+        while ((ent = readdir(dir)) != NULL)
+        {
+            if (strncmp(ent->d_name, "ttsc_", 5) == 0)
+            {
+                snprintf(path, sizeof(path), TTS_CACHE_DIR "/%s", ent->d_name);
+                remove(path);
+            }
+        }
+        closedir(dir);
+    }
+    mkdir(TTS_CACHE_DIR, 0755);
+}
+
+static void test_hit_miss(void)
+{
+    printf("hit / miss:\n");
+    tts_cache_stats_t st;
+    uint64_t key = tts_cache_key("你好", "per=0");
+    check(key != tts_cache_key("你好", "per=1"), "voice parameters are part of the key");
+    check(tts_cache_key("ab", "c") != tts_cache_key("a", "bc"), "text / parameter boundary is part of the key");
+
+    check(tts_cache_read(key, sink_copy) == ESP_ERR_NOT_FOUND, "empty cache misses");
+    insert(key, 1, 3000);
+    check(read_matches(key, 1, 3000), "committed response is returned unchanged");
+
+    uint64_t dropped = tts_cache_key("dropped", "per=0");
+    tts_cache_begin(dropped);
+    tts_cache_append("partial", 7);
+    tts_cache_discard();
+    check(tts_cache_read(dropped, sink_copy) == ESP_ERR_NOT_FOUND, "discarded download is not cached");
+
+    uint64_t big = tts_cache_key("too long", "per=0");
+    insert(big, 2, TTS_CACHE_ITEM_MAX + 1);
+    check(tts_cache_read(big, sink_copy) == ESP_ERR_NOT_FOUND, "response over TTS_CACHE_ITEM_MAX is not cached");
+
+    tts_cache_get_stats(&st);
+    check(st.hits_ram == 1 && st.misses == 3 && st.inserts == 1, "hit / miss counters");
+}
+
+static void test_sink_failure(void)
+{
+    printf("sink failure:\n");
+    uint64_t key = tts_cache_key("你好", "per=0");
+    s_sink_result = ESP_FAIL;
+    check(tts_cache_read(key, sink_copy) == ESP_FAIL, "sink error is returned, not reported as a hit");
+    s_sink_result = ESP_OK;
+    check(read_matches(key, 1, 3000), "entry is still usable after a failed sink");
+}
+
+static void test_eviction(void)
+{
+    printf("spill / eviction:\n");
+    tts_cache_stats_t st;
+    char text[16];
+    // 共 11 条 100K: PSRAM 放 5 条, storage 分区放 5 条, 最早的 1 条被彻底淘汰
+    for (int i = 0; i < 11; i++)
+    {
+        snprintf(text, sizeof(text), "item %d", i);
+        insert(tts_cache_key(text, "per=0"), 100 + i, TEST_ITEM_BYTES);
+        if (i == 4)
+        {
+            // 读一次 item 1, 它变成最近使用, 溢出时先轮到 item 2
+            snprintf(text, sizeof(text), "item %d", 1);
+            read_matches(tts_cache_key(text, "per=0"), 101, TEST_ITEM_BYTES);
+        }
+    }
+    tts_cache_get_stats(&st);
+    check(st.ram_bytes <= TTS_CACHE_RAM_BYTES, "PSRAM use stays under TTS_CACHE_RAM_BYTES");
+    check(st.disk_bytes <= TTS_CACHE_DISK_BYTES, "storage use stays under TTS_CACHE_DISK_BYTES");
+    check(st.spills > 0 && st.evictions > 0, "old entries spill to storage and are evicted");
+
+    uint32_t hits_disk = st.hits_disk;
+    check(tts_cache_read(tts_cache_key("item 0", "per=0"), sink_copy) == ESP_ERR_NOT_FOUND, "least recently used entry is evicted first");
+    check(read_matches(tts_cache_key("item 1", "per=0"), 101, TEST_ITEM_BYTES), "recently read entry survives");
+    check(read_matches(tts_cache_key("item 3", "per=0"), 103, TEST_ITEM_BYTES), "spilled entry is read back from storage");
+    tts_cache_get_stats(&st);
+    check(st.hits_disk > hits_disk, "read back counts as a storage hit");
+    check(read_matches(tts_cache_key("item 10", "per=0"), 110, TEST_ITEM_BYTES), "newest entry is in PSRAM");
+}
+
+typedef struct
+{
+    uint64_t key;
+    esp_err_t err;
+    bool same;
+} slow_reader_t;
+
+static esp_err_t sink_slow(const void *data, size_t len)
+{
+    // 模拟播放器消费慢时 audio_stream_write 阻塞, 结束后数据必须仍然完好
+    uint8_t *before = malloc(len);
+    memcpy(before, data, len);
+    usleep(300 * 1000);
+    bool same = memcmp(before, data, len) == 0;
+    free(before);
+    return same ? ESP_OK : ESP_FAIL;
+}
+
+static void *slow_reader_task(void *arg)
+{
+    slow_reader_t *r = (slow_reader_t *)arg;
+    r->err = tts_cache_read(r->key, sink_slow);
+    return NULL;
+}
+
+static void test_sink_without_lock(void)
+{
+    printf("blocking sink:\n");
+    slow_reader_t reader = {.key = tts_cache_key("item 10", "per=0")};
+    pthread_t thread;
+    pthread_create(&thread, NULL, slow_reader_task, &reader);
+    usleep(50 * 1000);
+
+    // sink 阻塞期间, 其他任务的写入和淘汰不能被挡住, 也不能释放正在读的条目
+    int64_t start = esp_timer_get_time();
+    char text[16];
+    for (int i = 0; i < 12; i++)
+    {
+        snprintf(text, sizeof(text), "flood %d", i);
+        insert(tts_cache_key(text, "per=0"), 200 + i, TEST_ITEM_BYTES);
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    pthread_join(thread, NULL);
+
+    check(elapsed < 200 * 1000, "commit does not wait for a blocked sink");
+    check(reader.err == ESP_OK, "pinned entry is not freed while the sink runs");
+    check(read_matches(reader.key, 110, TEST_ITEM_BYTES), "pinned entry is intact afterwards");
+}
+
+int main(void)
+{
+    clean_dir();
+    if (tts_cache_init() != ESP_OK)
+    {
+        printf("FAIL: tts_cache_init\n");
+        return 1;
+    }
+    test_hit_miss();
+    test_sink_failure();
+    test_eviction();
+    test_sink_without_lock();
+    tts_cache_log_stats();
+    clean_dir();
+    rmdir(TTS_CACHE_DIR);
+
+    printf("%s\n", s_failures ? "FAIL" : "PASS");
+    return s_failures ? 1 : 0;
+}